@@ -131,7 +131,8 @@ public:
 		  return false;
 	  }
 
-	  typedef size_t bufType;
+	  // 64 bits on every platform, so that a refill lasts for several Golomb codes on x86 as well
+	  typedef uint64_t bufType;
 
 	  enum { 
 		  bufferbits = sizeof( bufType ) * 8
@@ -189,18 +190,12 @@ public:
 
 	  BYTE* FindNextFF()
 	  {
-		  BYTE* pbyteNextFF = _position;
+		  if (_position >= _endPosition)
+			  return _endPosition;
 
-		  while (pbyteNextFF < _endPosition)
-	      {
-			  if (*pbyteNextFF == 0xFF) 
-				  break;
-
-			  pbyteNextFF++;
-		  }
-		  
-
-		  return pbyteNextFF;
+		  // memchr of the C runtime compares many bytes at once
+		  BYTE* pbyteNextFF = (BYTE*)::memchr(_position, 0xFF, _endPosition - _position);
+		  return pbyteNextFF != NULL ? pbyteNextFF : _endPosition;
 	  }
 
 
@@ -222,6 +217,13 @@ public:
 	  }
 
 
+	  // Position of the marker that ends the scan, for leaving a scan before its last line.
+	  BYTE* FindNextMarker() const
+	  {
+		  return FindMarker(GetCurBytePos(), _endPosition);
+	  }
+
+
 	  inlinehint LONG ReadValue(LONG length)
 	  {
 		  if (_validBits < length)
@@ -246,7 +248,7 @@ public:
 			  MakeValid();
 		  }
 
-		  return _readCache >> (bufferbits - 8); 
+		  return LONG(_readCache >> (bufferbits - 8)); 
 	  }
 
 
@@ -271,31 +273,39 @@ public:
 		  {
 			  MakeValid();
 		  }
-		  bufType valTest = _readCache;
 
-		  for (LONG count = 0; count < 16; count++)
-		  {
-			  if ((valTest & (bufType(1) << (bufferbits - 1))) != 0)
-				  return count;
+		  // bits past _validBits are zero, so a set bit among the first 16 is a valid one
+		  if ((_readCache >> (bufferbits - 16)) == 0)
+			  return -1;
 
-			  valTest <<= 1;
-		  }
-		  return -1;
+		  return CountLeadingZeros(_readCache);
 	  }
 
 
 
 	  inlinehint LONG ReadHighbits()
 	  {
-		  LONG count = Peek0Bits();
-		  if (count >= 0)
+		  if (_validBits < 32)
 		  {
-			  Skip(count + 1);
-			  return count;
+			  MakeValid();
 		  }
-		  Skip(15);
 
-		  for (LONG highbits = 15; ; highbits++)
+		  // a unary prefix of up to 31 zero bits is found at once
+		  if ((_readCache >> (bufferbits - 32)) != 0)
+		  {
+			  LONG count = CountLeadingZeros(_readCache);
+			  if (count < _validBits)
+			  {
+				  Skip(count + 1);
+				  return count;
+			  }
+		  }
+
+		  // longer prefixes only end escape codes, or lie at the end of the data
+		  LONG highbits = _validBits < 31 ? _validBits : 31;
+		  Skip(highbits);
+
+		  for (; ; highbits++)
 		  { 
 			  if (ReadBit())
 				  return highbits;
@@ -119,13 +119,13 @@ protected:
 	void OverFlow()
 	{
 		if (_compressedStream == NULL)	
-			throw new JlsException(CompressedBufferTooSmall);
+			throw JlsException(CompressedBufferTooSmall);
 		
 		size_t bytesCount = _position-(BYTE*)&_buffer[0];
 		size_t bytesWritten = _compressedStream->sputn((char*)&_buffer[0], _position - (BYTE*)&_buffer[0]);
 
 		if (bytesWritten != bytesCount)
-			throw new JlsException(CompressedBufferTooSmall);
+			throw JlsException(CompressedBufferTooSmall);
 
 		_position = (BYTE*)&_buffer[0];
 		_compressedLength = _buffer.size();
@@ -145,6 +145,9 @@ protected:
 			if (bitpos >= 32)
 				break;
 
+			if (_compressedLength == 0)
+				throw JlsException(CompressedBufferTooSmall);
+
 			if (_isFFWritten)
 			{
 				// insert highmost bit
@@ -256,6 +256,96 @@ void JLSInputStream::Read(ByteStreamInfo rawPixels)
 {
 	ReadHeader();
 
+	int64_t bytesPerPlane = BeginRead(rawPixels, _info.components);
+
+	int componentsSeen = 0;
+	
+	while (componentsSeen < _info.components)
+	{
+		ReadStartOfScan(componentsSeen == 0);
+		ReadScan(rawPixels);
+		SkipBytes(&rawPixels, (size_t)bytesPerPlane);		
+
+		if (_info.ilv != ILV_NONE)
+			return;
+
+		componentsSeen += 1;
+	}	
+}
+
+
+//
+// ReadComponent()
+//
+// Decodes the scan of one component of a non-interleaved image into rawPixels, which holds a single plane. 
+// scanOffset is the position of the segments before the scan, as found by FindScans.
+//
+void JLSInputStream::ReadComponent(ByteStreamInfo rawPixels, size_t scanOffset)
+{
+	ReadHeader();
+
+	BeginRead(rawPixels, 1);
+
+	if (_byteStream.rawData == NULL)
+		throw JlsException(ParameterValueNotSupported);
+
+	size_t length = size_t(_byteStream.rawData - _byteStreamStart) + _byteStream.count;
+	if (scanOffset >= length)
+		throw JlsException(InvalidCompressedData);
+
+	_byteStream.rawData = _byteStreamStart + scanOffset;
+	_byteStream.count = length - scanOffset;
+
+	ReadStartOfScan(false);
+	if (_info.ilv != ILV_NONE)
+		throw JlsException(ParameterValueNotSupported);
+
+	ReadScan(rawPixels);
+}
+
+
+//
+// FindScans()
+//
+// Records the positions of the segments before each of the first scanCount scans of a non-interleaved image,
+// skipping the entropy coded data of each scan without decoding it.
+//
+void JLSInputStream::FindScans(size_t* scanOffsets, int scanCount)
+{
+	ReadHeader();
+
+	if (_byteStream.rawData == NULL || scanCount < 1)
+		throw JlsException(ParameterValueNotSupported);
+
+	// the first scan follows the frame header; its SOS marker is read again by ReadComponent
+	scanOffsets[0] = size_t(_byteStream.rawData - _byteStreamStart) - 2;
+	ReadStartOfScan(true);
+
+	for (int scan = 1; scan < scanCount; ++scan)
+	{
+		if (_info.ilv != ILV_NONE)
+			throw JlsException(ParameterValueNotSupported);
+
+		BYTE* end = _byteStream.rawData + _byteStream.count;
+		BYTE* position = FindMarker(_byteStream.rawData, end);
+		if (position == end)
+			throw JlsException(InvalidCompressedData);
+		SkipBytes(&_byteStream, size_t(position - _byteStream.rawData));
+
+		scanOffsets[scan] = size_t(position - _byteStreamStart);
+		ReadStartOfScan(false);
+	}
+
+	if (_info.ilv != ILV_NONE)
+		throw JlsException(ParameterValueNotSupported);
+}
+
+
+//
+// BeginRead()
+//
+int64_t JLSInputStream::BeginRead(const ByteStreamInfo& rawPixels, int planes)
+{
 	JLS_ERROR error = CheckParameterCoherent(&_info);
 	if (error != OK)
 		throw JlsException(error);
@@ -268,25 +358,21 @@ void JLSInputStream::Read(ByteStreamInfo rawPixels)
 
 	int64_t bytesPerPlane = (int64_t)(_rect.Width) * _rect.Height * ((_info.bitspersample + 7)/8);
 
-	if (rawPixels.rawData != NULL && int64_t(rawPixels.count) < bytesPerPlane * _info.components)
+	if (rawPixels.rawData != NULL && int64_t(rawPixels.count) < bytesPerPlane * planes)
 		throw JlsException(UncompressedBufferTooSmall);
 
-	int componentsSeen = 0;
-	
-	while (componentsSeen < _info.components)
-	{
-		ReadStartOfScan(componentsSeen == 0);
-
-		std::auto_ptr<DecoderStrategy> qcodec = JlsCodecFactory<DecoderStrategy>().GetCodec(_info, _info.custom);	
-		ProcessLine* processLine = qcodec->CreateProcess(rawPixels);
-		qcodec->DecodeScan(std::auto_ptr<ProcessLine>(processLine), _rect, &_byteStream, _bCompare); 
-		SkipBytes(&rawPixels, (size_t)bytesPerPlane);		
+	return bytesPerPlane;
+}
 
-		if (_info.ilv != ILV_NONE)
-			return;
 
-		componentsSeen += 1;
-	}	
+//
+// ReadScan()
+//
+void JLSInputStream::ReadScan(ByteStreamInfo rawPixels)
+{
+	std::auto_ptr<DecoderStrategy> qcodec = JlsCodecFactory<DecoderStrategy>().GetCodec(_info, _info.custom);	
+	ProcessLine* processLine = qcodec->CreateProcess(rawPixels);
+	qcodec->DecodeScan(std::auto_ptr<ProcessLine>(processLine), _rect, &_byteStream, _bCompare); 
 }
 
 // ReadNBytes()
@@ -310,7 +396,18 @@ void JLSInputStream::ReadHeader()
 
 	if (ReadByte() != JPEG_SOI)
 		throw JlsException(InvalidCompressedData);
-	
+
+	ReadMarkers();
+}
+
+
+//
+// ReadMarkers()
+//
+// Reads the marker segments up to and including the next SOS marker.
+//
+void JLSInputStream::ReadMarkers()
+{
 	for (;;)
 	{
 		if (ReadByte() != 0xFF)
@@ -433,10 +530,11 @@ void Assert(bool valid)
 //
 void JLSInputStream::ReadStartOfScan(bool firstComponent)
 {
+	// the segments before a later scan, such as the presets that are repeated for every component of a
+	// non-interleaved image
 	if (!firstComponent)
 	{
-		Assert(ReadByte() == 0xFF);
-		Assert(ReadByte() == JPEG_SOS);
+		ReadMarkers();
 	}
 	int length = ReadByte(); //length
 	length = length * 256 + ReadByte();
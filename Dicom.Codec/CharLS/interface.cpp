@@ -99,7 +99,14 @@ extern "C"
 			stream.AddScan(rawStreamInfo, &info);
 		}
 
-		stream.Write((BYTE*)compressedData, compressedLength);
+		try
+		{
+			stream.Write((BYTE*)compressedData, compressedLength);
+		}
+		catch (JlsException& e)
+		{
+			return e._error;
+		}
 		*pcbyteWritten = stream.GetBytesWritten();	
 		return OK;
 	}
@@ -166,6 +173,47 @@ extern "C"
 	}
 
 
+	CHARLS_IMEXPORT(JLS_ERROR) JpegLsFindScans(const void* compressedData, size_t compressedLength, size_t* scanOffsets, int scanCount)
+	{
+		JLSInputStream reader(FromByteArray(compressedData, compressedLength));
+
+		try
+		{
+			reader.FindScans(scanOffsets, scanCount);
+			return OK;
+		}
+		catch (JlsException& e)
+		{
+			return e._error;
+		}
+	}
+
+
+	CHARLS_IMEXPORT(JLS_ERROR) JpegLsDecodeScan(void* uncompressedData, size_t uncompressedLength, const void* compressedData, size_t compressedLength, size_t scanOffset, JlsRect roi, JlsParameters* info)
+	{
+		JLSInputStream reader(FromByteArray(compressedData, compressedLength));
+
+		ByteStreamInfo rawStreamInfo = FromByteArray(uncompressedData, uncompressedLength);
+
+		if(info != NULL)
+		{
+			reader.SetInfo(info);
+		}
+
+		reader.SetRect(roi);
+
+		try
+		{
+			reader.ReadComponent(rawStreamInfo, scanOffset);
+			return OK;
+		}
+		catch (JlsException& e)
+		{
+			return e._error;
+		}
+	}
+
+
 	CHARLS_IMEXPORT(JLS_ERROR) JpegLsVerifyEncode(const void* uncompressedData, size_t uncompressedLength, const void* compressedData, size_t compressedLength)
 	{
 		JlsParameters info = JlsParameters();
@@ -47,6 +47,16 @@ extern "C"
 		const void* compressedData, size_t compressedLength, 
 		struct JlsRect rect, struct JlsParameters* info);
 
+  // Finds the SOS markers of the first scanCount component scans of a non-interleaved (ILV_NONE) image.
+  CHARLS_IMEXPORT(enum JLS_ERROR) JpegLsFindScans(const void* compressedData, size_t compressedLength, 
+		size_t* scanOffsets, int scanCount);
+
+  // Decodes the component scan at scanOffset, as found by JpegLsFindScans, into a single plane. The scans
+  // of an image may be decoded concurrently.
+  CHARLS_IMEXPORT(enum JLS_ERROR) JpegLsDecodeScan(void* uncompressedData, size_t uncompressedLength, 
+		const void* compressedData, size_t compressedLength, size_t scanOffset,
+		struct JlsRect rect, struct JlsParameters* info);
+
   CHARLS_IMEXPORT(enum JLS_ERROR) JpegLsReadHeader(const void* compressedData, size_t compressedLength, 
 		struct JlsParameters* pparams);
 
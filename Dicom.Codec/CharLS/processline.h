@@ -72,7 +72,7 @@ public:
 		std::streamsize bytesRead = _rawData->sgetn((char*)dest, bytesToRead);
 		
 		if (bytesRead != bytesToRead)
-			throw new JlsException(UncompressedBufferTooSmall);
+			throw JlsException(UncompressedBufferTooSmall);
 
 		if (_bytesPerLine - bytesToRead > 0)
 		{
@@ -85,7 +85,7 @@ public:
 		int bytesToWrite = pixelCount * _bytesPerPixel;
 		std::streamsize bytesWritten = _rawData->sputn((const char*)pSrc, bytesToWrite); 	
 		if (bytesWritten != bytesToWrite)
-			throw new JlsException(UncompressedBufferTooSmall);
+			throw JlsException(UncompressedBufferTooSmall);
 	}
 
 private:
@@ -218,7 +218,7 @@ public:
 		{
 			std::streamsize read = rawStream->sgetn((char*)&_buffer[0], bytesToRead);
 			if (read == 0)
-				throw new JlsException(UncompressedBufferTooSmall);
+				throw JlsException(UncompressedBufferTooSmall);
 
 			bytesToRead -= read;
 		}
@@ -287,7 +287,7 @@ public:
 		
 			std::streamsize bytesWritten = _rawPixels.rawStream->sputn(&buffer[0], bytesToWrite); 	
 			if (bytesWritten != bytesToWrite)
-				throw new JlsException(UncompressedBufferTooSmall);
+				throw JlsException(UncompressedBufferTooSmall);
 		}
 		else
 		{			
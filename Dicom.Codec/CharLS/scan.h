@@ -6,6 +6,7 @@
 #define CHARLS_SCAN
 
 #include "lookuptable.h"
+#include "../SampleFormat/sampleformat.h"
 
 // This file contains the code for handling a "scan". Usually an image is encoded as a single scan. 
 
@@ -27,6 +28,63 @@ inlinehint LONG ApplySign(LONG i, LONG sign)
 { return (sign ^ i) - sign; }									
 
 
+//
+// Run length detection and run filling of run mode. The pixel types of 8 and 16 bit images
+// and of 8 bit color images use the SIMD routines of the sample format library.
+//
+template<class PIXEL>
+inlinehint LONG CountRunPixels(const PIXEL* ptype, LONG cpixel, PIXEL value)
+{
+	LONG i = 0;
+	while (i < cpixel && ptype[i] == value)
+	{
+		++i;
+	}
+	return i;
+}
+
+template<class SAMPLE>
+inlinehint LONG CountRunPixels(const Triplet<SAMPLE>* ptype, LONG cpixel, Triplet<SAMPLE> value)
+{
+	LONG i = 0;
+	while (i < cpixel && ptype[i].v1 == value.v1 && ptype[i].v2 == value.v2 && ptype[i].v3 == value.v3)
+	{
+		++i;
+	}
+	return i;
+}
+
+inlinehint LONG CountRunPixels(const BYTE* ptype, LONG cpixel, BYTE value)
+{ return LONG(sf_run8(ptype, cpixel, value)); }
+
+inlinehint LONG CountRunPixels(const USHORT* ptype, LONG cpixel, USHORT value)
+{ return LONG(sf_run16(ptype, cpixel, value)); }
+
+inlinehint LONG CountRunPixels(const Triplet<BYTE>* ptype, LONG cpixel, Triplet<BYTE> value)
+{ return LONG(sf_run24(&ptype->v1, cpixel, &value.v1)); }
+
+template<class PIXEL>
+inlinehint void FillRunPixels(PIXEL* ptype, LONG cpixel, PIXEL value)
+{
+	for (LONG i = 0; i < cpixel; ++i)
+	{
+		ptype[i] = value;
+	}
+}
+
+inlinehint void FillRunPixels(BYTE* ptype, LONG cpixel, BYTE value)
+{ ::memset(ptype, value, cpixel); }
+
+inlinehint void FillRunPixels(USHORT* ptype, LONG cpixel, USHORT value)
+{ sf_fill16(ptype, cpixel, value); }
+
+inlinehint void FillRunPixels(Triplet<BYTE>* ptype, LONG cpixel, Triplet<BYTE> value)
+{ sf_fill24(&ptype->v1, cpixel, &value.v1); }
+
+// the routines for Triplet<BYTE> take the pixels as packed bytes
+typedef char TripletIsPacked[sizeof(Triplet<BYTE>) == 3 ? 1 : -1];
+
+
 
 // Two alternatives for GetPredictedValue() (second is slightly faster due to reduced branching)
 
@@ -113,6 +171,7 @@ public:
 	  JlsCodec(const TRAITS& inTraits, const JlsParameters& info) : STRATEGY(info), 
 	  traits(inTraits),
 		  _rect(),
+		  _endLine(0),
 		  _width(info.width),
 		  T1(0),
 		  T2(0),
@@ -201,6 +260,7 @@ protected:
 	// codec parameters 
 	TRAITS traits;
 	JlsRect _rect;
+	LONG _endLine;	// decoding stops before this line; 0 for the whole scan
 	int _width;
 	LONG T1;	
 	LONG T2;
@@ -572,10 +632,7 @@ LONG JlsCodec<TRAITS,STRATEGY>::DecodeRunPixels(PIXEL Ra, PIXEL* startPos, LONG
 	if (index > cpixelMac)
 		throw JlsException(InvalidCompressedData);
 
-	for (LONG i = 0; i < index; ++i)
-	{
-		startPos[i] = Ra;
-	}	
+	FillRunPixels(startPos, index, Ra);
 
 	return index;
 }
@@ -591,13 +648,21 @@ LONG JlsCodec<TRAITS,STRATEGY>::DoRunMode(LONG index, EncoderStrategy*)
 
 	LONG runLength = 0;
 
-	while (traits.IsNear(ptypeCurX[runLength],Ra)) 
+	if (traits.NEAR == 0)
+	{
+		// lossless: the run is the pixels equal to Ra, which need not be replaced
+		runLength = CountRunPixels(ptypeCurX, ctypeRem, Ra);
+	}
+	else
 	{
-		ptypeCurX[runLength] = Ra;
-		runLength++;
+		while (traits.IsNear(ptypeCurX[runLength],Ra)) 
+		{
+			ptypeCurX[runLength] = Ra;
+			runLength++;
 
-		if (runLength == ctypeRem)
-			break;
+			if (runLength == ctypeRem)
+				break;
+		}
 	}
 
 	EncodeRunPixels(runLength, runLength == ctypeRem);
@@ -711,8 +776,9 @@ void JlsCodec<TRAITS,STRATEGY>::DoScan()
 
 	std::vector<PIXEL> vectmp(2 * components * pixelstride);
 	std::vector<LONG> rgRUNindex(components);
+	const LONG endLine = _endLine > 0 ? _endLine : Info().height;
 	
-	for (LONG line = 0; line < Info().height; ++line)
+	for (LONG line = 0; line < endLine; ++line)
 	{
 		_previousLine			= &vectmp[1];	
 		_currentLine			= &vectmp[1 + components * pixelstride];	
@@ -743,7 +809,11 @@ void JlsCodec<TRAITS,STRATEGY>::DoScan()
 		}
 	}
 
-	STRATEGY::EndScan();
+	// a scan that is left before its end is not checked
+	if (endLine == Info().height)
+	{
+		STRATEGY::EndScan();
+	}
 }
 
 
@@ -822,9 +892,18 @@ void JlsCodec<TRAITS,STRATEGY>::DecodeScan(std::auto_ptr<ProcessLine> processLin
 	_bCompare = bCompare;	
 	_rect = rect;
 
+	// lines below the rectangle are not decoded when the rest of the scan can be skipped in memory
+	_endLine = Info().height;
+	if (compressedData->rawStream == NULL && rect.Height > 0 && rect.Y + rect.Height < Info().height)
+	{
+		_endLine = rect.Y + rect.Height;
+	}
+
 	STRATEGY::Init(compressedData);
 	DoScan();
-	SkipBytes(compressedData, STRATEGY::GetCurBytePos() - compressedBytes);
+
+	BYTE* endBytes = _endLine < Info().height ? STRATEGY::FindNextMarker() : STRATEGY::GetCurBytePos();
+	SkipBytes(compressedData, endBytes - compressedBytes);
 }
 
 
@@ -72,6 +72,9 @@ private:
 	{ 
 		ASSERT(!_bCompare || _pdata[_cbyteOffset] == val);
 		
+		if (_cbyteOffset >= _cbyteLength)
+			throw JlsException(CompressedBufferTooSmall);
+
 		_pdata[_cbyteOffset++] = val; 
 	}
 
@@ -120,6 +123,8 @@ public:
 
 	void Read(ByteStreamInfo info);
 	void ReadHeader();
+	void ReadComponent(ByteStreamInfo rawPixels, size_t scanOffset);
+	void FindScans(size_t* scanOffsets, int scanCount);
 	
 	void EnableCompare(bool bCompare)
 		{ _bCompare = bCompare;	}
@@ -132,6 +137,8 @@ public:
 	BYTE ReadByte();
 
 private:
+	void ReadMarkers();
+	int64_t BeginRead(const ByteStreamInfo& rawPixels, int planes);
 	void ReadScan(ByteStreamInfo rawPixels);	
 	int ReadPresetParameters();
 	int ReadComment();
@@ -10,6 +10,10 @@
 #include <string.h>
 #include "publictypes.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 
 #ifndef MAX
 #define MAX(a,b)            (((a) > (b)) ? (a) : (b))
@@ -129,12 +133,68 @@ struct FromBigEndian<8>
 {
 	inlinehint static uint64_t Read(BYTE* pbyte)
 	{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+		uint64_t value;
+		::memcpy(&value, pbyte, sizeof(value));
+		return _byteswap_uint64(value);
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+		uint64_t value;
+		::memcpy(&value, pbyte, sizeof(value));
+		return __builtin_bswap64(value);
+#else
 		return  (uint64_t(pbyte[0]) << 56) + (uint64_t(pbyte[1]) << 48) + (uint64_t(pbyte[2]) << 40) + (uint64_t(pbyte[3]) << 32) + 
 		  		(uint64_t(pbyte[4]) << 24) + (uint64_t(pbyte[5]) << 16) + (uint64_t(pbyte[6]) <<  8) + (uint64_t(pbyte[7]) << 0);
+#endif
 	}
 };
 
 
+// Number of zero bits above the highest set bit of a nonzero value. BSR rather than LZCNT,
+// which older processors execute as BSR with a different result.
+inlinehint LONG CountLeadingZeros(uint64_t value)
+{
+	ASSERT(value != 0);
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return 63 - LONG(index);
+#elif defined(_MSC_VER) && defined(_M_IX86)
+	unsigned long index;
+	if (_BitScanReverse(&index, (unsigned long)(value >> 32)))
+		return 31 - LONG(index);
+	_BitScanReverse(&index, (unsigned long)value);
+	return 63 - LONG(index);
+#elif defined(__GNUC__)
+	return __builtin_clzll(value);
+#else
+	LONG count = 0;
+	while ((value & (uint64_t(1) << 63)) == 0)
+	{
+		value <<= 1;
+		count++;
+	}
+	return count;
+#endif
+}
+
+
+// Position of the first marker in [position, end), or end if there is none. JPEG bitstream rule: no FF
+// may be followed by 0x80 or higher, except in a marker.
+inline BYTE* FindMarker(BYTE* position, BYTE* end)
+{
+	while (position + 1 < end)
+	{
+		position = (BYTE*)::memchr(position, 0xFF, size_t(end - position) - 1);
+		if (position == NULL)
+			break;
+		if ((position[1] & 0x80) != 0)
+			return position;
+		++position;
+	}
+	return end;
+}
+
+
 class JlsException
 {
 public:
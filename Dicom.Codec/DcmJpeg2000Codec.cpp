@@ -22,7 +22,11 @@
 #include "stdio.h"
 #include "string.h"
 
+#include <vector>
+
 #include "DcmJpeg2000Codec.h"
+#include "FrameEngine.h"
+#include "SampleFormat/sampleformat.h"
 
 using namespace System;
 using namespace System::IO;
@@ -65,21 +69,26 @@ OPJ_COLOR_SPACE getOpenJpegColorSpace(String^ photometricInterpretation) {
 		return CLRSPC_UNKNOWN;
 }
 
-void DcmJpeg2000Codec::Encode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters) {
-	if ((oldPixelData->PhotometricInterpretation == "YBR_FULL_422")    ||
-		(oldPixelData->PhotometricInterpretation == "YBR_PARTIAL_422") ||
-		(oldPixelData->PhotometricInterpretation == "YBR_PARTIAL_420"))
-		throw gcnew DicomCodecException(String::Format("Photometric Interpretation '{0}' not supported by JPEG 2000 encoder",
-														oldPixelData->PhotometricInterpretation));
+ref class Jpeg2000EncodeWorker : public FrameWorker {
+public:
+	Jpeg2000EncodeWorker(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpeg2000Parameters^ jparams) {
+		_oldPixelData = oldPixelData;
+		_newPixelData = newPixelData;
+		_jparams = jparams;
+	}
 
-	DcmJpeg2000Parameters^ jparams = (DcmJpeg2000Parameters^)parameters;
-	if (jparams == nullptr)
-		jparams = (DcmJpeg2000Parameters^)GetDefaultParameters();
+	virtual Object^ Fetch(int frame) override {
+		return _oldPixelData->GetFrameDataU8(frame);
+	}
+
+	virtual Object^ Process(int frame, Object^ input) override {
+		DcmPixelData^ oldPixelData = _oldPixelData;
+		DcmPixelData^ newPixelData = _newPixelData;
+		DcmJpeg2000Parameters^ jparams = _jparams;
 
-	int pixelCount = oldPixelData->ImageHeight * oldPixelData->ImageWidth;
+		const int pixelCount = oldPixelData->ImageHeight * oldPixelData->ImageWidth;
 
-	for (int frame = 0; frame < oldPixelData->NumberOfFrames; frame++) {
-		array<unsigned char>^ frameArray = oldPixelData->GetFrameDataU8(frame);
+		array<unsigned char>^ frameArray = (array<unsigned char>^)input;
 		pin_ptr<unsigned char> framePin = &frameArray[0];
 		unsigned char* frameData = framePin;
 		const int frameDataSize = frameArray->Length;
@@ -146,74 +155,38 @@ void DcmJpeg2000Codec::Encode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, D
 			image->x1 =	image->x0 + ((oldPixelData->ImageWidth - 1) * eparams.subsampling_dx) + 1;
 			image->y1 =	image->y0 + ((oldPixelData->ImageHeight - 1) * eparams.subsampling_dy) + 1;
 
-			for (int c = 0; c < image->numcomps; c++) {
-				opj_image_comp_t* comp = &image->comps[c];
-
-				int pos = oldPixelData->IsPlanar ? (c * pixelCount) : c;
-				const int offset = oldPixelData->IsPlanar ? 1 : image->numcomps;
-
-				if (oldPixelData->BytesAllocated == 1) {
-					if (comp->sgnd) {
-						if (oldPixelData->BitsStored < 8) {
-							const unsigned char sign = 1 << oldPixelData->HighBit;
-							const unsigned char mask = sign - 1;
-							for (int p = 0; p < pixelCount; p++) {
-								const unsigned char pixel = frameData[pos];
-								if (pixel & sign)
-									comp->data[p] = -(pixel & mask);
-								else
-									comp->data[p] = pixel;
-								pos += offset;
-							}
-						}
-						else {
-							char* frameData8 = (char*)frameData;
-							for (int p = 0; p < pixelCount; p++) {
-								comp->data[p] = frameData8[pos];
-								pos += offset;
-							}
-						}
-					}
-					else {
-						for (int p = 0; p < pixelCount; p++) {
-							comp->data[p] = frameData[pos];
-							pos += offset;
-						}
-					}
-				}
-				else if (oldPixelData->BytesAllocated == 2) {
-					if (comp->sgnd) {
-						if (oldPixelData->BitsStored < 16) {
-							unsigned short* frameData16 = (unsigned short*)frameData;
-							const unsigned short sign = 1 << oldPixelData->HighBit;
-							const unsigned short mask = sign - 1;
-							for (int p = 0; p < pixelCount; p++) {
-								const unsigned short pixel = frameData16[pos];
-								if (pixel & sign)
-									comp->data[p] = -(pixel & mask);
-								else
-									comp->data[p] = pixel;
-								pos += offset;
-							}
-						}
-						else {
-							short* frameData16 = (short*)frameData;
-							for (int p = 0; p < pixelCount; p++) {
-								comp->data[p] = frameData16[pos];
-								pos += offset;
-							}
-						}
-					}
-					else {
-						unsigned short* frameData16 = (unsigned short*)frameData;
-						for (int p = 0; p < pixelCount; p++) {
-							comp->data[p] = frameData16[pos];
-							pos += offset;
-						}
-					}
+			const int bytesAllocated = oldPixelData->BytesAllocated;
+			if (bytesAllocated != 1 && bytesAllocated != 2)
+				throw gcnew DicomCodecException("JPEG 2000 codec only supports Bits Allocated == 8 or 16");
+
+			// OpenJPEG takes a plane of integers per component
+			const size_t planeSize = (size_t)pixelCount * bytesAllocated;
+			const unsigned char* planes = frameData;
+			std::vector<unsigned char> planarData;
+			if (!oldPixelData->IsPlanar && image->numcomps > 1) {
+				planarData.resize(planeSize * image->numcomps);
+				sf_deinterleave(&planarData[0], planeSize, frameData, pixelCount, image->numcomps, bytesAllocated);
+				planes = &planarData[0];
+			}
+
+			// signed samples narrower than Bits Allocated are sign-magnitude at High Bit
+			sf_representation rep = SF_UNSIGNED;
+			int highBit = oldPixelData->BitsAllocated - 1;
+			if (image->comps[0].sgnd) {
+				if (oldPixelData->BitsStored < oldPixelData->BitsAllocated) {
+					rep = SF_SIGN_MAGNITUDE;
+					highBit = oldPixelData->HighBit;
 				}
 				else
-					throw gcnew DicomCodecException("JPEG 2000 codec only supports Bits Allocated == 8 or 16");
+					rep = SF_TWOS_COMPLEMENT;
+			}
+
+			for (int c = 0; c < image->numcomps; c++) {
+				const unsigned char* plane = planes + c * planeSize;
+				if (bytesAllocated == 1)
+					sf_unpack8(image->comps[c].data, plane, pixelCount, highBit, rep);
+				else
+					sf_unpack16(image->comps[c].data, (const unsigned short*)plane, pixelCount, highBit, rep);
 			}
 
 			opj_setup_encoder(cinfo, &eparams, image);
@@ -224,7 +197,7 @@ void DcmJpeg2000Codec::Encode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, D
 				int clen = cio_tell(cio);
 				array<unsigned char>^ cbuf = gcnew array<unsigned char>(clen);
 				Marshal::Copy((IntPtr)cio->buffer, cbuf, 0, clen);
-				newPixelData->AddFrame(cbuf);
+				return cbuf;
 			} else
 				throw gcnew DicomCodecException("Unable to JPEG 2000 encode image");
 		}
@@ -238,38 +211,107 @@ void DcmJpeg2000Codec::Encode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, D
 		}
 	}
 
-	if (oldPixelData->PhotometricInterpretation == "RGB" && jparams->AllowMCT) {
-		if (jparams->UpdatePhotometricInterpretation) {
-			if (newPixelData->TransferSyntax == DicomTransferSyntax::JPEG2000Lossy && jparams->Irreversible)
-				newPixelData->PhotometricInterpretation = "YBR_ICT";
-			else
-				newPixelData->PhotometricInterpretation = "YBR_RCT";
-		}
+	virtual void Commit(int frame, Object^ output) override {
+		_oldPixelData->Unload();
+		_newPixelData->AddFrame((array<unsigned char>^)output);
 	}
 
-	if (newPixelData->TransferSyntax == DicomTransferSyntax::JPEG2000Lossy && newPixelData->NumberOfFrames > 0) {
-		newPixelData->IsLossy = true;
-		newPixelData->LossyCompressionMethod = "ISO_15444_1";
+private:
+	DcmPixelData^ _oldPixelData;
+	DcmPixelData^ _newPixelData;
+	DcmJpeg2000Parameters^ _jparams;
+};
+
+// Stores the samples of the decoded components in the frame, a row at a time.
+void storeComponents(const FrameLayout& layout, opj_image_t* image, int width, int height, int bytesAllocated, int highBit) {
+	const int components = image->numcomps;
+	const size_t rowSize = (size_t)width * bytesAllocated;
+	const bool direct = layout.planar || components == 1;
+
+	// interleaved frames are packed into a row of each component first
+	std::vector<unsigned char> rows;
+	if (!direct)
+		rows.resize(rowSize * components);
+
+	for (int y = 0; y < height; y++) {
+		unsigned char* row = layout.data + y * layout.row_stride;
+
+		for (int c = 0; c < components; c++) {
+			opj_image_comp_t* comp = &image->comps[c];
+			const sf_representation rep = comp->sgnd ? SF_SIGN_MAGNITUDE : SF_UNSIGNED;
+			unsigned char* dst = direct ? row + c * layout.plane_stride : &rows[c * rowSize];
+
+			if (bytesAllocated == 1)
+				sf_pack8(dst, comp->data + y * width, width, highBit, rep);
+			else
+				sf_pack16((unsigned short*)dst, comp->data + y * width, width, highBit, rep);
+		}
 
-		const double oldSize = oldPixelData->GetFrameSize(0);
-		const double newSize = newPixelData->GetFrameSize(0);
-		String^ ratio = String::Format("{0:0.000}", oldSize / newSize);
-		newPixelData->LossyCompressionRatio = ratio;
+		if (!direct)
+			sf_interleave(row, &rows[0], rowSize, width, components, bytesAllocated);
 	}
 }
 
-void DcmJpeg2000Codec::Decode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters) {
-	DcmJpeg2000Parameters^ jparams = (DcmJpeg2000Parameters^)parameters;
-	if (jparams == nullptr)
-		jparams = (DcmJpeg2000Parameters^)GetDefaultParameters();
+// Decodes a code stream into destination, with the geometry of oldPixelData and the sample format of newPixelData.
+void decodeFrame(array<unsigned char>^ jpegArray, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpeg2000Parameters^ jparams, FrameBuffer destination) {
+	const int width = oldPixelData->ImageWidth;
+	const int height = oldPixelData->ImageHeight;
+
+	if (newPixelData->BytesAllocated != 1 && newPixelData->BytesAllocated != 2)
+		throw gcnew DicomCodecException("JPEG 2000 module only supports Bytes Allocated == 8 or 16!");
+
+	pin_ptr<unsigned char> jpegPin = &jpegArray[0];
+	unsigned char* jpegData = jpegPin;
+	const int jpegDataSize = jpegArray->Length;
+
+	opj_dparameters_t dparams;
+	opj_event_mgr_t event_mgr;
+	opj_image_t *image = NULL;
+	opj_dinfo_t* dinfo = NULL;
+	opj_cio_t *cio = NULL;
+
+	memset(&event_mgr, 0, sizeof(opj_event_mgr_t));
+	event_mgr.error_handler = opj_error_callback;
+	if (jparams->IsVerbose) {
+		event_mgr.warning_handler = opj_warning_callback;
+		event_mgr.info_handler = opj_info_callback;
+	}
+
+	opj_set_default_decoder_parameters(&dparams);
+	dparams.cp_layer=0;
+	dparams.cp_reduce=0;
+
+	try {
+		dinfo = opj_create_decompress(CODEC_J2K);
+
+		opj_set_event_mgr((opj_common_ptr)dinfo, &event_mgr, NULL);
+
+		opj_setup_decoder(dinfo, &dparams);
 
-	array<unsigned char>^ destArray = gcnew array<unsigned char>(oldPixelData->UncompressedFrameSize);
-	pin_ptr<unsigned char> destPin = &destArray[0];
-	unsigned char* destData = destPin;
-	const int destDataSize = destArray->Length;
+		bool opj_err = false;
+		dinfo->client_data = (void*)&opj_err;
 
-	const int pixelCount = oldPixelData->ImageHeight * oldPixelData->ImageWidth;
+		cio = opj_cio_open((opj_common_ptr)dinfo, jpegData, (int)jpegDataSize);
+		image = opj_decode(dinfo, cio);
 
+		if (image == nullptr)
+			throw gcnew DicomCodecException("Error in JPEG 2000 code stream!");
+
+		FrameLayout layout = destination.GetLayout(width, height, image->numcomps, newPixelData->BytesAllocated);
+		storeComponents(layout, image, width, height, newPixelData->BytesAllocated, newPixelData->HighBit);
+	}
+	finally {
+		if (cio != nullptr)
+			opj_cio_close(cio);
+		if (dinfo != nullptr)
+			opj_destroy_decompress(dinfo);
+		if (image != nullptr)
+			opj_image_destroy(image);
+	}
+}
+
+// Sets the attributes of the decoded pixel data.
+void prepareDecode(DcmPixelData^ newPixelData) {
 	if (newPixelData->PhotometricInterpretation == "YBR_RCT" || newPixelData->PhotometricInterpretation == "YBR_ICT")
 		newPixelData->PhotometricInterpretation = "RGB";
 
@@ -278,108 +320,107 @@ void DcmJpeg2000Codec::Decode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, D
 	
 	if (newPixelData->PhotometricInterpretation == "YBR_FULL")
 		newPixelData->PlanarConfiguration = 1;
+}
 
-	for (int frame = 0; frame < oldPixelData->NumberOfFrames; frame++) {
-		array<unsigned char>^ jpegArray = oldPixelData->GetFrameDataU8(frame);
-		pin_ptr<unsigned char> jpegPin = &jpegArray[0];
-		unsigned char* jpegData = jpegPin;
-		const int jpegDataSize = jpegArray->Length;
+ref class Jpeg2000DecodeWorker : public FrameWorker {
+public:
+	Jpeg2000DecodeWorker(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpeg2000Parameters^ jparams) {
+		_oldPixelData = oldPixelData;
+		_newPixelData = newPixelData;
+		_jparams = jparams;
 
-		opj_dparameters_t dparams;
-		opj_event_mgr_t event_mgr;
-		opj_image_t *image = NULL;
-		opj_dinfo_t* dinfo = NULL;
-		opj_cio_t *cio = NULL;
+		// each worker owns its destination buffer; AddFrame copies it into the new pixel data
+		_destArray = gcnew array<unsigned char>(oldPixelData->UncompressedFrameSize);
+	}
 
-		memset(&event_mgr, 0, sizeof(opj_event_mgr_t));
-		event_mgr.error_handler = opj_error_callback;
-		if (jparams->IsVerbose) {
-			event_mgr.warning_handler = opj_warning_callback;
-			event_mgr.info_handler = opj_info_callback;
-		}
+	virtual Object^ Fetch(int frame) override {
+		return _oldPixelData->GetFrameDataU8(frame);
+	}
 
-		opj_set_default_decoder_parameters(&dparams);
-		dparams.cp_layer=0;
-		dparams.cp_reduce=0;
+	virtual Object^ Process(int frame, Object^ input) override {
+		pin_ptr<unsigned char> destPin = &_destArray[0];
+		FrameBuffer destination = FrameBuffer::Packed(IntPtr((unsigned char*)destPin), _destArray->Length, _oldPixelData->ImageWidth, _oldPixelData->ImageHeight,
+			_newPixelData->SamplesPerPixel, _newPixelData->BytesAllocated, _newPixelData->IsPlanar);
 
-		try {
-			dinfo = opj_create_decompress(CODEC_J2K);
+		decodeFrame((array<unsigned char>^)input, _oldPixelData, _newPixelData, _jparams, destination);
+		return _destArray;
+	}
 
-			opj_set_event_mgr((opj_common_ptr)dinfo, &event_mgr, NULL);
+	virtual void Commit(int frame, Object^ output) override {
+		_oldPixelData->Unload();
+		_newPixelData->AddFrame((array<unsigned char>^)output);
+	}
 
-			opj_setup_decoder(dinfo, &dparams);
+private:
+	DcmPixelData^ _oldPixelData;
+	DcmPixelData^ _newPixelData;
+	DcmJpeg2000Parameters^ _jparams;
+	array<unsigned char>^ _destArray;
+};
 
-			bool opj_err = false;
-			dinfo->client_data = (void*)&opj_err;
+void DcmJpeg2000Codec::Encode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters) {
+	if ((oldPixelData->PhotometricInterpretation == "YBR_FULL_422")    ||
+		(oldPixelData->PhotometricInterpretation == "YBR_PARTIAL_422") ||
+		(oldPixelData->PhotometricInterpretation == "YBR_PARTIAL_420"))
+		throw gcnew DicomCodecException(String::Format("Photometric Interpretation '{0}' not supported by JPEG 2000 encoder",
+														oldPixelData->PhotometricInterpretation));
 
-			cio = opj_cio_open((opj_common_ptr)dinfo, jpegData, (int)jpegDataSize);
-			image = opj_decode(dinfo, cio);
+	if (parameters == nullptr || parameters->GetType() != DcmJpeg2000Parameters::typeid)
+		parameters = GetDefaultParameters();
 
-			oldPixelData->Unload();
+	DcmJpeg2000Parameters^ jparams = (DcmJpeg2000Parameters^)parameters;
 
-			if (image == nullptr)
-				throw gcnew DicomCodecException("Error in JPEG 2000 code stream!");
+	array<FrameWorker^>^ workers = gcnew array<FrameWorker^>(FrameEngine::GetWorkerCount(jparams, oldPixelData->NumberOfFrames));
+	for (int i = 0; i < workers->Length; i++) {
+		workers[i] = gcnew Jpeg2000EncodeWorker(oldPixelData, newPixelData, jparams);
+	}
 
-			for (int c = 0; c < image->numcomps; c++) {
-				opj_image_comp_t* comp = &image->comps[c];
-
-				int pos = newPixelData->IsPlanar ? (c * pixelCount) : c;
-				const int offset = newPixelData->IsPlanar ? 1 : image->numcomps;
-
-				if (newPixelData->BytesAllocated == 1) {
-					if (comp->sgnd) {
-						const unsigned char sign = 1 << newPixelData->HighBit;
-						for (int p = 0; p < pixelCount; p++) {
-							const int i = comp->data[p];
-							if (i < 0)
-								destArray[pos] = (unsigned char)(-i | sign);
-							else
-								destArray[pos] = (unsigned char)(i);
-							pos += offset;
-						}
-					}
-					else {
-						for (int p = 0; p < pixelCount; p++) {
-							destArray[pos] = (unsigned char)comp->data[p];
-							pos += offset;
-						}
-					}
-				}
-				else if (newPixelData->BytesAllocated == 2) {
-					const unsigned short sign = 1 << newPixelData->HighBit;
-					unsigned short* destData16 = (unsigned short*)destData;
-					if (comp->sgnd) {
-						for (int p = 0; p < pixelCount; p++) {
-							const int i = comp->data[p];
-							if (i < 0)
-								destData16[pos] = (unsigned short)(-i | sign);
-							else
-								destData16[pos] = (unsigned short)(i);
-							pos += offset;
-						}
-					}
-					else {
-						for (int p = 0; p < pixelCount; p++) {
-							destData16[pos] = (unsigned short)comp->data[p];
-							pos += offset;
-						}
-					}
-				}
-				else
-					throw gcnew DicomCodecException("JPEG 2000 module only supports Bytes Allocated == 8 or 16!");
-			}
+	FrameEngine::Run(oldPixelData->NumberOfFrames, workers);
 
-			newPixelData->AddFrame(destArray);
-		}
-		finally {
-			if (cio != nullptr)
-				opj_cio_close(cio);
-			if (dinfo != nullptr)
-				opj_destroy_decompress(dinfo);
-			if (image != nullptr)
-				opj_image_destroy(image);
+	if (oldPixelData->PhotometricInterpretation == "RGB" && jparams->AllowMCT) {
+		if (jparams->UpdatePhotometricInterpretation) {
+			if (newPixelData->TransferSyntax == DicomTransferSyntax::JPEG2000Lossy && jparams->Irreversible)
+				newPixelData->PhotometricInterpretation = "YBR_ICT";
+			else
+				newPixelData->PhotometricInterpretation = "YBR_RCT";
 		}
 	}
+
+	if (newPixelData->TransferSyntax == DicomTransferSyntax::JPEG2000Lossy && newPixelData->NumberOfFrames > 0) {
+		newPixelData->IsLossy = true;
+		newPixelData->LossyCompressionMethod = "ISO_15444_1";
+
+		const double oldSize = oldPixelData->GetFrameSize(0);
+		const double newSize = newPixelData->GetFrameSize(0);
+		String^ ratio = String::Format("{0:0.000}", oldSize / newSize);
+		newPixelData->LossyCompressionRatio = ratio;
+	}
+}
+
+void DcmJpeg2000Codec::Decode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters) {
+	if (parameters == nullptr || parameters->GetType() != DcmJpeg2000Parameters::typeid)
+		parameters = GetDefaultParameters();
+
+	DcmJpeg2000Parameters^ jparams = (DcmJpeg2000Parameters^)parameters;
+
+	prepareDecode(newPixelData);
+
+	array<FrameWorker^>^ workers = gcnew array<FrameWorker^>(FrameEngine::GetWorkerCount(jparams, oldPixelData->NumberOfFrames));
+	for (int i = 0; i < workers->Length; i++) {
+		workers[i] = gcnew Jpeg2000DecodeWorker(oldPixelData, newPixelData, jparams);
+	}
+
+	FrameEngine::Run(oldPixelData->NumberOfFrames, workers);
+}
+
+void DcmJpeg2000Codec::DecodeFrame(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, int frame, DcmCodecParameters^ parameters, FrameBuffer destination) {
+	if (parameters == nullptr || parameters->GetType() != DcmJpeg2000Parameters::typeid)
+		parameters = GetDefaultParameters();
+
+	DcmJpeg2000Parameters^ jparams = (DcmJpeg2000Parameters^)parameters;
+
+	prepareDecode(newPixelData);
+	decodeFrame(oldPixelData->GetFrameDataU8(frame), oldPixelData, newPixelData, jparams, destination);
 }
 
 void DcmJpeg2000Codec::Register() {
@@ -29,6 +29,8 @@ using namespace System;
 using namespace Dicom::Data;
 using namespace Dicom::Codec;
 
+#include "FrameBuffer.h"
+
 namespace Dicom {
 namespace Codec {
 namespace Jpeg2000 {
@@ -101,7 +103,7 @@ namespace Jpeg2000 {
 	};
 
 
-	public ref class DcmJpeg2000Codec abstract : public IDcmCodec
+	public ref class DcmJpeg2000Codec abstract : public IDcmCodec, public IDcmFrameDecoder
 	{
 	public:
 		virtual String^ GetName() {
@@ -117,6 +119,9 @@ namespace Jpeg2000 {
 		virtual void Encode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters);
 		virtual void Decode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters);
 
+		// Decodes a frame into memory of the caller; see IDcmFrameDecoder.
+		virtual void DecodeFrame(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, int frame, DcmCodecParameters^ parameters, FrameBuffer destination);
+
 		static void Register();
 	};
 
@@ -31,10 +31,81 @@ using namespace Dicom::IO;
 #include "JpegCodec.h"
 #include "JpegHelper.h"
 #include "DcmJpegParameters.h"
+#include "FrameEngine.h"
 
 namespace Dicom {
 namespace Codec {
 namespace Jpeg {
+	ref class JpegEncodeWorker : public FrameWorker {
+	public:
+		JpegEncodeWorker(IJpegCodec^ codec, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params) {
+			_codec = codec;
+			_oldPixelData = oldPixelData;
+			_newPixelData = newPixelData;
+			_params = params;
+		}
+
+		virtual Object^ Fetch(int frame) override {
+			return IJpegCodec::GetEncoderFrameData(_oldPixelData, frame);
+		}
+
+		virtual Object^ Process(int frame, Object^ input) override {
+			return _codec->EncodeFrame((array<unsigned char>^)input, _oldPixelData, _newPixelData, _params);
+		}
+
+		virtual void Commit(int frame, Object^ output) override {
+			_newPixelData->AddFrame((List<ByteBuffer^>^)output);
+		}
+
+	private:
+		IJpegCodec^ _codec;
+		DcmPixelData^ _oldPixelData;
+		DcmPixelData^ _newPixelData;
+		DcmJpegParameters^ _params;
+	};
+
+	// Checkpoint index of a frame in the cache of the parameters, or null if they have none.
+	JpegCheckpointIndex^ GetCheckpoints(DcmJpegParameters^ params, DcmPixelData^ pixelData, int frame) {
+		if (params->Checkpoints == nullptr)
+			return nullptr;
+		return params->Checkpoints->GetIndex(pixelData, frame);
+	}
+
+	ref class JpegDecodeWorker : public FrameWorker {
+	public:
+		JpegDecodeWorker(IJpegCodec^ codec, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params) {
+			_codec = codec;
+			_oldPixelData = oldPixelData;
+			_newPixelData = newPixelData;
+			_params = params;
+		}
+
+		virtual Object^ Fetch(int frame) override {
+			return gcnew PinnedFragments(_oldPixelData->GetFrameFragments(frame));
+		}
+
+		virtual Object^ Process(int frame, Object^ input) override {
+			PinnedFragments^ jpegData = (PinnedFragments^)input;
+			try {
+				return _codec->DecodeFrame(jpegData, _oldPixelData, _params, GetCheckpoints(_params, _oldPixelData, frame));
+			}
+			finally {
+				delete jpegData;
+			}
+		}
+
+		virtual void Commit(int frame, Object^ output) override {
+			_oldPixelData->Unload();
+			_newPixelData->AddFrame((array<unsigned char>^)output);
+		}
+
+	private:
+		IJpegCodec^ _codec;
+		DcmPixelData^ _oldPixelData;
+		DcmPixelData^ _newPixelData;
+		DcmJpegParameters^ _params;
+	};
+
 	void DcmJpegCodec::Encode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters)
 	{
 		if (oldPixelData->NumberOfFrames == 0)
@@ -50,13 +121,25 @@ namespace Jpeg {
 			parameters = GetDefaultParameters();
 
 		DcmJpegParameters^ jparams = (DcmJpegParameters^)parameters;
+		if (jparams->MemoryStatistics != nullptr)
+			jparams->MemoryStatistics->Reset();
+
+		// the entropy coding is part of the process that the transfer syntax names
+		if (jparams->ArithmeticCoding && !IsArithmetic)
+			throw gcnew DicomCodecException(String::Format("{0} does not allow arithmetic coding; use JPEG Extended (Process 3 & 5) or JPEG Lossless (Process 15)", GetName()));
+		if (!jparams->ArithmeticCoding && IsArithmetic)
+			throw gcnew DicomCodecException(String::Format("{0} requires arithmetic coding", GetName()));
 
 		IJpegCodec^ codec = GetCodec(oldPixelData->BitsStored, jparams);
 
-		for (int frame = 0; frame < oldPixelData->NumberOfFrames; frame++) {
-			codec->Encode(oldPixelData, newPixelData, jparams, frame);
+		array<FrameWorker^>^ workers = gcnew array<FrameWorker^>(FrameEngine::GetWorkerCount(jparams, oldPixelData->NumberOfFrames));
+		for (int i = 0; i < workers->Length; i++) {
+			IJpegCodec^ workerCodec = (i == 0) ? codec : GetCodec(oldPixelData->BitsStored, jparams);
+			workers[i] = gcnew JpegEncodeWorker(workerCodec, oldPixelData, newPixelData, jparams);
 		}
 
+		FrameEngine::Run(oldPixelData->NumberOfFrames, workers);
+
 		if (codec->Mode != JpegMode::Lossless) {
 			newPixelData->IsLossy = true;
 			newPixelData->LossyCompressionMethod = "ISO_10918_1";
@@ -68,22 +151,14 @@ namespace Jpeg {
 		}
 	}
 
-	void DcmJpegCodec::Decode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters)
+	int DcmJpegCodec::PrepareDecode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData)
 	{
-		if (oldPixelData->NumberOfFrames == 0)
-			return;
-
 		// IJG eats the extra padding bits. Is there a better way to test for this?
 		if (newPixelData->BitsAllocated == 16 && newPixelData->BitsStored <= 8) {
 			// check for embedded overlays here or below?
 			newPixelData->BitsAllocated = 8;
 		}
 
-		if (parameters == nullptr || parameters->GetType() != DcmJpegParameters::typeid)
-			parameters = GetDefaultParameters();
-
-		DcmJpegParameters^ jparams = (DcmJpegParameters^)parameters;
-
 		int precision = 0;
 		try {
 			precision = JpegHelper::ScanHeaderForBitDepth(oldPixelData);
@@ -97,18 +172,106 @@ namespace Jpeg {
 		if (newPixelData->BitsStored <= 8 && precision > 8)
 			newPixelData->BitsAllocated = 16; // embedded overlay?
 
-		IJpegCodec^ codec = GetCodec(precision, jparams);
+		return precision;
+	}
+
+	void DcmJpegCodec::Decode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters)
+	{
+		if (oldPixelData->NumberOfFrames == 0)
+			return;
+
+		if (parameters == nullptr || parameters->GetType() != DcmJpegParameters::typeid)
+			parameters = GetDefaultParameters();
+
+		DcmJpegParameters^ jparams = (DcmJpegParameters^)parameters;
+		if (jparams->MemoryStatistics != nullptr)
+			jparams->MemoryStatistics->Reset();
+
+		int precision = PrepareDecode(oldPixelData, newPixelData);
+
+		// the workers decode frames concurrently, so the frames are described up front, from the first one
+		PinnedFragments^ jpegData = gcnew PinnedFragments(oldPixelData->GetFrameFragments(0));
+		try {
+			GetCodec(precision, jparams)->DescribeFrame(jpegData, oldPixelData, newPixelData, jparams);
+		}
+		finally {
+			delete jpegData;
+		}
 
-		for (int frame = 0; frame < oldPixelData->NumberOfFrames; frame++) {
-			codec->Decode(oldPixelData, newPixelData, jparams, frame);
+		array<FrameWorker^>^ workers = gcnew array<FrameWorker^>(FrameEngine::GetWorkerCount(jparams, oldPixelData->NumberOfFrames));
+		for (int i = 0; i < workers->Length; i++) {
+			workers[i] = gcnew JpegDecodeWorker(GetCodec(precision, jparams), oldPixelData, newPixelData, jparams);
 		}
+
+		FrameEngine::Run(oldPixelData->NumberOfFrames, workers);
+	}
+
+	void DcmJpegCodec::DecodeFrame(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, int frame, DcmCodecParameters^ parameters, FrameBuffer destination)
+	{
+		if (parameters == nullptr || parameters->GetType() != DcmJpegParameters::typeid)
+			parameters = GetDefaultParameters();
+
+		DcmJpegParameters^ jparams = (DcmJpegParameters^)parameters;
+		IJpegCodec^ codec = GetCodec(PrepareDecode(oldPixelData, newPixelData), jparams);
+
+		PinnedFragments^ jpegData = gcnew PinnedFragments(oldPixelData->GetFrameFragments(frame));
+		try {
+			codec->DescribeFrame(jpegData, oldPixelData, newPixelData, jparams);
+			codec->DecodeFrame(jpegData, oldPixelData, jparams, destination, GetCheckpoints(jparams, oldPixelData, frame));
+		}
+		finally {
+			delete jpegData;
+		}
+	}
+
+	array<unsigned char>^ DcmJpegCodec::DecodeRegion(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, int frame, DcmCodecParameters^ parameters,
+		int x, int y, int width, int height)
+	{
+		if (parameters == nullptr || parameters->GetType() != DcmJpegParameters::typeid)
+			parameters = GetDefaultParameters();
+
+		DcmJpegParameters^ jparams = (DcmJpegParameters^)parameters;
+		IJpegCodec^ codec = GetCodec(PrepareDecode(oldPixelData, newPixelData), jparams);
+
+		PinnedFragments^ jpegData = gcnew PinnedFragments(oldPixelData->GetFrameFragments(frame));
+		try {
+			return codec->DecodeRegion(jpegData, oldPixelData, newPixelData, jparams, x, y, width, height, GetCheckpoints(jparams, oldPixelData, frame));
+		}
+		finally {
+			delete jpegData;
+		}
+	}
+
+	JpegProgressiveDecoder^ DcmJpegCodec::CreateProgressiveDecoder(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters, JpegScanHandler^ handler)
+	{
+		// IJG eats the extra padding bits
+		if (newPixelData->BitsAllocated == 16 && newPixelData->BitsStored <= 8)
+			newPixelData->BitsAllocated = 8;
+
+		if (parameters == nullptr || parameters->GetType() != DcmJpegParameters::typeid)
+			parameters = GetDefaultParameters();
+
+		DcmJpegParameters^ jparams = (DcmJpegParameters^)parameters;
+		if (jparams->MemoryStatistics != nullptr)
+			jparams->MemoryStatistics->Reset();
+
+		return GetCodec(oldPixelData->BitsStored, jparams)->CreateProgressiveDecoder(oldPixelData, newPixelData, jparams, handler);
+	}
+
+	void DcmJpegCodec::UseSimd::set(bool value) {
+		Jpeg8Codec::EnableSimd(value);
+		Jpeg12Codec::EnableSimd(value);
+		Jpeg16Codec::EnableSimd(value);
+		_useSimd = value;
 	}
 
 	void DcmJpegCodec::Register() {
 		DicomCodec::RegisterCodec(DicomTransferSyntax::JPEGProcess1, DcmJpegProcess1Codec::typeid);
 		DicomCodec::RegisterCodec(DicomTransferSyntax::JPEGProcess2_4, DcmJpegProcess4Codec::typeid);
+		DicomCodec::RegisterCodec(DicomTransferSyntax::JPEGProcess3_5Retired, DcmJpegProcess5Codec::typeid);
 		DicomCodec::RegisterCodec(DicomTransferSyntax::JPEGProcess14, DcmJpegLossless14Codec::typeid);
 		DicomCodec::RegisterCodec(DicomTransferSyntax::JPEGProcess14SV1, DcmJpegLossless14SV1Codec::typeid);
+		DicomCodec::RegisterCodec(DicomTransferSyntax::JPEGProcess15Retired, DcmJpegLossless15Codec::typeid);
 	}
 } // Jpeg
 } // Codec
@@ -37,7 +37,7 @@ namespace Dicom {
 namespace Codec {
 namespace Jpeg {
 
-public ref class DcmJpegCodec abstract : public IDcmCodec {
+public ref class DcmJpegCodec abstract : public IDcmCodec, public IDcmFrameDecoder {
 public:
 	virtual String^ GetName() {
 		return GetTransferSyntax()->UID->Description;
@@ -49,12 +49,48 @@ public:
 		return gcnew DcmJpegParameters();
 	}
 
+	// Whether the process of the transfer syntax is arithmetic coded. DcmJpegParameters::ArithmeticCoding must
+	// match it when encoding.
+	virtual property bool IsArithmetic {
+		bool get() { return false; }
+	}
+
 	virtual void Encode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters);
 	virtual void Decode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters);
 
+	// Decodes a frame into memory of the caller; see IDcmFrameDecoder. The memory statistics of the
+	// parameters are added to, not reset.
+	virtual void DecodeFrame(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, int frame, DcmCodecParameters^ parameters, FrameBuffer destination);
+
+	// Decodes the rectangle of a frame at (x, y) of width by height pixels, in the coordinates of the decoded (and
+	// scaled) frame, into a new packed array. newPixelData is described as after Decode, but with the size of the
+	// rectangle. Blocks left and right of the rectangle are not inverse transformed. Where the frame has restart
+	// markers, decoding starts at the last restart interval above it; otherwise at the last checkpoint above it
+	// that a full decode with the same DcmJpegParameters::Checkpoints has recorded. The memory statistics of the
+	// parameters are added to, not reset.
+	array<unsigned char>^ DecodeRegion(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, int frame, DcmCodecParameters^ parameters,
+		int x, int y, int width, int height);
+
+	// Starts decoding a frame of oldPixelData whose compressed data is still arriving; see JpegProgressiveDecoder.
+	// The codec is chosen by the BitsStored of oldPixelData, as the frame header is not there yet.
+	JpegProgressiveDecoder^ CreateProgressiveDecoder(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters, JpegScanHandler^ handler);
+
 	virtual IJpegCodec^ GetCodec(int bits, DcmJpegParameters^ jparams) = 0;
 
 	static void Register();
+
+	// Use the SSE2/AVX2 code paths of the IJG libraries where the CPU supports them (default).
+	// They produce the same output as the portable code; this switch exists for testing.
+	static property bool UseSimd {
+		bool get() { return _useSimd; }
+		void set(bool value);
+	}
+
+private:
+	// Fixes up the sample size of newPixelData for decoding, and returns the precision of the frames.
+	int PrepareDecode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData);
+
+	static bool _useSimd = true;
 };
 
 
@@ -88,6 +124,33 @@ public:
 	}
 };
 
+[DicomCodec]
+public ref class DcmJpegProcess5Codec : public DcmJpegCodec {
+public:
+	virtual DicomTransferSyntax^ GetTransferSyntax() override {
+		return DicomTransferSyntax::JPEGProcess3_5Retired;
+	}
+
+	virtual DcmCodecParameters^ GetDefaultParameters() override {
+		DcmJpegParameters^ jparams = gcnew DcmJpegParameters();
+		jparams->ArithmeticCoding = true;
+		return jparams;
+	}
+
+	virtual property bool IsArithmetic {
+		bool get() override { return true; }
+	}
+
+	virtual IJpegCodec^ GetCodec(int bits, DcmJpegParameters^ jparams) override {
+		if (bits == 8)
+			return gcnew Jpeg8Codec(JpegMode::Sequential, 0, 0);
+		else if (bits == 12)
+			return gcnew Jpeg12Codec(JpegMode::Sequential, 0, 0);
+		else
+			throw gcnew DicomCodecException(String::Format("Unable to create JPEG Process 5 codec for bits stored == {0}", bits));
+	}
+};
+
 [DicomCodec]
 public ref class DcmJpegLossless14Codec : public DcmJpegCodec {
 public:
@@ -126,6 +189,35 @@ public:
 	}
 };
 
+[DicomCodec]
+public ref class DcmJpegLossless15Codec : public DcmJpegCodec {
+public:
+	virtual DicomTransferSyntax^ GetTransferSyntax() override {
+		return DicomTransferSyntax::JPEGProcess15Retired;
+	}
+
+	virtual DcmCodecParameters^ GetDefaultParameters() override {
+		DcmJpegParameters^ jparams = gcnew DcmJpegParameters();
+		jparams->ArithmeticCoding = true;
+		return jparams;
+	}
+
+	virtual property bool IsArithmetic {
+		bool get() override { return true; }
+	}
+
+	virtual IJpegCodec^ GetCodec(int bits, DcmJpegParameters^ jparams) override {
+		if (bits <= 8)
+			return gcnew Jpeg8Codec(JpegMode::Lossless, jparams->Predictor, jparams->PointTransform);
+		else if (bits <= 12)
+			return gcnew Jpeg12Codec(JpegMode::Lossless, jparams->Predictor, jparams->PointTransform);
+		else if (bits <= 16)
+			return gcnew Jpeg16Codec(JpegMode::Lossless, jparams->Predictor, jparams->PointTransform);
+		else
+			throw gcnew DicomCodecException(String::Format("Unable to create JPEG Process 15 codec for bits stored == {0}", bits));
+	}
+};
+
 } // Jpeg
 } // Codec
 } // Dicom
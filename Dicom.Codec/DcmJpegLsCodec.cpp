@@ -20,15 +20,22 @@
 //    Colby Dillion (colby.dillion@gmail.com)
 
 #include "DcmJpegLsCodec.h"
+#include "FrameEngine.h"
+
+#include <vector>
 
 #include "CharLS/interface.h"
 
 using namespace System;
+using namespace System::Collections::Generic;
 using namespace System::IO;
 using namespace System::Runtime::InteropServices;
+using namespace System::Threading;
+using namespace System::Threading::Tasks;
 
 using namespace Dicom::Data;
 using namespace Dicom::Codec;
+using namespace Dicom::IO;
 
 namespace Dicom {
 namespace Codec {
@@ -66,6 +73,266 @@ private:
 	}
 };
 
+// Native output buffer of the JPEG-LS encoder. A buffer is taken for the encode of a frame and returned to a
+// pool shared by all threads, so that buffers are reused between frames and encodes; it grows when a frame does
+// not fit. The native memory is reported to the GC, and buffers grown beyond MaxPooledSize by a large frame are
+// freed instead of pooled.
+ref class JpegLsOutputBuffer {
+public:
+	~JpegLsOutputBuffer() {
+		this->!JpegLsOutputBuffer();
+	}
+
+	!JpegLsOutputBuffer() {
+		if (Size > 0)
+			GC::RemoveMemoryPressure((__int64)Size);
+		delete[] Data;
+		Data = NULL;
+		Size = 0;
+	}
+
+	// Grows the buffer to at least size bytes; its contents are not kept.
+	void Reserve(size_t size) {
+		if (size <= Size)
+			return;
+		this->!JpegLsOutputBuffer();
+		Data = new unsigned char[size];
+		Size = size;
+		GC::AddMemoryPressure((__int64)size);
+	}
+
+	static JpegLsOutputBuffer^ Take() {
+		Monitor::Enter(_pool);
+		try {
+			if (_pool->Count > 0)
+				return _pool->Pop();
+		}
+		finally {
+			Monitor::Exit(_pool);
+		}
+		return gcnew JpegLsOutputBuffer();
+	}
+
+	// Returns a buffer to the pool, which keeps one buffer of at most MaxPooledSize bytes per processor.
+	static void Return(JpegLsOutputBuffer^ buffer) {
+		Monitor::Enter(_pool);
+		try {
+			if (buffer->Size <= (size_t)MaxPooledSize && _pool->Count < Environment::ProcessorCount) {
+				_pool->Push(buffer);
+				return;
+			}
+		}
+		finally {
+			Monitor::Exit(_pool);
+		}
+		delete buffer;
+	}
+
+	unsigned char* Data;
+	size_t Size;
+
+private:
+	literal int MaxPooledSize = 32 * 1024 * 1024;
+
+	JpegLsOutputBuffer() {
+		Data = NULL;
+		Size = 0;
+	}
+
+	static JpegLsOutputBuffer() {
+		_pool = gcnew Stack<JpegLsOutputBuffer^>();
+	}
+
+	static Stack<JpegLsOutputBuffer^>^ _pool;
+};
+
+ref class JpegLsEncodeWorker : public FrameWorker {
+public:
+	JpegLsEncodeWorker(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, JlsParameters* params) {
+		_oldPixelData = oldPixelData;
+		_newPixelData = newPixelData;
+		_params = params;
+		_fragmentSize = Math::Max(2, (int)Math::Min(newPixelData->FragmentSize, (unsigned int)Int32::MaxValue) & ~1);
+	}
+
+	virtual Object^ Fetch(int frame) override {
+		return _oldPixelData->GetFrameDataU8(frame);
+	}
+
+	virtual Object^ Process(int frame, Object^ input) override {
+		array<unsigned char>^ frameArray = (array<unsigned char>^)input;
+		pin_ptr<unsigned char> framePin = &frameArray[0];
+		void* frameData = framePin;
+		size_t frameDataSize = frameArray->Length;
+
+		// most frames compress to less than their size; frames of noise can expand, up to four times for
+		// samples coded with the longest Golomb codes, and are encoded again into a buffer twice as large
+		const size_t headerSize = 1024;
+		const size_t maxSize = frameDataSize * 4 + headerSize;
+		JpegLsOutputBuffer^ output = JpegLsOutputBuffer::Take();
+		try {
+			output->Reserve(frameDataSize + headerSize);
+
+			size_t jpegDataSize = 0;
+			JLS_ERROR err;
+			for (;;) {
+				JlsParameters params = *_params;
+				err = JpegLsEncode(output->Data, output->Size, &jpegDataSize, frameData, frameDataSize, &params);
+				if (err != CompressedBufferTooSmall || output->Size >= maxSize)
+					break;
+				output->Reserve(Math::Min(output->Size * 2, maxSize));
+			}
+			if (err != OK) throw gcnew DicomJpegLsCodecException(err);
+
+			// split the frame into fragments; fragments must have an even length, the last one is padded with a zero byte
+			List<ByteBuffer^>^ fragments = gcnew List<ByteBuffer^>();
+			for (size_t offset = 0; offset < jpegDataSize; offset += _fragmentSize) {
+				int size = (int)Math::Min((size_t)_fragmentSize, jpegDataSize - offset);
+				array<unsigned char>^ fragment = gcnew array<unsigned char>(size + (size % 2));
+				Marshal::Copy(IntPtr(output->Data + offset), fragment, 0, size);
+				fragments->Add(gcnew ByteBuffer(fragment));
+			}
+			return fragments;
+		}
+		finally {
+			JpegLsOutputBuffer::Return(output);
+		}
+	}
+
+	virtual void Commit(int frame, Object^ output) override {
+		_oldPixelData->Unload();
+		_newPixelData->AddFrame((List<ByteBuffer^>^)output);
+	}
+
+private:
+	DcmPixelData^ _oldPixelData;
+	DcmPixelData^ _newPixelData;
+	JlsParameters* _params;
+	int _fragmentSize;
+};
+
+// Decodes the component scans of a non-interleaved frame into consecutive planes on the thread pool, each from
+// the position of its scan in the frame.
+ref class ComponentScanDecoder {
+public:
+	ComponentScanDecoder(void* jpegData, size_t jpegDataSize, const JlsParameters* params, const JlsRect* rect,
+		unsigned char* destData, size_t planeSize, const size_t* scanOffsets) {
+		_jpegData = jpegData;
+		_jpegDataSize = jpegDataSize;
+		_params = params;
+		_rect = rect;
+		_destData = destData;
+		_planeSize = planeSize;
+		_scanOffsets = scanOffsets;
+	}
+
+	void Decode(int component) {
+		JlsParameters params = *_params;
+		JLS_ERROR err = JpegLsDecodeScan(_destData + component * _planeSize, _planeSize, _jpegData, _jpegDataSize,
+			_scanOffsets[component], *_rect, &params);
+		if (err != OK) throw gcnew DicomJpegLsCodecException(err);
+	}
+
+	// Decodes the rectangle of a frame on up to maxParallelism threads, as for MaxComponentParallelism. Returns
+	// false without decoding if the frame is not decoded concurrently, and is to be decoded serially instead.
+	static bool Run(void* jpegData, size_t jpegDataSize, const JlsParameters& params, const JlsRect& rect,
+		unsigned char* destData, size_t destDataSize, int maxParallelism) {
+		if (maxParallelism < 1)
+			maxParallelism = Environment::ProcessorCount;
+		if (maxParallelism == 1 || params.ilv != ILV_NONE || params.components < 2)
+			return false;
+
+		const size_t planeSize = (size_t)rect.Width * rect.Height * ((params.bitspersample + 7) / 8);
+		if (destDataSize < planeSize * params.components)
+			return false;
+
+		// frames with other segments between the scans, or damaged ones, are left to the serial decoder
+		std::vector<size_t> scanOffsets(params.components);
+		if (JpegLsFindScans(jpegData, jpegDataSize, &scanOffsets[0], params.components) != OK)
+			return false;
+
+		ComponentScanDecoder^ decoder = gcnew ComponentScanDecoder(jpegData, jpegDataSize, &params, &rect,
+			destData, planeSize, &scanOffsets[0]);
+
+		ParallelOptions^ options = gcnew ParallelOptions();
+		options->MaxDegreeOfParallelism = maxParallelism;
+
+		try {
+			Parallel::For(0, params.components, options, gcnew Action<int>(decoder, &ComponentScanDecoder::Decode));
+		}
+		catch (AggregateException^ e) {
+			ExceptionDispatchInfo::Capture(e->InnerExceptions[0])->Throw();
+			throw;
+		}
+		return true;
+	}
+
+private:
+	void* _jpegData;
+	size_t _jpegDataSize;
+	const JlsParameters* _params;
+	const JlsRect* _rect;
+	unsigned char* _destData;
+	size_t _planeSize;
+	const size_t* _scanOffsets;
+};
+
+ref class JpegLsDecodeWorker : public FrameWorker {
+public:
+	JpegLsDecodeWorker(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, int maxParallelism) {
+		_oldPixelData = oldPixelData;
+		_newPixelData = newPixelData;
+		_maxParallelism = maxParallelism;
+
+		// each worker owns its destination buffer; AddFrame copies it into the new pixel data
+		_destArray = gcnew array<unsigned char>(oldPixelData->UncompressedFrameSize);
+	}
+
+	virtual Object^ Fetch(int frame) override {
+		return _oldPixelData->GetFrameDataU8(frame);
+	}
+
+	virtual Object^ Process(int frame, Object^ input) override {
+		pin_ptr<unsigned char> destPin = &_destArray[0];
+		void* destData = destPin;
+		size_t destDataSize = _destArray->Length;
+
+		array<unsigned char>^ jpegArray = (array<unsigned char>^)input;
+		pin_ptr<unsigned char> jpegPin = &jpegArray[0];
+		void* jpegData = jpegPin;
+		size_t jpegDataSize = jpegArray->Length;
+
+		JlsParameters params = {0};
+		JLS_ERROR err;
+
+		if (_maxParallelism != 1) {
+			JlsParameters header = {0};
+			err = JpegLsReadHeader(jpegData, jpegDataSize, &header);
+			if (err != OK) throw gcnew DicomJpegLsCodecException(err);
+
+			JlsRect rect = { 0, 0, header.width, header.height };
+			if (ComponentScanDecoder::Run(jpegData, jpegDataSize, header, rect, (unsigned char*)destData, destDataSize, _maxParallelism))
+				return _destArray;
+		}
+
+		err = JpegLsDecode(destData, destDataSize, jpegData, jpegDataSize, &params);
+		if (err != OK) throw gcnew DicomJpegLsCodecException(err);
+
+		return _destArray;
+	}
+
+	virtual void Commit(int frame, Object^ output) override {
+		_oldPixelData->Unload();
+		_newPixelData->AddFrame((array<unsigned char>^)output);
+	}
+
+private:
+	DcmPixelData^ _oldPixelData;
+	DcmPixelData^ _newPixelData;
+	array<unsigned char>^ _destArray;
+	int _maxParallelism;
+};
+
 void DcmJpegLsCodec::Encode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters) {
 	if ((oldPixelData->PhotometricInterpretation == "YBR_FULL_422")    ||
 		(oldPixelData->PhotometricInterpretation == "YBR_PARTIAL_422") ||
@@ -73,9 +340,10 @@ void DcmJpegLsCodec::Encode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, Dcm
 		throw gcnew DicomCodecException(String::Format("Photometric Interpretation '{0}' not supported by JPEG-LS encoder",
 														oldPixelData->PhotometricInterpretation));
 
+	if (parameters == nullptr || parameters->GetType() != DcmJpegLsParameters::typeid)
+		parameters = GetDefaultParameters();
+
 	DcmJpegLsParameters^ jparams = (DcmJpegLsParameters^)parameters;
-	if (jparams == nullptr)
-		jparams = (DcmJpegLsParameters^)GetDefaultParameters();
 
 	JlsParameters params = {0};
 	params.width = oldPixelData->ImageWidth;
@@ -99,29 +367,13 @@ void DcmJpegLsCodec::Encode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, Dcm
 		newPixelData->IsLossy = true;
 	}
 
-	for (int frame = 0; frame < oldPixelData->NumberOfFrames; frame++) {
-		array<unsigned char>^ frameArray = oldPixelData->GetFrameDataU8(frame);
-		pin_ptr<unsigned char> framePin = &frameArray[0];
-		void* frameData = framePin;
-		size_t frameDataSize = frameArray->Length;
-
-		// assume compressed frame will be smaller than original
-		void* jpegData = new unsigned char[frameDataSize];
-		size_t jpegDataSize = 0;
-
-		JLS_ERROR err = JpegLsEncode(jpegData, frameDataSize, &jpegDataSize, frameData, frameDataSize, &params);
-		if (err != OK) throw gcnew DicomJpegLsCodecException(err);
-
-		oldPixelData->Unload();
-
-		array<unsigned char>^ compData = gcnew array<unsigned char>(jpegDataSize);
-		Marshal::Copy((IntPtr)jpegData, compData, 0, jpegDataSize);
-
-		delete[] jpegData;
-
-		newPixelData->AddFrame(compData);
+	array<FrameWorker^>^ workers = gcnew array<FrameWorker^>(FrameEngine::GetWorkerCount(jparams, oldPixelData->NumberOfFrames));
+	for (int i = 0; i < workers->Length; i++) {
+		workers[i] = gcnew JpegLsEncodeWorker(oldPixelData, newPixelData, &params);
 	}
 
+	FrameEngine::Run(oldPixelData->NumberOfFrames, workers);
+
 	if (newPixelData->TransferSyntax == DicomTransferSyntax::JPEGLSNearLossless && newPixelData->NumberOfFrames > 0) {
 		newPixelData->IsLossy = true;
 		newPixelData->LossyCompressionMethod = "ISO_14495_1";
@@ -134,28 +386,122 @@ void DcmJpegLsCodec::Encode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, Dcm
 }
 
 void DcmJpegLsCodec::Decode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters) {
-	array<unsigned char>^ destArray = gcnew array<unsigned char>(oldPixelData->UncompressedFrameSize);
-	pin_ptr<unsigned char> destPin = &destArray[0];
-	void* destData = destPin;
-	size_t destDataSize = destArray->Length;
+	if (parameters == nullptr || parameters->GetType() != DcmJpegLsParameters::typeid)
+		parameters = GetDefaultParameters();
 
-	for (int frame = 0; frame < oldPixelData->NumberOfFrames; frame++) {
-		array<unsigned char>^ jpegArray = oldPixelData->GetFrameDataU8(frame);
-		pin_ptr<unsigned char> jpegPin = &jpegArray[0];
-		void* jpegData = jpegPin;
-		size_t jpegDataSize = jpegArray->Length;
+	DcmJpegLsParameters^ jparams = (DcmJpegLsParameters^)parameters;
 
-		JlsParameters params = {0};
+	array<FrameWorker^>^ workers = gcnew array<FrameWorker^>(FrameEngine::GetWorkerCount(parameters, oldPixelData->NumberOfFrames));
+	for (int i = 0; i < workers->Length; i++) {
+		workers[i] = gcnew JpegLsDecodeWorker(oldPixelData, newPixelData, jparams->MaxComponentParallelism);
+	}
 
-		JLS_ERROR err = JpegLsDecode(destData, destDataSize, jpegData, jpegDataSize, &params);
+	FrameEngine::Run(oldPixelData->NumberOfFrames, workers);
+}
+
+// Decodes the rectangle of a frame into the layout, which is the size of the rectangle, with the component scans
+// of non-interleaved frames decoded on up to maxParallelism threads.
+static void decodeRect(void* jpegData, size_t jpegDataSize, JlsParameters& params, const JlsRect& rect, const FrameLayout& layout, size_t length,
+	int maxParallelism) {
+	const int sampleSize = (params.bitspersample + 7) / 8;
+
+	// CharLS writes rows at any stride, and ILV_NONE frames as packed planes; other layouts are decoded
+	// packed and copied into place
+	const size_t rowSize = (size_t)rect.Width * sampleSize;
+	const size_t planeSize = rowSize * rect.Height;
+	if (params.components == 1 || (params.ilv != ILV_NONE && !layout.planar)) {
+		params.bytesperline = (int)layout.row_stride;
+		JLS_ERROR err = JpegLsDecodeRect(layout.data, length, jpegData, jpegDataSize, rect, &params);
+		if (err != OK) throw gcnew DicomJpegLsCodecException(err);
+		return;
+	}
+	if (params.ilv == ILV_NONE && layout.planar && layout.row_stride == rowSize && layout.plane_stride == planeSize) {
+		params.bytesperline = (int)rowSize;
+		if (ComponentScanDecoder::Run(jpegData, jpegDataSize, params, rect, (unsigned char*)layout.data, length, maxParallelism))
+			return;
+		JLS_ERROR err = JpegLsDecodeRect(layout.data, length, jpegData, jpegDataSize, rect, &params);
 		if (err != OK) throw gcnew DicomJpegLsCodecException(err);
+		return;
+	}
 
-		oldPixelData->Unload();
+	std::vector<unsigned char> packed(planeSize * params.components);
+	params.bytesperline = 0;
+	if (!ComponentScanDecoder::Run(jpegData, jpegDataSize, params, rect, &packed[0], packed.size(), maxParallelism)) {
+		JLS_ERROR err = JpegLsDecodeRect(&packed[0], packed.size(), jpegData, jpegDataSize, rect, &params);
+		if (err != OK) throw gcnew DicomJpegLsCodecException(err);
+	}
 
-		newPixelData->AddFrame(destArray);
+	for (int row = 0; row < rect.Height; row++) {
+		if (params.ilv == ILV_NONE) {
+			for (int c = 0; c < params.components; c++)
+				storePlaneRow(layout, c, row, &packed[c * planeSize + row * rowSize], rect.Width, params.components, sampleSize);
+		}
+		else {
+			storeInterleavedRow(layout, row, &packed[row * rowSize * params.components], rect.Width, params.components, sampleSize);
+		}
 	}
 }
 
+void DcmJpegLsCodec::DecodeFrame(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, int frame, DcmCodecParameters^ parameters, FrameBuffer destination) {
+	if (parameters == nullptr || parameters->GetType() != DcmJpegLsParameters::typeid)
+		parameters = GetDefaultParameters();
+
+	DcmJpegLsParameters^ jparams = (DcmJpegLsParameters^)parameters;
+
+	array<unsigned char>^ jpegArray = oldPixelData->GetFrameDataU8(frame);
+	pin_ptr<unsigned char> jpegPin = &jpegArray[0];
+	void* jpegData = jpegPin;
+	size_t jpegDataSize = jpegArray->Length;
+
+	JlsParameters params = {0};
+	JLS_ERROR err = JpegLsReadHeader(jpegData, jpegDataSize, &params);
+	if (err != OK) throw gcnew DicomJpegLsCodecException(err);
+
+	const int sampleSize = (params.bitspersample + 7) / 8;
+	FrameLayout layout = destination.GetLayout(params.width, params.height, params.components, sampleSize);
+
+	JlsRect rect = { 0, 0, params.width, params.height };
+	decodeRect(jpegData, jpegDataSize, params, rect, layout, (size_t)destination.Length, jparams->MaxComponentParallelism);
+}
+
+array<unsigned char>^ DcmJpegLsCodec::DecodeRegion(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, int frame, DcmCodecParameters^ parameters,
+	int x, int y, int width, int height)
+{
+	if (parameters == nullptr || parameters->GetType() != DcmJpegLsParameters::typeid)
+		parameters = GetDefaultParameters();
+
+	DcmJpegLsParameters^ jparams = (DcmJpegLsParameters^)parameters;
+
+	array<unsigned char>^ jpegArray = oldPixelData->GetFrameDataU8(frame);
+	pin_ptr<unsigned char> jpegPin = &jpegArray[0];
+	void* jpegData = jpegPin;
+	size_t jpegDataSize = jpegArray->Length;
+
+	JlsParameters params = {0};
+	JLS_ERROR err = JpegLsReadHeader(jpegData, jpegDataSize, &params);
+	if (err != OK) throw gcnew DicomJpegLsCodecException(err);
+
+	if (x < 0 || y < 0 || width < 1 || height < 1 ||
+		(__int64)x + width > params.width || (__int64)y + height > params.height)
+		throw gcnew ArgumentOutOfRangeException("region", "Region lies outside of the decoded frame");
+
+	newPixelData->ImageWidth = (unsigned short)width;
+	newPixelData->ImageHeight = (unsigned short)height;
+
+	const int sampleSize = (params.bitspersample + 7) / 8;
+	int frameSize = width * params.components * sampleSize * height;
+	if ((frameSize % 2) != 0)
+		frameSize++;
+	array<unsigned char>^ frameBuffer = gcnew array<unsigned char>(frameSize);
+	pin_ptr<unsigned char> framePin = &frameBuffer[0];
+	FrameLayout layout = FrameBuffer::Packed(IntPtr((unsigned char*)framePin), frameSize, width, height,
+		params.components, sampleSize, newPixelData->IsPlanar).GetLayout(width, height, params.components, sampleSize);
+
+	JlsRect rect = { x, y, width, height };
+	decodeRect(jpegData, jpegDataSize, params, rect, layout, (size_t)frameSize, jparams->MaxComponentParallelism);
+	return frameBuffer;
+}
+
 void DcmJpegLsCodec::Register() {
 	DicomCodec::RegisterCodec(DicomTransferSyntax::JPEGLSNearLossless, DcmJpegLsNearLosslessCodec::typeid);
 	DicomCodec::RegisterCodec(DicomTransferSyntax::JPEGLSLossless, DcmJpegLsLosslessCodec::typeid);
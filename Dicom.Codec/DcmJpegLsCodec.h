@@ -29,6 +29,8 @@ using namespace System;
 using namespace Dicom::Data;
 using namespace Dicom::Codec;
 
+#include "FrameBuffer.h"
+
 namespace Dicom {
 namespace Codec {
 namespace JpegLs {
@@ -50,12 +52,14 @@ namespace JpegLs {
 		int _allowedError;
 		DcmJpegLsInterleaveMode _ilMode;
 		DcmJpegLsColorTransform _colorTransform;
+		int _maxComponentParallelism;
 
 	public:
 		DcmJpegLsParameters() {
 			_allowedError = 3;
 			_ilMode = DcmJpegLsInterleaveMode::Line;
 			_colorTransform = DcmJpegLsColorTransform::HP1;
+			_maxComponentParallelism = 1;
 		}
 
 		property int AllowedError {
@@ -72,10 +76,19 @@ namespace JpegLs {
 			DcmJpegLsColorTransform get() { return _colorTransform; }
 			void set(DcmJpegLsColorTransform value) { _colorTransform = value; }
 		}
+
+		// Maximum number of threads that decode a single frame. Each component of a non-interleaved frame is
+		// coded in a scan of its own; the scans are located up front and decoded concurrently into their planes.
+		// Interleaved and single component frames are decoded serially. The default of 1 always decodes
+		// serially; values less than 1 use one thread per processor.
+		property int MaxComponentParallelism {
+			int get() { return _maxComponentParallelism; }
+			void set(int value) { _maxComponentParallelism = value; }
+		}
 	};
 
 
-	public ref class DcmJpegLsCodec abstract : public IDcmCodec
+	public ref class DcmJpegLsCodec abstract : public IDcmCodec, public IDcmFrameDecoder
 	{
 	public:
 		virtual String^ GetName() {
@@ -91,6 +104,15 @@ namespace JpegLs {
 		virtual void Encode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters);
 		virtual void Decode(DcmDataset^ dataset, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmCodecParameters^ parameters);
 
+		// Decodes a frame into memory of the caller; see IDcmFrameDecoder.
+		virtual void DecodeFrame(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, int frame, DcmCodecParameters^ parameters, FrameBuffer destination);
+
+		// Decodes the rectangle of a frame at (x, y) of width by height pixels into a new packed array. newPixelData is
+		// described as after Decode, but with the size of the rectangle. Decoding stops after the last line of the
+		// rectangle, and only the columns of the rectangle are written.
+		array<unsigned char>^ DecodeRegion(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, int frame, DcmCodecParameters^ parameters,
+			int x, int y, int width, int height);
+
 		static void Register();
 	};
 
@@ -25,7 +25,10 @@
 #pragma once
 
 using namespace System;
+using namespace System::Collections::Generic;
 using namespace System::IO;
+using namespace System::Runtime::CompilerServices;
+using namespace System::Threading;
 
 using namespace Dicom::Codec;
 using namespace Dicom::Data;
@@ -42,6 +45,349 @@ public enum class JpegSampleFactor {
 	Unknown
 };
 
+public enum class JpegScale {
+	Full = 1,
+	Half = 2,
+	Quarter = 4,
+	Eighth = 8
+};
+
+public enum class JpegDctMethod {
+	Integer,
+	FastInteger,
+	Float
+};
+
+// Huffman tables shared by the frames of a series or of a modality profile. When the same cache is given to
+// related encodes, the first baseline, sequential or lossless frame of each kind (bits stored, process,
+// predictor and samples per pixel) is compressed with optimized tables, which are kept here; later frames of
+// that kind are compressed in a single pass with the kept tables. The tables are dropped, and rebuilt from the
+// next frame, when a frame compresses to more than (1 + DriftTolerance) times the size expected from the
+// compression ratio of the frame they were built from.
+public ref class JpegHuffmanTableCache {
+public:
+	JpegHuffmanTableCache() {
+		_entries = gcnew Dictionary<String^, Entry^>();
+		_driftTolerance = 0.1;
+	}
+
+	property double DriftTolerance {
+		double get() { return _driftTolerance; }
+		void set(double value) { _driftTolerance = value; }
+	}
+
+	void Clear() {
+		Monitor::Enter(_entries);
+		try {
+			_entries->Clear();
+		}
+		finally {
+			Monitor::Exit(_entries);
+		}
+	}
+
+internal:
+	// Tables of one kind of frame, in the layout of the codec that built them.
+	ref class Entry {
+	public:
+		Entry(array<unsigned char>^ tables, double ratio) {
+			Tables = tables;
+			Ratio = ratio;
+		}
+
+		array<unsigned char>^ Tables;
+
+		// compressed size / uncompressed size of the frame the tables were built from
+		double Ratio;
+	};
+
+	Entry^ Find(String^ key) {
+		Monitor::Enter(_entries);
+		try {
+			Entry^ entry;
+			return _entries->TryGetValue(key, entry) ? entry : nullptr;
+		}
+		finally {
+			Monitor::Exit(_entries);
+		}
+	}
+
+	void Store(String^ key, Entry^ entry) {
+		Monitor::Enter(_entries);
+		try {
+			_entries[key] = entry;
+		}
+		finally {
+			Monitor::Exit(_entries);
+		}
+	}
+
+	// Drops the tables of a kind of frame, unless another encoder has replaced them already.
+	void Remove(String^ key, Entry^ entry) {
+		Monitor::Enter(_entries);
+		try {
+			Entry^ current;
+			if (_entries->TryGetValue(key, current) && current == entry)
+				_entries->Remove(key);
+		}
+		finally {
+			Monitor::Exit(_entries);
+		}
+	}
+
+private:
+	Dictionary<String^, Entry^>^ _entries;
+	double _driftTolerance;
+};
+
+// Entropy decoder checkpoints of one frame, recorded while the frame is decoded in full. A region decode of the
+// frame starts at the nearest checkpoint above the region instead of at the top of the frame. Only frames coded
+// in a single sequential or lossless Huffman scan without restart markers get checkpoints; frames with restart
+// markers are entered at their markers instead. A lossless checkpoint also holds the row of samples that the
+// rows after it are predicted from.
+public ref class JpegCheckpointIndex {
+public:
+	// Number of checkpoints recorded.
+	property int Count {
+		int get() {
+			Monitor::Enter(this);
+			try {
+				return (_checkpoints == nullptr) ? 0 : _checkpoints->Count;
+			}
+			finally {
+				Monitor::Exit(this);
+			}
+		}
+	}
+
+	// Whether a full decode of the frame has recorded its checkpoints, if it can have any.
+	property bool IsRecorded {
+		bool get() {
+			Monitor::Enter(this);
+			try {
+				return _checkpoints != nullptr;
+			}
+			finally {
+				Monitor::Exit(this);
+			}
+		}
+	}
+
+	// MCU rows between checkpoints.
+	property int Interval {
+		int get() { return _interval; }
+	}
+
+internal:
+	JpegCheckpointIndex(int interval) {
+		_interval = interval;
+		_checkpoints = nullptr;
+	}
+
+	// Decoder state at the start of an MCU row, in the layout of the codec that recorded it, and the position of
+	// the entropy-coded data of the row in the fragments of the frame.
+	ref class Checkpoint {
+	public:
+		Checkpoint(int row, int fragment, int offset, array<unsigned char>^ state) {
+			Row = row;
+			Fragment = fragment;
+			Offset = offset;
+			State = state;
+		}
+
+		int Row;
+		int Fragment;
+		int Offset;
+		array<unsigned char>^ State;
+	};
+
+	// Keeps the checkpoints of a full decode, ordered by row, unless another decode has kept its own already.
+	void Record(List<Checkpoint^>^ checkpoints) {
+		Monitor::Enter(this);
+		try {
+			if (_checkpoints == nullptr)
+				_checkpoints = checkpoints;
+		}
+		finally {
+			Monitor::Exit(this);
+		}
+	}
+
+	// MCU rows of the checkpoints, in order.
+	array<int>^ GetRows() {
+		Monitor::Enter(this);
+		try {
+			if (_checkpoints == nullptr)
+				return gcnew array<int>(0);
+			array<int>^ rows = gcnew array<int>(_checkpoints->Count);
+			for (int i = 0; i < rows->Length; i++)
+				rows[i] = _checkpoints[i]->Row;
+			return rows;
+		}
+		finally {
+			Monitor::Exit(this);
+		}
+	}
+
+	// Last checkpoint at or above the given MCU row, or null if there is none.
+	Checkpoint^ Find(int row) {
+		Monitor::Enter(this);
+		try {
+			if (_checkpoints == nullptr)
+				return nullptr;
+			Checkpoint^ found = nullptr;
+			for each (Checkpoint^ checkpoint in _checkpoints) {
+				if (checkpoint->Row > row)
+					break;
+				found = checkpoint;
+			}
+			return found;
+		}
+		finally {
+			Monitor::Exit(this);
+		}
+	}
+
+private:
+	int _interval;
+	List<Checkpoint^>^ _checkpoints;
+};
+
+// Checkpoint indexes of the frames of compressed pixel data, kept for as long as the DcmPixelData they belong
+// to. When the same cache is given to a Decode or DecodeFrame of a frame and later to DecodeRegion calls, the
+// full decode records a checkpoint every Interval MCU rows, and the region decodes resume from them; see
+// JpegCheckpointIndex.
+public ref class JpegCheckpointCache {
+public:
+	JpegCheckpointCache() {
+		_entries = gcnew ConditionalWeakTable<DcmPixelData^, Dictionary<int, JpegCheckpointIndex^>^>();
+		_interval = 8;
+	}
+
+	// MCU rows between checkpoints of the frames decoded from now on. Each checkpoint takes about a hundred bytes,
+	// plus a row of samples per component, at four bytes a sample, in lossless frames.
+	property int Interval {
+		int get() { return _interval; }
+		void set(int value) {
+			if (value < 1)
+				throw gcnew ArgumentOutOfRangeException("value", "Checkpoint interval must be at least one MCU row");
+			_interval = value;
+		}
+	}
+
+	void Clear() {
+		Monitor::Enter(this);
+		try {
+			_entries = gcnew ConditionalWeakTable<DcmPixelData^, Dictionary<int, JpegCheckpointIndex^>^>();
+		}
+		finally {
+			Monitor::Exit(this);
+		}
+	}
+
+	// Checkpoints of a frame, which the next full decode records if it has not been recorded yet.
+	JpegCheckpointIndex^ GetIndex(DcmPixelData^ pixelData, int frame) {
+		Monitor::Enter(this);
+		try {
+			Dictionary<int, JpegCheckpointIndex^>^ frames = _entries->GetOrCreateValue(pixelData);
+			JpegCheckpointIndex^ index;
+			if (!frames->TryGetValue(frame, index)) {
+				index = gcnew JpegCheckpointIndex(_interval);
+				frames[frame] = index;
+			}
+			return index;
+		}
+		finally {
+			Monitor::Exit(this);
+		}
+	}
+
+private:
+	ConditionalWeakTable<DcmPixelData^, Dictionary<int, JpegCheckpointIndex^>^>^ _entries;
+	int _interval;
+};
+
+// Memory obtained by the IJG compressors and decompressors during Encode or Decode calls that are given this
+// object through DcmJpegParameters::MemoryStatistics. The calls reset it when they start, and add the memory of
+// every frame, stripe and restart band as it is done, whichever thread coded it.
+public ref class JpegMemoryStatistics {
+public:
+	JpegMemoryStatistics() {
+		_lock = gcnew Object();
+	}
+
+	// Largest amount of memory held at once while coding a single frame, stripe or restart band, in bytes.
+	property __int64 PeakBytes {
+		__int64 get() {
+			Monitor::Enter(_lock);
+			try {
+				return _peakBytes;
+			}
+			finally {
+				Monitor::Exit(_lock);
+			}
+		}
+	}
+
+	// Memory handed out to the IJG memory managers, in bytes, including blocks reused from earlier frames.
+	property __int64 TotalBytes {
+		__int64 get() {
+			Monitor::Enter(_lock);
+			try {
+				return _totalBytes;
+			}
+			finally {
+				Monitor::Exit(_lock);
+			}
+		}
+	}
+
+	// Part of TotalBytes that was newly allocated from the heap, in bytes.
+	property __int64 HeapBytes {
+		__int64 get() {
+			Monitor::Enter(_lock);
+			try {
+				return _heapBytes;
+			}
+			finally {
+				Monitor::Exit(_lock);
+			}
+		}
+	}
+
+	void Reset() {
+		Monitor::Enter(_lock);
+		try {
+			_peakBytes = 0;
+			_totalBytes = 0;
+			_heapBytes = 0;
+		}
+		finally {
+			Monitor::Exit(_lock);
+		}
+	}
+
+internal:
+	void Add(__int64 peakBytes, __int64 totalBytes, __int64 heapBytes) {
+		Monitor::Enter(_lock);
+		try {
+			if (_peakBytes < peakBytes)
+				_peakBytes = peakBytes;
+			_totalBytes += totalBytes;
+			_heapBytes += heapBytes;
+		}
+		finally {
+			Monitor::Exit(_lock);
+		}
+	}
+
+private:
+	Object^ _lock;
+	__int64 _peakBytes;
+	__int64 _totalBytes;
+	__int64 _heapBytes;
+};
+
 public ref class DcmJpegParameters : public DcmCodecParameters {
 private:
 	int _quality;
@@ -50,6 +396,16 @@ private:
 	JpegSampleFactor _sample;
 	int _predictor;
 	int _pointTransform;
+	JpegScale _scale;
+	JpegDctMethod _dctMethod;
+	bool _mergedUpsampling;
+	int _maxRestartParallelism;
+	int _maxStripeParallelism;
+	JpegHuffmanTableCache^ _huffmanTables;
+	bool _arithmeticCoding;
+	int _maxMemoryToUse;
+	JpegMemoryStatistics^ _memoryStatistics;
+	JpegCheckpointCache^ _checkpoints;
 
 public:
 	DcmJpegParameters() {
@@ -59,6 +415,16 @@ public:
 		_sample = JpegSampleFactor::SF444;
 		_predictor = 1;
 		_pointTransform = 0;
+		_scale = JpegScale::Full;
+		_dctMethod = JpegDctMethod::Integer;
+		_mergedUpsampling = false;
+		_maxRestartParallelism = 1;
+		_maxStripeParallelism = 1;
+		_huffmanTables = nullptr;
+		_arithmeticCoding = false;
+		_maxMemoryToUse = 0;
+		_memoryStatistics = nullptr;
+		_checkpoints = nullptr;
 	}
 
 	property int Quality {
@@ -90,6 +456,83 @@ public:
 		int get() { return _pointTransform; }
 		void set(int value) { _pointTransform = value; }
 	}
+
+	// Output size of lossy decompression; the decoded pixel data gets the reduced dimensions.
+	// Lossless images are always decompressed at full size.
+	property JpegScale Scale {
+		JpegScale get() { return _scale; }
+		void set(JpegScale value) { _scale = value; }
+	}
+
+	property JpegDctMethod DctMethod {
+		JpegDctMethod get() { return _dctMethod; }
+		void set(JpegDctMethod value) { _dctMethod = value; }
+	}
+
+	// Replicate subsampled chroma instead of interpolating it. When converting to RGB, 2h1v and 2h2v
+	// images are then upsampled and color converted in a single pass.
+	property bool MergedUpsampling {
+		bool get() { return _mergedUpsampling; }
+		void set(bool value) { _mergedUpsampling = value; }
+	}
+
+	// Maximum number of threads that decode the restart intervals of a single frame. Frames coded in one
+	// sequential scan with restart markers are split at the markers that start an MCU row and the bands are
+	// decoded concurrently. Frames without them whose checkpoints a full decode has recorded (see Checkpoints)
+	// are split at the checkpoints in the same way; other frames are decoded serially. The default of 1 always
+	// decodes serially; values less than 1 use one thread per processor.
+	property int MaxRestartParallelism {
+		int get() { return _maxRestartParallelism; }
+		void set(int value) { _maxRestartParallelism = value; }
+	}
+
+	// Maximum number of threads that compress a single frame. Baseline, sequential and lossless frames are
+	// split into horizontal stripes of MCU rows that are compressed concurrently, with optimal Huffman
+	// tables built from the symbols of all stripes, and joined with a restart marker between stripes.
+	// The default of 1 always compresses serially; values less than 1 use one thread per processor.
+	property int MaxStripeParallelism {
+		int get() { return _maxStripeParallelism; }
+		void set(int value) { _maxStripeParallelism = value; }
+	}
+
+	// Huffman tables to reuse across frames and encodes; see JpegHuffmanTableCache. The default of null
+	// builds optimized tables for every frame in a second pass over its data.
+	property JpegHuffmanTableCache^ HuffmanTables {
+		JpegHuffmanTableCache^ get() { return _huffmanTables; }
+		void set(JpegHuffmanTableCache^ value) { _huffmanTables = value; }
+	}
+
+	// Compress with arithmetic instead of Huffman entropy coding (SOF9 or SOF11), which is usually smaller but
+	// slower and not readable by all decoders. Only the JPEG Extended (Process 3 & 5) and JPEG Lossless
+	// (Process 15) codecs encode arithmetic frames, and they require this setting, which is on in their default
+	// parameters; the other codecs refuse it. Arithmetic coded frames are compressed serially without
+	// HuffmanTables, and are decompressed regardless of this setting.
+	property bool ArithmeticCoding {
+		bool get() { return _arithmeticCoding; }
+		void set(bool value) { _arithmeticCoding = value; }
+	}
+
+	// Memory budget of each compressor and decompressor, in bytes. The whole-image buffers of progressive and
+	// multi-scan frames that do not fit in it are kept in temporary files; other memory is not limited. The
+	// default of 0 keeps everything in memory.
+	property int MaxMemoryToUse {
+		int get() { return _maxMemoryToUse; }
+		void set(int value) { _maxMemoryToUse = value; }
+	}
+
+	// Receives the memory used by Encode and Decode calls with these parameters; see JpegMemoryStatistics.
+	// The default of null keeps no statistics.
+	property JpegMemoryStatistics^ MemoryStatistics {
+		JpegMemoryStatistics^ get() { return _memoryStatistics; }
+		void set(JpegMemoryStatistics^ value) { _memoryStatistics = value; }
+	}
+
+	// Checkpoints that let DcmJpegCodec::DecodeRegion skip the entropy-coded data above a region of frames
+	// that have been decoded in full before; see JpegCheckpointCache. The default of null records none.
+	property JpegCheckpointCache^ Checkpoints {
+		JpegCheckpointCache^ get() { return _checkpoints; }
+		void set(JpegCheckpointCache^ value) { _checkpoints = value; }
+	}
 };
 
 } // Jpeg
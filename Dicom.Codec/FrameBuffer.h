@@ -0,0 +1,137 @@
+// mDCM: A C# DICOM library
+//
+// Copyright (c) 2010  Colby Dillion
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// Author:
+//    Colby Dillion (colby.dillion@gmail.com)
+
+#ifndef __FRAMEBUFFER_H__
+#define __FRAMEBUFFER_H__
+
+#pragma once
+
+#include <string.h>
+
+#include "SampleFormat/sampleformat.h"
+
+using namespace System;
+
+using namespace Dicom::Data;
+
+namespace Dicom {
+namespace Codec {
+
+// Native view of a FrameBuffer, as handed to the decoders.
+struct FrameLayout {
+	unsigned char* data;
+	size_t row_stride;
+	size_t plane_stride;
+	bool planar;
+};
+
+// Stores a row of interleaved samples at the given row of the frame.
+inline void storeInterleavedRow(const FrameLayout& layout, int row, const unsigned char* src, int width, int components, int sampleSize) {
+	unsigned char* dst = layout.data + row * layout.row_stride;
+	if (!layout.planar || components == 1) {
+		memcpy(dst, src, (size_t)width * components * sampleSize);
+		return;
+	}
+
+	sf_deinterleave(dst, (size_t)layout.plane_stride, src, width, components, sampleSize);
+}
+
+// Stores the samples of one component at the given row of the frame.
+inline void storePlaneRow(const FrameLayout& layout, int component, int row, const unsigned char* src, int width, int components, int sampleSize) {
+	if (layout.planar || components == 1) {
+		memcpy(layout.data + component * layout.plane_stride + row * layout.row_stride, src, (size_t)width * sampleSize);
+		return;
+	}
+
+	unsigned char* dst = layout.data + row * layout.row_stride + component * sampleSize;
+	if (sampleSize == 1) {
+		for (int x = 0; x < width; x++, dst += components)
+			*dst = src[x];
+	}
+	else {
+		for (int x = 0; x < width; x++, dst += components * sampleSize)
+			memcpy(dst, src + x * sampleSize, sampleSize);
+	}
+}
+
+// Memory of the caller that a frame is decoded into, instead of a new managed array: native memory, or an
+// array pinned for the duration of the call.
+//
+//   RowStride    bytes from one row of pixels to the next; for planar frames, from one row of a plane to the next
+//   PlaneStride  bytes from one plane to the next; only used for planar frames of more than one sample per pixel
+//
+// Samples take BytesAllocated bytes each, in the byte order of the machine.
+public value struct FrameBuffer {
+	FrameBuffer(IntPtr data, __int64 length, int rowStride, __int64 planeStride, bool planar) {
+		Data = data;
+		Length = length;
+		RowStride = rowStride;
+		PlaneStride = planeStride;
+		Planar = planar;
+	}
+
+	// Packed frame of the given geometry, as DcmPixelData stores frames.
+	static FrameBuffer Packed(IntPtr data, __int64 length, int width, int height, int samplesPerPixel, int bytesAllocated, bool planar) {
+		if (planar)
+			return FrameBuffer(data, length, width * bytesAllocated, (__int64)width * height * bytesAllocated, true);
+		return FrameBuffer(data, length, width * samplesPerPixel * bytesAllocated, 0, false);
+	}
+
+	IntPtr Data;
+	__int64 Length;
+	int RowStride;
+	__int64 PlaneStride;
+	bool Planar;
+
+internal:
+	// Checks that a frame of the given geometry fits, and returns the view the decoders write through.
+	FrameLayout GetLayout(int width, int height, int samplesPerPixel, int sampleSize) {
+		bool planar = Planar && samplesPerPixel > 1;
+		__int64 rowSize = (__int64)width * sampleSize * (planar ? 1 : samplesPerPixel);
+		__int64 planeSize = (height - 1) * (__int64)RowStride + rowSize;
+
+		if (Data == IntPtr::Zero)
+			throw gcnew ArgumentException("Frame buffer has no memory");
+		if (RowStride < rowSize || (planar && PlaneStride < planeSize))
+			throw gcnew ArgumentException("Frame buffer strides are too small for the frame");
+		if (Length < (planar ? (samplesPerPixel - 1) * PlaneStride + planeSize : planeSize))
+			throw gcnew ArgumentException("Frame buffer is too small for the frame");
+
+		FrameLayout layout;
+		layout.data = (unsigned char*)Data.ToPointer();
+		layout.row_stride = (size_t)RowStride;
+		layout.plane_stride = planar ? (size_t)PlaneStride : 0;
+		layout.planar = planar;
+		return layout;
+	}
+};
+
+// Decodes single frames straight into memory of the caller, so that frame buffers can be pooled.
+public interface class IDcmFrameDecoder {
+	// Decodes frame of oldPixelData into destination. newPixelData receives the attributes Decode would give it,
+	// but no frame. Different frames may be decoded concurrently.
+	void DecodeFrame(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, int frame, DcmCodecParameters^ parameters, FrameBuffer destination);
+};
+
+} // Codec
+} // Dicom
+
+#endif
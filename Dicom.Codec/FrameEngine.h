@@ -0,0 +1,153 @@
+// mDCM: A C# DICOM library
+//
+// Copyright (c) 2010  Colby Dillion
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// Author:
+//    Colby Dillion (colby.dillion@gmail.com)
+
+#ifndef __FRAMEENGINE_H__
+#define __FRAMEENGINE_H__
+
+#pragma once
+
+using namespace System;
+using namespace System::Runtime::ExceptionServices;
+using namespace System::Threading;
+using namespace System::Threading::Tasks;
+
+using namespace Dicom::Codec;
+
+namespace Dicom {
+namespace Codec {
+
+// Per-thread state of a frame encoder or decoder.
+//
+// Fetch and Commit are called one at a time, in frame order, and are the only calls that may touch the
+// pixel data buffers (reading, unloading or adding frames). Process may run concurrently with the Process
+// calls of other workers; it may only set pixel data attributes to values that do not depend on the frame.
+ref class FrameWorker abstract {
+public:
+	virtual Object^ Fetch(int frame) abstract;
+	virtual Object^ Process(int frame, Object^ input) abstract;
+	virtual void Commit(int frame, Object^ output) abstract;
+};
+
+// Runs frame workers over all frames of a pixel data object.
+//
+// With a single worker the frames are processed serially on the calling thread. Otherwise the workers run on
+// the thread pool, so that the per-thread codec contexts of its threads are reused across calls; each worker
+// takes the next frame as soon as it has committed its previous one, so at most one input and one output per
+// worker are alive at any time. A worker only waits for frames taken by workers that are already running, so
+// the workers finish even when the pool runs fewer of them at once.
+ref class FrameEngine {
+public:
+	static int GetWorkerCount(DcmCodecParameters^ parameters, int frames) {
+		int workers = (parameters != nullptr) ? parameters->MaxDegreeOfParallelism : 1;
+		if (workers < 1)
+			workers = Environment::ProcessorCount;
+		return Math::Max(1, Math::Min(workers, frames));
+	}
+
+	static void Run(int frames, array<FrameWorker^>^ workers) {
+		if (workers->Length == 1) {
+			FrameWorker^ worker = workers[0];
+			for (int frame = 0; frame < frames; frame++) {
+				worker->Commit(frame, worker->Process(frame, worker->Fetch(frame)));
+			}
+			return;
+		}
+
+		FrameEngine^ engine = gcnew FrameEngine(frames, workers);
+
+		ParallelOptions^ options = gcnew ParallelOptions();
+		options->MaxDegreeOfParallelism = workers->Length;
+		Parallel::For(0, workers->Length, options, gcnew Action<int>(engine, &FrameEngine::Work));
+
+		if (engine->_error != nullptr)
+			ExceptionDispatchInfo::Capture(engine->_error)->Throw();
+	}
+
+private:
+	FrameEngine(int frames, array<FrameWorker^>^ workers) {
+		_lock = gcnew Object();
+		_workers = workers;
+		_frames = frames;
+		_next = 0;
+		_committed = 0;
+		_error = nullptr;
+	}
+
+	void Work(int index) {
+		FrameWorker^ worker = _workers[index];
+		try {
+			for (;;) {
+				int frame = 0;
+				Object^ input = nullptr;
+
+				Monitor::Enter(_lock);
+				try {
+					if (_error != nullptr || _next >= _frames)
+						return;
+					frame = _next++;
+					input = worker->Fetch(frame);
+				}
+				finally {
+					Monitor::Exit(_lock);
+				}
+
+				Object^ output = worker->Process(frame, input);
+
+				Monitor::Enter(_lock);
+				try {
+					while (_committed != frame && _error == nullptr)
+						Monitor::Wait(_lock);
+					if (_error != nullptr)
+						return;
+					worker->Commit(frame, output);
+					_committed++;
+					Monitor::PulseAll(_lock);
+				}
+				finally {
+					Monitor::Exit(_lock);
+				}
+			}
+		}
+		catch (Exception^ e) {
+			Monitor::Enter(_lock);
+			try {
+				if (_error == nullptr)
+					_error = e;
+				Monitor::PulseAll(_lock);
+			}
+			finally {
+				Monitor::Exit(_lock);
+			}
+		}
+	}
+
+	Object^ _lock;
+	array<FrameWorker^>^ _workers;
+	int _frames;
+	int _next;
+	int _committed;
+	Exception^ _error;
+};
+
+} // Codec
+} // Dicom
+
+#endif
@@ -0,0 +1,282 @@
+// mDCM: A C# DICOM library
+//
+// Copyright (c) 2010  Colby Dillion
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// Author:
+//    Colby Dillion (colby.dillion@gmail.com)
+
+#include "FrameProbe.h"
+
+#include "CharLS/interface.h"
+
+using namespace System;
+
+using namespace Dicom::Data;
+using namespace Dicom::Codec;
+using namespace Dicom::IO;
+
+namespace Dicom {
+namespace Codec {
+
+static inline int readWord(const unsigned char* data) {
+	return (data[0] << 8) | data[1];
+}
+
+static inline int readDWord(const unsigned char* data) {
+	return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+//DCMTK djcodecd.cxx, extended to read the first scan and JPEG-LS frames
+static int probeJpeg(const unsigned char* data, int length, FrameHeader% header) {
+	int pos = 2;
+	for (;;) {
+		if (pos + 4 > length)
+			return pos + 4;
+		if (data[pos] != 0xff)
+			return -1;
+
+		int marker = data[pos + 1];
+		if (marker == 0xff) { // fill byte
+			pos++;
+			continue;
+		}
+		pos += 2;
+
+		if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) // TEM, RSTm
+			continue;
+		if (marker == 0xd8 || marker == 0xd9) // SOI, EOI
+			return -1;
+
+		const int size = readWord(data + pos);
+		if (size < 2)
+			return -1;
+		const int end = pos + size;
+
+		switch (marker) {
+		case 0xc0: // SOF_0: JPEG baseline
+		case 0xc1: // SOF_1: JPEG extended sequential DCT
+		case 0xc2: // SOF_2: JPEG progressive DCT
+		case 0xc3: // SOF_3: JPEG lossless sequential
+		case 0xc5: // SOF_5: differential (hierarchical) extended sequential, Huffman
+		case 0xc6: // SOF_6: differential (hierarchical) progressive, Huffman
+		case 0xc7: // SOF_7: differential (hierarchical) lossless, Huffman
+		case 0xc9: // SOF_9: extended sequential, arithmetic
+		case 0xca: // SOF_10: progressive, arithmetic
+		case 0xcb: // SOF_11: lossless, arithmetic
+		case 0xcd: // SOF_13: differential (hierarchical) extended sequential, arithmetic
+		case 0xce: // SOF_14: differential (hierarchical) progressive, arithmetic
+		case 0xcf: // SOF_15: differential (hierarchical) lossless, arithmetic
+		case 0xf7: // SOF_55: JPEG-LS
+			{
+				if (end > length)
+					return end;
+				if (header.Coding != FrameCoding::Unknown || size < 8)
+					return -1;
+
+				header.Coding = (marker == 0xf7) ? FrameCoding::JpegLs : FrameCoding::Jpeg;
+				header.Process = marker - 0xc0;
+				header.Precision = data[pos + 2];
+				header.Height = readWord(data + pos + 3);
+				header.Width = readWord(data + pos + 5);
+				header.Components = data[pos + 7];
+
+				if (size < 8 + header.Components * 3)
+					return -1;
+
+				for (int c = 0; c < header.Components && c < 4; c++)
+					header.Sampling |= (unsigned int)data[pos + 8 + c * 3 + 1] << (c * 8);
+			}
+			break;
+		case 0xda: // SOS
+			{
+				if (end > length)
+					return end;
+				if (header.Coding == FrameCoding::Unknown)
+					return -1;
+
+				const int count = data[pos + 2];
+				if (size < 6 + count * 2)
+					return -1;
+
+				const unsigned char* spectral = data + pos + 3 + count * 2;
+				if (header.Coding == FrameCoding::JpegLs) {
+					// let CharLS validate everything up to and including the first scan header
+					JlsParameters params = {0};
+					if (JpegLsReadHeader(data, end, &params) != OK)
+						return -1;
+
+					header.Precision = params.bitspersample;
+					header.Width = params.width;
+					header.Height = params.height;
+					header.Components = params.components;
+					header.Predictor = params.allowedlossyerror;
+					header.Transform = params.colorTransform;
+				}
+				else if ((header.Process & 3) == 3) {
+					header.Predictor = spectral[0];
+					header.Transform = spectral[2] & 0x0f;
+				}
+			}
+			return 0;
+		default:
+			if (end > length)
+				return end + 4;
+			break;
+		}
+
+		pos = end;
+	}
+}
+
+static int probeJpeg2000(const unsigned char* data, int length, FrameHeader% header) {
+	header.Coding = FrameCoding::Jpeg2000;
+
+	bool siz = false;
+	bool cod = false;
+
+	int pos = 2;
+	while (!siz || !cod) {
+		if (pos + 4 > length)
+			return pos + 4;
+		if (data[pos] != 0xff)
+			return -1;
+
+		const int marker = data[pos + 1];
+		if (marker == 0x90 || marker == 0x93 || marker == 0xd9) // SOT, SOD, EOC
+			return -1;
+		pos += 2;
+
+		const int size = readWord(data + pos);
+		if (size < 2)
+			return -1;
+		const int end = pos + size;
+		if (end > length)
+			return (marker == 0x51 || marker == 0x52) ? end : end + 4;
+
+		switch (marker) {
+		case 0x51: // SIZ
+			{
+				if (size < 38)
+					return -1;
+
+				const int width = readDWord(data + pos + 4) - readDWord(data + pos + 12);
+				const int height = readDWord(data + pos + 8) - readDWord(data + pos + 16);
+				const int components = readWord(data + pos + 36);
+				if (width <= 0 || height <= 0 || components == 0 || size < 38 + components * 3)
+					return -1;
+
+				header.Width = width;
+				header.Height = height;
+				header.Components = components;
+				header.Precision = (data[pos + 38] & 0x7f) + 1;
+				header.IsSigned = (data[pos + 38] & 0x80) != 0;
+
+				// J2K stores subsampling distances, convert them to JPEG style sampling factors
+				int dx = 1, dy = 1;
+				for (int c = 0; c < components; c++) {
+					dx = Math::Max(dx, (int)data[pos + 38 + c * 3 + 1]);
+					dy = Math::Max(dy, (int)data[pos + 38 + c * 3 + 2]);
+				}
+				for (int c = 0; c < components && c < 4; c++) {
+					const int xr = Math::Max(1, (int)data[pos + 38 + c * 3 + 1]);
+					const int yr = Math::Max(1, (int)data[pos + 38 + c * 3 + 2]);
+					const unsigned int h = Math::Min(15, dx / xr);
+					const unsigned int v = Math::Min(15, dy / yr);
+					header.Sampling |= ((h << 4) | v) << (c * 8);
+				}
+				siz = true;
+			}
+			break;
+		case 0x52: // COD
+			{
+				if (size < 12)
+					return -1;
+
+				header.Transform = data[pos + 6];
+				header.Predictor = data[pos + 11];
+				cod = true;
+			}
+			break;
+		default:
+			break;
+		}
+
+		pos = end;
+	}
+
+	return 0;
+}
+
+int FrameProbe::Probe(const unsigned char* data, int length, FrameHeader% header) {
+	header = FrameHeader();
+
+	if (length < 2)
+		return 2;
+	if (data[0] != 0xff)
+		return -1;
+
+	if (data[1] == 0xd8) // SOI
+		return probeJpeg(data, length, header);
+	if (data[1] == 0x4f) // SOC
+		return probeJpeg2000(data, length, header);
+
+	return -1;
+}
+
+FrameHeader FrameProbe::Probe(ByteBuffer^ fragment) {
+	FrameHeader header;
+
+	int length = fragment->Length;
+	if (length == 0)
+		throw gcnew DicomCodecException("Unable to read frame header: empty fragment!");
+
+	if (!fragment->CanUnload || fragment->IsDeferred) {
+		array<unsigned char>^ data = fragment->ToBytes();
+		pin_ptr<unsigned char> dataPin = &data[0];
+		if (Probe(dataPin, data->Length, header) != 0)
+			throw gcnew DicomCodecException("Unable to read frame header: unknown or corrupt code stream!");
+		return header;
+	}
+
+	// read fragments that are still on disk in growing windows
+	int count = Math::Min(length, (int)WindowSize);
+	for (;;) {
+		if (_window == nullptr || _window->Length < count)
+			_window = gcnew array<unsigned char>(Math::Max(count, (int)WindowSize));
+
+		fragment->CopyTo(0, _window, 0, count);
+
+		pin_ptr<unsigned char> windowPin = &_window[0];
+		int result = Probe(windowPin, count, header);
+		if (result == 0)
+			return header;
+		if (result < 0 || count == length)
+			throw gcnew DicomCodecException("Unable to read frame header: unknown or corrupt code stream!");
+
+		count = Math::Min(length, Math::Max(result, count * 2));
+	}
+}
+
+FrameHeader FrameProbe::Probe(DcmPixelData^ pixelData) {
+	if (!pixelData->IsEncapsulated || pixelData->PixelDataSequence->Fragments->Count == 0)
+		throw gcnew DicomCodecException("Unable to read frame header: no fragmented pixel data!");
+
+	return Probe(pixelData->PixelDataSequence->Fragments[0]);
+}
+
+} // Codec
+} // Dicom
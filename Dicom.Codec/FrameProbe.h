@@ -0,0 +1,113 @@
+// mDCM: A C# DICOM library
+//
+// Copyright (c) 2010  Colby Dillion
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// Author:
+//    Colby Dillion (colby.dillion@gmail.com)
+
+#ifndef __FRAMEPROBE_H__
+#define __FRAMEPROBE_H__
+
+#pragma once
+
+using namespace System;
+
+using namespace Dicom::Data;
+using namespace Dicom::IO;
+
+namespace Dicom {
+namespace Codec {
+	public enum class FrameCoding {
+		Unknown = 0,
+		Jpeg = 1,
+		JpegLs = 2,
+		Jpeg2000 = 3
+	};
+
+	// Coding parameters of a compressed frame, as found in its main header.
+	//
+	//   Process    JPEG: SOF process number (0 = baseline ... 15), JPEG-LS: 55, JPEG 2000: 0
+	//   Predictor  JPEG: selection value of the first scan (lossless only), JPEG-LS: NEAR,
+	//              JPEG 2000: wavelet filter (0 = 9-7 irreversible, 1 = 5-3 reversible)
+	//   Transform  JPEG: point transform of the first scan (lossless only), JPEG-LS: HP color transform,
+	//              JPEG 2000: multiple component transform
+	public value struct FrameHeader {
+		FrameCoding Coding;
+		int Precision;
+		int Width;
+		int Height;
+		int Components;
+		int Process;
+		int Predictor;
+		int Transform;
+		bool IsSigned;
+
+		// sampling factors of the first four components, one byte each (high nibble H, low nibble V)
+		unsigned int Sampling;
+
+		int GetHorizontalSampling(int component) {
+			if (component < 0 || component >= Math::Min(Components, 4))
+				return 1;
+			return (Sampling >> (component * 8 + 4)) & 0x0f;
+		}
+
+		int GetVerticalSampling(int component) {
+			if (component < 0 || component >= Math::Min(Components, 4))
+				return 1;
+			return (Sampling >> (component * 8)) & 0x0f;
+		}
+
+		property bool IsLossless {
+			bool get() {
+				switch (Coding) {
+				case FrameCoding::Jpeg:
+					return (Process & 3) == 3;
+				case FrameCoding::JpegLs:
+					return Predictor == 0;
+				case FrameCoding::Jpeg2000:
+					return Predictor == 1;
+				default:
+					return false;
+				}
+			}
+		}
+	};
+
+	// Reads the coding parameters of a JPEG, JPEG-LS or JPEG 2000 frame without decoding or copying it.
+	//
+	// Only the main header of the first fragment is parsed. Loaded fragments are read in place; fragments
+	// that are still on disk are read in small windows until the header is complete.
+	public ref class FrameProbe {
+	public:
+		static FrameHeader Probe(DcmPixelData^ pixelData);
+		static FrameHeader Probe(ByteBuffer^ fragment);
+
+	internal:
+		// Parses the header at data. Returns 0 when done, the number of bytes needed when the header
+		// extends beyond length, or -1 if the data is not a valid code stream.
+		static int Probe(const unsigned char* data, int length, FrameHeader% header);
+
+	private:
+		literal int WindowSize = 512;
+
+		[ThreadStatic]
+		static array<unsigned char>^ _window;
+	};
+} // Codec
+} // Dicom
+
+#endif
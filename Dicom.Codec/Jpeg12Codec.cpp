@@ -24,7 +24,9 @@
 
 using namespace System;
 using namespace System::IO;
+using namespace System::Runtime::ExceptionServices;
 using namespace System::Runtime::InteropServices;
+using namespace System::Threading::Tasks;
 
 using namespace Dicom::Data;
 
@@ -45,6 +47,7 @@ extern "C" {
 #include "libijg12/jpeglib12.h"
 #include "libijg12/jerror12.h"
 #include "libijg12/jpegint12.h"
+#include "libijg12/jchuff12.h"
 #undef boolean
 
 // disable any preprocessor magic the IJG library might be doing with the "const" keyword
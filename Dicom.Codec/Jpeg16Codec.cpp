@@ -24,7 +24,9 @@
 
 using namespace System;
 using namespace System::IO;
+using namespace System::Runtime::ExceptionServices;
 using namespace System::Runtime::InteropServices;
+using namespace System::Threading::Tasks;
 
 using namespace Dicom::Data;
 
@@ -45,6 +47,7 @@ extern "C" {
 #include "libijg16/jpeglib16.h"
 #include "libijg16/jerror16.h"
 #include "libijg16/jpegint16.h"
+#include "libijg16/jchuff16.h"
 #undef boolean
 
 // disable any preprocessor magic the IJG library might be doing with the "const" keyword
@@ -25,13 +25,18 @@
 #pragma once
 
 using namespace System;
+using namespace System::Collections::Generic;
 using namespace System::IO;
+using namespace System::Runtime::InteropServices;
 using namespace System::Threading;
 
 using namespace Dicom::Codec;
 using namespace Dicom::Data;
+using namespace Dicom::IO;
 
 #include "DcmJpegParameters.h"
+#include "FrameBuffer.h"
+#include "SampleFormat/sampleformat.h"
 
 namespace Dicom {
 namespace Codec {
@@ -45,17 +50,192 @@ public enum class JpegMode : int {
 	Lossless
 };
 
+// Pins the fragments of a compressed frame so that the IJG source managers can read them in place,
+// without concatenating them into a contiguous copy of the frame.
+ref class PinnedFragments {
+public:
+	PinnedFragments(IList<ByteBuffer^>^ fragments) {
+		_handles = gcnew array<GCHandle>(fragments->Count);
+		Count = 0;
+		Data = new unsigned char*[_handles->Length];
+		Sizes = new unsigned int[_handles->Length];
+
+		for (int i = 0; i < _handles->Length; i++) {
+			array<unsigned char>^ fragment = fragments[i]->ToBytes();
+			if (fragment->Length == 0)
+				continue;
+			_handles[i] = GCHandle::Alloc(fragment, GCHandleType::Pinned);
+			Data[Count] = (unsigned char*)_handles[i].AddrOfPinnedObject().ToPointer();
+			Sizes[Count] = fragment->Length;
+			Count++;
+		}
+	}
+
+	~PinnedFragments() {
+		this->!PinnedFragments();
+	}
+
+	!PinnedFragments() {
+		if (_handles != nullptr) {
+			for (int i = 0; i < _handles->Length; i++) {
+				if (_handles[i].IsAllocated)
+					_handles[i].Free();
+			}
+			_handles = nullptr;
+		}
+		delete[] Data;
+		delete[] Sizes;
+		Data = nullptr;
+		Sizes = nullptr;
+	}
+
+	int Count;
+	unsigned char** Data;
+	unsigned int* Sizes;
+
+private:
+	array<GCHandle>^ _handles;
+};
+
+// Owns a native IJG compressor or decompressor. The codecs keep one per thread so that the JPEG object and
+// its permanent pool survive between frames. [ThreadStatic] handles are only released when the GC finalizes
+// them, so the context reports the native memory it holds between frames as memory pressure, which is updated
+// whenever the codecs fetch it for a call.
+ref class JpegContext {
+public:
+	typedef void (*DestroyFunction)(void*);
+	typedef size_t (*MeasureFunction)(void*);
+
+	JpegContext(void* pointer, DestroyFunction destroy, MeasureFunction measure) {
+		Pointer = pointer;
+		_destroy = destroy;
+		_measure = measure;
+		_pressure = 0;
+		UpdateMemoryPressure();
+	}
+
+	~JpegContext() {
+		this->!JpegContext();
+	}
+
+	!JpegContext() {
+		if (Pointer != nullptr) {
+			_destroy(Pointer);
+			Pointer = nullptr;
+		}
+		if (_pressure > 0) {
+			GC::RemoveMemoryPressure(_pressure);
+			_pressure = 0;
+		}
+	}
+
+	// Reports the memory now held by the context to the GC.
+	void UpdateMemoryPressure() {
+		__int64 bytes = (__int64)_measure(Pointer);
+		if (bytes > _pressure)
+			GC::AddMemoryPressure(bytes - _pressure);
+		else if (bytes < _pressure)
+			GC::RemoveMemoryPressure(_pressure - bytes);
+		_pressure = bytes;
+	}
+
+	void* Pointer;
+
+private:
+	DestroyFunction _destroy;
+	MeasureFunction _measure;
+	__int64 _pressure;
+};
+
+// Receives the images of a JpegProgressiveDecoder. scan is the number of scans of the frame the image is
+// made of, and complete is set for the final image, which is the same as Decode would have produced.
+public delegate void JpegScanHandler(array<unsigned char>^ frame, int scan, bool complete);
+
+// Decodes a frame while its compressed data arrives. A full size approximation of the frame is handed to
+// the JpegScanHandler after each scan of a progressive or multi-scan frame, or after the latest of the
+// scans completed by one Append; frames of a single scan are only handed over once they are complete.
+// Calls must not overlap.
+public ref class JpegProgressiveDecoder abstract {
+public:
+	~JpegProgressiveDecoder() {
+	}
+
+	// Adds the next bytes of the compressed frame, in stream order across fragments, and decodes as much as
+	// they allow. The handler is called from here.
+	virtual void Append(array<unsigned char>^ data, int offset, int count) abstract;
+
+	// Ends the compressed frame. A frame that was cut short is completed with the scans received so far,
+	// and the missing part of the last one is left gray.
+	virtual void Finish() abstract;
+
+	// True once the final image has been handed over.
+	property bool IsComplete {
+		virtual bool get() abstract;
+	}
+};
+
 public ref class IJpegCodec abstract {
 public:
 	virtual void Encode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, int frame) abstract;
 	virtual void Decode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, int frame) abstract;
 
+	// Starts decoding a frame of oldPixelData incrementally; newPixelData is described as after Decode once the
+	// frame header has arrived.
+	virtual JpegProgressiveDecoder^ CreateProgressiveDecoder(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, JpegScanHandler^ handler) abstract;
+
 internal:
 	virtual int ScanHeaderForPrecision(DcmPixelData^ pixelData) abstract;
 
-	MemoryStream^ MemoryBuffer;
-	array<unsigned char>^ DataBuffer;
-	unsigned char* DataPtr;
+	// Frame level encode and decode; unlike Encode and Decode these leave adding the frame to the caller. A full
+	// decode records checkpoints into an index that has not been recorded yet; a region decode resumes from them.
+	// Frame decodes leave newPixelData alone so that they can run concurrently; DescribeFrame describes the
+	// frames they decode in newPixelData beforehand.
+	virtual List<ByteBuffer^>^ EncodeFrame(array<unsigned char>^ frameData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params) abstract;
+	virtual void DescribeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params) abstract;
+	virtual array<unsigned char>^ DecodeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmJpegParameters^ params,
+		JpegCheckpointIndex^ checkpoints) abstract;
+	virtual void DecodeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmJpegParameters^ params, FrameBuffer destination,
+		JpegCheckpointIndex^ checkpoints) abstract;
+
+	// Decodes the given rectangle of the output frame into a new packed array; newPixelData takes the size of the rectangle.
+	virtual array<unsigned char>^ DecodeRegion(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params,
+		int x, int y, int width, int height, JpegCheckpointIndex^ checkpoints) abstract;
+
+	static array<unsigned char>^ GetEncoderFrameData(DcmPixelData^ pixelData, int frame) {
+		// IJG eats the extra padding bits
+		if (pixelData->BitsAllocated == 16 && pixelData->BitsStored <= 8) {
+			array<unsigned short>^ frameData16 = pixelData->GetFrameDataU16(frame);
+			array<unsigned char>^ frameData = gcnew array<unsigned char>(frameData16->Length);
+			if (frameData->Length > 0) {
+				pin_ptr<unsigned short> src = &frameData16[0];
+				pin_ptr<unsigned char> dst = &frameData[0];
+				sf_narrow(dst, src, frameData->Length);
+			}
+			return frameData;
+		}
+		return pixelData->GetFrameDataU8(frame);
+	}
+
+	// Copy of a frame of pixelData in the other planar configuration. The sample size is that of frameData,
+	// which may have been narrowed by GetEncoderFrameData.
+	static array<unsigned char>^ ChangePlanarConfiguration(array<unsigned char>^ frameData, DcmPixelData^ pixelData, int oldPlanarConfiguration) {
+		int pixels = pixelData->ImageWidth * pixelData->ImageHeight;
+		int components = pixelData->SamplesPerPixel;
+		int sampleSize = Math::Max(1, frameData->Length / Math::Max(1, pixels * components));
+		size_t planeStride = (size_t)pixels * sampleSize;
+
+		array<unsigned char>^ result = gcnew array<unsigned char>(frameData->Length);
+		if (pixels == 0)
+			return result;
+
+		pin_ptr<unsigned char> src = &frameData[0];
+		pin_ptr<unsigned char> dst = &result[0];
+		if (oldPlanarConfiguration == 1)
+			sf_interleave(dst, src, planeStride, pixels, components, sampleSize);
+		else
+			sf_deinterleave(dst, planeStride, src, pixels, components, sampleSize);
+		return result;
+	}
 
 	JpegMode Mode;
 	int Predictor;
@@ -67,12 +247,33 @@ public:
 	Jpeg16Codec(JpegMode mode, int predictor, int point_transform);
 	virtual void Encode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, int frame) override;
 	virtual void Decode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, int frame) override;
+	virtual JpegProgressiveDecoder^ CreateProgressiveDecoder(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, JpegScanHandler^ handler) override;
 
 internal:
 	virtual int ScanHeaderForPrecision(DcmPixelData^ pixelData) override;
 
+	virtual List<ByteBuffer^>^ EncodeFrame(array<unsigned char>^ frameData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params) override;
+	virtual void DescribeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params) override;
+	virtual array<unsigned char>^ DecodeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmJpegParameters^ params,
+		JpegCheckpointIndex^ checkpoints) override;
+	virtual void DecodeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmJpegParameters^ params, FrameBuffer destination,
+		JpegCheckpointIndex^ checkpoints) override;
+	virtual array<unsigned char>^ DecodeRegion(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params,
+		int x, int y, int width, int height, JpegCheckpointIndex^ checkpoints) override;
+	int ScanHeaderForPrecision(PinnedFragments^ jpegData);
+
+	static void EnableSimd(bool enable);
+
+	// Compressor and decompressor of the calling thread, created on first use.
+	static JpegContext^ GetCompressContext();
+	static JpegContext^ GetDecompressContext();
+
+private:
+	[ThreadStatic]
+	static JpegContext^ _compressContext;
+
 	[ThreadStatic]
-	static Jpeg16Codec^ This;
+	static JpegContext^ _decompressContext;
 };
 
 public ref class Jpeg12Codec : public IJpegCodec {
@@ -80,12 +281,33 @@ public:
 	Jpeg12Codec(JpegMode mode, int predictor, int point_transform);
 	virtual void Encode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, int frame) override;
 	virtual void Decode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, int frame) override;
+	virtual JpegProgressiveDecoder^ CreateProgressiveDecoder(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, JpegScanHandler^ handler) override;
 
 internal:
 	virtual int ScanHeaderForPrecision(DcmPixelData^ pixelData) override;
 
+	virtual List<ByteBuffer^>^ EncodeFrame(array<unsigned char>^ frameData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params) override;
+	virtual void DescribeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params) override;
+	virtual array<unsigned char>^ DecodeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmJpegParameters^ params,
+		JpegCheckpointIndex^ checkpoints) override;
+	virtual void DecodeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmJpegParameters^ params, FrameBuffer destination,
+		JpegCheckpointIndex^ checkpoints) override;
+	virtual array<unsigned char>^ DecodeRegion(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params,
+		int x, int y, int width, int height, JpegCheckpointIndex^ checkpoints) override;
+	int ScanHeaderForPrecision(PinnedFragments^ jpegData);
+
+	static void EnableSimd(bool enable);
+
+	// Compressor and decompressor of the calling thread, created on first use.
+	static JpegContext^ GetCompressContext();
+	static JpegContext^ GetDecompressContext();
+
+private:
+	[ThreadStatic]
+	static JpegContext^ _compressContext;
+
 	[ThreadStatic]
-	static Jpeg12Codec^ This;
+	static JpegContext^ _decompressContext;
 };
 
 public ref class Jpeg8Codec : public IJpegCodec {
@@ -93,12 +315,33 @@ public:
 	Jpeg8Codec(JpegMode mode, int predictor, int point_transform);
 	virtual void Encode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, int frame) override;
 	virtual void Decode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, int frame) override;
+	virtual JpegProgressiveDecoder^ CreateProgressiveDecoder(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, JpegScanHandler^ handler) override;
 
 internal:
 	virtual int ScanHeaderForPrecision(DcmPixelData^ pixelData) override;
 
+	virtual List<ByteBuffer^>^ EncodeFrame(array<unsigned char>^ frameData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params) override;
+	virtual void DescribeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params) override;
+	virtual array<unsigned char>^ DecodeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmJpegParameters^ params,
+		JpegCheckpointIndex^ checkpoints) override;
+	virtual void DecodeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmJpegParameters^ params, FrameBuffer destination,
+		JpegCheckpointIndex^ checkpoints) override;
+	virtual array<unsigned char>^ DecodeRegion(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params,
+		int x, int y, int width, int height, JpegCheckpointIndex^ checkpoints) override;
+	int ScanHeaderForPrecision(PinnedFragments^ jpegData);
+
+	static void EnableSimd(bool enable);
+
+	// Compressor and decompressor of the calling thread, created on first use.
+	static JpegContext^ GetCompressContext();
+	static JpegContext^ GetDecompressContext();
+
+private:
+	[ThreadStatic]
+	static JpegContext^ _compressContext;
+
 	[ThreadStatic]
-	static Jpeg8Codec^ This;
+	static JpegContext^ _decompressContext;
 };
 
 } // Jpeg
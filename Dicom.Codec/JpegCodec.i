@@ -19,6 +19,101 @@ namespace IJGVERS {
 		(*cinfo->err->format_message)((jpeg_common_struct *)cinfo, buffer); /* Create the message */
 		Dicom::Debug::Log->Info("IJG: {0}", gcnew String(buffer));
 	}
+
+	// compressor kept alive between frames
+	struct CompressContext {
+		struct jpeg_compress_struct cinfo;
+		struct ErrorStruct jerr;
+		struct jpeg_memory_arena arena;
+	};
+
+	// decompressor kept alive between frames
+	struct DecompressContext {
+		struct jpeg_decompress_struct dinfo;
+		struct ErrorStruct jerr;
+		struct jpeg_memory_arena arena;
+	};
+
+	void destroyCompressContext(void *context) {
+		CompressContext *ctx = (CompressContext *)context;
+		jpeg_destroy_compress(&ctx->cinfo);
+		delete ctx;
+	}
+
+	void destroyDecompressContext(void *context) {
+		DecompressContext *ctx = (DecompressContext *)context;
+		jpeg_destroy_decompress(&ctx->dinfo);
+		delete ctx;
+	}
+
+	// the context itself and the memory its arena holds or keeps for reuse
+	size_t measureCompressContext(void *context) {
+		CompressContext *ctx = (CompressContext *)context;
+		return sizeof(CompressContext) + ctx->arena.bytes_in_use + ctx->arena.cached_bytes;
+	}
+
+	size_t measureDecompressContext(void *context) {
+		DecompressContext *ctx = (DecompressContext *)context;
+		return sizeof(DecompressContext) + ctx->arena.bytes_in_use + ctx->arena.cached_bytes;
+	}
+
+	JpegContext^ createCompressContext() {
+		CompressContext *ctx = new CompressContext;
+		memset(ctx, 0, sizeof(CompressContext));
+		ctx->cinfo.err = jpeg_std_error(&ctx->jerr.pub);
+		ctx->jerr.pub.error_exit = ErrorExit;
+		ctx->jerr.pub.output_message = OutputMessage;
+		jpeg_create_compress(&ctx->cinfo);
+		ctx->cinfo.arena = &ctx->arena;
+		return gcnew JpegContext(ctx, destroyCompressContext, measureCompressContext);
+	}
+
+	JpegContext^ createDecompressContext() {
+		DecompressContext *ctx = new DecompressContext;
+		memset(ctx, 0, sizeof(DecompressContext));
+		ctx->dinfo.err = jpeg_std_error(&ctx->jerr.pub);
+		ctx->jerr.pub.error_exit = ErrorExit;
+		ctx->jerr.pub.output_message = OutputMessage;
+		jpeg_create_decompress(&ctx->dinfo);
+		ctx->dinfo.arena = &ctx->arena;
+		return gcnew JpegContext(ctx, destroyDecompressContext, measureDecompressContext);
+	}
+
+	// Starts counting the memory of a codec call and applies its memory budget.
+	void beginMemoryAccounting(j_common_ptr cinfo, DcmJpegParameters^ params) {
+		struct jpeg_memory_arena *arena = cinfo->arena;
+		arena->peak_bytes = arena->bytes_in_use;
+		arena->total_bytes = 0;
+		arena->heap_bytes = 0;
+		cinfo->mem->max_memory_to_use = Math::Max(params->MaxMemoryToUse, 0);
+	}
+
+	// Adds the memory counted since the last call to the statistics of the parameters, if any, and starts
+	// counting again.
+	void endMemoryAccounting(j_common_ptr cinfo, DcmJpegParameters^ params) {
+		struct jpeg_memory_arena *arena = cinfo->arena;
+		JpegMemoryStatistics^ statistics = params->MemoryStatistics;
+		if (statistics != nullptr)
+			statistics->Add((__int64)arena->peak_bytes, (__int64)arena->total_bytes, (__int64)arena->heap_bytes);
+		arena->peak_bytes = arena->bytes_in_use;
+		arena->total_bytes = 0;
+		arena->heap_bytes = 0;
+	}
+
+	// Runs body for 0 <= i < count on at most maxParallelism threads of the thread pool, rethrowing the first
+	// exception of a failed iteration.
+	void runParallel(int count, int maxParallelism, Action<int>^ body) {
+		ParallelOptions^ options = gcnew ParallelOptions();
+		options->MaxDegreeOfParallelism = Math::Max(1, Math::Min(count, maxParallelism));
+
+		try {
+			Parallel::For(0, count, options, body);
+		}
+		catch (AggregateException^ e) {
+			ExceptionDispatchInfo::Capture(e->InnerExceptions[0])->Throw();
+			throw;
+		}
+	}
 }
 
 
@@ -42,28 +137,103 @@ namespace IJGVERS {
 			return JCS_UNKNOWN;
 	}
 
+	J_DCT_METHOD getJpegDctMethod(JpegDctMethod method) {
+		if (method == JpegDctMethod::FastInteger)
+			return JDCT_IFAST;
+		else if (method == JpegDctMethod::Float)
+			return JDCT_FLOAT;
+		else
+			return JDCT_ISLOW;
+	}
+
+	// private destination manager struct, reached through cinfo->client_data
+	struct DestinationManagerStruct {
+		// the standard IJG destination manager object
+		struct jpeg_destination_mgr pub;
+
+		// completed fragments of the compressed frame
+		gcroot<List<ByteBuffer^>^> fragments;
+
+		// fragment currently being filled by IJG
+		gcroot<array<unsigned char>^> buffer;
+
+		// pinning handle of the current fragment
+		void *buffer_handle;
+
+		// maximum (even) fragment size
+		int fragment_size;
+
+		// initial buffer size of each fragment, grown up to fragment_size as needed
+		int initial_size;
+	};
+
+	void pinFragment(DestinationManagerStruct *dest, int offset) {
+		GCHandle handle = GCHandle::Alloc((array<unsigned char>^)dest->buffer, GCHandleType::Pinned);
+		dest->buffer_handle = GCHandle::ToIntPtr(handle).ToPointer();
+		dest->pub.next_output_byte = (JOCTET *)handle.AddrOfPinnedObject().ToPointer() + offset;
+		dest->pub.free_in_buffer = dest->buffer->Length - offset;
+	}
+
+	void unpinFragment(DestinationManagerStruct *dest) {
+		if (dest->buffer_handle != NULL) {
+			GCHandle::FromIntPtr(IntPtr(dest->buffer_handle)).Free();
+			dest->buffer_handle = NULL;
+		}
+	}
+
+	void beginFragment(DestinationManagerStruct *dest) {
+		dest->buffer = gcnew array<unsigned char>(Math::Min(dest->initial_size, dest->fragment_size));
+		pinFragment(dest, 0);
+	}
+
+	void endFragment(DestinationManagerStruct *dest, int count) {
+		unpinFragment(dest);
+
+		// fragments must have an even length; the resize pads with a zero byte
+		array<unsigned char>^ buffer = dest->buffer;
+		if ((count % 2) != 0)
+			count++;
+		if (count != buffer->Length)
+			Array::Resize(buffer, count);
+
+		dest->fragments->Add(gcnew ByteBuffer(buffer));
+		dest->buffer = nullptr;
+	}
+
 	// callbacks for compress-destination-manager
 	void initDestination(j_compress_ptr cinfo) {
-		JPEGCODEC^ thisPtr = (JPEGCODEC^)JPEGCODEC::This;
-		thisPtr->MemoryBuffer = gcnew MemoryStream();
-		cinfo->dest->next_output_byte = thisPtr->DataPtr;
-		cinfo->dest->free_in_buffer = IJGE_BLOCKSIZE;
+		DestinationManagerStruct *dest = (DestinationManagerStruct *)cinfo->client_data;
+		dest->fragments = gcnew List<ByteBuffer^>();
+		beginFragment(dest);
 	}
 
 	ijg_boolean emptyOutputBuffer(j_compress_ptr cinfo) {
-		JPEGCODEC^ thisPtr = (JPEGCODEC^)JPEGCODEC::This;
-		thisPtr->MemoryBuffer->Write(thisPtr->DataBuffer, 0, IJGE_BLOCKSIZE);
-		cinfo->dest->next_output_byte = thisPtr->DataPtr;
-		cinfo->dest->free_in_buffer = IJGE_BLOCKSIZE;
+		DestinationManagerStruct *dest = (DestinationManagerStruct *)cinfo->client_data;
+		array<unsigned char>^ buffer = dest->buffer;
+		int count = buffer->Length;
+
+		if (count < dest->fragment_size) {
+			// grow the current fragment towards the maximum fragment size
+			unpinFragment(dest);
+			Array::Resize(buffer, (int)Math::Min((__int64)count * 2, (__int64)dest->fragment_size));
+			dest->buffer = buffer;
+			pinFragment(dest, count);
+		}
+		else {
+			// current fragment is full, start the next one
+			endFragment(dest, count);
+			beginFragment(dest);
+		}
 		return TRUE;
 	}
 
 	void termDestination(j_compress_ptr cinfo) {
-		JPEGCODEC^ thisPtr = (JPEGCODEC^)JPEGCODEC::This;
-		int count = IJGE_BLOCKSIZE - cinfo->dest->free_in_buffer;
-		thisPtr->MemoryBuffer->Write(thisPtr->DataBuffer, 0, count);
-		thisPtr->DataPtr = nullptr;
-		thisPtr->DataBuffer = nullptr;
+		DestinationManagerStruct *dest = (DestinationManagerStruct *)cinfo->client_data;
+		int count = dest->buffer->Length - (int)dest->pub.free_in_buffer;
+		if (count > 0 || dest->fragments->Count == 0)
+			endFragment(dest, count);
+		else
+			unpinFragment(dest);
 	}
 
 	// Borrowed from DCMTK djeijgXX.cxx
@@ -198,148 +368,647 @@ namespace IJGVERS {
 			}
 		}
 	}
-}
-
-void JPEGCODEC::Encode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, int frame) {
-	if ((oldPixelData->PhotometricInterpretation == "YBR_ICT") ||
-		(oldPixelData->PhotometricInterpretation == "YBR_RCT"))
-		throw gcnew DicomCodecException(String::Format("Photometric Interpretation '{0}' not supported by JPEG encoder!",
-														oldPixelData->PhotometricInterpretation));
-
-	array<unsigned char>^ frameData = nullptr;
-	
-	if (oldPixelData->BitsAllocated == 16 && oldPixelData->BitsStored <= 8) {
-		array<unsigned short>^ frameData16 = oldPixelData->GetFrameDataU16(frame);
-		frameData = gcnew array<unsigned char>(frameData16->Length);
-		
-		for (int i = 0, l = frameData->Length; i < l; i++) {
-			frameData[i] = static_cast<unsigned char>(frameData16[i]);
-		}
-	}
-	else
-		frameData = oldPixelData->GetFrameDataU8(frame);
-
-	pin_ptr<unsigned char> framePin = &frameData[0];
-	unsigned char* framePtr = framePin;
-	unsigned int frameSize = frameData->Length;
-
-	DataBuffer = gcnew array<unsigned char>(IJGE_BLOCKSIZE);
-	pin_ptr<unsigned char> DataPin = &DataBuffer[0];
-	DataPtr = DataPin;
-
-	try {
-		if (oldPixelData->IsPlanar && oldPixelData->SamplesPerPixel > 1) {
-			newPixelData->PlanarConfiguration = 0;
-			DcmCodecHelper::ChangePlanarConfiguration(frameData, frameData->Length / oldPixelData->BytesAllocated, 
-				oldPixelData->BitsAllocated, oldPixelData->SamplesPerPixel, 1);
-		}
-
-		struct jpeg_compress_struct cinfo;
-		struct IJGVERS::ErrorStruct jerr;
-		cinfo.err = jpeg_std_error(&jerr.pub);
-		jerr.pub.error_exit = IJGVERS::ErrorExit;
-		jerr.pub.output_message = IJGVERS::OutputMessage;
-
-		jpeg_create_compress(&cinfo);
-		cinfo.client_data = nullptr;
-		
-		JPEGCODEC::This = this;
-
-		// Specify destination manager
-		jpeg_destination_mgr dest;
-		dest.init_destination = IJGVERS::initDestination;
-		dest.empty_output_buffer = IJGVERS::emptyOutputBuffer;
-		dest.term_destination = IJGVERS::termDestination;
-		cinfo.dest = &dest;
 
-		cinfo.image_width = oldPixelData->ImageWidth;
-		cinfo.image_height = oldPixelData->ImageHeight;
-		cinfo.input_components = oldPixelData->SamplesPerPixel;
-		cinfo.in_color_space = IJGVERS::getJpegColorSpace(oldPixelData->PhotometricInterpretation);
+	// Sets the compression parameters of a frame; the stripe encoder changes the height afterwards.
+	void setupCompress(j_compress_ptr cinfo, DcmPixelData^ oldPixelData, DcmJpegParameters^ params, JpegMode mode, int predictor, int pointTransform) {
+		cinfo->image_width = oldPixelData->ImageWidth;
+		cinfo->image_height = oldPixelData->ImageHeight;
+		cinfo->input_components = oldPixelData->SamplesPerPixel;
+		cinfo->in_color_space = getJpegColorSpace(oldPixelData->PhotometricInterpretation);
 
-		jpeg_set_defaults(&cinfo);
+		jpeg_set_defaults(cinfo);
 
-		cinfo.optimize_coding = true;
+		cinfo->optimize_coding = true;
 
-		if (Mode == JpegMode::Baseline || Mode == JpegMode::Sequential) {
-			jpeg_set_quality(&cinfo, params->Quality, 0);
+		if (mode == JpegMode::Baseline || mode == JpegMode::Sequential) {
+			jpeg_set_quality(cinfo, params->Quality, 0);
 		}
-		else if (Mode == JpegMode::SpectralSelection) {
-			jpeg_set_quality(&cinfo, params->Quality, 0);
-			IJGVERS::jpeg_simple_spectral_selection(&cinfo);
+		else if (mode == JpegMode::SpectralSelection) {
+			jpeg_set_quality(cinfo, params->Quality, 0);
+			jpeg_simple_spectral_selection(cinfo);
 		}
-		else if (Mode == JpegMode::Progressive) {
-			jpeg_set_quality(&cinfo, params->Quality, 0);
-			jpeg_simple_progression(&cinfo);
+		else if (mode == JpegMode::Progressive) {
+			jpeg_set_quality(cinfo, params->Quality, 0);
+			jpeg_simple_progression(cinfo);
 		}
 		else {
-			jpeg_simple_lossless(&cinfo, Predictor, PointTransform);
+			jpeg_simple_lossless(cinfo, predictor, pointTransform);
 		}
 		
-		cinfo.smoothing_factor = params->SmoothingFactor;
+		cinfo->smoothing_factor = params->SmoothingFactor;
+		cinfo->dct_method = getJpegDctMethod(params->DctMethod);
 
-		if (Mode == JpegMode::Lossless) {
-			jpeg_set_colorspace(&cinfo, cinfo.in_color_space);
-			cinfo.comp_info[0].h_samp_factor = 1;
-			cinfo.comp_info[0].v_samp_factor = 1;
+		// baseline frames are Huffman coded by definition
+		if (params->ArithmeticCoding && mode != JpegMode::Baseline) {
+			cinfo->arith_code = TRUE;
+			cinfo->optimize_coding = FALSE;
+		}
+
+		if (mode == JpegMode::Lossless) {
+			jpeg_set_colorspace(cinfo, cinfo->in_color_space);
+			cinfo->comp_info[0].h_samp_factor = 1;
+			cinfo->comp_info[0].v_samp_factor = 1;
 		}
 		else {
 			// initialize sampling factors
-			if (cinfo.jpeg_color_space == JCS_YCbCr && params->SampleFactor != JpegSampleFactor::Unknown) {
+			if (cinfo->jpeg_color_space == JCS_YCbCr && params->SampleFactor != JpegSampleFactor::Unknown) {
 				switch(params->SampleFactor) {
 				  case JpegSampleFactor::SF444: /* 4:4:4 sampling (no subsampling) */
-					cinfo.comp_info[0].h_samp_factor = 1;
-					cinfo.comp_info[0].v_samp_factor = 1;
+					cinfo->comp_info[0].h_samp_factor = 1;
+					cinfo->comp_info[0].v_samp_factor = 1;
 					break;
 				  case JpegSampleFactor::SF422: /* 4:2:2 sampling (horizontal subsampling of chroma components) */
-					cinfo.comp_info[0].h_samp_factor = 2;
-					cinfo.comp_info[0].v_samp_factor = 1;
+					cinfo->comp_info[0].h_samp_factor = 2;
+					cinfo->comp_info[0].v_samp_factor = 1;
 					break;
 				//case JpegSampleFactor::SF411: /* 4:1:1 sampling (horizontal and vertical subsampling of chroma components) */
-				//	cinfo.comp_info[0].h_samp_factor = 2;
-				//	cinfo.comp_info[0].v_samp_factor = 2;
+				//	cinfo->comp_info[0].h_samp_factor = 2;
+				//	cinfo->comp_info[0].v_samp_factor = 2;
 				//	break;
 				}
 			}
 			else {
 				if (params->SampleFactor == JpegSampleFactor::Unknown)
-					jpeg_set_colorspace(&cinfo, cinfo.in_color_space);
+					jpeg_set_colorspace(cinfo, cinfo->in_color_space);
 
 				// JPEG color space is not YCbCr, disable subsampling.
-				cinfo.comp_info[0].h_samp_factor = 1;
-				cinfo.comp_info[0].v_samp_factor = 1;
+				cinfo->comp_info[0].h_samp_factor = 1;
+				cinfo->comp_info[0].v_samp_factor = 1;
 			}
 		}
 
 		// all other components are set to 1x1
 		for (int sfi = 1; sfi < MAX_COMPONENTS; sfi++) {
-			cinfo.comp_info[sfi].h_samp_factor = 1;
-			cinfo.comp_info[sfi].v_samp_factor = 1;
+			cinfo->comp_info[sfi].h_samp_factor = 1;
+			cinfo->comp_info[sfi].v_samp_factor = 1;
+		}
+	}
+
+	// destination manager that collects the compressed data of a stripe in memory
+	struct MemoryDestinationStruct {
+		// the standard IJG destination manager object
+		struct jpeg_destination_mgr pub;
+
+		// compressed data
+		std::vector<unsigned char> *buffer;
+	};
+
+	void initMemoryDestination(j_compress_ptr cinfo) {
+		MemoryDestinationStruct *dest = (MemoryDestinationStruct *)cinfo->dest;
+		dest->buffer->resize(IJGE_BLOCKSIZE);
+		dest->pub.next_output_byte = &(*dest->buffer)[0];
+		dest->pub.free_in_buffer = dest->buffer->size();
+	}
+
+	ijg_boolean emptyMemoryBuffer(j_compress_ptr cinfo) {
+		MemoryDestinationStruct *dest = (MemoryDestinationStruct *)cinfo->dest;
+		size_t count = dest->buffer->size();
+		dest->buffer->resize(count * 2);
+		dest->pub.next_output_byte = &(*dest->buffer)[count];
+		dest->pub.free_in_buffer = count;
+		return TRUE;
+	}
+
+	void termMemoryDestination(j_compress_ptr cinfo) {
+		MemoryDestinationStruct *dest = (MemoryDestinationStruct *)cinfo->dest;
+		dest->buffer->resize(dest->buffer->size() - dest->pub.free_in_buffer);
+	}
+
+	void initMemoryDestination(MemoryDestinationStruct *dest, std::vector<unsigned char> *buffer) {
+		dest->pub.init_destination = initMemoryDestination;
+		dest->pub.empty_output_buffer = emptyMemoryBuffer;
+		dest->pub.term_destination = termMemoryDestination;
+		dest->buffer = buffer;
+	}
+
+	// Huffman tables of a frame, indexed by table number
+	struct HuffmanTableSet {
+		JHUFF_TBL dc_tables[NUM_HUFF_TBLS];
+		JHUFF_TBL ac_tables[NUM_HUFF_TBLS];
+		bool dc_used[NUM_HUFF_TBLS];
+		bool ac_used[NUM_HUFF_TBLS];
+	};
+
+	// horizontal stripes of a frame that are compressed independently and joined with RSTn markers
+	struct StripePlan {
+		// uncompressed frame
+		unsigned char *frame;
+		int row_stride;
+		JDIMENSION image_height;
+
+		// every stripe but the last is stripe_height rows high and holds one restart interval
+		JDIMENSION stripe_height;
+		unsigned int restart_interval;
+		int stripe_count;
+
+		// stripes are limited in height by the restart interval, so there may be more of them than threads
+		int workers;
+
+		// Huffman symbol counts of each stripe: NUM_HUFF_TBLS DC tables, then NUM_HUFF_TBLS AC tables
+		std::vector<long> counts;
+
+		// Huffman symbol counts of the frame
+		std::vector<long> totals;
+
+		// Huffman tables for the whole frame; if have_tables is set they were given in advance, otherwise
+		// they are built from the symbol counts of the stripes
+		HuffmanTableSet tables;
+		bool have_tables;
+
+		// compressed stripes, each a complete JPEG stream
+		std::vector<std::vector<unsigned char> > output;
+	};
+
+	// Splits a frame into stripes of whole MCU rows. cinfo must hold the parameters of the frame. Returns
+	// false, leaving the frame to the serial encoder, if there would be only one stripe.
+	bool planStripes(j_compress_ptr cinfo, int workers, StripePlan &plan) {
+		// smoothing reads the rows around each row, across the stripe boundaries
+		if (workers < 2 || cinfo->smoothing_factor != 0)
+			return false;
+
+		// MCU geometry of the (single, interleaved) scan
+		int dataUnit = cinfo->lossless ? 1 : DCTSIZE;
+		int maxH = 1, maxV = 1;
+		for (int ci = 0; ci < cinfo->num_components; ci++) {
+			maxH = Math::Max(maxH, cinfo->comp_info[ci].h_samp_factor);
+			maxV = Math::Max(maxV, cinfo->comp_info[ci].v_samp_factor);
+		}
+		if (cinfo->num_components == 1)
+			maxH = maxV = 1;
+
+		JDIMENSION mcusPerRow = (JDIMENSION)jdiv_round_up((long)cinfo->image_width, (long)(maxH * dataUnit));
+		JDIMENSION mcuRows = (JDIMENSION)jdiv_round_up((long)cinfo->image_height, (long)(maxV * dataUnit));
+
+		// DRI holds a 16 bit interval, which limits the height of a stripe
+		if (mcusPerRow > 65535)
+			return false;
+		JDIMENSION stripeRows = (mcuRows + workers - 1) / workers;
+		stripeRows = Math::Min(stripeRows, 65535 / mcusPerRow);
+		if (stripeRows >= mcuRows)
+			return false;
+
+		plan.image_height = cinfo->image_height;
+		plan.stripe_height = stripeRows * maxV * dataUnit;
+		plan.restart_interval = stripeRows * mcusPerRow;
+		plan.stripe_count = (int)((mcuRows + stripeRows - 1) / stripeRows);
+		plan.workers = workers;
+		plan.counts.assign((size_t)plan.stripe_count * 2 * NUM_HUFF_TBLS * 257, 0);
+		plan.have_tables = false;
+		plan.output.resize(plan.stripe_count);
+		return true;
+	}
+
+	// Compresses the rows of a stripe; cinfo must have been started with the height of the stripe.
+	void writeStripe(j_compress_ptr cinfo, StripePlan &plan, int stripe) {
+		unsigned char *first = plan.frame + (size_t)stripe * plan.stripe_height * plan.row_stride;
+
+		std::vector<JSAMPROW> rows(cinfo->image_height);
+		for (JDIMENSION row = 0; row < cinfo->image_height; row++)
+			rows[row] = (JSAMPROW)(first + (size_t)row * plan.row_stride);
+
+		while (cinfo->next_scanline < cinfo->image_height)
+			jpeg_write_scanlines(cinfo, &rows[cinfo->next_scanline], cinfo->image_height - cinfo->next_scanline);
+	}
+
+	// Directs the symbol counts of the optimize_coding pass of a compressor to counts, which holds
+	// NUM_HUFF_TBLS DC tables and then NUM_HUFF_TBLS AC tables of 257 entries.
+	void collectHuffmanCounts(j_compress_ptr cinfo, long *counts) {
+		for (int t = 0; t < NUM_HUFF_TBLS; t++) {
+			cinfo->dc_huff_counts[t] = counts + t * 257;
+			cinfo->ac_huff_counts[t] = counts + (NUM_HUFF_TBLS + t) * 257;
+		}
+	}
+
+	void releaseHuffmanCounts(j_compress_ptr cinfo) {
+		for (int t = 0; t < NUM_HUFF_TBLS; t++) {
+			cinfo->dc_huff_counts[t] = NULL;
+			cinfo->ac_huff_counts[t] = NULL;
+		}
+	}
+
+	void collectStripeCounts(j_compress_ptr cinfo, StripePlan &plan, int stripe) {
+		collectHuffmanCounts(cinfo, &plan.counts[(size_t)stripe * 2 * NUM_HUFF_TBLS * 257]);
+	}
+
+	// Builds optimal Huffman tables from symbol counts laid out as for collectHuffmanCounts. If complete is
+	// set, every symbol that the process and precision of cinfo can produce gets a code in each used table,
+	// so that the tables can code other frames of the same kind too.
+	void buildHuffmanTables(j_compress_ptr cinfo, const long *counts, HuffmanTableSet &tables, bool complete) {
+		int maxDcSymbol = cinfo->lossless ? 16 : cinfo->data_precision + 3;
+		int maxAcSize = cinfo->data_precision + 2;
+
+		for (int t = 0; t < 2 * NUM_HUFF_TBLS; t++) {
+			// jpeg_gen_optimal_table clobbers the counts
+			long freq[257];
+			memcpy(freq, counts + t * 257, sizeof(freq));
+
+			bool used = false;
+			for (int i = 0; i < 257; i++)
+				used |= freq[i] != 0;
+
+			// a count of 1 gives an unseen symbol one of the longest codes
+			bool dc = t < NUM_HUFF_TBLS;
+			if (used && complete) {
+				if (dc) {
+					for (int i = 0; i <= maxDcSymbol; i++) {
+						if (freq[i] == 0)
+							freq[i] = 1;
+					}
+				}
+				else {
+					for (int run = 0; run < 16; run++) {
+						for (int size = 0; size <= maxAcSize; size++) {
+							// size 0 is only valid for EOB (run 0) and ZRL (run 15)
+							int symbol = (run << 4) | size;
+							if (freq[symbol] == 0 && (size != 0 || run == 0 || run == 15))
+								freq[symbol] = 1;
+						}
+					}
+				}
+			}
+
+			JHUFF_TBL *htbl = dc ? &tables.dc_tables[t] : &tables.ac_tables[t - NUM_HUFF_TBLS];
+			if (used)
+				jpeg_gen_optimal_table(cinfo, htbl, freq);
+			if (dc)
+				tables.dc_used[t] = used;
+			else
+				tables.ac_used[t - NUM_HUFF_TBLS] = used;
+		}
+	}
+
+	// Builds the Huffman tables of the frame from the symbol counts of all stripes.
+	void buildStripeTables(j_compress_ptr cinfo, StripePlan &plan) {
+		size_t tableCounts = 2 * NUM_HUFF_TBLS * 257;
+		plan.totals.assign(tableCounts, 0);
+		for (int stripe = 0; stripe < plan.stripe_count; stripe++) {
+			const long *counts = &plan.counts[stripe * tableCounts];
+			for (size_t i = 0; i < tableCounts; i++)
+				plan.totals[i] += counts[i];
+		}
+
+		buildHuffmanTables(cinfo, &plan.totals[0], plan.tables, false);
+	}
+
+	// Makes a compressor code its scan in a single pass with the given Huffman tables.
+	void installHuffmanTables(j_compress_ptr cinfo, const HuffmanTableSet &tables) {
+		for (int t = 0; t < NUM_HUFF_TBLS; t++) {
+			if (tables.dc_used[t]) {
+				if (cinfo->dc_huff_tbl_ptrs[t] == NULL)
+					cinfo->dc_huff_tbl_ptrs[t] = jpeg_alloc_huff_table((j_common_ptr)cinfo);
+				*cinfo->dc_huff_tbl_ptrs[t] = tables.dc_tables[t];
+				cinfo->dc_huff_tbl_ptrs[t]->sent_table = FALSE;
+			}
+			if (tables.ac_used[t]) {
+				if (cinfo->ac_huff_tbl_ptrs[t] == NULL)
+					cinfo->ac_huff_tbl_ptrs[t] = jpeg_alloc_huff_table((j_common_ptr)cinfo);
+				*cinfo->ac_huff_tbl_ptrs[t] = tables.ac_tables[t];
+				cinfo->ac_huff_tbl_ptrs[t]->sent_table = FALSE;
+			}
+		}
+		cinfo->optimize_coding = FALSE;
+		cinfo->lossless_supplied_tables = TRUE;
+	}
+
+	// Kind of frame whose Huffman tables are shared through a JpegHuffmanTableCache. The symbols depend on the
+	// precision and process, the quantization, the sampling and the colour space, which also decides whether the
+	// components share one table or the chroma components use their own.
+	String^ huffmanCacheKey(j_compress_ptr cinfo, DcmPixelData^ pixelData, DcmJpegParameters^ params, JpegMode mode, int predictor, int pointTransform) {
+		return String::Format("{0}/{1}/{2}/{3}/{4}/{5}/{6}/{7}", pixelData->BitsStored, (int)mode, predictor, pointTransform,
+			pixelData->SamplesPerPixel, (int)cinfo->jpeg_color_space, params->Quality, (int)params->SampleFactor);
+	}
+
+	bool loadHuffmanTables(JpegHuffmanTableCache::Entry^ entry, HuffmanTableSet &tables) {
+		if (entry->Tables->Length != sizeof(HuffmanTableSet))
+			return false;
+		Marshal::Copy(entry->Tables, 0, IntPtr(&tables), sizeof(HuffmanTableSet));
+		return true;
+	}
+
+	// Caches complete tables built from the symbol counts of a frame, or, if the frame was coded with cached
+	// tables, drops them when the frame compressed noticeably worse than the one they were built from.
+	void updateHuffmanCache(j_compress_ptr cinfo, JpegHuffmanTableCache^ cache, String^ key, JpegHuffmanTableCache::Entry^ used,
+							const std::vector<long> &counts, double ratio) {
+		if (used != nullptr) {
+			if (ratio > used->Ratio * (1.0 + cache->DriftTolerance))
+				cache->Remove(key, used);
+			return;
+		}
+
+		HuffmanTableSet tables;
+		buildHuffmanTables(cinfo, &counts[0], tables, true);
+
+		array<unsigned char>^ data = gcnew array<unsigned char>(sizeof(HuffmanTableSet));
+		Marshal::Copy(IntPtr(&tables), data, 0, data->Length);
+		cache->Store(key, gcnew JpegHuffmanTableCache::Entry(data, ratio));
+	}
+
+	// Returns the offset of the image height in the SOF marker of the frame headers, or -1 if there is none.
+	int findFrameHeight(const std::vector<unsigned char> &header) {
+		size_t pos = 2;
+		while (pos + 4 <= header.size()) {
+			if (header[pos] != 0xff)
+				return -1;
+
+			int marker = header[pos + 1];
+			if (marker == 0xff) { // fill byte
+				pos++;
+				continue;
+			}
+
+			size_t size = (header[pos + 2] << 8) | header[pos + 3];
+			if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+				return (pos + 7 <= header.size()) ? (int)pos + 5 : -1;
+			pos += 2 + size;
+		}
+		return -1;
+	}
+
+	// Returns the offset of the entropy-coded data in a JPEG stream, just after its SOS marker, or -1.
+	int findScanData(const std::vector<unsigned char> &stream) {
+		size_t pos = 2;
+		while (pos + 4 <= stream.size()) {
+			if (stream[pos] != 0xff)
+				return -1;
+
+			int marker = stream[pos + 1];
+			if (marker == 0xff) { // fill byte
+				pos++;
+				continue;
+			}
+
+			pos += 2 + ((stream[pos + 2] << 8) | stream[pos + 3]);
+			if (marker == 0xda) // SOS
+				return (pos <= stream.size()) ? (int)pos : -1;
+		}
+		return -1;
+	}
+
+	// Joins the compressed stripes into one frame: the headers of the first stripe with the height of the
+	// frame, followed by the entropy-coded data of every stripe, with an RSTn marker between stripes.
+	void joinStripes(StripePlan &plan, std::vector<unsigned char> &frame) {
+		for (int stripe = 0; stripe < plan.stripe_count; stripe++) {
+			const std::vector<unsigned char> &output = plan.output[stripe];
+
+			int begin = findScanData(output);
+			int end = (int)output.size() - 2;
+			if (begin < 0 || end < begin || output[end] != 0xff || output[end + 1] != 0xd9)
+				throw gcnew DicomCodecException("Unable to compress JPEG: invalid stripe");
+
+			if (stripe == 0) {
+				frame.insert(frame.end(), output.begin(), output.begin() + begin);
+
+				std::vector<unsigned char> header(output.begin(), output.begin() + begin);
+				int heightOffset = findFrameHeight(header);
+				if (heightOffset < 0)
+					throw gcnew DicomCodecException("Unable to compress JPEG: invalid stripe");
+				frame[heightOffset] = (unsigned char)(plan.image_height >> 8);
+				frame[heightOffset + 1] = (unsigned char)plan.image_height;
+			}
+			else {
+				frame.push_back(0xff);
+				frame.push_back((unsigned char)(0xd0 + (stripe - 1) % 8));
+			}
+
+			frame.insert(frame.end(), output.begin() + begin, output.begin() + end);
+		}
+
+		frame.push_back(0xff);
+		frame.push_back(0xd9);
+	}
+
+	ref class StripeEncoder {
+	public:
+		StripeEncoder(StripePlan *plan, DcmPixelData^ pixelData, DcmJpegParameters^ params, JpegMode mode, int predictor, int pointTransform) {
+			_plan = plan;
+			_pixelData = pixelData;
+			_params = params;
+			_mode = mode;
+			_predictor = predictor;
+			_pointTransform = pointTransform;
+		}
+
+		// First pass: counts the Huffman symbols of a stripe. The compressed data is discarded.
+		void Gather(int stripe) {
+			jpeg_compress_struct &cinfo = ((CompressContext *)JPEGCODEC::GetCompressContext()->Pointer)->cinfo;
+			std::vector<unsigned char> output;
+			MemoryDestinationStruct dest;
+			initMemoryDestination(&dest, &output);
+			beginMemoryAccounting((j_common_ptr)&cinfo, _params);
+
+			try {
+				setupStripe(&cinfo, &dest, stripe);
+				cinfo.optimize_coding = TRUE;
+				collectStripeCounts(&cinfo, *_plan, stripe);
+
+				// the symbols are counted as the rows are written; stop before the output pass
+				jpeg_start_compress(&cinfo, TRUE);
+				writeStripe(&cinfo, *_plan, stripe);
+			}
+			finally {
+				releaseStripe(&cinfo);
+			}
+		}
+
+		// Second pass: compresses a stripe with the Huffman tables of the frame.
+		void Encode(int stripe) {
+			jpeg_compress_struct &cinfo = ((CompressContext *)JPEGCODEC::GetCompressContext()->Pointer)->cinfo;
+			MemoryDestinationStruct dest;
+			initMemoryDestination(&dest, &_plan->output[stripe]);
+			beginMemoryAccounting((j_common_ptr)&cinfo, _params);
+
+			try {
+				setupStripe(&cinfo, &dest, stripe);
+				cinfo.restart_interval = _plan->restart_interval;
+				installHuffmanTables(&cinfo, _plan->tables);
+
+				jpeg_start_compress(&cinfo, TRUE);
+				writeStripe(&cinfo, *_plan, stripe);
+				jpeg_finish_compress(&cinfo);
+			}
+			finally {
+				releaseStripe(&cinfo);
+			}
+		}
+
+		// Compresses all stripes of the plan; the calling thread's compressor must not be in use.
+		static void Run(StripePlan &plan, j_compress_ptr cinfo, DcmPixelData^ pixelData, DcmJpegParameters^ params, JpegMode mode, int predictor, int pointTransform) {
+			StripeEncoder^ encoder = gcnew StripeEncoder(&plan, pixelData, params, mode, predictor, pointTransform);
+			if (!plan.have_tables) {
+				runParallel(plan.stripe_count, plan.workers, gcnew Action<int>(encoder, &StripeEncoder::Gather));
+				buildStripeTables(cinfo, plan);
+			}
+			runParallel(plan.stripe_count, plan.workers, gcnew Action<int>(encoder, &StripeEncoder::Encode));
+		}
+
+	private:
+		void setupStripe(j_compress_ptr cinfo, MemoryDestinationStruct *dest, int stripe) {
+			cinfo->client_data = dest;
+			cinfo->dest = &dest->pub;
+
+			setupCompress(cinfo, _pixelData, _params, _mode, _predictor, _pointTransform);
+			cinfo->image_height = Math::Min(_plan->stripe_height, _plan->image_height - stripe * _plan->stripe_height);
+		}
+
+		void releaseStripe(j_compress_ptr cinfo) {
+			jpeg_abort_compress(cinfo);
+			releaseHuffmanCounts(cinfo);
+			cinfo->client_data = NULL;
+			cinfo->dest = NULL;
+			endMemoryAccounting((j_common_ptr)cinfo, _params);
 		}
 
-		jpeg_start_compress(&cinfo, TRUE);
+		StripePlan *_plan;
+		DcmPixelData^ _pixelData;
+		DcmJpegParameters^ _params;
+		JpegMode _mode;
+		int _predictor;
+		int _pointTransform;
+	};
+}
+
+void JPEGCODEC::Encode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, int frame) {
+	newPixelData->AddFrame(EncodeFrame(GetEncoderFrameData(oldPixelData, frame), oldPixelData, newPixelData, params));
+}
+
+List<ByteBuffer^>^ JPEGCODEC::EncodeFrame(array<unsigned char>^ frameData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params) {
+	if ((oldPixelData->PhotometricInterpretation == "YBR_ICT") ||
+		(oldPixelData->PhotometricInterpretation == "YBR_RCT"))
+		throw gcnew DicomCodecException(String::Format("Photometric Interpretation '{0}' not supported by JPEG encoder!",
+														oldPixelData->PhotometricInterpretation));
+
+	// the compressor takes interleaved pixels
+	if (oldPixelData->IsPlanar && oldPixelData->SamplesPerPixel > 1) {
+		newPixelData->PlanarConfiguration = 0;
+		frameData = ChangePlanarConfiguration(frameData, oldPixelData, 1);
+	}
+
+	pin_ptr<unsigned char> framePin = &frameData[0];
+	unsigned char* framePtr = framePin;
+	unsigned int frameSize = frameData->Length;
+
+	// Compressed data is written straight into fragment sized buffers. Each fragment starts with a few
+	// blocks and the destination manager doubles it as needed, so small outputs do not pay for a buffer
+	// sized after the uncompressed frame.
+	IJGVERS::DestinationManagerStruct dest;
+	dest.pub.init_destination = IJGVERS::initDestination;
+	dest.pub.empty_output_buffer = IJGVERS::emptyOutputBuffer;
+	dest.pub.term_destination = IJGVERS::termDestination;
+	dest.buffer_handle = NULL;
+	dest.fragment_size = Math::Max(2, (int)Math::Min(newPixelData->FragmentSize, (unsigned int)Int32::MaxValue) & ~1);
+	dest.initial_size = Math::Min(4 * IJGE_BLOCKSIZE, dest.fragment_size);
+
+	try {
+		struct jpeg_compress_struct &cinfo = ((IJGVERS::CompressContext *)GetCompressContext()->Pointer)->cinfo;
+		IJGVERS::beginMemoryAccounting((j_common_ptr)&cinfo, params);
+
+		IJGVERS::setupCompress(&cinfo, oldPixelData, params, Mode, Predictor, PointTransform);
+		J_COLOR_SPACE jpegColorSpace = cinfo.jpeg_color_space;
 
-		JSAMPROW row_pointer[1];
 		int row_stride = oldPixelData->ImageWidth * oldPixelData->SamplesPerPixel * (oldPixelData->BitsStored <= 8 ? 1 : oldPixelData->BytesAllocated);
 
-		while (cinfo.next_scanline < cinfo.image_height) {
-			row_pointer[0] = (JSAMPLE *)(&framePtr[cinfo.next_scanline * row_stride]);
-			jpeg_write_scanlines(&cinfo, row_pointer, 1);
+		int workers = params->MaxStripeParallelism;
+		if (workers < 1)
+			workers = Environment::ProcessorCount;
+
+		// stripes and cached tables only apply to Huffman coded frames of one scan
+		bool singleScan = (Mode == JpegMode::Baseline || Mode == JpegMode::Sequential || Mode == JpegMode::Lossless) && !cinfo.arith_code;
+
+		// Huffman tables shared with earlier frames of the same kind; without them the symbol counts of this
+		// frame are kept to build them
+		JpegHuffmanTableCache^ cache = singleScan ? params->HuffmanTables : nullptr;
+		String^ cacheKey = nullptr;
+		JpegHuffmanTableCache::Entry^ cached = nullptr;
+		IJGVERS::HuffmanTableSet cachedTables;
+		std::vector<long> counts;
+		size_t compressedSize = 0;
+		if (cache != nullptr) {
+			cacheKey = IJGVERS::huffmanCacheKey(&cinfo, oldPixelData, params, Mode, Predictor, PointTransform);
+			cached = cache->Find(cacheKey);
+			if (cached != nullptr && !IJGVERS::loadHuffmanTables(cached, cachedTables))
+				cached = nullptr;
+		}
+
+		IJGVERS::StripePlan plan;
+		if (singleScan && IJGVERS::planStripes(&cinfo, workers, plan)) {
+			plan.frame = framePtr;
+			plan.row_stride = row_stride;
+			if (cached != nullptr) {
+				plan.tables = cachedTables;
+				plan.have_tables = true;
+			}
+
+			// this thread compresses stripes too, with the same compressor, and counts their memory separately
+			IJGVERS::endMemoryAccounting((j_common_ptr)&cinfo, params);
+			IJGVERS::StripeEncoder::Run(plan, &cinfo, oldPixelData, params, Mode, Predictor, PointTransform);
+			if (cache != nullptr && cached == nullptr)
+				counts = plan.totals;
+
+			std::vector<unsigned char> joined;
+			IJGVERS::joinStripes(plan, joined);
+			compressedSize = joined.size();
+
+			// split the frame into fragments; fragments must have an even length
+			if ((joined.size() % 2) != 0)
+				joined.push_back(0);
+			dest.fragments = gcnew List<ByteBuffer^>();
+			for (size_t offset = 0; offset < joined.size(); offset += dest.fragment_size) {
+				int size = (int)Math::Min((size_t)dest.fragment_size, joined.size() - offset);
+				array<unsigned char>^ fragment = gcnew array<unsigned char>(size);
+				Marshal::Copy(IntPtr(&joined[offset]), fragment, 0, size);
+				dest.fragments->Add(gcnew ByteBuffer(fragment));
+			}
+		}
+		else {
+			// Specify destination manager
+			cinfo.client_data = &dest;
+			cinfo.dest = &dest.pub;
+
+			if (cached != nullptr)
+				IJGVERS::installHuffmanTables(&cinfo, cachedTables);
+			else if (cache != nullptr) {
+				counts.assign(2 * NUM_HUFF_TBLS * 257, 0);
+				IJGVERS::collectHuffmanCounts(&cinfo, &counts[0]);
+			}
+
+			jpeg_start_compress(&cinfo, TRUE);
+
+			JSAMPROW row_pointer[1];
+
+			while (cinfo.next_scanline < cinfo.image_height) {
+				row_pointer[0] = (JSAMPLE *)(&framePtr[cinfo.next_scanline * row_stride]);
+				jpeg_write_scanlines(&cinfo, row_pointer, 1);
+			}
+
+			jpeg_finish_compress(&cinfo);
+
+			List<ByteBuffer^>^ fragments = dest.fragments;
+			for (int i = 0; i < fragments->Count; i++)
+				compressedSize += fragments[i]->Length;
 		}
 
-		jpeg_finish_compress(&cinfo);
-		jpeg_destroy_compress(&cinfo);
+		if (cache != nullptr)
+			IJGVERS::updateHuffmanCache(&cinfo, cache, cacheKey, cached, counts, (double)compressedSize / frameSize);
 
-		if (oldPixelData->PhotometricInterpretation == "RGB" && cinfo.jpeg_color_space == JCS_YCbCr) {
+		if (oldPixelData->PhotometricInterpretation == "RGB" && jpegColorSpace == JCS_YCbCr) {
 			if (params->SampleFactor == JpegSampleFactor::SF422)
 				newPixelData->PhotometricInterpretation = "YBR_FULL_422";
 			else
 				newPixelData->PhotometricInterpretation = "YBR_FULL";
 		}
 
-		newPixelData->AddFrame(MemoryBuffer->ToArray());
+		return dest.fragments;
 	} finally {
-		MemoryBuffer = nullptr;
+		// release the image pool; the permanent pool, with the quantization and Huffman tables, is kept
+		if (_compressContext != nullptr) {
+			struct jpeg_compress_struct &cinfo = ((IJGVERS::CompressContext *)_compressContext->Pointer)->cinfo;
+			jpeg_abort_compress(&cinfo);
+			IJGVERS::releaseHuffmanCounts(&cinfo);
+			cinfo.client_data = NULL;
+			cinfo.dest = NULL;
+			IJGVERS::endMemoryAccounting((j_common_ptr)&cinfo, params);
+		}
+		IJGVERS::unpinFragment(&dest);
 	}
 }
 
@@ -354,11 +1023,17 @@ namespace IJGVERS {
 		// number of bytes to skip at start of buffer
 		long skip_bytes;
 
-		// buffer from which reading will continue as soon as the current buffer is empty
-		unsigned char *next_buffer;
+		// fragments of the compressed frame, read in sequence as each one is exhausted
+		unsigned char **fragments;
+
+		// fragment sizes
+		unsigned int *fragment_sizes;
 
-		// buffer size
-		unsigned int *next_buffer_size;
+		// number of fragments
+		int fragment_count;
+
+		// index of the fragment from which reading will continue as soon as the current buffer is empty
+		int next_fragment;
 	};
 
 	void initSource(j_decompress_ptr /* cinfo */) {
@@ -367,22 +1042,21 @@ namespace IJGVERS {
 	ijg_boolean fillInputBuffer(j_decompress_ptr cinfo) {
 		SourceManagerStruct *src = (SourceManagerStruct *)(cinfo->src);
 
-		// if we already have the next buffer, switch buffers
-		if (src->next_buffer) {
-			src->pub.next_input_byte    = src->next_buffer;
-			src->pub.bytes_in_buffer    = (unsigned int) src->next_buffer_size;
-			src->next_buffer            = NULL;
-			src->next_buffer_size       = 0;
+		// switch to the next fragment, if there is one
+		while (src->next_fragment < src->fragment_count) {
+			src->pub.next_input_byte    = src->fragments[src->next_fragment];
+			src->pub.bytes_in_buffer    = src->fragment_sizes[src->next_fragment];
+			src->next_fragment++;
 
-			// The suspension was caused by IJG16skipInputData iff src->skip_bytes > 0.
-			// In this case we must skip the remaining number of bytes here.
+			// The suspension was caused by skipInputData iff src->skip_bytes > 0.
+			// In this case we must skip the remaining number of bytes here,
+			// which may span several fragments.
 			if (src->skip_bytes > 0) {
-				if (src->pub.bytes_in_buffer < (unsigned long) src->skip_bytes) {
-					src->skip_bytes            -= src->pub.bytes_in_buffer;
+				if (src->pub.bytes_in_buffer <= (unsigned long) src->skip_bytes) {
+					src->skip_bytes            -= (long) src->pub.bytes_in_buffer;
 					src->pub.next_input_byte   += src->pub.bytes_in_buffer;
 					src->pub.bytes_in_buffer    = 0;
-					// cause a suspension return
-					return FALSE;
+					continue;
 				}
 				else {
 					src->pub.bytes_in_buffer   -= (unsigned int) src->skip_bytes;
@@ -390,7 +1064,9 @@ namespace IJGVERS {
 					src->skip_bytes             = 0;
 				}
 			}
-			return TRUE;
+
+			if (src->pub.bytes_in_buffer > 0)
+				return TRUE;
 		}
 
 		// otherwise cause a suspension return
@@ -414,128 +1090,1288 @@ namespace IJGVERS {
 
 	void termSource(j_decompress_ptr /* cinfo */) {
 	}
-}
 
-void JPEGCODEC::Decode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, int frame) {
-	array<unsigned char>^ jpegData = oldPixelData->GetFrameDataU8(frame);
-	pin_ptr<unsigned char> jpegPin = &jpegData[0];
-	unsigned char* jpegPtr = jpegPin;
-	unsigned int jpegSize = jpegData->Length;
-	
-	jpeg_decompress_struct dinfo;
-	memset(&dinfo, 0, sizeof(dinfo));
+	void initSourceManager(SourceManagerStruct *src, unsigned char **fragments, unsigned int *sizes, int count) {
+		memset(src, 0, sizeof(SourceManagerStruct));
+		src->pub.init_source       = initSource;
+		src->pub.fill_input_buffer = fillInputBuffer;
+		src->pub.skip_input_data   = skipInputData;
+		src->pub.resync_to_restart = jpeg_resync_to_restart;
+		src->pub.term_source       = termSource;
+		src->pub.bytes_in_buffer   = 0;
+		src->pub.next_input_byte   = NULL;
+		src->skip_bytes            = 0;
+		src->fragments             = fragments;
+		src->fragment_sizes        = sizes;
+		src->fragment_count        = count;
+		src->next_fragment         = 0;
+	}
 
-	IJGVERS::SourceManagerStruct src;
-	memset(&src, 0, sizeof(IJGVERS::SourceManagerStruct));
-	src.pub.init_source       = IJGVERS::initSource;
-	src.pub.fill_input_buffer = IJGVERS::fillInputBuffer;
-	src.pub.skip_input_data   = IJGVERS::skipInputData;
-	src.pub.resync_to_restart = jpeg_resync_to_restart;
-	src.pub.term_source       = IJGVERS::termSource;
-	src.pub.bytes_in_buffer   = 0;
-	src.pub.next_input_byte   = NULL;
-	src.skip_bytes            = 0;
-	src.next_buffer           = jpegPin;
-	src.next_buffer_size      = (unsigned int*)jpegSize;
-
-    IJGVERS::ErrorStruct jerr;
-	memset(&jerr, 0, sizeof(IJGVERS::ErrorStruct));
-	dinfo.err = jpeg_std_error(&jerr.pub);
-	jerr.pub.error_exit = IJGVERS::ErrorExit;
-	jerr.pub.output_message = IJGVERS::OutputMessage;
-
-	jpeg_create_decompress(&dinfo);
-	dinfo.src = (jpeg_source_mgr*)&src.pub;
+	void initSourceManager(SourceManagerStruct *src, PinnedFragments^ fragments) {
+		initSourceManager(src, fragments->Data, fragments->Sizes, fragments->Count);
+	}
 
-	if (jpeg_read_header(&dinfo, TRUE) == JPEG_SUSPENDED)
-		throw gcnew DicomCodecException("Unable to decompress JPEG: Suspended");
-		
-	if (newPixelData->PhotometricInterpretation == "YBR_FULL_422" || newPixelData->PhotometricInterpretation == "YBR_PARTIAL_422")
-		newPixelData->PhotometricInterpretation = "YBR_FULL";
-	else
-		newPixelData->PhotometricInterpretation = oldPixelData->PhotometricInterpretation;
-
-	if (params->ConvertColorspaceToRGB && (dinfo.out_color_space == JCS_YCbCr || dinfo.out_color_space == JCS_RGB)) { 
-		if (oldPixelData->IsSigned) 
-			throw gcnew DicomCodecException("JPEG codec unable to perform colorspace conversion on signed pixel data");
-		dinfo.jpeg_color_space = IJGVERS::getJpegColorSpace(oldPixelData->PhotometricInterpretation);
-		dinfo.out_color_space = JCS_RGB;
-		newPixelData->PhotometricInterpretation = "RGB";
-		newPixelData->PlanarConfiguration = 0;
+	// Applies the decoding parameters to a decompressor that has read the frame header.
+	void setupDecompress(j_decompress_ptr dinfo, DcmPixelData^ oldPixelData, DcmJpegParameters^ params) {
+		if (params->ConvertColorspaceToRGB && (dinfo->out_color_space == JCS_YCbCr || dinfo->out_color_space == JCS_RGB)) {
+			if (oldPixelData->IsSigned)
+				throw gcnew DicomCodecException("JPEG codec unable to perform colorspace conversion on signed pixel data");
+			dinfo->jpeg_color_space = getJpegColorSpace(oldPixelData->PhotometricInterpretation);
+			dinfo->out_color_space = JCS_RGB;
+		}
+		else {
+			dinfo->jpeg_color_space = JCS_UNKNOWN;
+			dinfo->out_color_space = JCS_UNKNOWN;
+		}
+
+		dinfo->scale_num = 1;
+		dinfo->scale_denom = (unsigned int)params->Scale;
+		dinfo->dct_method = getJpegDctMethod(params->DctMethod);
+		dinfo->do_fancy_upsampling = params->MergedUpsampling ? FALSE : TRUE;
+
+		jpeg_calc_output_dimensions(dinfo);
 	}
-	else {
-		dinfo.jpeg_color_space = JCS_UNKNOWN; 
-		dinfo.out_color_space = JCS_UNKNOWN;
+
+	// Photometric interpretation of the frames of a decompressor set up by setupDecompress.
+	String^ getOutputPhotometricInterpretation(j_decompress_ptr dinfo, DcmPixelData^ oldPixelData) {
+		if (dinfo->out_color_space == JCS_RGB)
+			return "RGB";
+		if (oldPixelData->PhotometricInterpretation == "YBR_FULL_422" || oldPixelData->PhotometricInterpretation == "YBR_PARTIAL_422")
+			return "YBR_FULL";
+		return oldPixelData->PhotometricInterpretation;
 	}
-	
-	if (newPixelData->PhotometricInterpretation == "YBR_FULL")
-		newPixelData->PlanarConfiguration = 1;
 
-	jpeg_calc_output_dimensions(&dinfo);
-	jpeg_start_decompress(&dinfo);
+	// Planar configuration of the frames of a decompressor set up by setupDecompress. Frame decodes take their
+	// layout from here rather than from newPixelData, which they may share with other threads.
+	bool isOutputPlanar(j_decompress_ptr dinfo, DcmPixelData^ oldPixelData) {
+		if (dinfo->out_color_space == JCS_RGB)
+			return false;
+		if (getOutputPhotometricInterpretation(dinfo, oldPixelData) == "YBR_FULL")
+			return true;
+		return oldPixelData->IsPlanar;
+	}
 
-	int rowSize = dinfo.output_width * dinfo.output_components * sizeof(JSAMPLE);
-	int frameSize = rowSize * dinfo.output_height;
-	if ((frameSize % 2) != 0)
-		frameSize++;
-	array<unsigned char>^ frameBuffer = gcnew array<unsigned char>(frameSize);
-	pin_ptr<unsigned char> framePin = &frameBuffer[0];
-	unsigned char* framePtr = framePin;
+	// Describes the frames of a decompressor set up by setupDecompress in newPixelData.
+	void describeOutput(j_decompress_ptr dinfo, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData) {
+		newPixelData->PhotometricInterpretation = getOutputPhotometricInterpretation(dinfo, oldPixelData);
+		newPixelData->PlanarConfiguration = isOutputPlanar(dinfo, oldPixelData) ? 1 : 0;
+		newPixelData->ImageWidth = (unsigned short)dinfo->output_width;
+		newPixelData->ImageHeight = (unsigned short)dinfo->output_height;
+	}
+
+	// Reads the rows of the current output pass from the next one up to lastRow into the frame, from row firstRow of
+	// the frame on. Planar frames are read through a few rows of scratch space, and split into their planes.
+	void readRows(j_decompress_ptr dinfo, const FrameLayout &layout, JDIMENSION firstRow, JDIMENSION lastRow) {
+		const int components = dinfo->output_components;
+		const int rowSize = dinfo->output_width * components * sizeof(JSAMPLE);
+		const bool planar = layout.planar && components > 1;
+
+		std::vector<unsigned char> scratch;
+		std::vector<JSAMPROW> rows(planar ? dinfo->rec_outbuf_height : lastRow);
+		if (planar) {
+			scratch.resize((size_t)rows.size() * rowSize);
+			for (size_t row = 0; row < rows.size(); row++)
+				rows[row] = (JSAMPROW)&scratch[row * rowSize];
+		}
+		else {
+			for (JDIMENSION row = dinfo->output_scanline; row < lastRow; row++)
+				rows[row] = (JSAMPROW)(layout.data + (firstRow + row) * layout.row_stride);
+		}
+
+		// IJG may return several rows per call, e.g. when upsampling 2h2v chroma
+		while (dinfo->output_scanline < lastRow) {
+			JDIMENSION row = dinfo->output_scanline;
+			JDIMENSION count;
+			if (planar)
+				count = jpeg_read_scanlines(dinfo, &rows[0], Math::Min((JDIMENSION)rows.size(), lastRow - row));
+			else
+				count = jpeg_read_scanlines(dinfo, &rows[row], lastRow - row);
+			if (count == 0)
+				throw gcnew DicomCodecException("Unable to decompress JPEG: Suspended");
 
-	while (dinfo.output_scanline < dinfo.output_height) {
-		int rows = jpeg_read_scanlines(&dinfo, (JSAMPARRAY)&framePtr, dinfo.output_height - dinfo.output_scanline);
-		framePtr += rows * rowSize;
+			if (planar) {
+				for (JDIMENSION i = 0; i < count; i++)
+					storeInterleavedRow(layout, firstRow + row + i, (const unsigned char *)rows[i], dinfo->output_width, components, sizeof(JSAMPLE));
+			}
+		}
 	}
 
-	oldPixelData->Unload();
-	
-	if (newPixelData->IsPlanar)
-		DcmCodecHelper::ChangePlanarConfiguration(frameBuffer, frameSize / newPixelData->BytesAllocated, newPixelData->BitsAllocated, newPixelData->SamplesPerPixel, 0);
+	// position in the fragments of a compressed frame
+	struct StreamPosition {
+		int fragment;
+		unsigned int offset;
+	};
 
-	newPixelData->AddFrame(frameBuffer);
+	// RSTn marker in the entropy-coded data
+	struct RestartMarker {
+		// position of the marker (including any fill bytes in front of it)
+		StreamPosition start;
 
-	jpeg_destroy_decompress(&dinfo);
-}
+		// position of the entropy-coded data that follows the marker
+		StreamPosition end;
+	};
 
-int JPEGCODEC::ScanHeaderForPrecision(DcmPixelData^ pixelData) {
-	array<unsigned char>^ jpegData = pixelData->GetFrameDataU8(0);
-	pin_ptr<unsigned char> jpegPin = &jpegData[0];
-	unsigned char* jpegPtr = jpegPin;
-	unsigned int jpegSize = jpegData->Length;
-	
-	jpeg_decompress_struct dinfo;
-	memset(&dinfo, 0, sizeof(dinfo));
+	// band of MCU rows that starts at a restart marker and is decoded as a frame of its own
+	struct RestartSegment {
+		// first image row of the band
+		JDIMENSION first_row;
 
-	IJGVERS::SourceManagerStruct src;
-	memset(&src, 0, sizeof(IJGVERS::SourceManagerStruct));
-	src.pub.init_source       = IJGVERS::initSource;
-	src.pub.fill_input_buffer = IJGVERS::fillInputBuffer;
-	src.pub.skip_input_data   = IJGVERS::skipInputData;
-	src.pub.resync_to_restart = jpeg_resync_to_restart;
-	src.pub.term_source       = IJGVERS::termSource;
-	src.pub.bytes_in_buffer   = 0;
-	src.pub.next_input_byte   = NULL;
-	src.skip_bytes            = 0;
-	src.next_buffer           = jpegPin;
-	src.next_buffer_size      = (unsigned int*)jpegSize;
-
-    IJGVERS::ErrorStruct jerr;
-	memset(&jerr, 0, sizeof(IJGVERS::ErrorStruct));
-	dinfo.err = jpeg_std_error(&jerr.pub);
-	jerr.pub.error_exit = IJGVERS::ErrorExit;
-	jerr.pub.output_message = IJGVERS::OutputMessage;
-
-	jpeg_create_decompress(&dinfo);
-	dinfo.src = (jpeg_source_mgr*)&src.pub;
+		// frame headers up to and including SOS, with the height of the band in SOF
+		std::vector<unsigned char> header;
 
-	if (jpeg_read_header(&dinfo, TRUE) == JPEG_SUSPENDED) {
-		jpeg_destroy_decompress(&dinfo);
-		throw gcnew DicomCodecException("Unable to read JPEG header: Suspended");
-	}
+		// entropy-coded data of the band, in pieces that do not cross fragment boundaries
+		std::vector<unsigned char*> data;
+		std::vector<unsigned int> sizes;
+	};
 
-	//pixelData->Unload();
+	// decompression parameters that the decoders of the bands of a frame share
+	struct BandParameters {
+		J_COLOR_SPACE jpeg_color_space;
+		J_COLOR_SPACE out_color_space;
+		unsigned int scale_num;
+		unsigned int scale_denom;
+		J_DCT_METHOD dct_method;
+		ijg_boolean do_fancy_upsampling;
+	};
 
-	jpeg_destroy_decompress(&dinfo);
+	// restart segments of a frame and the decompression parameters they share
+	struct RestartPlan {
+		std::vector<RestartSegment> segments;
+		int workers;
+		BandParameters parameters;
+
+		// decoded frame
+		FrameLayout layout;
+		JDIMENSION output_height;
+	};
+
+	// Lists the RSTn markers of the entropy-coded data that starts at begin, and finds the position of the marker
+	// (normally EOI) that ends it. Returns false if the restart markers are not numbered in sequence.
+	bool findRestartMarkers(SourceManagerStruct *src, StreamPosition begin, std::vector<RestartMarker> &markers, StreamPosition &end) {
+		RestartMarker marker;
+		bool prefix = false;
+
+		for (int f = begin.fragment; f < src->fragment_count; f++) {
+			unsigned char *data = src->fragments[f];
+			unsigned int size = src->fragment_sizes[f];
+			unsigned int pos = (f == begin.fragment) ? begin.offset : 0;
+
+			while (pos < size) {
+				if (!prefix) {
+					unsigned char *ff = (unsigned char *)memchr(data + pos, 0xff, size - pos);
+					if (ff == NULL)
+						break;
+					pos = (unsigned int)(ff - data);
+					marker.start.fragment = f;
+					marker.start.offset = pos++;
+					prefix = true;
+					continue;
+				}
+
+				int code = data[pos++];
+				if (code == 0xff) // fill byte
+					continue;
+				prefix = false;
+				if (code == 0x00) // stuffed zero byte
+					continue;
+
+				if (code < 0xd0 || code > 0xd7) {
+					end = marker.start;
+					return true;
+				}
+				if (code - 0xd0 != (int)(markers.size() % 8))
+					return false;
+				marker.end.fragment = f;
+				marker.end.offset = pos;
+				markers.push_back(marker);
+			}
+		}
+
+		end.fragment = src->fragment_count;
+		end.offset = 0;
+		return true;
+	}
+
+	// Appends the pieces of the compressed frame between two positions.
+	void appendRange(SourceManagerStruct *src, StreamPosition from, StreamPosition to, std::vector<unsigned char*> &data, std::vector<unsigned int> &sizes) {
+		for (int f = from.fragment; f <= to.fragment && f < src->fragment_count; f++) {
+			unsigned int start = (f == from.fragment) ? from.offset : 0;
+			unsigned int stop = (f == to.fragment) ? to.offset : src->fragment_sizes[f];
+			if (stop > start) {
+				data.push_back(src->fragments[f] + start);
+				sizes.push_back(stop - start);
+			}
+		}
+	}
+
+	// restart markers of a frame coded in a single sequential scan with restart intervals, and the MCU rows at
+	// which the frame can be cut into restart segments
+	struct RestartIndex {
+		// MCU geometry of the scan, as set up by per_scan_setup (jdinput.c)
+		JDIMENSION mcus_per_row;
+		JDIMENSION mcu_rows;
+		int mcu_height;
+
+		// a segment may start every band_rows MCU rows, where a restart interval and an MCU row start together
+		JDIMENSION band_rows;
+		JDIMENSION bands;
+
+		// entropy-coded data of the frame and the RSTn markers in it
+		StreamPosition begin;
+		StreamPosition end;
+		std::vector<RestartMarker> markers;
+
+		// frame headers up to and including SOS, and the offset of the image height in them
+		std::vector<unsigned char> header;
+		int height_offset;
+	};
+
+	// Indexes the restart markers of a frame. dinfo must have read the frame headers. Returns false if the frame
+	// is not coded in a single sequential scan with restart intervals, if it has fewer than minBands bands, or if
+	// the restart markers are not all present and in sequence. Arithmetic coded frames are not indexed.
+	bool indexRestartMarkers(j_decompress_ptr dinfo, SourceManagerStruct *src, JDIMENSION minBands, RestartIndex &index) {
+		if (dinfo->restart_interval == 0 || dinfo->process == JPROC_PROGRESSIVE || dinfo->arith_code ||
+			dinfo->comps_in_scan != dinfo->num_components)
+			return false;
+
+		if (dinfo->comps_in_scan == 1) {
+			index.mcus_per_row = dinfo->cur_comp_info[0]->width_in_data_units;
+			index.mcu_rows = dinfo->cur_comp_info[0]->height_in_data_units;
+			index.mcu_height = dinfo->data_unit;
+		}
+		else {
+			index.mcu_height = dinfo->max_v_samp_factor * dinfo->data_unit;
+			index.mcus_per_row = (JDIMENSION)jdiv_round_up((long)dinfo->image_width, (long)(dinfo->max_h_samp_factor * dinfo->data_unit));
+			index.mcu_rows = (JDIMENSION)jdiv_round_up((long)dinfo->image_height, (long)index.mcu_height);
+		}
+
+		unsigned int a = dinfo->restart_interval, b = index.mcus_per_row;
+		while (b != 0) {
+			unsigned int t = a % b;
+			a = b;
+			b = t;
+		}
+		index.band_rows = dinfo->restart_interval / a;
+		index.bands = (index.mcu_rows + index.band_rows - 1) / index.band_rows;
+		if (index.bands < minBands)
+			return false;
+
+		// the decoder has just read SOS, so the source points at the entropy-coded data
+		index.begin.fragment = src->next_fragment - 1;
+		index.begin.offset = (unsigned int)(src->pub.next_input_byte - src->fragments[index.begin.fragment]);
+
+		if (!findRestartMarkers(src, index.begin, index.markers, index.end))
+			return false;
+		if ((__int64)index.markers.size() != ((__int64)index.mcus_per_row * index.mcu_rows - 1) / dinfo->restart_interval)
+			return false;
+
+		StreamPosition origin = { 0, 0 };
+		std::vector<unsigned char*> headerData;
+		std::vector<unsigned int> headerSizes;
+		appendRange(src, origin, index.begin, headerData, headerSizes);
+
+		index.header.clear();
+		for (size_t i = 0; i < headerData.size(); i++)
+			index.header.insert(index.header.end(), headerData[i], headerData[i] + headerSizes[i]);
+		index.height_offset = findFrameHeight(index.header);
+		return index.height_offset >= 0;
+	}
+
+	// Describes MCU rows firstRow..lastRow-1 of an indexed frame as a restart segment. firstRow must start a band,
+	// and lastRow must start one or be the number of MCU rows.
+	void makeRestartSegment(j_decompress_ptr dinfo, SourceManagerStruct *src, const RestartIndex &index, JDIMENSION firstRow, JDIMENSION lastRow, RestartSegment &segment) {
+		StreamPosition from = (firstRow == 0) ? index.begin : index.markers[(__int64)firstRow * index.mcus_per_row / dinfo->restart_interval - 1].end;
+		StreamPosition to = (lastRow == index.mcu_rows) ? index.end : index.markers[(__int64)lastRow * index.mcus_per_row / dinfo->restart_interval - 1].start;
+		appendRange(src, from, to, segment.data, segment.sizes);
+
+		unsigned int height = Math::Min(dinfo->image_height, lastRow * index.mcu_height) - firstRow * index.mcu_height;
+		segment.first_row = firstRow * index.mcu_height;
+		segment.header = index.header;
+		segment.header[index.height_offset] = (unsigned char)(height >> 8);
+		segment.header[index.height_offset + 1] = (unsigned char)height;
+	}
+
+	// Copies the decompression parameters of dinfo for the decoders of its bands.
+	void getBandParameters(j_decompress_ptr dinfo, BandParameters &parameters) {
+		parameters.jpeg_color_space = dinfo->jpeg_color_space;
+		parameters.out_color_space = dinfo->out_color_space;
+		parameters.scale_num = dinfo->scale_num;
+		parameters.scale_denom = dinfo->scale_denom;
+		parameters.dct_method = dinfo->dct_method;
+		parameters.do_fancy_upsampling = dinfo->do_fancy_upsampling;
+	}
+
+	// Applies the decompression parameters of a frame to the decoder of one of its bands, which has read the
+	// frame headers.
+	void setBandParameters(j_decompress_ptr dinfo, const BandParameters &parameters) {
+		dinfo->jpeg_color_space = parameters.jpeg_color_space;
+		dinfo->out_color_space = parameters.out_color_space;
+		dinfo->scale_num = parameters.scale_num;
+		dinfo->scale_denom = parameters.scale_denom;
+		dinfo->dct_method = parameters.dct_method;
+		dinfo->do_fancy_upsampling = parameters.do_fancy_upsampling;
+	}
+
+	// True if fancy upsampling of a vertically subsampled component reads the neighbouring MCU rows.
+	bool needsContextRows(j_decompress_ptr dinfo) {
+		if (!dinfo->do_fancy_upsampling)
+			return false;
+		for (int ci = 0; ci < dinfo->num_components; ci++) {
+			if (dinfo->comp_info[ci].v_samp_factor != dinfo->max_v_samp_factor)
+				return true;
+		}
+		return false;
+	}
+
+	// Splits a frame that is coded in a single sequential scan with restart intervals into bands of MCU rows that
+	// each start at a restart marker, so that the bands can be decoded independently and concurrently. dinfo must
+	// have read the frame headers. Returns false, leaving the frame to the serial decoder, if there are no such
+	// bands or if the restart markers are not all present and in sequence. Arithmetic coded frames are decoded serially.
+	bool planRestartSegments(j_decompress_ptr dinfo, SourceManagerStruct *src, int workers, RestartPlan &plan) {
+		if (workers < 2 || needsContextRows(dinfo))
+			return false;
+
+		RestartIndex index;
+		if (!indexRestartMarkers(dinfo, src, 2, index))
+			return false;
+
+		int segments = (int)Math::Min((JDIMENSION)workers, index.bands);
+		plan.segments.resize(segments);
+		plan.workers = workers;
+		for (int i = 0; i < segments; i++) {
+			JDIMENSION firstRow = (JDIMENSION)((__int64)index.bands * i / segments) * index.band_rows;
+			JDIMENSION lastRow = (i + 1 < segments) ? (JDIMENSION)((__int64)index.bands * (i + 1) / segments) * index.band_rows : index.mcu_rows;
+			makeRestartSegment(dinfo, src, index, firstRow, lastRow, plan.segments[i]);
+		}
+
+		getBandParameters(dinfo, plan.parameters);
+		return true;
+	}
+
+	// Picks the restart segment of a frame that holds output rows firstRow..firstRow+rowCount-1, with an MCU row
+	// on either side where fancy upsampling reads neighbouring rows, so that the rows above it need not be entropy
+	// decoded. dinfo must have read the frame headers and computed the output dimensions. Returns false if the
+	// segment would start at the top of the frame anyway, or if the frame cannot be split at its restart markers.
+	bool planRestartRegion(j_decompress_ptr dinfo, SourceManagerStruct *src, JDIMENSION firstRow, JDIMENSION rowCount, RestartPlan &plan) {
+		RestartIndex index;
+		if (!indexRestartMarkers(dinfo, src, 2, index))
+			return false;
+
+		const JDIMENSION context = needsContextRows(dinfo) ? 1 : 0;
+		const JDIMENSION outputRowsPerMcuRow = (JDIMENSION)(index.mcu_height * dinfo->min_codec_data_unit / dinfo->data_unit);
+
+		JDIMENSION firstMcuRow = firstRow / outputRowsPerMcuRow;
+		firstMcuRow = (firstMcuRow > context) ? firstMcuRow - context : 0;
+		firstMcuRow -= firstMcuRow % index.band_rows;
+		if (firstMcuRow == 0)
+			return false;
+
+		JDIMENSION lastMcuRow = (firstRow + rowCount + outputRowsPerMcuRow - 1) / outputRowsPerMcuRow + context;
+		lastMcuRow = (lastMcuRow + index.band_rows - 1) / index.band_rows * index.band_rows;
+		lastMcuRow = Math::Min(lastMcuRow, index.mcu_rows);
+
+		plan.segments.resize(1);
+		plan.workers = 1;
+		makeRestartSegment(dinfo, src, index, firstMcuRow, lastMcuRow, plan.segments[0]);
+
+		getBandParameters(dinfo, plan.parameters);
+		return true;
+	}
+
+	// Restart segments other than the first start in the middle of the RSTn sequence. Their markers have been
+	// checked by findRestartMarkers, so any RSTn marker is accepted as the next one.
+	ijg_boolean resyncToAnyRestart(j_decompress_ptr cinfo, int desired) {
+		if (cinfo->unread_marker >= 0xd0 && cinfo->unread_marker <= 0xd7) {
+			cinfo->unread_marker = 0;
+			return TRUE;
+		}
+		return jpeg_resync_to_restart(cinfo, desired);
+	}
+
+	// compressed data of a restart segment, framed as a JPEG stream of its own
+	struct SegmentSource {
+		SourceManagerStruct src;
+		std::vector<unsigned char*> fragments;
+		std::vector<unsigned int> sizes;
+		unsigned char eoi[2];
+	};
+
+	// Starts decompressing a restart segment with the parameters of its plan.
+	void startRestartSegment(j_decompress_ptr dinfo, RestartPlan &plan, RestartSegment &segment, SegmentSource &source) {
+		source.eoi[0] = 0xff;
+		source.eoi[1] = 0xd9;
+		source.fragments.push_back(&segment.header[0]);
+		source.sizes.push_back((unsigned int)segment.header.size());
+		source.fragments.insert(source.fragments.end(), segment.data.begin(), segment.data.end());
+		source.sizes.insert(source.sizes.end(), segment.sizes.begin(), segment.sizes.end());
+		source.fragments.push_back(source.eoi);
+		source.sizes.push_back(2);
+
+		initSourceManager(&source.src, &source.fragments[0], &source.sizes[0], (int)source.fragments.size());
+		source.src.pub.resync_to_restart = resyncToAnyRestart;
+
+		dinfo->src = (jpeg_source_mgr*)&source.src.pub;
+
+		if (jpeg_read_header(dinfo, TRUE) == JPEG_SUSPENDED)
+			throw gcnew DicomCodecException("Unable to decompress JPEG: Suspended");
+
+		setBandParameters(dinfo, plan.parameters);
+
+		jpeg_start_decompress(dinfo);
+	}
+
+	// Decodes one restart segment into its rows of the frame.
+	void decodeRestartSegment(j_decompress_ptr dinfo, RestartPlan &plan, int index) {
+		RestartSegment &segment = plan.segments[index];
+		SegmentSource source;
+
+		try {
+			startRestartSegment(dinfo, plan, segment, source);
+
+			// all bands but the last are a whole number of MCU rows high, and so are scaled exactly
+			JDIMENSION outputRow;
+			if (index == (int)plan.segments.size() - 1)
+				outputRow = plan.output_height - dinfo->output_height;
+			else
+				outputRow = (JDIMENSION)((__int64)segment.first_row * dinfo->output_height / dinfo->image_height);
+
+			readRows(dinfo, plan.layout, outputRow, dinfo->output_height);
+		}
+		finally {
+			jpeg_abort_decompress(dinfo);
+			dinfo->src = NULL;
+		}
+	}
+
+	// Decodes the segments of a restart plan on the thread pool, each with the decompressor of its thread.
+	ref class RestartSegmentDecoder {
+	public:
+		RestartSegmentDecoder(RestartPlan *plan, DcmJpegParameters^ params) {
+			_plan = plan;
+			_params = params;
+		}
+
+		void Decode(int index) {
+			jpeg_decompress_struct &dinfo = ((DecompressContext *)JPEGCODEC::GetDecompressContext()->Pointer)->dinfo;
+			beginMemoryAccounting((j_common_ptr)&dinfo, _params);
+			try {
+				decodeRestartSegment(&dinfo, *_plan, index);
+			}
+			finally {
+				endMemoryAccounting((j_common_ptr)&dinfo, _params);
+			}
+		}
+
+		static void Run(RestartPlan &plan, DcmJpegParameters^ params) {
+			RestartSegmentDecoder^ decoder = gcnew RestartSegmentDecoder(&plan, params);
+			runParallel((int)plan.segments.size(), plan.workers, gcnew Action<int>(decoder, &RestartSegmentDecoder::Decode));
+		}
+
+	private:
+		RestartPlan *_plan;
+		DcmJpegParameters^ _params;
+	};
+
+	// checkpoint of the entropy decoder and the position of its data in the fragments of the frame; a lossless
+	// checkpoint keeps its predictor rows, one after the other, in rows
+	struct RecordedCheckpoint {
+		jpeg_checkpoint state;
+		std::vector<JDIFF> rows;
+		StreamPosition position;
+	};
+
+	// IJG checkpoint recorder that collects the checkpoints of a full decode
+	struct CheckpointRecorderStruct {
+		struct jpeg_checkpoint_mgr pub;
+		SourceManagerStruct *src;
+		std::vector<RecordedCheckpoint> checkpoints;
+	};
+
+	void recordCheckpoint(j_decompress_ptr cinfo, const jpeg_checkpoint *checkpoint) {
+		CheckpointRecorderStruct *recorder = (CheckpointRecorderStruct *)cinfo->checkpoint;
+		SourceManagerStruct *src = recorder->src;
+
+		// called again for a row after a suspension, or between fragments while a marker is skipped
+		if (!recorder->checkpoints.empty() && recorder->checkpoints.back().state.iMCU_row >= checkpoint->iMCU_row)
+			return;
+		if (src->skip_bytes != 0 || src->next_fragment == 0)
+			return;
+
+		recorder->checkpoints.push_back(RecordedCheckpoint());
+		RecordedCheckpoint &recorded = recorder->checkpoints.back();
+		recorded.state = *checkpoint;
+		for (int i = 0; i < checkpoint->num_prev_rows; i++) {
+			recorded.rows.insert(recorded.rows.end(), checkpoint->prev_row[i], checkpoint->prev_row[i] + checkpoint->prev_row_width[i]);
+			recorded.state.prev_row[i] = NULL;
+		}
+		recorded.position.fragment = src->next_fragment - 1;
+		recorded.position.offset = (unsigned int)(src->pub.next_input_byte - src->fragments[recorded.position.fragment]);
+	}
+
+	void initCheckpointRecorder(CheckpointRecorderStruct *recorder, SourceManagerStruct *src, JpegCheckpointIndex^ index) {
+		recorder->pub.record_checkpoint = recordCheckpoint;
+		recorder->pub.interval = (JDIMENSION)index->Interval;
+		recorder->src = src;
+	}
+
+	// Hands the checkpoints of a finished full decode to the index. The state of a checkpoint is its jpeg_checkpoint,
+	// followed by its predictor rows.
+	void storeCheckpoints(const CheckpointRecorderStruct *recorder, JpegCheckpointIndex^ index) {
+		List<JpegCheckpointIndex::Checkpoint^>^ checkpoints = gcnew List<JpegCheckpointIndex::Checkpoint^>((int)recorder->checkpoints.size());
+		for (size_t i = 0; i < recorder->checkpoints.size(); i++) {
+			const RecordedCheckpoint &recorded = recorder->checkpoints[i];
+			const int rowBytes = (int)(recorded.rows.size() * sizeof(JDIFF));
+			array<unsigned char>^ state = gcnew array<unsigned char>(sizeof(jpeg_checkpoint) + rowBytes);
+			Marshal::Copy(IntPtr((void*)&recorded.state), state, 0, sizeof(jpeg_checkpoint));
+			if (rowBytes > 0)
+				Marshal::Copy(IntPtr((void*)&recorded.rows[0]), state, sizeof(jpeg_checkpoint), rowBytes);
+			checkpoints->Add(gcnew JpegCheckpointIndex::Checkpoint((int)recorded.state.iMCU_row,
+				recorded.position.fragment, (int)recorded.position.offset, state));
+		}
+		index->Record(checkpoints);
+	}
+
+	// Unpacks the state of a checkpoint, pointing its predictor rows into rows. Returns false if the state is not
+	// laid out as storeCheckpoints lays it out.
+	bool loadCheckpointState(array<unsigned char>^ state, jpeg_checkpoint &checkpoint, std::vector<JDIFF> &rows) {
+		if (state->Length < (int)sizeof(jpeg_checkpoint))
+			return false;
+		Marshal::Copy(state, 0, IntPtr((void*)&checkpoint), sizeof(jpeg_checkpoint));
+		if (checkpoint.num_prev_rows < 0 || checkpoint.num_prev_rows > MAX_COMPS_IN_SCAN)
+			return false;
+
+		unsigned __int64 samples = 0;
+		for (int i = 0; i < checkpoint.num_prev_rows; i++)
+			samples += checkpoint.prev_row_width[i];
+		if ((unsigned __int64)state->Length != sizeof(jpeg_checkpoint) + samples * sizeof(JDIFF))
+			return false;
+
+		rows.resize((size_t)samples);
+		if (samples > 0)
+			Marshal::Copy(state, sizeof(jpeg_checkpoint), IntPtr((void*)&rows[0]), (int)(samples * sizeof(JDIFF)));
+		size_t offset = 0;
+		for (int i = 0; i < checkpoint.num_prev_rows; i++) {
+			checkpoint.prev_row[i] = &rows[offset];
+			offset += checkpoint.prev_row_width[i];
+		}
+		return true;
+	}
+
+	// True if decoding of a frame can resume at checkpoints: it is coded in a single sequential or lossless scan
+	// without restart markers. dinfo must have read the frame headers.
+	bool canResumeAtCheckpoints(j_decompress_ptr dinfo) {
+		return (dinfo->process == JPROC_SEQUENTIAL || dinfo->process == JPROC_LOSSLESS) &&
+			dinfo->restart_interval == 0 && dinfo->comps_in_scan == dinfo->num_components;
+	}
+
+	// Last checkpoint of the index that lets output rows firstRow on be decoded exactly, or null if there is none
+	// and decoding has to start at the top of the frame. dinfo must have read the frame headers.
+	JpegCheckpointIndex::Checkpoint^ findCheckpoint(j_decompress_ptr dinfo, JpegCheckpointIndex^ index, JDIMENSION firstRow) {
+		if (index == nullptr || !canResumeAtCheckpoints(dinfo))
+			return nullptr;
+
+		// fancy upsampling reads the last rows of the iMCU row above
+		int row = (int)(firstRow / (JDIMENSION)(dinfo->max_v_samp_factor * dinfo->min_codec_data_unit));
+		if (needsContextRows(dinfo))
+			row--;
+		return (row > 0) ? index->Find(row) : nullptr;
+	}
+
+	// Unpacks the state of a checkpoint into state and rows. Returns false if the checkpoint does not fit the frame
+	// of src, as the checkpoints of another frame, or of an earlier content of the fragments, may not.
+	bool loadCheckpoint(j_decompress_ptr dinfo, SourceManagerStruct *src, JpegCheckpointIndex::Checkpoint^ checkpoint,
+		jpeg_checkpoint &state, std::vector<JDIFF> &rows) {
+		if (checkpoint->Fragment < 0 || checkpoint->Fragment >= src->fragment_count ||
+			checkpoint->Offset < 0 || (unsigned int)checkpoint->Offset > src->fragment_sizes[checkpoint->Fragment])
+			return false;
+		if (!loadCheckpointState(checkpoint->State, state, rows))
+			return false;
+		return state.iMCU_row == (JDIMENSION)checkpoint->Row && state.iMCU_row < dinfo->total_iMCU_rows &&
+			(state.num_prev_rows > 0) == (dinfo->process == JPROC_LOSSLESS);
+	}
+
+	// Resumes entropy decoding at the checkpoint findCheckpoint finds for output rows firstRow on. dinfo must have
+	// started decompressing. The predictor rows of a lossless checkpoint are kept in rows, which must outlive the
+	// decode. Returns false if there is no such checkpoint, and throws if it does not fit the frame.
+	bool resumeAtCheckpoint(j_decompress_ptr dinfo, SourceManagerStruct *src, JpegCheckpointIndex^ index, JDIMENSION firstRow, std::vector<JDIFF> &rows) {
+		JpegCheckpointIndex::Checkpoint^ checkpoint = findCheckpoint(dinfo, index, firstRow);
+		if (checkpoint == nullptr)
+			return false;
+
+		jpeg_checkpoint state;
+		if (!loadCheckpoint(dinfo, src, checkpoint, state, rows))
+			throw gcnew DicomCodecException("Unable to decompress JPEG: Checkpoint does not fit the frame");
+		jpeg_resume_checkpoint(dinfo, &state);
+
+		src->next_fragment = checkpoint->Fragment + 1;
+		src->pub.next_input_byte = src->fragments[checkpoint->Fragment] + checkpoint->Offset;
+		src->pub.bytes_in_buffer = src->fragment_sizes[checkpoint->Fragment] - checkpoint->Offset;
+		src->skip_bytes = 0;
+		return true;
+	}
+
+	// bands of output rows of a frame that start at its checkpoints, and the decompression parameters they share
+	struct CheckpointPlan {
+		// first output row of each band, followed by the output height
+		std::vector<JDIMENSION> rows;
+		int workers;
+		BandParameters parameters;
+
+		// decoded frame
+		FrameLayout layout;
+	};
+
+	// Splits a frame whose checkpoints have been recorded into bands of output rows that start at checkpoints, so
+	// that the bands can be decoded concurrently, each resuming at the checkpoint above it. dinfo must have read
+	// the frame headers from src and computed the output dimensions. Returns false, leaving the frame to the serial
+	// decoder, if it has no checkpoints to resume at, or if one of the bands could not resume at its checkpoint.
+	bool planCheckpointBands(j_decompress_ptr dinfo, SourceManagerStruct *src, JpegCheckpointIndex^ index, int workers, CheckpointPlan &plan) {
+		if (workers < 2 || index == nullptr || !canResumeAtCheckpoints(dinfo))
+			return false;
+
+		array<int>^ checkpoints = index->GetRows();
+		if (checkpoints->Length == 0)
+			return false;
+
+		// the bands split the intervals between checkpoints as evenly as they can
+		const int bands = Math::Min(workers, checkpoints->Length + 1);
+		const JDIMENSION rowsPerIMCURow = (JDIMENSION)(dinfo->max_v_samp_factor * dinfo->min_codec_data_unit);
+		plan.rows.push_back(0);
+		for (int i = 1; i < bands; i++) {
+			int checkpoint = (int)((__int64)(checkpoints->Length + 1) * i / bands) - 1;
+			plan.rows.push_back((JDIMENSION)checkpoints[checkpoint] * rowsPerIMCURow);
+		}
+		plan.rows.push_back(dinfo->output_height);
+		plan.workers = workers;
+
+		// the checkpoints of a stale index may lie outside the frame, or its data
+		for (int band = 1; band < bands; band++) {
+			JpegCheckpointIndex::Checkpoint^ checkpoint = findCheckpoint(dinfo, index, plan.rows[band]);
+			jpeg_checkpoint state;
+			std::vector<JDIFF> rows;
+			if (plan.rows[band] <= plan.rows[band - 1] || plan.rows[band] >= dinfo->output_height ||
+				(checkpoint != nullptr && !loadCheckpoint(dinfo, src, checkpoint, state, rows))) {
+				plan.rows.clear();
+				return false;
+			}
+		}
+
+		getBandParameters(dinfo, plan.parameters);
+		return true;
+	}
+
+	// Decodes one band of a checkpoint plan into its rows of the frame. Where fancy upsampling needs the rows
+	// above the band, decoding resumes a checkpoint earlier, or starts at the top of the frame above the first one.
+	void decodeCheckpointBand(j_decompress_ptr dinfo, PinnedFragments^ jpegData, JpegCheckpointIndex^ index, CheckpointPlan &plan, int band) {
+		SourceManagerStruct src;
+		initSourceManager(&src, jpegData);
+		dinfo->src = (jpeg_source_mgr*)&src.pub;
+
+		try {
+			if (jpeg_read_header(dinfo, TRUE) == JPEG_SUSPENDED)
+				throw gcnew DicomCodecException("Unable to decompress JPEG: Suspended");
+			setBandParameters(dinfo, plan.parameters);
+
+			const JDIMENSION firstRow = plan.rows[band];
+			std::vector<JDIFF> rows;
+			jpeg_start_decompress(dinfo);
+			if (firstRow > 0)
+				resumeAtCheckpoint(dinfo, &src, index, firstRow, rows);
+			if (jpeg_skip_scanlines(dinfo, firstRow) != firstRow)
+				throw gcnew DicomCodecException("Unable to decompress JPEG: Suspended");
+
+			readRows(dinfo, plan.layout, 0, plan.rows[band + 1]);
+		}
+		finally {
+			jpeg_abort_decompress(dinfo);
+			dinfo->src = NULL;
+		}
+	}
+
+	// Decodes the bands of a checkpoint plan on the thread pool, each with the decompressor of its thread.
+	ref class CheckpointBandDecoder {
+	public:
+		CheckpointBandDecoder(CheckpointPlan *plan, PinnedFragments^ jpegData, JpegCheckpointIndex^ index, DcmJpegParameters^ params) {
+			_plan = plan;
+			_jpegData = jpegData;
+			_index = index;
+			_params = params;
+		}
+
+		void Decode(int band) {
+			jpeg_decompress_struct &dinfo = ((DecompressContext *)JPEGCODEC::GetDecompressContext()->Pointer)->dinfo;
+			beginMemoryAccounting((j_common_ptr)&dinfo, _params);
+			try {
+				decodeCheckpointBand(&dinfo, _jpegData, _index, *_plan, band);
+			}
+			finally {
+				endMemoryAccounting((j_common_ptr)&dinfo, _params);
+			}
+		}
+
+		static void Run(CheckpointPlan &plan, PinnedFragments^ jpegData, JpegCheckpointIndex^ index, DcmJpegParameters^ params) {
+			CheckpointBandDecoder^ decoder = gcnew CheckpointBandDecoder(&plan, jpegData, index, params);
+			runParallel((int)plan.rows.size() - 1, plan.workers, gcnew Action<int>(decoder, &CheckpointBandDecoder::Decode));
+		}
+
+	private:
+		CheckpointPlan *_plan;
+		PinnedFragments^ _jpegData;
+		JpegCheckpointIndex^ _index;
+		DcmJpegParameters^ _params;
+	};
+
+	// Decodes a frame into destination, or into a new packed array if allocate is set.
+	// A frame that is decoded serially records checkpoints into checkpoints, unless it is null or recorded already.
+	// Once they are recorded, the frame is decoded in bands that start at them, like a frame with restart markers.
+	array<unsigned char>^ decodeFrame(j_decompress_ptr dinfo, PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmJpegParameters^ params,
+		FrameBuffer destination, bool allocate, JpegCheckpointIndex^ checkpoints) {
+		SourceManagerStruct src;
+		initSourceManager(&src, jpegData);
+
+		dinfo->src = (jpeg_source_mgr*)&src.pub;
+		beginMemoryAccounting((j_common_ptr)dinfo, params);
+
+		try {
+			if (jpeg_read_header(dinfo, TRUE) == JPEG_SUSPENDED)
+				throw gcnew DicomCodecException("Unable to decompress JPEG: Suspended");
+
+			setupDecompress(dinfo, oldPixelData, params);
+
+			array<unsigned char>^ frameBuffer = nullptr;
+			pin_ptr<unsigned char> framePin = nullptr;
+			if (allocate) {
+				int frameSize = dinfo->output_width * dinfo->output_components * sizeof(JSAMPLE) * dinfo->output_height;
+				if ((frameSize % 2) != 0)
+					frameSize++;
+				frameBuffer = gcnew array<unsigned char>(frameSize);
+				framePin = &frameBuffer[0];
+				destination = FrameBuffer::Packed(IntPtr((unsigned char*)framePin), frameSize, dinfo->output_width, dinfo->output_height,
+					dinfo->output_components, (int)sizeof(JSAMPLE), isOutputPlanar(dinfo, oldPixelData));
+			}
+			FrameLayout layout = destination.GetLayout(dinfo->output_width, dinfo->output_height, dinfo->output_components, (int)sizeof(JSAMPLE));
+
+			int workers = params->MaxRestartParallelism;
+			if (workers < 1)
+				workers = Environment::ProcessorCount;
+
+			RestartPlan plan;
+			CheckpointPlan bands;
+			if (planRestartSegments(dinfo, &src, workers, plan)) {
+				plan.layout = layout;
+				plan.output_height = dinfo->output_height;
+
+				// this thread decodes segments too, with the same decompressor, and counts their memory separately
+				jpeg_abort_decompress(dinfo);
+				endMemoryAccounting((j_common_ptr)dinfo, params);
+				RestartSegmentDecoder::Run(plan, params);
+			}
+			else if (planCheckpointBands(dinfo, &src, checkpoints, workers, bands)) {
+				bands.layout = layout;
+
+				// as with restart segments, this thread decodes bands with the same decompressor
+				jpeg_abort_decompress(dinfo);
+				endMemoryAccounting((j_common_ptr)dinfo, params);
+				CheckpointBandDecoder::Run(bands, jpegData, checkpoints, params);
+			}
+			else {
+				CheckpointRecorderStruct recorder;
+				bool record = checkpoints != nullptr && !checkpoints->IsRecorded;
+				if (record) {
+					initCheckpointRecorder(&recorder, &src, checkpoints);
+					dinfo->checkpoint = &recorder.pub;
+				}
+
+				jpeg_start_decompress(dinfo);
+				readRows(dinfo, layout, 0, dinfo->output_height);
+
+				if (record)
+					storeCheckpoints(&recorder, checkpoints);
+			}
+
+			return frameBuffer;
+		}
+		finally {
+			// release the image pool and get ready for the next frame
+			jpeg_abort_decompress(dinfo);
+			dinfo->src = NULL;
+			dinfo->checkpoint = NULL;
+			endMemoryAccounting((j_common_ptr)dinfo, params);
+		}
+	}
+
+	// Reads output rows y..y+height-1, columns x..x+width-1, of the current output pass into a frame of the
+	// size of the region. Only the iMCU columns of the region, and one on either side for the upsampler, are
+	// inverse transformed, and the iMCU rows above it are skipped.
+	void readRegion(j_decompress_ptr dinfo, const FrameLayout &layout, JDIMENSION x, JDIMENSION y, JDIMENSION width, JDIMENSION height) {
+		const JDIMENSION align = (JDIMENSION)(dinfo->max_h_samp_factor * dinfo->min_codec_data_unit);
+		JDIMENSION cropX = (x > align) ? x - align : 0;
+		JDIMENSION cropWidth = Math::Min(x + width + align, dinfo->output_width) - cropX;
+		jpeg_crop_scanline(dinfo, &cropX, &cropWidth);
+
+		if (jpeg_skip_scanlines(dinfo, y) != y)
+			throw gcnew DicomCodecException("Unable to decompress JPEG: Suspended");
+
+		const int components = dinfo->output_components;
+		const size_t offset = (size_t)(x - cropX) * components * sizeof(JSAMPLE);
+		const int rowSize = dinfo->output_width * components * sizeof(JSAMPLE);
+
+		std::vector<unsigned char> scratch((size_t)dinfo->rec_outbuf_height * rowSize);
+		std::vector<JSAMPROW> rows(dinfo->rec_outbuf_height);
+		for (size_t row = 0; row < rows.size(); row++)
+			rows[row] = (JSAMPROW)&scratch[row * rowSize];
+
+		while (dinfo->output_scanline < y + height) {
+			JDIMENSION row = dinfo->output_scanline - y;
+			JDIMENSION count = jpeg_read_scanlines(dinfo, &rows[0], Math::Min((JDIMENSION)rows.size(), height - row));
+			if (count == 0)
+				throw gcnew DicomCodecException("Unable to decompress JPEG: Suspended");
+
+			for (JDIMENSION i = 0; i < count; i++)
+				storeInterleavedRow(layout, row + i, (const unsigned char *)rows[i] + offset, width, components, sizeof(JSAMPLE));
+		}
+	}
+
+	// Decodes a region of a frame into a new packed array. If the frame has restart markers, decoding starts at
+	// the last restart interval that begins an MCU row above the region; otherwise at the last checkpoint above it,
+	// if any. A checkpoint that does not fit the frame is an error rather than a reason to decode it all.
+	array<unsigned char>^ decodeRegion(j_decompress_ptr dinfo, PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params,
+		int x, int y, int width, int height, JpegCheckpointIndex^ checkpoints) {
+		SourceManagerStruct src;
+		initSourceManager(&src, jpegData);
+
+		dinfo->src = (jpeg_source_mgr*)&src.pub;
+		beginMemoryAccounting((j_common_ptr)dinfo, params);
+
+		try {
+			if (jpeg_read_header(dinfo, TRUE) == JPEG_SUSPENDED)
+				throw gcnew DicomCodecException("Unable to decompress JPEG: Suspended");
+
+			setupDecompress(dinfo, oldPixelData, params);
+			describeOutput(dinfo, oldPixelData, newPixelData);
+
+			if (x < 0 || y < 0 || width < 1 || height < 1 ||
+				(__int64)x + width > dinfo->output_width || (__int64)y + height > dinfo->output_height)
+				throw gcnew ArgumentOutOfRangeException("region", "Region lies outside of the decoded frame");
+
+			newPixelData->ImageWidth = (unsigned short)width;
+			newPixelData->ImageHeight = (unsigned short)height;
+
+			int frameSize = width * dinfo->output_components * sizeof(JSAMPLE) * height;
+			if ((frameSize % 2) != 0)
+				frameSize++;
+			array<unsigned char>^ frameBuffer = gcnew array<unsigned char>(frameSize);
+			pin_ptr<unsigned char> framePin = &frameBuffer[0];
+			FrameLayout layout = FrameBuffer::Packed(IntPtr((unsigned char*)framePin), frameSize, width, height,
+				dinfo->output_components, (int)sizeof(JSAMPLE), isOutputPlanar(dinfo, oldPixelData)).GetLayout(width, height, dinfo->output_components, (int)sizeof(JSAMPLE));
+
+			RestartPlan plan;
+			if (planRestartRegion(dinfo, &src, (JDIMENSION)y, (JDIMENSION)height, plan)) {
+				JDIMENSION imageHeight = dinfo->image_height;
+				JDIMENSION outputHeight = dinfo->output_height;
+				RestartSegment &segment = plan.segments[0];
+				SegmentSource source;
+
+				jpeg_abort_decompress(dinfo);
+				startRestartSegment(dinfo, plan, segment, source);
+
+				// the band that ends the frame may be scaled to a height that is not a whole number of MCU rows
+				JDIMENSION outputRow;
+				if (segment.first_row + dinfo->image_height == imageHeight)
+					outputRow = outputHeight - dinfo->output_height;
+				else
+					outputRow = (JDIMENSION)((__int64)segment.first_row * outputHeight / imageHeight);
+
+				readRegion(dinfo, layout, (JDIMENSION)x, (JDIMENSION)y - outputRow, (JDIMENSION)width, (JDIMENSION)height);
+			}
+			else {
+				std::vector<JDIFF> rows;
+				jpeg_start_decompress(dinfo);
+				resumeAtCheckpoint(dinfo, &src, checkpoints, (JDIMENSION)y, rows);
+				readRegion(dinfo, layout, (JDIMENSION)x, (JDIMENSION)y, (JDIMENSION)width, (JDIMENSION)height);
+			}
+
+			return frameBuffer;
+		}
+		finally {
+			jpeg_abort_decompress(dinfo);
+			dinfo->src = NULL;
+			endMemoryAccounting((j_common_ptr)dinfo, params);
+		}
+	}
+}
+
+void JPEGCODEC::Decode(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, int frame) {
+	array<unsigned char>^ frameBuffer = nullptr;
+	PinnedFragments^ jpegData = gcnew PinnedFragments(oldPixelData->GetFrameFragments(frame));
+	try {
+		DescribeFrame(jpegData, oldPixelData, newPixelData, params);
+		frameBuffer = DecodeFrame(jpegData, oldPixelData, params,
+			(params->Checkpoints != nullptr) ? params->Checkpoints->GetIndex(oldPixelData, frame) : nullptr);
+	}
+	finally {
+		delete jpegData;
+	}
+
+	oldPixelData->Unload();
+
+	newPixelData->AddFrame(frameBuffer);
+}
+
+JpegContext^ JPEGCODEC::GetCompressContext() {
+	if (_compressContext == nullptr)
+		_compressContext = IJGVERS::createCompressContext();
+	else
+		_compressContext->UpdateMemoryPressure();
+	return _compressContext;
+}
+
+JpegContext^ JPEGCODEC::GetDecompressContext() {
+	if (_decompressContext == nullptr)
+		_decompressContext = IJGVERS::createDecompressContext();
+	else
+		_decompressContext->UpdateMemoryPressure();
+	return _decompressContext;
+}
+
+void JPEGCODEC::DescribeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params) {
+	jpeg_decompress_struct &dinfo = ((IJGVERS::DecompressContext *)GetDecompressContext()->Pointer)->dinfo;
+
+	IJGVERS::SourceManagerStruct src;
+	IJGVERS::initSourceManager(&src, jpegData);
+
+	dinfo.src = (jpeg_source_mgr*)&src.pub;
+
+	try {
+		if (jpeg_read_header(&dinfo, TRUE) == JPEG_SUSPENDED)
+			throw gcnew DicomCodecException("Unable to read JPEG header: Suspended");
+
+		IJGVERS::setupDecompress(&dinfo, oldPixelData, params);
+		IJGVERS::describeOutput(&dinfo, oldPixelData, newPixelData);
+	}
+	finally {
+		jpeg_abort_decompress(&dinfo);
+		dinfo.src = NULL;
+	}
+}
+
+array<unsigned char>^ JPEGCODEC::DecodeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmJpegParameters^ params,
+	JpegCheckpointIndex^ checkpoints) {
+	jpeg_decompress_struct &dinfo = ((IJGVERS::DecompressContext *)GetDecompressContext()->Pointer)->dinfo;
+	return IJGVERS::decodeFrame(&dinfo, jpegData, oldPixelData, params, FrameBuffer(), true, checkpoints);
+}
+
+void JPEGCODEC::DecodeFrame(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmJpegParameters^ params, FrameBuffer destination,
+	JpegCheckpointIndex^ checkpoints) {
+	jpeg_decompress_struct &dinfo = ((IJGVERS::DecompressContext *)GetDecompressContext()->Pointer)->dinfo;
+	IJGVERS::decodeFrame(&dinfo, jpegData, oldPixelData, params, destination, false, checkpoints);
+}
+
+array<unsigned char>^ JPEGCODEC::DecodeRegion(PinnedFragments^ jpegData, DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params,
+	int x, int y, int width, int height, JpegCheckpointIndex^ checkpoints) {
+	jpeg_decompress_struct &dinfo = ((IJGVERS::DecompressContext *)GetDecompressContext()->Pointer)->dinfo;
+	return IJGVERS::decodeRegion(&dinfo, jpegData, oldPixelData, newPixelData, params, x, y, width, height, checkpoints);
+}
+
+int JPEGCODEC::ScanHeaderForPrecision(DcmPixelData^ pixelData) {
+	PinnedFragments^ jpegData = gcnew PinnedFragments(pixelData->GetFrameFragments(0));
+	try {
+		return ScanHeaderForPrecision(jpegData);
+	}
+	finally {
+		delete jpegData;
+	}
+}
+
+int JPEGCODEC::ScanHeaderForPrecision(PinnedFragments^ jpegData) {
+	jpeg_decompress_struct &dinfo = ((IJGVERS::DecompressContext *)GetDecompressContext()->Pointer)->dinfo;
+
+	IJGVERS::SourceManagerStruct src;
+	IJGVERS::initSourceManager(&src, jpegData);
+
+	dinfo.src = (jpeg_source_mgr*)&src.pub;
+
+	try {
+		if (jpeg_read_header(&dinfo, TRUE) == JPEG_SUSPENDED)
+			throw gcnew DicomCodecException("Unable to read JPEG header: Suspended");
+
+		return dinfo.data_precision;
+	}
+	finally {
+		jpeg_abort_decompress(&dinfo);
+		dinfo.src = NULL;
+	}
+}
+
+namespace IJGVERS {
+	// source manager of a progressive decoder, fed with the compressed frame as it arrives
+	struct IncrementalSourceStruct {
+		// the standard IJG source manager object
+		struct jpeg_source_mgr pub;
+
+		// number of bytes still to be skipped when more data arrives
+		long skip_bytes;
+
+		// compressed data received, from the position of the decoder on
+		std::vector<JOCTET> data;
+
+		// set when no more data will arrive
+		bool finished;
+	};
+
+	ijg_boolean fillIncrementalInput(j_decompress_ptr cinfo) {
+		static const JOCTET eoi[2] = { 0xff, JPEG_EOI };
+		IncrementalSourceStruct *src = (IncrementalSourceStruct *)(cinfo->src);
+
+		// suspend until Append brings more data
+		if (!src->finished)
+			return FALSE;
+
+		// the frame was cut short; insert a fake EOI marker, as jdatasrc.c does
+		WARNMS(cinfo, JWRN_JPEG_EOF);
+		src->pub.next_input_byte = eoi;
+		src->pub.bytes_in_buffer = 2;
+		return TRUE;
+	}
+
+	void skipIncrementalInput(j_decompress_ptr cinfo, long num_bytes) {
+		IncrementalSourceStruct *src = (IncrementalSourceStruct *)(cinfo->src);
+
+		if (src->pub.bytes_in_buffer < (size_t)num_bytes) {
+			src->skip_bytes            += num_bytes - (long) src->pub.bytes_in_buffer;
+			src->pub.next_input_byte   += src->pub.bytes_in_buffer;
+			src->pub.bytes_in_buffer    = 0; // causes a suspension return
+		}
+		else {
+			src->pub.bytes_in_buffer   -= (size_t) num_bytes;
+			src->pub.next_input_byte   += num_bytes;
+		}
+	}
+
+	void appendIncrementalInput(IncrementalSourceStruct *src, const unsigned char *bytes, size_t count) {
+		// IJG never backs up beyond next_input_byte, so the data before it can go
+		if (src->pub.next_input_byte != NULL)
+			src->data.erase(src->data.begin(), src->data.begin() + (src->pub.next_input_byte - &src->data[0]));
+		src->data.insert(src->data.end(), bytes, bytes + count);
+
+		if (src->skip_bytes > 0) {
+			size_t skip = Math::Min((size_t)src->skip_bytes, src->data.size());
+			src->data.erase(src->data.begin(), src->data.begin() + skip);
+			src->skip_bytes -= (long)skip;
+		}
+
+		src->pub.next_input_byte = src->data.empty() ? NULL : &src->data[0];
+		src->pub.bytes_in_buffer = src->data.size();
+	}
+
+	// True if the received data holds another SOS marker, or the end of the frame. Markers cannot occur
+	// inside the entropy-coded data, where 0xff bytes are followed by a stuffed zero.
+	bool hasNextScan(IncrementalSourceStruct *src) {
+		const JOCTET *data = src->pub.next_input_byte;
+		for (size_t i = 0; i + 1 < src->pub.bytes_in_buffer; i++) {
+			if (data[i] == 0xff && (data[i + 1] == 0xda || data[i + 1] == JPEG_EOI))
+				return true;
+		}
+		return false;
+	}
+
+	ref class ProgressiveDecoder : public JpegProgressiveDecoder {
+	public:
+		ProgressiveDecoder(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, JpegScanHandler^ handler) {
+			_oldPixelData = oldPixelData;
+			_newPixelData = newPixelData;
+			_params = params;
+			_handler = handler;
+			_state = State::ReadHeader;
+
+			_context = createDecompressContext();
+			_src = new IncrementalSourceStruct;
+			_src->pub.init_source       = initSource;
+			_src->pub.fill_input_buffer = fillIncrementalInput;
+			_src->pub.skip_input_data   = skipIncrementalInput;
+			_src->pub.resync_to_restart = jpeg_resync_to_restart;
+			_src->pub.term_source       = termSource;
+			_src->pub.bytes_in_buffer   = 0;
+			_src->pub.next_input_byte   = NULL;
+			_src->skip_bytes            = 0;
+			_src->finished              = false;
+
+			j_decompress_ptr dinfo = Decompressor;
+			dinfo->src = &_src->pub;
+			beginMemoryAccounting((j_common_ptr)dinfo, _params);
+		}
+
+		~ProgressiveDecoder() {
+			this->!ProgressiveDecoder();
+		}
+
+		!ProgressiveDecoder() {
+			if (_context != nullptr) {
+				delete _context;
+				_context = nullptr;
+			}
+			delete _src;
+			_src = NULL;
+		}
+
+		virtual void Append(array<unsigned char>^ data, int offset, int count) override {
+			if (_src == NULL || _src->finished)
+				throw gcnew DicomCodecException("Unable to decompress JPEG: data appended after the end of the frame");
+			if (offset < 0 || count < 0 || offset > data->Length - count)
+				throw gcnew ArgumentOutOfRangeException("count");
+			if (count == 0)
+				return;
+
+			pin_ptr<unsigned char> dataPin = &data[offset];
+			appendIncrementalInput(_src, dataPin, count);
+			Advance();
+		}
+
+		virtual void Finish() override {
+			if (_src == NULL || _src->finished)
+				return;
+			_src->finished = true;
+			Advance();
+		}
+
+		property bool IsComplete {
+			virtual bool get() override { return _state == State::Done; }
+		}
+
+	private:
+		enum class State {
+			ReadHeader,
+			StartDecompress,
+			ConsumeScans,
+			ReadRows,
+			FinishDecompress,
+			Done
+		};
+
+		property j_decompress_ptr Decompressor {
+			j_decompress_ptr get() { return &((DecompressContext *)_context->Pointer)->dinfo; }
+		}
+
+		void Advance() {
+			j_decompress_ptr dinfo = Decompressor;
+
+			if (_state == State::ReadHeader) {
+				if (jpeg_read_header(dinfo, TRUE) == JPEG_SUSPENDED)
+					return;
+				setupDecompress(dinfo, _oldPixelData, _params);
+				describeOutput(dinfo, _oldPixelData, _newPixelData);
+
+				// Single scan frames are decoded row by row instead: the lossless-capable IJG sets up its
+				// coefficient buffer while reading the header, before buffered_image can be set.
+				dinfo->buffered_image = jpeg_has_multiple_scans(dinfo);
+				_rowSize = dinfo->output_width * dinfo->output_components * sizeof(JSAMPLE);
+				_frameSize = _rowSize * dinfo->output_height;
+				if ((_frameSize % 2) != 0)
+					_frameSize++;
+				_state = State::StartDecompress;
+			}
+
+			// the arithmetic decoder cannot suspend, and reads a lack of data as the end of the frame
+			if (dinfo->arith_code && !_src->finished)
+				return;
+
+			if (_state == State::StartDecompress) {
+				if (!jpeg_start_decompress(dinfo))
+					return;
+				if (dinfo->buffered_image)
+					_state = State::ConsumeScans;
+				else {
+					_frame = gcnew array<unsigned char>(_frameSize);
+					_state = State::ReadRows;
+				}
+			}
+
+			while (_state == State::ConsumeScans) {
+				int retcode = jpeg_consume_input(dinfo);
+				if (retcode == JPEG_SUSPENDED)
+					return;
+				if (retcode == JPEG_REACHED_EOI) {
+					_state = State::FinishDecompress;
+					Deliver(Output(dinfo->input_scan_number), dinfo->input_scan_number, true);
+				}
+				else if (retcode == JPEG_REACHED_SOS && dinfo->input_scan_number > 1 && !hasNextScan(_src)) {
+					// none of the new scan has been decoded yet, so its predecessors show up on their own
+					Deliver(Output(dinfo->input_scan_number - 1), dinfo->input_scan_number - 1, false);
+				}
+			}
+
+			if (_state == State::ReadRows) {
+				pin_ptr<unsigned char> framePin = &_frame[0];
+				unsigned char* framePtr = framePin;
+
+				std::vector<JSAMPROW> rows(dinfo->output_height);
+				for (JDIMENSION row = 0; row < dinfo->output_height; row++)
+					rows[row] = (JSAMPROW)(framePtr + row * _rowSize);
+
+				while (dinfo->output_scanline < dinfo->output_height) {
+					if (jpeg_read_scanlines(dinfo, &rows[dinfo->output_scanline], dinfo->output_height - dinfo->output_scanline) == 0)
+						return;
+				}
+				_state = State::FinishDecompress;
+			}
+
+			if (_state == State::FinishDecompress) {
+				if (!jpeg_finish_decompress(dinfo))
+					return;
+				_state = State::Done;
+				endMemoryAccounting((j_common_ptr)dinfo, _params);
+
+				if (_frame != nullptr) {
+					array<unsigned char>^ frame = _frame;
+					_frame = nullptr;
+					Deliver(frame, 1, true);
+				}
+			}
+		}
+
+		// Runs an output pass over the coefficients of the first scans of the frame.
+		array<unsigned char>^ Output(int scan) {
+			j_decompress_ptr dinfo = Decompressor;
+			array<unsigned char>^ frame = gcnew array<unsigned char>(_frameSize);
+			pin_ptr<unsigned char> framePin = &frame[0];
+			unsigned char* framePtr = framePin;
+
+			std::vector<JSAMPROW> rows(dinfo->output_height);
+			for (JDIMENSION row = 0; row < dinfo->output_height; row++)
+				rows[row] = (JSAMPROW)(framePtr + row * _rowSize);
+
+			// the input is ahead of the requested scans, so the pass never has to wait for data
+			jpeg_start_output(dinfo, scan);
+			while (dinfo->output_scanline < dinfo->output_height)
+				jpeg_read_scanlines(dinfo, &rows[dinfo->output_scanline], dinfo->output_height - dinfo->output_scanline);
+			jpeg_finish_output(dinfo);
+
+			return frame;
+		}
+
+		void Deliver(array<unsigned char>^ frame, int scan, bool complete) {
+			if (_newPixelData->IsPlanar)
+				frame = ChangePlanarConfiguration(frame, _newPixelData, 0);
+			_handler(frame, scan, complete);
+		}
+
+		DcmPixelData^ _oldPixelData;
+		DcmPixelData^ _newPixelData;
+		DcmJpegParameters^ _params;
+		JpegScanHandler^ _handler;
+		JpegContext^ _context;
+		IncrementalSourceStruct *_src;
+		State _state;
+		int _rowSize;
+		int _frameSize;
+		array<unsigned char>^ _frame;
+	};
+}
+
+JpegProgressiveDecoder^ JPEGCODEC::CreateProgressiveDecoder(DcmPixelData^ oldPixelData, DcmPixelData^ newPixelData, DcmJpegParameters^ params, JpegScanHandler^ handler) {
+	return gcnew IJGVERS::ProgressiveDecoder(oldPixelData, newPixelData, params, handler);
+}
 
-	return dinfo.data_precision;
+void JPEGCODEC::EnableSimd(bool enable) {
+	jpeg_simd_mask(enable ? ~0U : 0U);
 }
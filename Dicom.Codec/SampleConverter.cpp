@@ -0,0 +1,106 @@
+// mDCM: A C# DICOM library
+//
+// Copyright (c) 2010  Colby Dillion
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// Author:
+//    Colby Dillion (colby.dillion@gmail.com)
+
+#include "SampleConverter.h"
+
+#include "SampleFormat/sampleformat.h"
+
+using namespace System;
+
+using namespace Dicom::Codec;
+using namespace Dicom::IO;
+
+namespace Dicom {
+namespace Codec {
+
+static void checkCount(Array^ source, Array^ destination, int count) {
+	if (count < 0 || source->Length < count || destination->Length < count)
+		throw gcnew ArgumentOutOfRangeException("count");
+}
+
+void NativeSampleConverter::ChangePlanarConfiguration(array<unsigned char>^ source, array<unsigned char>^ destination, int numValues,
+	int bytesAllocated, int samplesPerPixel, int oldPlanarConfiguration) {
+	checkCount(source, destination, numValues * bytesAllocated);
+	int numPixels = numValues / samplesPerPixel;
+	if (numPixels == 0)
+		return;
+
+	pin_ptr<unsigned char> src = &source[0];
+	pin_ptr<unsigned char> dst = &destination[0];
+	size_t planeStride = (size_t)numPixels * bytesAllocated;
+	if (oldPlanarConfiguration == 1)
+		sf_interleave(dst, src, planeStride, numPixels, samplesPerPixel, bytesAllocated);
+	else
+		sf_deinterleave(dst, planeStride, src, numPixels, samplesPerPixel, bytesAllocated);
+}
+
+void NativeSampleConverter::SwapBytes(array<unsigned char>^ data, int bytesToSwap) {
+	if (bytesToSwap != 2 && bytesToSwap != 4) {
+		Endian::SwapBytes(bytesToSwap, data);
+		return;
+	}
+	if (data->Length < bytesToSwap)
+		return;
+
+	pin_ptr<unsigned char> ptr = &data[0];
+	if (bytesToSwap == 2)
+		sf_swap16(ptr, data->Length / 2);
+	else
+		sf_swap32(ptr, data->Length / 4);
+}
+
+void NativeSampleConverter::ToInt16(array<unsigned short>^ source, array<short>^ destination, int count, int highBit, bool isSigned) {
+	checkCount(source, destination, count);
+	if (count == 0)
+		return;
+
+	pin_ptr<unsigned short> src = &source[0];
+	pin_ptr<short> dst = &destination[0];
+	sf_unpack16s(dst, src, count, highBit, isSigned ? SF_SIGN_MAGNITUDE : SF_UNSIGNED);
+}
+
+void NativeSampleConverter::ToInt32(array<unsigned char>^ source, array<int>^ destination, int count, int highBit, bool isSigned) {
+	checkCount(source, destination, count);
+	if (count == 0)
+		return;
+
+	pin_ptr<unsigned char> src = &source[0];
+	pin_ptr<int> dst = &destination[0];
+	sf_unpack8(dst, src, count, highBit, isSigned ? SF_SIGN_MAGNITUDE : SF_UNSIGNED);
+}
+
+void NativeSampleConverter::ToInt32(array<unsigned short>^ source, array<int>^ destination, int count, int highBit, bool isSigned) {
+	checkCount(source, destination, count);
+	if (count == 0)
+		return;
+
+	pin_ptr<unsigned short> src = &source[0];
+	pin_ptr<int> dst = &destination[0];
+	sf_unpack16(dst, src, count, highBit, isSigned ? SF_SIGN_MAGNITUDE : SF_UNSIGNED);
+}
+
+void NativeSampleConverter::UseSimd::set(bool value) {
+	sf_simd_mask(value ? ~0U : 0U);
+	_useSimd = value;
+}
+
+} // Codec
+} // Dicom
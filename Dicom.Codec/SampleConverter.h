@@ -0,0 +1,60 @@
+// mDCM: A C# DICOM library
+//
+// Copyright (c) 2010  Colby Dillion
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// Author:
+//    Colby Dillion (colby.dillion@gmail.com)
+
+#ifndef __SAMPLECONVERTER_H__
+#define __SAMPLECONVERTER_H__
+
+#pragma once
+
+using namespace System;
+
+using namespace Dicom::Codec;
+
+namespace Dicom {
+namespace Codec {
+
+// ISampleConverter on the native conversions of SampleFormat, with SSE2 and AVX2 versions chosen at run time.
+// Registering the codecs of this assembly makes it the converter of the pixel data accessors.
+[DicomSampleConverter]
+public ref class NativeSampleConverter : public ISampleConverter {
+public:
+	virtual void ChangePlanarConfiguration(array<unsigned char>^ source, array<unsigned char>^ destination, int numValues,
+		int bytesAllocated, int samplesPerPixel, int oldPlanarConfiguration);
+	virtual void SwapBytes(array<unsigned char>^ data, int bytesToSwap);
+	virtual void ToInt16(array<unsigned short>^ source, array<short>^ destination, int count, int highBit, bool isSigned);
+	virtual void ToInt32(array<unsigned char>^ source, array<int>^ destination, int count, int highBit, bool isSigned);
+	virtual void ToInt32(array<unsigned short>^ source, array<int>^ destination, int count, int highBit, bool isSigned);
+
+	// Use the SSE2/AVX2 versions where the CPU supports them (default). They produce the same output as the
+	// portable code; this switch exists for testing.
+	static property bool UseSimd {
+		bool get() { return _useSimd; }
+		void set(bool value);
+	}
+
+private:
+	static bool _useSimd = true;
+};
+
+} // Codec
+} // Dicom
+
+#endif
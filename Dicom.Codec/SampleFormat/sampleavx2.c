@@ -0,0 +1,287 @@
+// mDCM: A C# DICOM library
+//
+// Copyright (c) 2010  Colby Dillion
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// Author:
+//    Colby Dillion (colby.dillion@gmail.com)
+
+/*
+ * AVX2 versions of the sample format conversions (sampleformat.c).
+ *
+ * This file must be compiled with AVX code generation enabled (/arch:AVX),
+ * so that the compiler does not mix legacy SSE and VEX instructions.
+ * sampleformat.c only calls these routines when the CPU and OS support
+ * AVX2.
+ */
+
+#include "sampleformat.h"
+
+#ifdef SF_SIMD_SUPPORTED
+
+#include <immintrin.h>
+
+#ifdef __GNUC__
+#define AVX2_TARGET  __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+
+/*
+ * Byte shuffles between three planes of 16 samples and 16 interleaved
+ * pixels.  interleave_masks[c][o] picks the samples of component c that go
+ * to the 16 bytes at 16 * o of the pixels; deinterleave_masks[c][o] picks
+ * those of plane c out of them.  -1 clears the byte.
+ */
+
+static const signed char interleave_masks[3][3][16] = {
+	{ {  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1,  5 },
+	  { -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10, -1 },
+	  { -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1 } },
+	{ { -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1 },
+	  {  5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10 },
+	  { -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1 } },
+	{ { -1, -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1 },
+	  { -1,  5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1 },
+	  { 10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15 } }
+};
+
+static const signed char deinterleave_masks[3][3][16] = {
+	{ {  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  4,  7, 10, 13 } },
+	{ {  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14 } },
+	{ {  2,  5,  8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1,  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15 } }
+};
+
+#define MASK(table, c, o)  _mm_loadu_si128((const __m128i *) table[c][o])
+
+
+AVX2_TARGET
+size_t sf_avx2_interleave3(unsigned char *dst, const unsigned char *src,
+			   size_t plane_stride, size_t pixels)
+{
+	size_t i;
+	int o;
+
+	for (i = 0; i + 16 <= pixels; i += 16) {
+		__m128i p0 = _mm_loadu_si128((const __m128i *) (src + i));
+		__m128i p1 = _mm_loadu_si128((const __m128i *) (src + plane_stride + i));
+		__m128i p2 = _mm_loadu_si128((const __m128i *) (src + 2 * plane_stride + i));
+
+		for (o = 0; o < 3; o++) {
+			__m128i x = _mm_or_si128(_mm_or_si128(
+				_mm_shuffle_epi8(p0, MASK(interleave_masks, 0, o)),
+				_mm_shuffle_epi8(p1, MASK(interleave_masks, 1, o))),
+				_mm_shuffle_epi8(p2, MASK(interleave_masks, 2, o)));
+			_mm_storeu_si128((__m128i *) (dst + 3 * i + 16 * o), x);
+		}
+	}
+	return i;
+}
+
+AVX2_TARGET
+size_t sf_avx2_deinterleave3(unsigned char *dst, size_t plane_stride,
+			     const unsigned char *src, size_t pixels)
+{
+	size_t i;
+	int c;
+
+	for (i = 0; i + 16 <= pixels; i += 16) {
+		__m128i x0 = _mm_loadu_si128((const __m128i *) (src + 3 * i));
+		__m128i x1 = _mm_loadu_si128((const __m128i *) (src + 3 * i + 16));
+		__m128i x2 = _mm_loadu_si128((const __m128i *) (src + 3 * i + 32));
+
+		for (c = 0; c < 3; c++) {
+			__m128i p = _mm_or_si128(_mm_or_si128(
+				_mm_shuffle_epi8(x0, MASK(deinterleave_masks, c, 0)),
+				_mm_shuffle_epi8(x1, MASK(deinterleave_masks, c, 1))),
+				_mm_shuffle_epi8(x2, MASK(deinterleave_masks, c, 2)));
+			_mm_storeu_si128((__m128i *) (dst + c * plane_stride + i), p);
+		}
+	}
+	return i;
+}
+
+
+AVX2_TARGET
+size_t sf_avx2_widen(unsigned short *dst, const unsigned char *src, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+		_mm256_storeu_si256((__m256i *) (dst + i), _mm256_cvtepu8_epi16(x));
+	}
+	return i;
+}
+
+AVX2_TARGET
+size_t sf_avx2_narrow(unsigned char *dst, const unsigned short *src, size_t count)
+{
+	const __m256i low = _mm256_set1_epi16(0xff);
+	size_t i;
+
+	/* the packs work within 128 bit lanes; put the quarters back in order */
+	for (i = 0; i + 32 <= count; i += 32) {
+		__m256i a = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (src + i)), low);
+		__m256i b = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (src + i + 16)), low);
+		__m256i x = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+		_mm256_storeu_si256((__m256i *) (dst + i), x);
+	}
+	return i;
+}
+
+
+AVX2_TARGET
+size_t sf_avx2_swap16(void *data, size_t count)
+{
+	const __m256i order = _mm256_setr_epi8(
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	unsigned short *data16 = (unsigned short *) data;
+	size_t i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m256i x = _mm256_loadu_si256((const __m256i *) (data16 + i));
+		_mm256_storeu_si256((__m256i *) (data16 + i), _mm256_shuffle_epi8(x, order));
+	}
+	return i;
+}
+
+AVX2_TARGET
+size_t sf_avx2_swap32(void *data, size_t count)
+{
+	const __m256i order = _mm256_setr_epi8(
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	unsigned int *data32 = (unsigned int *) data;
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		__m256i x = _mm256_loadu_si256((const __m256i *) (data32 + i));
+		_mm256_storeu_si256((__m256i *) (data32 + i), _mm256_shuffle_epi8(x, order));
+	}
+	return i;
+}
+
+
+/* Applies rep to bits 0..high_bit of zero extended 32 bit lanes. */
+AVX2_TARGET
+static __m256i unpack_lanes(__m256i x, int high_bit, sf_representation rep)
+{
+	const __m256i sign = _mm256_set1_epi32(1 << high_bit);
+	const __m128i shift = _mm_cvtsi32_si128(31 - high_bit);
+	__m256i mag, neg;
+
+	switch (rep) {
+	case SF_TWOS_COMPLEMENT:
+		return _mm256_sra_epi32(_mm256_sll_epi32(x, shift), shift);
+	case SF_SIGN_MAGNITUDE:
+		mag = _mm256_and_si256(x, _mm256_sub_epi32(sign, _mm256_set1_epi32(1)));
+		neg = _mm256_cmpeq_epi32(_mm256_and_si256(x, sign), sign);
+		return _mm256_sub_epi32(_mm256_xor_si256(mag, neg), neg);
+	default:
+		return _mm256_and_si256(x, _mm256_sub_epi32(_mm256_add_epi32(sign, sign), _mm256_set1_epi32(1)));
+	}
+}
+
+/* Stores the magnitude and sign of negative lanes for SF_SIGN_MAGNITUDE. */
+AVX2_TARGET
+static __m256i pack_lanes(__m256i x, int high_bit, sf_representation rep)
+{
+	__m256i neg;
+
+	if (rep != SF_SIGN_MAGNITUDE)
+		return x;
+	neg = _mm256_srai_epi32(x, 31);
+	x = _mm256_sub_epi32(_mm256_xor_si256(x, neg), neg);
+	return _mm256_or_si256(x, _mm256_and_si256(neg, _mm256_set1_epi32(1 << high_bit)));
+}
+
+AVX2_TARGET
+size_t sf_avx2_unpack8(int *dst, const unsigned char *src, size_t count,
+		       int high_bit, sf_representation rep)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+		__m256i lo = unpack_lanes(_mm256_cvtepu8_epi32(x), high_bit, rep);
+		__m256i hi = unpack_lanes(_mm256_cvtepu8_epi32(_mm_srli_si128(x, 8)), high_bit, rep);
+		_mm256_storeu_si256((__m256i *) (dst + i), lo);
+		_mm256_storeu_si256((__m256i *) (dst + i + 8), hi);
+	}
+	return i;
+}
+
+AVX2_TARGET
+size_t sf_avx2_unpack16(int *dst, const unsigned short *src, size_t count,
+			int high_bit, sf_representation rep)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (src + i));
+		__m128i b = _mm_loadu_si128((const __m128i *) (src + i + 8));
+		_mm256_storeu_si256((__m256i *) (dst + i), unpack_lanes(_mm256_cvtepu16_epi32(a), high_bit, rep));
+		_mm256_storeu_si256((__m256i *) (dst + i + 8), unpack_lanes(_mm256_cvtepu16_epi32(b), high_bit, rep));
+	}
+	return i;
+}
+
+AVX2_TARGET
+size_t sf_avx2_pack8(unsigned char *dst, const int *src, size_t count,
+		     int high_bit, sf_representation rep)
+{
+	const __m256i low = _mm256_set1_epi32(0xff);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	size_t i;
+
+	/* the packs work within 128 bit lanes; put the dwords back in order */
+	for (i = 0; i + 32 <= count; i += 32) {
+		__m256i a = _mm256_and_si256(pack_lanes(_mm256_loadu_si256((const __m256i *) (src + i)), high_bit, rep), low);
+		__m256i b = _mm256_and_si256(pack_lanes(_mm256_loadu_si256((const __m256i *) (src + i + 8)), high_bit, rep), low);
+		__m256i c = _mm256_and_si256(pack_lanes(_mm256_loadu_si256((const __m256i *) (src + i + 16)), high_bit, rep), low);
+		__m256i d = _mm256_and_si256(pack_lanes(_mm256_loadu_si256((const __m256i *) (src + i + 24)), high_bit, rep), low);
+		__m256i x = _mm256_packus_epi16(_mm256_packus_epi32(a, b), _mm256_packus_epi32(c, d));
+		_mm256_storeu_si256((__m256i *) (dst + i), _mm256_permutevar8x32_epi32(x, order));
+	}
+	return i;
+}
+
+AVX2_TARGET
+size_t sf_avx2_pack16(unsigned short *dst, const int *src, size_t count,
+		      int high_bit, sf_representation rep)
+{
+	const __m256i low = _mm256_set1_epi32(0xffff);
+	size_t i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m256i a = _mm256_and_si256(pack_lanes(_mm256_loadu_si256((const __m256i *) (src + i)), high_bit, rep), low);
+		__m256i b = _mm256_and_si256(pack_lanes(_mm256_loadu_si256((const __m256i *) (src + i + 8)), high_bit, rep), low);
+		__m256i x = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xd8);
+		_mm256_storeu_si256((__m256i *) (dst + i), x);
+	}
+	return i;
+}
+
+#endif /* SF_SIMD_SUPPORTED */
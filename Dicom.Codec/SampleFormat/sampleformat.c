@@ -0,0 +1,674 @@
+// mDCM: A C# DICOM library
+//
+// Copyright (c) 2010  Colby Dillion
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// Author:
+//    Colby Dillion (colby.dillion@gmail.com)
+
+/*
+ * Portable and SSE2 versions of the sample format conversions, and the
+ * run-time CPU detection that picks between them and sampleavx2.c.
+ */
+
+#include <string.h>
+
+#include "sampleformat.h"
+
+#ifdef SF_SIMD_SUPPORTED
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+
+static unsigned int simd_mask = ~0U;	/* set by sf_simd_mask */
+
+
+#ifdef SF_SIMD_SUPPORTED
+
+/*
+ * Query CPUID.  AVX2 also needs the OS to save the YMM registers, which
+ * XGETBV reports once CPUID has announced OSXSAVE.
+ */
+
+static unsigned int detect_cpu(void)
+{
+	unsigned int flags = 0;
+	unsigned int regs[4], xcr0;
+
+#ifdef _MSC_VER
+	__cpuid((int *) regs, 0);
+	if (regs[0] < 1)
+		return 0;
+	if (regs[0] >= 7) {
+		__cpuidex((int *) regs, 1, 0);
+		if (regs[2] & (1 << 27)) {	/* OSXSAVE */
+			xcr0 = (unsigned int) _xgetbv(0);
+			__cpuidex((int *) regs, 7, 0);
+			if ((xcr0 & 6) == 6 && (regs[1] & (1 << 5)))	/* YMM state, AVX2 */
+				flags |= SF_SIMD_AVX2;
+		}
+	}
+	__cpuid((int *) regs, 1);
+#else
+	unsigned int max = __get_cpuid_max(0, NULL);
+
+	if (max < 1)
+		return 0;
+	if (max >= 7) {
+		__cpuid_count(1, 0, regs[0], regs[1], regs[2], regs[3]);
+		if (regs[2] & (1 << 27)) {	/* OSXSAVE */
+			__asm__ ("xgetbv" : "=a" (xcr0) : "c" (0) : "edx");
+			__cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+			if ((xcr0 & 6) == 6 && (regs[1] & (1 << 5)))	/* YMM state, AVX2 */
+				flags |= SF_SIMD_AVX2;
+		}
+	}
+	__cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	if (regs[3] & (1 << 26))	/* SSE2 */
+		flags |= SF_SIMD_SSE2;
+
+	return flags;
+}
+
+#endif /* SF_SIMD_SUPPORTED */
+
+
+/*
+ * The CPU is only queried once; the result is the same on every thread.
+ */
+
+unsigned int sf_simd_support(void)
+{
+#ifdef SF_SIMD_SUPPORTED
+	static int cpu_flags = -1;
+
+	if (cpu_flags < 0)
+		cpu_flags = (int) detect_cpu();
+	return (unsigned int) cpu_flags & simd_mask;
+#else
+	return 0;
+#endif
+}
+
+void sf_simd_mask(unsigned int mask)
+{
+	simd_mask = mask;
+}
+
+
+/*
+ * Single samples, as the SIMD versions treat every lane.
+ */
+
+static int unpack_sample(unsigned int d, int high_bit, sf_representation rep)
+{
+	unsigned int sign = 1U << high_bit;
+
+	switch (rep) {
+	case SF_TWOS_COMPLEMENT:
+		return ((int) (d << (31 - high_bit))) >> (31 - high_bit);
+	case SF_SIGN_MAGNITUDE:
+		if (d & sign)
+			return -(int) (d & (sign - 1));
+		return (int) (d & (sign - 1));
+	default:
+		return (int) (d & (sign | (sign - 1)));
+	}
+}
+
+static unsigned int pack_sample(int i, int high_bit, sf_representation rep)
+{
+	if (rep == SF_SIGN_MAGNITUDE && i < 0)
+		return (0U - (unsigned int) i) | (1U << high_bit);
+	return (unsigned int) i;
+}
+
+
+#ifdef SF_SIMD_SUPPORTED
+
+/*
+ * SSE2 versions.  Like the AVX2 ones they return the number of samples
+ * done, always a multiple of the vector width.
+ */
+
+/* Applies rep to bits 0..high_bit of 16 bit lanes. */
+static __m128i sse2_unpack_lanes(__m128i x, int high_bit, sf_representation rep)
+{
+	const __m128i sign = _mm_set1_epi16((short) (1 << high_bit));
+	const __m128i shift = _mm_cvtsi32_si128(15 - high_bit);
+	__m128i mag, neg;
+
+	switch (rep) {
+	case SF_TWOS_COMPLEMENT:
+		return _mm_sra_epi16(_mm_sll_epi16(x, shift), shift);
+	case SF_SIGN_MAGNITUDE:
+		mag = _mm_and_si128(x, _mm_sub_epi16(sign, _mm_set1_epi16(1)));
+		neg = _mm_cmpeq_epi16(_mm_and_si128(x, sign), sign);
+		return _mm_sub_epi16(_mm_xor_si128(mag, neg), neg);
+	default:
+		return _mm_srl_epi16(_mm_sll_epi16(x, shift), shift);
+	}
+}
+
+/* Stores the magnitude and sign of negative 32 bit lanes for SF_SIGN_MAGNITUDE. */
+static __m128i sse2_pack_lanes(__m128i x, int high_bit, sf_representation rep)
+{
+	__m128i neg;
+
+	if (rep != SF_SIGN_MAGNITUDE)
+		return x;
+	neg = _mm_srai_epi32(x, 31);
+	x = _mm_sub_epi32(_mm_xor_si128(x, neg), neg);
+	return _mm_or_si128(x, _mm_and_si128(neg, _mm_set1_epi32(1 << high_bit)));
+}
+
+static size_t sse2_widen(unsigned short *dst, const unsigned char *src, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi8(x, zero));
+		_mm_storeu_si128((__m128i *) (dst + i + 8), _mm_unpackhi_epi8(x, zero));
+	}
+	return i;
+}
+
+static size_t sse2_narrow(unsigned char *dst, const unsigned short *src, size_t count)
+{
+	const __m128i low = _mm_set1_epi16(0xff);
+	size_t i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i *) (src + i)), low);
+		__m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i *) (src + i + 8)), low);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(a, b));
+	}
+	return i;
+}
+
+static size_t sse2_swap16(unsigned short *data, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (data + i));
+		x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+		_mm_storeu_si128((__m128i *) (data + i), x);
+	}
+	return i;
+}
+
+static size_t sse2_swap32(unsigned int *data, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (data + i));
+		x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+		x = _mm_or_si128(_mm_slli_epi32(x, 16), _mm_srli_epi32(x, 16));
+		_mm_storeu_si128((__m128i *) (data + i), x);
+	}
+	return i;
+}
+
+static size_t sse2_mask16(unsigned short *data, size_t count, int high_bit)
+{
+	const __m128i mask = _mm_set1_epi16((short) ((2 << high_bit) - 1));
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (data + i));
+		_mm_storeu_si128((__m128i *) (data + i), _mm_and_si128(x, mask));
+	}
+	return i;
+}
+
+static size_t sse2_unpack8(int *dst, const unsigned char *src, size_t count,
+			   int high_bit, sf_representation rep)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i;
+
+	/* every result fits in 16 bits, so the lanes are sign extended to 32 */
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+		__m128i lo = sse2_unpack_lanes(_mm_unpacklo_epi8(x, zero), high_bit, rep);
+		__m128i hi = sse2_unpack_lanes(_mm_unpackhi_epi8(x, zero), high_bit, rep);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16));
+		_mm_storeu_si128((__m128i *) (dst + i + 4), _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16));
+		_mm_storeu_si128((__m128i *) (dst + i + 8), _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16));
+		_mm_storeu_si128((__m128i *) (dst + i + 12), _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16));
+	}
+	return i;
+}
+
+static size_t sse2_unpack16(int *dst, const unsigned short *src, size_t count,
+			    int high_bit, sf_representation rep)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		__m128i x = sse2_unpack_lanes(_mm_loadu_si128((const __m128i *) (src + i)), high_bit, rep);
+		if (rep == SF_UNSIGNED) {
+			_mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(x, zero));
+			_mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(x, zero));
+		}
+		else {
+			_mm_storeu_si128((__m128i *) (dst + i), _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+			_mm_storeu_si128((__m128i *) (dst + i + 4), _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+		}
+	}
+	return i;
+}
+
+static size_t sse2_unpack16s(short *dst, const unsigned short *src, size_t count,
+			     int high_bit, sf_representation rep)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+		_mm_storeu_si128((__m128i *) (dst + i), sse2_unpack_lanes(x, high_bit, rep));
+	}
+	return i;
+}
+
+static size_t sse2_pack8(unsigned char *dst, const int *src, size_t count,
+			 int high_bit, sf_representation rep)
+{
+	const __m128i low = _mm_set1_epi32(0xff);
+	size_t i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i a = _mm_and_si128(sse2_pack_lanes(_mm_loadu_si128((const __m128i *) (src + i)), high_bit, rep), low);
+		__m128i b = _mm_and_si128(sse2_pack_lanes(_mm_loadu_si128((const __m128i *) (src + i + 4)), high_bit, rep), low);
+		__m128i c = _mm_and_si128(sse2_pack_lanes(_mm_loadu_si128((const __m128i *) (src + i + 8)), high_bit, rep), low);
+		__m128i d = _mm_and_si128(sse2_pack_lanes(_mm_loadu_si128((const __m128i *) (src + i + 12)), high_bit, rep), low);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+	}
+	return i;
+}
+
+static size_t sse2_pack16(unsigned short *dst, const int *src, size_t count,
+			  int high_bit, sf_representation rep)
+{
+	size_t i;
+
+	/* SSE2 has no unsigned 32 bit pack; sign extend the low half and pack that */
+	for (i = 0; i + 8 <= count; i += 8) {
+		__m128i a = sse2_pack_lanes(_mm_loadu_si128((const __m128i *) (src + i)), high_bit, rep);
+		__m128i b = sse2_pack_lanes(_mm_loadu_si128((const __m128i *) (src + i + 4)), high_bit, rep);
+		a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_packs_epi32(a, b));
+	}
+	return i;
+}
+
+/* The run versions stop at the first vector that holds a different sample;
+ * the caller finds it in the remaining samples. */
+static size_t sse2_run8(const unsigned char *src, size_t count, unsigned char value)
+{
+	const __m128i v = _mm_set1_epi8((char) value);
+	size_t i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, v)) != 0xffff)
+			break;
+	}
+	return i;
+}
+
+static size_t sse2_run16(const unsigned short *src, size_t count, unsigned short value)
+{
+	const __m128i v = _mm_set1_epi16((short) value);
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(x, v)) != 0xffff)
+			break;
+	}
+	return i;
+}
+
+/* 16 pixels of three bytes are three vectors of the repeated pixel. */
+static void sse2_pattern24(__m128i pattern[3], const unsigned char *value)
+{
+	unsigned char bytes[48];
+	int b;
+
+	for (b = 0; b < 48; b++)
+		bytes[b] = value[b % 3];
+	for (b = 0; b < 3; b++)
+		pattern[b] = _mm_loadu_si128((const __m128i *) (bytes + b * 16));
+}
+
+static size_t sse2_run24(const unsigned char *src, size_t count, const unsigned char *value)
+{
+	__m128i pattern[3];
+	size_t i;
+
+	sse2_pattern24(pattern, value);
+	for (i = 0; i + 16 <= count; i += 16) {
+		const unsigned char *p = src + i * 3;
+		__m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) p), pattern[0]);
+		eq = _mm_and_si128(eq, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (p + 16)), pattern[1]));
+		eq = _mm_and_si128(eq, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (p + 32)), pattern[2]));
+		if (_mm_movemask_epi8(eq) != 0xffff)
+			break;
+	}
+	return i;
+}
+
+static size_t sse2_fill16(unsigned short *dst, size_t count, unsigned short value)
+{
+	const __m128i v = _mm_set1_epi16((short) value);
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8)
+		_mm_storeu_si128((__m128i *) (dst + i), v);
+	return i;
+}
+
+static size_t sse2_fill24(unsigned char *dst, size_t count, const unsigned char *value)
+{
+	__m128i pattern[3];
+	size_t i;
+
+	sse2_pattern24(pattern, value);
+	for (i = 0; i + 16 <= count; i += 16) {
+		unsigned char *p = dst + i * 3;
+		_mm_storeu_si128((__m128i *) p, pattern[0]);
+		_mm_storeu_si128((__m128i *) (p + 16), pattern[1]);
+		_mm_storeu_si128((__m128i *) (p + 32), pattern[2]);
+	}
+	return i;
+}
+
+#define SIMD_DONE(avx2, sse2)						\
+	((sf_simd_support() & SF_SIMD_AVX2) ? (avx2) :			\
+	 (sf_simd_support() & SF_SIMD_SSE2) ? (sse2) : 0)
+
+#endif /* SF_SIMD_SUPPORTED */
+
+
+void sf_interleave(void *dst, const void *src, size_t plane_stride,
+		   size_t pixels, int components, int sample_size)
+{
+	unsigned char *out = (unsigned char *) dst;
+	const unsigned char *in = (const unsigned char *) src;
+	size_t i = 0;
+	int c;
+
+#ifdef SF_SIMD_SUPPORTED
+	if (components == 3 && sample_size == 1 && (sf_simd_support() & SF_SIMD_AVX2))
+		i = sf_avx2_interleave3(out, in, plane_stride, pixels);
+#endif
+
+	for (c = 0; c < components; c++) {
+		const unsigned char *plane = in + c * plane_stride;
+		size_t p;
+
+		if (sample_size == 1) {
+			for (p = i; p < pixels; p++)
+				out[p * components + c] = plane[p];
+		}
+		else if (sample_size == 2) {
+			unsigned short *out16 = (unsigned short *) out;
+			const unsigned short *plane16 = (const unsigned short *) plane;
+			for (p = i; p < pixels; p++)
+				out16[p * components + c] = plane16[p];
+		}
+		else {
+			for (p = i; p < pixels; p++)
+				memcpy(out + (p * components + c) * sample_size, plane + p * sample_size, sample_size);
+		}
+	}
+}
+
+void sf_deinterleave(void *dst, size_t plane_stride, const void *src,
+		     size_t pixels, int components, int sample_size)
+{
+	unsigned char *out = (unsigned char *) dst;
+	const unsigned char *in = (const unsigned char *) src;
+	size_t i = 0;
+	int c;
+
+#ifdef SF_SIMD_SUPPORTED
+	if (components == 3 && sample_size == 1 && (sf_simd_support() & SF_SIMD_AVX2))
+		i = sf_avx2_deinterleave3(out, plane_stride, in, pixels);
+#endif
+
+	for (c = 0; c < components; c++) {
+		unsigned char *plane = out + c * plane_stride;
+		size_t p;
+
+		if (sample_size == 1) {
+			for (p = i; p < pixels; p++)
+				plane[p] = in[p * components + c];
+		}
+		else if (sample_size == 2) {
+			unsigned short *plane16 = (unsigned short *) plane;
+			const unsigned short *in16 = (const unsigned short *) in;
+			for (p = i; p < pixels; p++)
+				plane16[p] = in16[p * components + c];
+		}
+		else {
+			for (p = i; p < pixels; p++)
+				memcpy(plane + p * sample_size, in + (p * components + c) * sample_size, sample_size);
+		}
+	}
+}
+
+void sf_widen(unsigned short *dst, const unsigned char *src, size_t count)
+{
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	i = SIMD_DONE(sf_avx2_widen(dst, src, count), sse2_widen(dst, src, count));
+#endif
+	for (; i < count; i++)
+		dst[i] = src[i];
+}
+
+void sf_narrow(unsigned char *dst, const unsigned short *src, size_t count)
+{
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	i = SIMD_DONE(sf_avx2_narrow(dst, src, count), sse2_narrow(dst, src, count));
+#endif
+	for (; i < count; i++)
+		dst[i] = (unsigned char) src[i];
+}
+
+void sf_swap16(void *data, size_t count)
+{
+	unsigned short *data16 = (unsigned short *) data;
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	i = SIMD_DONE(sf_avx2_swap16(data16, count), sse2_swap16(data16, count));
+#endif
+	for (; i < count; i++)
+		data16[i] = (unsigned short) ((data16[i] << 8) | (data16[i] >> 8));
+}
+
+void sf_swap32(void *data, size_t count)
+{
+	unsigned int *data32 = (unsigned int *) data;
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	i = SIMD_DONE(sf_avx2_swap32(data32, count), sse2_swap32(data32, count));
+#endif
+	for (; i < count; i++) {
+		unsigned int d = data32[i];
+		data32[i] = (d << 24) | ((d << 8) & 0xff0000) | ((d >> 8) & 0xff00) | (d >> 24);
+	}
+}
+
+void sf_mask16(unsigned short *data, size_t count, int high_bit)
+{
+	const unsigned short mask = (unsigned short) ((2 << high_bit) - 1);
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	if (sf_simd_support() & (SF_SIMD_SSE2 | SF_SIMD_AVX2))
+		i = sse2_mask16(data, count, high_bit);
+#endif
+	for (; i < count; i++)
+		data[i] &= mask;
+}
+
+void sf_unpack8(int *dst, const unsigned char *src, size_t count,
+		int high_bit, sf_representation rep)
+{
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	i = SIMD_DONE(sf_avx2_unpack8(dst, src, count, high_bit, rep),
+		      sse2_unpack8(dst, src, count, high_bit, rep));
+#endif
+	for (; i < count; i++)
+		dst[i] = unpack_sample(src[i], high_bit, rep);
+}
+
+void sf_unpack16(int *dst, const unsigned short *src, size_t count,
+		 int high_bit, sf_representation rep)
+{
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	i = SIMD_DONE(sf_avx2_unpack16(dst, src, count, high_bit, rep),
+		      sse2_unpack16(dst, src, count, high_bit, rep));
+#endif
+	for (; i < count; i++)
+		dst[i] = unpack_sample(src[i], high_bit, rep);
+}
+
+void sf_unpack16s(short *dst, const unsigned short *src, size_t count,
+		  int high_bit, sf_representation rep)
+{
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	if (sf_simd_support() & (SF_SIMD_SSE2 | SF_SIMD_AVX2))
+		i = sse2_unpack16s(dst, src, count, high_bit, rep);
+#endif
+	for (; i < count; i++)
+		dst[i] = (short) unpack_sample(src[i], high_bit, rep);
+}
+
+void sf_pack8(unsigned char *dst, const int *src, size_t count,
+	      int high_bit, sf_representation rep)
+{
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	i = SIMD_DONE(sf_avx2_pack8(dst, src, count, high_bit, rep),
+		      sse2_pack8(dst, src, count, high_bit, rep));
+#endif
+	for (; i < count; i++)
+		dst[i] = (unsigned char) pack_sample(src[i], high_bit, rep);
+}
+
+void sf_pack16(unsigned short *dst, const int *src, size_t count,
+	       int high_bit, sf_representation rep)
+{
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	i = SIMD_DONE(sf_avx2_pack16(dst, src, count, high_bit, rep),
+		      sse2_pack16(dst, src, count, high_bit, rep));
+#endif
+	for (; i < count; i++)
+		dst[i] = (unsigned short) pack_sample(src[i], high_bit, rep);
+}
+
+size_t sf_run8(const unsigned char *src, size_t count, unsigned char value)
+{
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	if (sf_simd_support() & (SF_SIMD_SSE2 | SF_SIMD_AVX2))
+		i = sse2_run8(src, count, value);
+#endif
+	while (i < count && src[i] == value)
+		i++;
+	return i;
+}
+
+size_t sf_run16(const unsigned short *src, size_t count, unsigned short value)
+{
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	if (sf_simd_support() & (SF_SIMD_SSE2 | SF_SIMD_AVX2))
+		i = sse2_run16(src, count, value);
+#endif
+	while (i < count && src[i] == value)
+		i++;
+	return i;
+}
+
+size_t sf_run24(const unsigned char *src, size_t count, const unsigned char *value)
+{
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	if (sf_simd_support() & (SF_SIMD_SSE2 | SF_SIMD_AVX2))
+		i = sse2_run24(src, count, value);
+#endif
+	while (i < count && src[i * 3] == value[0] && src[i * 3 + 1] == value[1] && src[i * 3 + 2] == value[2])
+		i++;
+	return i;
+}
+
+void sf_fill16(unsigned short *dst, size_t count, unsigned short value)
+{
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	if (sf_simd_support() & (SF_SIMD_SSE2 | SF_SIMD_AVX2))
+		i = sse2_fill16(dst, count, value);
+#endif
+	for (; i < count; i++)
+		dst[i] = value;
+}
+
+void sf_fill24(unsigned char *dst, size_t count, const unsigned char *value)
+{
+	size_t i = 0;
+
+#ifdef SF_SIMD_SUPPORTED
+	if (sf_simd_support() & (SF_SIMD_SSE2 | SF_SIMD_AVX2))
+		i = sse2_fill24(dst, count, value);
+#endif
+	for (; i < count; i++)
+		memcpy(dst + i * 3, value, 3);
+}
@@ -0,0 +1,137 @@
+// mDCM: A C# DICOM library
+//
+// Copyright (c) 2010  Colby Dillion
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// Author:
+//    Colby Dillion (colby.dillion@gmail.com)
+
+/*
+ * Sample format conversions shared by the codecs and the pixel data
+ * accessors: planar configuration, sample size, byte order and the
+ * integer representation of stored bits.
+ *
+ * Every routine has a portable version; on x86 the SSE2 and AVX2 versions
+ * are chosen at run time and give exactly the same results.  Samples are
+ * in the byte order of the machine, and source and destination must not
+ * overlap unless a routine works in place.
+ */
+
+#ifndef __SAMPLEFORMAT_H__
+#define __SAMPLEFORMAT_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define SF_SIMD_SUPPORTED
+#endif
+
+/* Instruction set extensions, as reported by sf_simd_support */
+#define SF_SIMD_SSE2	0x01
+#define SF_SIMD_AVX2	0x02
+
+/* How the bits 0..high_bit of a stored sample map to an integer */
+typedef enum {
+	SF_UNSIGNED,		/* zero extended */
+	SF_TWOS_COMPLEMENT,	/* sign extended from high_bit */
+	SF_SIGN_MAGNITUDE	/* high_bit is the sign of the magnitude below it */
+} sf_representation;
+
+/* Extensions the routines may use on this CPU; see sf_simd_mask. */
+unsigned int sf_simd_support(void);
+
+/* Restricts the extensions used from now on, e.g. to compare the SIMD
+ * routines against the portable code. */
+void sf_simd_mask(unsigned int mask);
+
+/* Planar to interleaved: pixels samples of each component, plane_stride
+ * bytes apart in src, become pixels interleaved pixels in dst. */
+void sf_interleave(void *dst, const void *src, size_t plane_stride,
+		   size_t pixels, int components, int sample_size);
+
+/* Interleaved to planar: the reverse of sf_interleave. */
+void sf_deinterleave(void *dst, size_t plane_stride, const void *src,
+		     size_t pixels, int components, int sample_size);
+
+/* 8 <-> 16 bit samples; narrowing keeps the low byte. */
+void sf_widen(unsigned short *dst, const unsigned char *src, size_t count);
+void sf_narrow(unsigned char *dst, const unsigned short *src, size_t count);
+
+/* Reverses the byte order of 16 or 32 bit samples in place. */
+void sf_swap16(void *data, size_t count);
+void sf_swap32(void *data, size_t count);
+
+/* Clears the bits above high_bit in place. */
+void sf_mask16(unsigned short *data, size_t count, int high_bit);
+
+/* Stored samples to integers, reading bits 0..high_bit as rep. */
+void sf_unpack8(int *dst, const unsigned char *src, size_t count,
+		int high_bit, sf_representation rep);
+void sf_unpack16(int *dst, const unsigned short *src, size_t count,
+		 int high_bit, sf_representation rep);
+void sf_unpack16s(short *dst, const unsigned short *src, size_t count,
+		  int high_bit, sf_representation rep);
+
+/* Integers to stored samples.  Negative values are stored as a magnitude
+ * with the sign at high_bit for SF_SIGN_MAGNITUDE; otherwise, and for
+ * values that are not negative, the low bits of the value are stored. */
+void sf_pack8(unsigned char *dst, const int *src, size_t count,
+	      int high_bit, sf_representation rep);
+void sf_pack16(unsigned short *dst, const int *src, size_t count,
+	       int high_bit, sf_representation rep);
+
+/* Number of samples from the start of src that equal value, for finding
+ * runs.  sf_run24 takes pixels of three 8 bit samples, and value points to
+ * the three samples of one. */
+size_t sf_run8(const unsigned char *src, size_t count, unsigned char value);
+size_t sf_run16(const unsigned short *src, size_t count, unsigned short value);
+size_t sf_run24(const unsigned char *src, size_t count, const unsigned char *value);
+
+/* Sets count samples, or pixels of three 8 bit samples, to value. */
+void sf_fill16(unsigned short *dst, size_t count, unsigned short value);
+void sf_fill24(unsigned char *dst, size_t count, const unsigned char *value);
+
+#ifdef SF_SIMD_SUPPORTED
+/* AVX2 versions (sampleavx2.c).  Each does as much of its work as it can
+ * and returns the number of samples or pixels done; the caller finishes
+ * the rest. */
+size_t sf_avx2_interleave3(unsigned char *dst, const unsigned char *src,
+			   size_t plane_stride, size_t pixels);
+size_t sf_avx2_deinterleave3(unsigned char *dst, size_t plane_stride,
+			     const unsigned char *src, size_t pixels);
+size_t sf_avx2_widen(unsigned short *dst, const unsigned char *src, size_t count);
+size_t sf_avx2_narrow(unsigned char *dst, const unsigned short *src, size_t count);
+size_t sf_avx2_swap16(void *data, size_t count);
+size_t sf_avx2_swap32(void *data, size_t count);
+size_t sf_avx2_unpack8(int *dst, const unsigned char *src, size_t count,
+		       int high_bit, sf_representation rep);
+size_t sf_avx2_unpack16(int *dst, const unsigned short *src, size_t count,
+			int high_bit, sf_representation rep);
+size_t sf_avx2_pack8(unsigned char *dst, const int *src, size_t count,
+		     int high_bit, sf_representation rep);
+size_t sf_avx2_pack16(unsigned short *dst, const int *src, size_t count,
+		      int high_bit, sf_representation rep);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
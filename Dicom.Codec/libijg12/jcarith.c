@@ -5,12 +5,1064 @@
  * This file is part of the Independent JPEG Group's software.
  * For conditions of distribution and use, see the accompanying README file.
  *
- * This file holds place for arithmetic entropy encoding routines.
+ * This file contains portable arithmetic entropy encoding routines for JPEG
+ * (implementing the ISO/IEC IS 10918-1 and CCITT Recommendation ITU-T T.81).
+ *
+ * Both sequential and progressive modes are supported in this single module,
+ * as well as the lossless mode (Annex H), which codes the sample differences
+ * with a two-dimensional version of the DC statistical model.
+ *
+ * Suspension is not currently supported in this module.
  */
 
 #define JPEG_INTERNALS
 #include "jinclude12.h"
 #include "jpeglib12.h"
+#include "jlossy12.h"		/* Private declarations for lossy codec */
+#include "jlossls12.h"		/* Private declarations for lossless codec */
+
+
+/* Expanded entropy encoder object for arithmetic encoding. */
+
+typedef struct {
+  IJG_INT32 c; /* C register, base of coding interval, layout as in sec. D.1.3 */
+  IJG_INT32 a;		/* A register, normalized size of coding interval */
+  IJG_INT32 sc;		/* counter for stacked 0xFF values which might overflow */
+  IJG_INT32 zc;		/* counter for pending 0x00 output values which might *
+			 * be discarded at the end ("Pacman" termination) */
+  int ct;  /* bit shift counter, determines when next byte will be written */
+  int buffer;		/* buffer for most recent output byte != 0xFF */
+
+  int last_dc_val[MAX_COMPS_IN_SCAN]; /* last DC coef for each component */
+  int dc_context[MAX_COMPS_IN_SCAN]; /* context index for DC conditioning */
+
+  unsigned int restarts_to_go;	/* MCUs left in this restart interval */
+  int next_restart_num;		/* next restart number to write (0-7) */
+
+  /* Pointers to statistics areas (these workspaces have image lifespan) */
+  unsigned char * dc_stats[NUM_ARITH_TBLS];
+  unsigned char * ac_stats[NUM_ARITH_TBLS];
+  int dc_stat_bins;		/* size of a DC statistics area */
+
+  /* Statistics bin for coding with fixed probability 0.5 */
+  unsigned char fixed_bin[4];
+
+#ifdef C_LOSSLESS_SUPPORTED
+  /* Conditioning categories (Section H.1.2.3.1) of the differences in the
+   * line above, for each component, and of the difference to the left, for
+   * each group of data units within an MCU.  The groups and input pointers
+   * are set up like in jclhuff.c.
+   */
+  unsigned char * above_cats[MAX_COMPONENTS];
+  JDIMENSION above_width[MAX_COMPONENTS];
+  unsigned char * above_ptr[C_MAX_DATA_UNITS_IN_MCU];
+  int left_cat[C_MAX_DATA_UNITS_IN_MCU];
+
+  JDIFFROW input_ptr[C_MAX_DATA_UNITS_IN_MCU];
+  int input_ptr_ci[C_MAX_DATA_UNITS_IN_MCU];
+  int input_ptr_yoffset[C_MAX_DATA_UNITS_IN_MCU];
+  int input_ptr_MCU_width[C_MAX_DATA_UNITS_IN_MCU];
+  int num_input_ptrs;
+
+  /* Index of the proper input pointer for each data unit within an MCU */
+  int input_ptr_index[C_MAX_DATA_UNITS_IN_MCU];
+  /* Index of the scan component for each data unit within an MCU */
+  int input_comp_index[C_MAX_DATA_UNITS_IN_MCU];
+#endif
+} arith_entropy_encoder;
+
+typedef arith_entropy_encoder * arith_entropy_ptr;
+
+/* The following two definitions specify the allocation chunk size
+ * for the statistics area.
+ * According to sections F.1.4.4.1.3 and F.1.4.4.2, we need at least
+ * 49 statistics bins for DC, and 245 statistics bins for AC coding.
+ * The lossless model of Table H.3 needs 158 bins.
+ *
+ * We use a compact representation with 1 byte per statistics bin,
+ * thus the numbers directly represent byte sizes.
+ * This 1 byte per statistics bin contains the meaning of the MPS
+ * (more probable symbol) in the highest bit (mask 0x80), and the
+ * index into the probability estimation state machine table
+ * in the lower bits (mask 0x7F).
+ */
+
+#define DC_STAT_BINS 64
+#define AC_STAT_BINS 256
+#define DIFF_STAT_BINS 158
+
+/* NOTE: Uncomment the following #define if you want to use the
+ * given formula for calculating the AC conditioning parameter Kx
+ * for spectral selection progressive coding in section G.1.3.2
+ * of the spec (Kx = Kmin + SRL (8 + Se - Kmin) 4).
+ * Although the spec and P&M authors recommend this formula,
+ * it is not used by default here.
+ */
+
+/* #define CALCULATE_SPECTRAL_CONDITIONING */
+
+/* IRIGHT_SHIFT is like RIGHT_SHIFT, but works on int rather than IJG_INT32.
+ * We assume that int right shift is unsigned if IJG_INT32 right shift is,
+ * which should be safe.
+ */
+
+#ifdef RIGHT_SHIFT_IS_UNSIGNED
+#define ISHIFT_TEMPS	int ishift_temp;
+#define IRIGHT_SHIFT(x,shft)  \
+	((ishift_temp = (x)) < 0 ? \
+	 (ishift_temp >> (shft)) | ((~0) << (16-(shft))) : \
+	 (ishift_temp >> (shft)))
+#else
+#define ISHIFT_TEMPS
+#define IRIGHT_SHIFT(x,shft)	((x) >> (shft))
+#endif
+
+
+LOCAL(void)
+emit_byte (int val, j_compress_ptr cinfo)
+/* Write next output byte; we do not support suspension in this module. */
+{
+  struct jpeg_destination_mgr * dest = cinfo->dest;
+
+  *dest->next_output_byte++ = (JOCTET) val;
+  if (--dest->free_in_buffer == 0)
+    if (! (*dest->empty_output_buffer) (cinfo))
+      ERREXIT(cinfo, JERR_CANT_SUSPEND);
+}
+
+
+/*
+ * Finish up at the end of an arithmetic-compressed scan.
+ */
+
+LOCAL(void)
+finish_arith (j_compress_ptr cinfo, arith_entropy_ptr e)
+{
+  IJG_INT32 temp;
+
+  /* Section D.1.8: Termination of encoding */
+
+  /* Find the e->c in the coding interval with the largest
+   * number of trailing zero bits */
+  if ((temp = (e->a - 1 + e->c) & 0xFFFF0000L) < e->c)
+    e->c = temp + 0x8000L;
+  else
+    e->c = temp;
+  /* Send remaining bytes to output */
+  e->c <<= e->ct;
+  if (e->c & 0xF8000000L) {
+    /* One final overflow has to be handled */
+    if (e->buffer >= 0) {
+      if (e->zc)
+	do emit_byte(0x00, cinfo);
+	while (--e->zc);
+      emit_byte(e->buffer + 1, cinfo);
+      if (e->buffer + 1 == 0xFF)
+	emit_byte(0x00, cinfo);
+    }
+    e->zc += e->sc;  /* carry-over converts stacked 0xFF bytes to 0x00 */
+    e->sc = 0;
+  } else {
+    if (e->buffer == 0)
+      ++e->zc;
+    else if (e->buffer >= 0) {
+      if (e->zc)
+	do emit_byte(0x00, cinfo);
+	while (--e->zc);
+      emit_byte(e->buffer, cinfo);
+    }
+    if (e->sc) {
+      if (e->zc)
+	do emit_byte(0x00, cinfo);
+	while (--e->zc);
+      do {
+	emit_byte(0xFF, cinfo);
+	emit_byte(0x00, cinfo);
+      } while (--e->sc);
+    }
+  }
+  /* Output final bytes only if they are not 0x00 */
+  if (e->c & 0x7FFF800L) {
+    if (e->zc)  /* output final pending zero bytes */
+      do emit_byte(0x00, cinfo);
+      while (--e->zc);
+    emit_byte((e->c >> 19) & 0xFF, cinfo);
+    if (((e->c >> 19) & 0xFF) == 0xFF)
+      emit_byte(0x00, cinfo);
+    if (e->c & 0x7F800L) {
+      emit_byte((e->c >> 11) & 0xFF, cinfo);
+      if (((e->c >> 11) & 0xFF) == 0xFF)
+	emit_byte(0x00, cinfo);
+    }
+  }
+}
+
+
+/*
+ * The core arithmetic encoding routine (common in JPEG and JBIG).
+ * This needs to go as fast as possible.
+ * Machine-dependent optimization facilities
+ * are not utilized in this portable implementation.
+ * However, this code should be fairly efficient and
+ * may be a good base for further optimizations anyway.
+ *
+ * Parameter 'val' to be encoded may be 0 or 1 (binary decision).
+ *
+ * Note: I've added full "Pacman" termination support to the
+ * byte output routines, which is equivalent to the optional
+ * Discard_final_zeros procedure (Figure D.15) in the spec.
+ * Thus, we always produce the shortest possible output
+ * stream compliant to the spec (no trailing zero bytes,
+ * except for FF stuffing).
+ *
+ * I've also introduced a new scheme for accessing
+ * the probability estimation state machine table,
+ * derived from Markus Kuhn's JBIG implementation.
+ */
+
+LOCAL(void)
+arith_encode (j_compress_ptr cinfo, arith_entropy_ptr e, unsigned char *st,
+	      int val)
+{
+  register unsigned char nl, nm;
+  register IJG_INT32 qe, temp;
+  register int sv;
+
+  /* Fetch values from our compact representation of Table D.2:
+   * Qe values and probability estimation state machine
+   */
+  sv = *st;
+  qe = jpeg_aritab[sv & 0x7F];	/* => Qe_Value */
+  nl = (unsigned char) (qe & 0xFF); qe >>= 8;	/* Next_Index_LPS + Switch_MPS */
+  nm = (unsigned char) (qe & 0xFF); qe >>= 8;	/* Next_Index_MPS */
+
+  /* Encode & estimation procedures per sections D.1.4 & D.1.5 */
+  e->a -= qe;
+  if (val != (sv >> 7)) {
+    /* Encode the less probable symbol */
+    if (e->a >= qe) {
+      /* If the interval size (qe) for the less probable symbol (LPS)
+       * is larger than the interval size for the MPS, then exchange
+       * the two symbols for coding efficiency, otherwise code the LPS
+       * as usual: */
+      e->c += e->a;
+      e->a = qe;
+    }
+    *st = (sv & 0x80) ^ nl;	/* Estimate_after_LPS */
+  } else {
+    /* Encode the more probable symbol */
+    if (e->a >= 0x8000L)
+      return;  /* A >= 0x8000 -> ready, no renormalization required */
+    if (e->a < qe) {
+      /* If the interval size (qe) for the less probable symbol (LPS)
+       * is larger than the interval size for the MPS, then exchange
+       * the two symbols for coding efficiency: */
+      e->c += e->a;
+      e->a = qe;
+    }
+    *st = (sv & 0x80) ^ nm;	/* Estimate_after_MPS */
+  }
+
+  /* Renormalization & data output per section D.1.6 */
+  do {
+    e->a <<= 1;
+    e->c <<= 1;
+    if (--e->ct == 0) {
+      /* Another byte is ready for output */
+      temp = e->c >> 19;
+      if (temp > 0xFF) {
+	/* Handle overflow over all stacked 0xFF bytes */
+	if (e->buffer >= 0) {
+	  if (e->zc)
+	    do emit_byte(0x00, cinfo);
+	    while (--e->zc);
+	  emit_byte(e->buffer + 1, cinfo);
+	  if (e->buffer + 1 == 0xFF)
+	    emit_byte(0x00, cinfo);
+	}
+	e->zc += e->sc;  /* carry-over converts stacked 0xFF bytes to 0x00 */
+	e->sc = 0;
+	/* Note: The 3 spacer bits in the C register guarantee
+	 * that the new buffer byte can't be 0xFF here
+	 * (see page 160 in the P&M JPEG book). */
+	e->buffer = (int) (temp & 0xFF);  /* new output byte, might overflow later */
+      } else if (temp == 0xFF) {
+	++e->sc;  /* stack 0xFF byte (which might overflow later) */
+      } else {
+	/* Output all stacked 0xFF bytes, they will not overflow any more */
+	if (e->buffer == 0)
+	  ++e->zc;
+	else if (e->buffer >= 0) {
+	  if (e->zc)
+	    do emit_byte(0x00, cinfo);
+	    while (--e->zc);
+	  emit_byte(e->buffer, cinfo);
+	}
+	if (e->sc) {
+	  if (e->zc)
+	    do emit_byte(0x00, cinfo);
+	    while (--e->zc);
+	  do {
+	    emit_byte(0xFF, cinfo);
+	    emit_byte(0x00, cinfo);
+	  } while (--e->sc);
+	}
+	e->buffer = (int) (temp & 0xFF);  /* new output byte (can still overflow) */
+      }
+      e->c &= 0x7FFFFL;
+      e->ct += 8;
+    }
+  } while (e->a < 0x8000L);
+}
+
+
+/*
+ * Encode a DC coefficient difference or a lossless sample difference v,
+ * using the statistics bins starting at S0 (st) and X1 (x1) of Tables F.4
+ * and H.3.  lo and hi are the bounds (1 << L) >> 1 and (1 << U) >> 1 of the
+ * conditioning table.  Returns the conditioning category of v, for coding
+ * the differences that follow (Section F.1.4.4.1.2): 0 for zero, 1 and 2 for
+ * small positive and negative, 3 and 4 for large positive and negative.
+ */
+
+LOCAL(int)
+encode_diff (j_compress_ptr cinfo, arith_entropy_ptr e, unsigned char *st,
+	     unsigned char *x1, int v, int lo, int hi)
+{
+  int v2, m, cat;
+
+  /* Figure F.4: Encode_DC_DIFF */
+  if (v == 0) {
+    arith_encode(cinfo, e, st, 0);
+    return 0;			/* zero diff category */
+  }
+
+  arith_encode(cinfo, e, st, 1);
+  /* Figure F.6: Encoding nonzero value v */
+  /* Figure F.7: Encoding the sign of v */
+  if (v > 0) {
+    arith_encode(cinfo, e, st + 1, 0);	/* Table F.4: SS = S0 + 1 */
+    st += 2;				/* Table F.4: SP = S0 + 2 */
+    cat = 1;				/* small positive diff category */
+  } else {
+    v = -v;
+    arith_encode(cinfo, e, st + 1, 1);	/* Table F.4: SS = S0 + 1 */
+    st += 3;				/* Table F.4: SN = S0 + 3 */
+    cat = 2;				/* small negative diff category */
+  }
+  /* Figure F.8: Encoding the magnitude category of v */
+  m = 0;
+  if (v -= 1) {
+    arith_encode(cinfo, e, st, 1);
+    m = 1;
+    v2 = v;
+    st = x1;
+    while (v2 >>= 1) {
+      arith_encode(cinfo, e, st, 1);
+      m <<= 1;
+      st += 1;
+    }
+  }
+  arith_encode(cinfo, e, st, 0);
+  /* Section F.1.4.4.1.2: Establish conditioning category */
+  if (m < lo)
+    cat = 0;			/* zero diff category */
+  else if (m > hi)
+    cat += 2;			/* large diff category */
+  /* Figure F.9: Encoding the magnitude bit pattern of v */
+  st += 14;
+  while (m >>= 1)
+    arith_encode(cinfo, e, st, (m & v) ? 1 : 0);
+
+  return cat;
+}
+
+
+/*
+ * Encode an AC coefficient magnitude v (which is nonzero, and the sign of
+ * which has been coded) at position k, with st pointing to the SE bin of k.
+ */
+
+LOCAL(void)
+encode_ac_value (j_compress_ptr cinfo, arith_entropy_ptr e, unsigned char *st,
+		 int tbl, int k, int v)
+{
+  int v2, m;
+
+  st += 2;
+  /* Figure F.8: Encoding the magnitude category of v */
+  m = 0;
+  if (v -= 1) {
+    arith_encode(cinfo, e, st, 1);
+    m = 1;
+    v2 = v;
+    if (v2 >>= 1) {
+      arith_encode(cinfo, e, st, 1);
+      m <<= 1;
+      st = e->ac_stats[tbl] + (k <= cinfo->arith_ac_K[tbl] ? 189 : 217);
+      while (v2 >>= 1) {
+	arith_encode(cinfo, e, st, 1);
+	m <<= 1;
+	st += 1;
+      }
+    }
+  }
+  arith_encode(cinfo, e, st, 0);
+  /* Figure F.9: Encoding the magnitude bit pattern of v */
+  st += 14;
+  while (m >>= 1)
+    arith_encode(cinfo, e, st, (m & v) ? 1 : 0);
+}
+
+
+/*
+ * Reset the statistics areas and the coder at the start of a scan or of a
+ * restart interval.
+ */
+
+LOCAL(void)
+reset_coder (j_compress_ptr cinfo, arith_entropy_ptr entropy)
+{
+  int ci;
+  jpeg_component_info * compptr;
+
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    /* DC needs no table for refinement scan */
+    if (cinfo->process == JPROC_LOSSLESS ||
+	(cinfo->Ss == 0 && cinfo->Ah == 0)) {
+      MEMZERO(entropy->dc_stats[compptr->dc_tbl_no], entropy->dc_stat_bins);
+      /* Reset DC predictions to 0 */
+      entropy->last_dc_val[ci] = 0;
+      entropy->dc_context[ci] = 0;
+    }
+    /* AC needs no table when not present */
+    if (cinfo->process != JPROC_LOSSLESS && cinfo->Se) {
+      MEMZERO(entropy->ac_stats[compptr->ac_tbl_no], AC_STAT_BINS);
+    }
+#ifdef C_LOSSLESS_SUPPORTED
+    /* The first line of an interval has no line above (Section H.1.2.3.1) */
+    if (cinfo->process == JPROC_LOSSLESS)
+      MEMZERO(entropy->above_cats[compptr->component_index],
+	      entropy->above_width[compptr->component_index]);
+#endif
+  }
+
+  /* Reset arithmetic encoding variables */
+  entropy->c = 0;
+  entropy->a = 0x10000L;
+  entropy->sc = 0;
+  entropy->zc = 0;
+  entropy->ct = 11;
+  entropy->buffer = -1;  /* empty */
+}
+
+
+/*
+ * Emit a restart marker & resynchronize predictions.
+ */
+
+LOCAL(void)
+emit_restart (j_compress_ptr cinfo, arith_entropy_ptr entropy)
+{
+  finish_arith(cinfo, entropy);
+
+  emit_byte(0xFF, cinfo);
+  emit_byte(JPEG_RST0 + entropy->next_restart_num, cinfo);
+
+  reset_coder(cinfo, entropy);
+
+  entropy->restarts_to_go = cinfo->restart_interval;
+  entropy->next_restart_num++;
+  entropy->next_restart_num &= 7;
+}
+
+
+/*
+ * Allocate the statistics areas of the tables used in this scan and
+ * initialize the coder.
+ */
+
+LOCAL(void)
+start_arith (j_compress_ptr cinfo, arith_entropy_ptr entropy)
+{
+  int ci, tbl;
+  jpeg_component_info * compptr;
+
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    /* DC needs no table for refinement scan */
+    if (cinfo->process == JPROC_LOSSLESS ||
+	(cinfo->Ss == 0 && cinfo->Ah == 0)) {
+      tbl = compptr->dc_tbl_no;
+      if (tbl < 0 || tbl >= NUM_ARITH_TBLS)
+	ERREXIT1(cinfo, JERR_NO_ARITH_TABLE, tbl);
+      if (entropy->dc_stats[tbl] == NULL)
+	entropy->dc_stats[tbl] = (unsigned char *) (*cinfo->mem->alloc_small)
+	  ((j_common_ptr) cinfo, JPOOL_IMAGE, entropy->dc_stat_bins);
+    }
+    /* AC needs no table when not present */
+    if (cinfo->process != JPROC_LOSSLESS && cinfo->Se) {
+      tbl = compptr->ac_tbl_no;
+      if (tbl < 0 || tbl >= NUM_ARITH_TBLS)
+	ERREXIT1(cinfo, JERR_NO_ARITH_TABLE, tbl);
+      if (entropy->ac_stats[tbl] == NULL)
+	entropy->ac_stats[tbl] = (unsigned char *) (*cinfo->mem->alloc_small)
+	  ((j_common_ptr) cinfo, JPOOL_IMAGE, AC_STAT_BINS);
+#ifdef CALCULATE_SPECTRAL_CONDITIONING
+      if (cinfo->process == JPROC_PROGRESSIVE)
+	/* Section G.1.3.2: Set appropriate arithmetic conditioning value Kx */
+	cinfo->arith_ac_K[tbl] = cinfo->Ss + ((8 + cinfo->Se - cinfo->Ss) >> 4);
+#endif
+    }
+  }
+
+  reset_coder(cinfo, entropy);
+
+  /* Initialize restart stuff */
+  entropy->restarts_to_go = cinfo->restart_interval;
+  entropy->next_restart_num = 0;
+}
+
+
+/*
+ * MCU encoding for DC initial scan (either spectral selection,
+ * or first pass of successive approximation), and for sequential mode
+ * with Se = 0.
+ */
+
+METHODDEF(boolean)
+encode_mcu_DC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  j_lossy_c_ptr lossyc = (j_lossy_c_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) lossyc->entropy_private;
+  int blkn, ci, tbl;
+  int m;
+  ISHIFT_TEMPS
+
+  /* Emit restart marker if needed */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      emit_restart(cinfo, entropy);
+    entropy->restarts_to_go--;
+  }
+
+  /* Encode the MCU data blocks */
+  for (blkn = 0; blkn < cinfo->data_units_in_MCU; blkn++) {
+    ci = cinfo->MCU_membership[blkn];
+    tbl = cinfo->cur_comp_info[ci]->dc_tbl_no;
+
+    /* Compute the DC value after the required point transform by Al.
+     * This is simply an arithmetic right shift.
+     */
+    m = IRIGHT_SHIFT((int) (MCU_data[blkn][0][0]), cinfo->Al);
+
+    /* Sections F.1.4.1 & F.1.4.4.1: Encoding of DC coefficients */
+    /* Table F.4: Point to statistics bin S0 for DC coefficient coding */
+    entropy->dc_context[ci] = 4 *
+      encode_diff(cinfo, entropy, entropy->dc_stats[tbl] + entropy->dc_context[ci],
+		  entropy->dc_stats[tbl] + 20, /* Table F.4: X1 = 20 */
+		  m - entropy->last_dc_val[ci],
+		  (int) ((1L << cinfo->arith_dc_L[tbl]) >> 1),
+		  (int) ((1L << cinfo->arith_dc_U[tbl]) >> 1));
+    entropy->last_dc_val[ci] = m;
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * MCU encoding for AC initial scan (either spectral selection,
+ * or first pass of successive approximation).
+ */
+
+METHODDEF(boolean)
+encode_mcu_AC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  j_lossy_c_ptr lossyc = (j_lossy_c_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) lossyc->entropy_private;
+  JBLOCKROW block;
+  unsigned char *st;
+  int tbl, k, ke;
+  int v;
+
+  /* Emit restart marker if needed */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      emit_restart(cinfo, entropy);
+    entropy->restarts_to_go--;
+  }
+
+  /* Encode the MCU data block */
+  block = MCU_data[0];
+  tbl = cinfo->cur_comp_info[0]->ac_tbl_no;
+
+  /* Sections F.1.4.2 & F.1.4.4.2: Encoding of AC coefficients */
+
+  /* Establish EOB (end-of-block) index */
+  ke = cinfo->Se;
+  do {
+    /* We must apply the point transform by Al.  For AC coefficients this
+     * is an integer division with rounding towards 0.  To do this portably
+     * in C, we shift after obtaining the absolute value.
+     */
+    if ((v = (*block)[jpeg_natural_order[ke]]) >= 0) {
+      if (v >>= cinfo->Al) break;
+    } else {
+      v = -v;
+      if (v >>= cinfo->Al) break;
+    }
+  } while (--ke);
+
+  /* Figure F.5: Encode_AC_Coefficients */
+  for (k = cinfo->Ss - 1; k < ke;) {
+    st = entropy->ac_stats[tbl] + 3 * k;
+    arith_encode(cinfo, entropy, st, 0);	/* EOB decision */
+    for (;;) {
+      if ((v = (*block)[jpeg_natural_order[++k]]) >= 0) {
+	if (v >>= cinfo->Al) {
+	  arith_encode(cinfo, entropy, st + 1, 1);
+	  arith_encode(cinfo, entropy, entropy->fixed_bin, 0);
+	  break;
+	}
+      } else {
+	v = -v;
+	if (v >>= cinfo->Al) {
+	  arith_encode(cinfo, entropy, st + 1, 1);
+	  arith_encode(cinfo, entropy, entropy->fixed_bin, 1);
+	  break;
+	}
+      }
+      arith_encode(cinfo, entropy, st + 1, 0);
+      st += 3;
+    }
+    encode_ac_value(cinfo, entropy, st, tbl, k, v);
+  }
+  /* Encode EOB decision only if k < cinfo->Se */
+  if (k < cinfo->Se) {
+    st = entropy->ac_stats[tbl] + 3 * k;
+    arith_encode(cinfo, entropy, st, 1);
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * MCU encoding for DC successive approximation refinement scan.
+ */
+
+METHODDEF(boolean)
+encode_mcu_DC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  j_lossy_c_ptr lossyc = (j_lossy_c_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) lossyc->entropy_private;
+  unsigned char *st;
+  int Al, blkn;
+
+  /* Emit restart marker if needed */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      emit_restart(cinfo, entropy);
+    entropy->restarts_to_go--;
+  }
+
+  st = entropy->fixed_bin;	/* use fixed probability estimation */
+  Al = cinfo->Al;
+
+  /* Encode the MCU data blocks */
+  for (blkn = 0; blkn < cinfo->data_units_in_MCU; blkn++) {
+    /* We simply emit the Al'th bit of the DC coefficient value. */
+    arith_encode(cinfo, entropy, st, (MCU_data[blkn][0][0] >> Al) & 1);
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * MCU encoding for AC successive approximation refinement scan.
+ */
+
+METHODDEF(boolean)
+encode_mcu_AC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  j_lossy_c_ptr lossyc = (j_lossy_c_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) lossyc->entropy_private;
+  JBLOCKROW block;
+  unsigned char *st;
+  int tbl, k, ke, kex;
+  int v;
+
+  /* Emit restart marker if needed */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      emit_restart(cinfo, entropy);
+    entropy->restarts_to_go--;
+  }
+
+  /* Encode the MCU data block */
+  block = MCU_data[0];
+  tbl = cinfo->cur_comp_info[0]->ac_tbl_no;
+
+  /* Section G.1.3.3: Encoding of AC coefficients */
+
+  /* Establish EOB (end-of-block) index */
+  ke = cinfo->Se;
+  do {
+    /* We must apply the point transform by Al.  For AC coefficients this
+     * is an integer division with rounding towards 0.  To do this portably
+     * in C, we shift after obtaining the absolute value.
+     */
+    if ((v = (*block)[jpeg_natural_order[ke]]) >= 0) {
+      if (v >>= cinfo->Al) break;
+    } else {
+      v = -v;
+      if (v >>= cinfo->Al) break;
+    }
+  } while (--ke);
+
+  /* Establish EOBx (previous stage end-of-block) index */
+  for (kex = ke; kex > 0; kex--)
+    if ((v = (*block)[jpeg_natural_order[kex]]) >= 0) {
+      if (v >>= cinfo->Ah) break;
+    } else {
+      v = -v;
+      if (v >>= cinfo->Ah) break;
+    }
+
+  /* Figure G.10: Encode_AC_Coefficients_SA */
+  for (k = cinfo->Ss - 1; k < ke;) {
+    st = entropy->ac_stats[tbl] + 3 * k;
+    if (k >= kex)
+      arith_encode(cinfo, entropy, st, 0);	/* EOB decision */
+    for (;;) {
+      if ((v = (*block)[jpeg_natural_order[++k]]) >= 0) {
+	if (v >>= cinfo->Al) {
+	  if (v >> 1)			/* previously nonzero coef */
+	    arith_encode(cinfo, entropy, st + 2, (v & 1));
+	  else {			/* newly nonzero coef */
+	    arith_encode(cinfo, entropy, st + 1, 1);
+	    arith_encode(cinfo, entropy, entropy->fixed_bin, 0);
+	  }
+	  break;
+	}
+      } else {
+	v = -v;
+	if (v >>= cinfo->Al) {
+	  if (v >> 1)			/* previously nonzero coef */
+	    arith_encode(cinfo, entropy, st + 2, (v & 1));
+	  else {			/* newly nonzero coef */
+	    arith_encode(cinfo, entropy, st + 1, 1);
+	    arith_encode(cinfo, entropy, entropy->fixed_bin, 1);
+	  }
+	  break;
+	}
+      }
+      arith_encode(cinfo, entropy, st + 1, 0);
+      st += 3;
+    }
+  }
+  /* Encode EOB decision only if k < cinfo->Se */
+  if (k < cinfo->Se) {
+    st = entropy->ac_stats[tbl] + 3 * k;
+    arith_encode(cinfo, entropy, st, 1);
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * Encode and output one MCU's worth of arithmetic-compressed coefficients
+ * in sequential mode.
+ */
+
+METHODDEF(boolean)
+encode_mcu (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  j_lossy_c_ptr lossyc = (j_lossy_c_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) lossyc->entropy_private;
+  jpeg_component_info * compptr;
+  JBLOCKROW block;
+  unsigned char *st;
+  int blkn, ci, tbl, k, ke;
+  int v;
+
+  /* Emit restart marker if needed */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      emit_restart(cinfo, entropy);
+    entropy->restarts_to_go--;
+  }
+
+  /* Encode the MCU data blocks */
+  for (blkn = 0; blkn < cinfo->data_units_in_MCU; blkn++) {
+    block = MCU_data[blkn];
+    ci = cinfo->MCU_membership[blkn];
+    compptr = cinfo->cur_comp_info[ci];
+
+    /* Sections F.1.4.1 & F.1.4.4.1: Encoding of DC coefficients */
+
+    tbl = compptr->dc_tbl_no;
+    /* Table F.4: Point to statistics bin S0 for DC coefficient coding */
+    entropy->dc_context[ci] = 4 *
+      encode_diff(cinfo, entropy, entropy->dc_stats[tbl] + entropy->dc_context[ci],
+		  entropy->dc_stats[tbl] + 20, /* Table F.4: X1 = 20 */
+		  (*block)[0] - entropy->last_dc_val[ci],
+		  (int) ((1L << cinfo->arith_dc_L[tbl]) >> 1),
+		  (int) ((1L << cinfo->arith_dc_U[tbl]) >> 1));
+    entropy->last_dc_val[ci] = (*block)[0];
+
+    /* Sections F.1.4.2 & F.1.4.4.2: Encoding of AC coefficients */
+
+    tbl = compptr->ac_tbl_no;
+
+    /* Establish EOB (end-of-block) index */
+    ke = DCTSIZE2 - 1;
+    do {
+      if ((*block)[jpeg_natural_order[ke]]) break;
+    } while (--ke);
+
+    /* Figure F.5: Encode_AC_Coefficients */
+    for (k = 0; k < ke;) {
+      st = entropy->ac_stats[tbl] + 3 * k;
+      arith_encode(cinfo, entropy, st, 0);	/* EOB decision */
+      while ((v = (*block)[jpeg_natural_order[++k]]) == 0) {
+	arith_encode(cinfo, entropy, st + 1, 0);
+	st += 3;
+      }
+      arith_encode(cinfo, entropy, st + 1, 1);
+      /* Figure F.6: Encoding nonzero value v */
+      /* Figure F.7: Encoding the sign of v */
+      if (v > 0) {
+	arith_encode(cinfo, entropy, entropy->fixed_bin, 0);
+      } else {
+	v = -v;
+	arith_encode(cinfo, entropy, entropy->fixed_bin, 1);
+      }
+      encode_ac_value(cinfo, entropy, st, tbl, k, v);
+    }
+    /* Encode EOB decision only if k < DCTSIZE2 - 1 */
+    if (k < DCTSIZE2 - 1) {
+      st = entropy->ac_stats[tbl] + 3 * k;
+      arith_encode(cinfo, entropy, st, 1);
+    }
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * Finish up at the end of an arithmetic-compressed lossy scan.
+ */
+
+METHODDEF(void)
+finish_pass (j_compress_ptr cinfo)
+{
+  j_lossy_c_ptr lossyc = (j_lossy_c_ptr) cinfo->codec;
+
+  finish_arith(cinfo, (arith_entropy_ptr) lossyc->entropy_private);
+}
+
+
+/*
+ * Initialize for an arithmetic-compressed lossy scan.
+ */
+
+METHODDEF(void)
+start_pass (j_compress_ptr cinfo, boolean gather_statistics)
+{
+  j_lossy_c_ptr lossyc = (j_lossy_c_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) lossyc->entropy_private;
+
+  if (gather_statistics)
+    /* Make sure to avoid that in the master control logic!
+     * We are fully adaptive here and need no extra
+     * statistics gathering pass!
+     */
+    ERREXIT(cinfo, JERR_NOT_COMPILED);
+
+  /* We assume jcmaster.c already validated the progressive scan parameters. */
+
+  /* Select execution routines */
+  if (cinfo->process == JPROC_PROGRESSIVE) {
+    if (cinfo->Ah == 0) {
+      if (cinfo->Ss == 0)
+	lossyc->entropy_encode_mcu = encode_mcu_DC_first;
+      else
+	lossyc->entropy_encode_mcu = encode_mcu_AC_first;
+    } else {
+      if (cinfo->Ss == 0)
+	lossyc->entropy_encode_mcu = encode_mcu_DC_refine;
+      else
+	lossyc->entropy_encode_mcu = encode_mcu_AC_refine;
+    }
+  } else
+    lossyc->entropy_encode_mcu = encode_mcu;
+
+  start_arith(cinfo, entropy);
+}
+
+
+#ifdef C_LOSSLESS_SUPPORTED
+
+/*
+ * Encode and output nMCU's worth of arithmetic-compressed differences.
+ *
+ * Each difference is coded like a DC difference (Section H.1.2.3), with the
+ * statistics selected by the conditioning categories of the differences to
+ * the left (Da) and above (Db) per Figure H.3 and Table H.3:
+ * S0 = 4 * (5 * Da + Db), and X1 = 100, or X1 = 129 if Db is large.
+ */
+
+METHODDEF(JDIMENSION)
+encode_mcus_diff (j_compress_ptr cinfo, JDIFFIMAGE diff_buf,
+		  JDIMENSION MCU_row_num, JDIMENSION MCU_col_num,
+		  JDIMENSION nMCU)
+{
+  j_lossless_c_ptr losslsc = (j_lossless_c_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) losslsc->entropy_private;
+  jpeg_component_info * compptr;
+  unsigned char *st;
+  unsigned int mcu_num;
+  int sampn, ci, ptrn, tbl, v, da, db;
+  int lo[MAX_COMPS_IN_SCAN], hi[MAX_COMPS_IN_SCAN];
+
+  /* Emit restart marker if needed */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      emit_restart(cinfo, entropy);
+  }
+
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    tbl = cinfo->cur_comp_info[ci]->dc_tbl_no;
+    lo[ci] = (int) ((1L << cinfo->arith_dc_L[tbl]) >> 1);
+    hi[ci] = (int) ((1L << cinfo->arith_dc_U[tbl]) >> 1);
+  }
+
+  /* Set input pointer locations based on MCU_col_num; the difference to
+   * the left of the first one in a line counts as zero.
+   */
+  for (ptrn = 0; ptrn < entropy->num_input_ptrs; ptrn++) {
+    ci = entropy->input_ptr_ci[ptrn];
+    entropy->input_ptr[ptrn] =
+      diff_buf[ci][MCU_row_num + entropy->input_ptr_yoffset[ptrn]] +
+      (MCU_col_num * entropy->input_ptr_MCU_width[ptrn]);
+    entropy->above_ptr[ptrn] = entropy->above_cats[ci] +
+      (MCU_col_num * entropy->input_ptr_MCU_width[ptrn]);
+    if (MCU_col_num == 0)
+      entropy->left_cat[ptrn] = 0;
+  }
+
+  for (mcu_num = 0; mcu_num < nMCU; mcu_num++) {
+
+    /* Inner loop handles the samples in the MCU */
+    for (sampn = 0; sampn < cinfo->data_units_in_MCU; sampn++) {
+      ptrn = entropy->input_ptr_index[sampn];
+      ci = entropy->input_comp_index[sampn];
+      compptr = cinfo->cur_comp_info[ci];
+      st = entropy->dc_stats[compptr->dc_tbl_no];
+
+      /* Input the sample difference, as a signed value mod 2^16 */
+      v = *entropy->input_ptr[ptrn]++;
+      v = (v & 0x7FFF) - (v & 0x8000);
+
+      /* Table H.3: Point to statistics bins S0 and X1 */
+      da = entropy->left_cat[ptrn];
+      db = *entropy->above_ptr[ptrn];
+      da = encode_diff(cinfo, entropy, st + 4 * (5 * da + db),
+		       st + (db > 2 ? 129 : 100), v, lo[ci], hi[ci]);
+      entropy->left_cat[ptrn] = da;
+      *entropy->above_ptr[ptrn]++ = (unsigned char) da;
+    }
+
+    /* Update restart-interval state too */
+    if (cinfo->restart_interval)
+      entropy->restarts_to_go--;
+  }
+
+  return nMCU;
+}
+
+
+/*
+ * Finish up at the end of an arithmetic-compressed lossless scan.
+ */
+
+METHODDEF(void)
+finish_pass_diff (j_compress_ptr cinfo)
+{
+  j_lossless_c_ptr losslsc = (j_lossless_c_ptr) cinfo->codec;
+
+  finish_arith(cinfo, (arith_entropy_ptr) losslsc->entropy_private);
+}
+
+
+/*
+ * Initialize for an arithmetic-compressed lossless scan.
+ */
+
+METHODDEF(void)
+start_pass_diff (j_compress_ptr cinfo, boolean gather_statistics)
+{
+  j_lossless_c_ptr losslsc = (j_lossless_c_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) losslsc->entropy_private;
+  int ci, sampn, ptrn, yoffset, xoffset;
+  JDIMENSION width;
+  jpeg_component_info * compptr;
+
+  if (gather_statistics)
+    ERREXIT(cinfo, JERR_NOT_COMPILED);
+
+  losslsc->entropy_encode_mcus = encode_mcus_diff;
+
+  /* Allocate the conditioning rows, which span the MCUs of a line */
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    width = cinfo->MCUs_per_row * (JDIMENSION) compptr->MCU_width;
+    if (entropy->above_width[compptr->component_index] < width) {
+      entropy->above_cats[compptr->component_index] = (unsigned char *)
+	(*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				    (size_t) width);
+      entropy->above_width[compptr->component_index] = width;
+    }
+  }
+
+  /* Precalculate encoding info for each sample in an MCU of this scan */
+  for (sampn = 0, ptrn = 0; sampn < cinfo->data_units_in_MCU;) {
+    compptr = cinfo->cur_comp_info[cinfo->MCU_membership[sampn]];
+    for (yoffset = 0; yoffset < compptr->MCU_height; yoffset++, ptrn++) {
+      /* Precalculate the setup info for each input pointer */
+      entropy->input_ptr_ci[ptrn] = compptr->component_index;
+      entropy->input_ptr_yoffset[ptrn] = yoffset;
+      entropy->input_ptr_MCU_width[ptrn] = compptr->MCU_width;
+      for (xoffset = 0; xoffset < compptr->MCU_width; xoffset++, sampn++) {
+	/* Precalculate the input pointer index for each sample */
+	entropy->input_ptr_index[sampn] = ptrn;
+	entropy->input_comp_index[sampn] = cinfo->MCU_membership[sampn];
+      }
+    }
+  }
+  entropy->num_input_ptrs = ptrn;
+
+  start_arith(cinfo, entropy);
+}
+
+#endif /* C_LOSSLESS_SUPPORTED */
+
+
+/*
+ * Arithmetic coding needs no optimization pass.
+ */
+
+METHODDEF(boolean)
+need_optimization_pass (j_compress_ptr cinfo)
+{
+  return FALSE;
+}
 
 
 /*
@@ -20,5 +1072,46 @@
 GLOBAL(void)
 jinit_arith_encoder (j_compress_ptr cinfo)
 {
-  ERREXIT(cinfo, JERR_ARITH_NOTIMPL);
+  arith_entropy_ptr entropy;
+  int i;
+
+  entropy = (arith_entropy_ptr)
+    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				SIZEOF(arith_entropy_encoder));
+
+  if (cinfo->process == JPROC_LOSSLESS) {
+#ifdef C_LOSSLESS_SUPPORTED
+    j_lossless_c_ptr losslsc = (j_lossless_c_ptr) cinfo->codec;
+
+    losslsc->entropy_private = (void *) entropy;
+    losslsc->pub.entropy_start_pass = start_pass_diff;
+    losslsc->pub.entropy_finish_pass = finish_pass_diff;
+    losslsc->pub.need_optimization_pass = need_optimization_pass;
+    entropy->dc_stat_bins = DIFF_STAT_BINS;
+
+    for (i = 0; i < MAX_COMPONENTS; i++) {
+      entropy->above_cats[i] = NULL;
+      entropy->above_width[i] = 0;
+    }
+#else
+    ERREXIT(cinfo, JERR_NOT_COMPILED);
+#endif
+  } else {
+    j_lossy_c_ptr lossyc = (j_lossy_c_ptr) cinfo->codec;
+
+    lossyc->entropy_private = (void *) entropy;
+    lossyc->pub.entropy_start_pass = start_pass;
+    lossyc->pub.entropy_finish_pass = finish_pass;
+    lossyc->pub.need_optimization_pass = need_optimization_pass;
+    entropy->dc_stat_bins = DC_STAT_BINS;
+  }
+
+  /* Mark tables unallocated */
+  for (i = 0; i < NUM_ARITH_TBLS; i++) {
+    entropy->dc_stats[i] = NULL;
+    entropy->ac_stats[i] = NULL;
+  }
+
+  /* Initialize index for fixed probability estimation */
+  entropy->fixed_bin[0] = 113;
 }
@@ -157,13 +157,18 @@ start_pass_huff (j_compress_ptr cinfo, boolean gather_statistics)
       /* (make_c_derived_tbl does this in the other path) */
       if (dctbl < 0 || dctbl >= NUM_HUFF_TBLS)
 	ERREXIT1(cinfo, JERR_NO_HUFF_TABLE, dctbl);
-      /* Allocate and zero the statistics tables */
+      /* Allocate and zero the statistics tables, unless the application */
+      /* collects the counts itself */
       /* Note that jpeg_gen_optimal_table expects 257 entries in each table! */
-      if (entropy->count_ptrs[dctbl] == NULL)
-	entropy->count_ptrs[dctbl] = (long *)
-	  (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				      257 * SIZEOF(long));
-      MEMZERO(entropy->count_ptrs[dctbl], 257 * SIZEOF(long));
+      if (cinfo->dc_huff_counts[dctbl] != NULL)
+	entropy->count_ptrs[dctbl] = cinfo->dc_huff_counts[dctbl];
+      else {
+	if (entropy->count_ptrs[dctbl] == NULL)
+	  entropy->count_ptrs[dctbl] = (long *)
+	    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+					257 * SIZEOF(long));
+	MEMZERO(entropy->count_ptrs[dctbl], 257 * SIZEOF(long));
+      }
 #endif
     } else {
       /* Compute derived values for Huffman tables */
@@ -543,6 +548,7 @@ finish_pass_gather (j_compress_ptr cinfo)
   jpeg_component_info * compptr;
   JHUFF_TBL **htblptr;
   boolean did_dc[NUM_HUFF_TBLS];
+  long freq[257];
 
   /* It's important not to apply jpeg_gen_optimal_table more than once
    * per table, because it clobbers the input frequency counts!
@@ -556,7 +562,9 @@ finish_pass_gather (j_compress_ptr cinfo)
       htblptr = & cinfo->dc_huff_tbl_ptrs[dctbl];
       if (*htblptr == NULL)
 	*htblptr = jpeg_alloc_huff_table((j_common_ptr) cinfo);
-      jpeg_gen_optimal_table(cinfo, *htblptr, entropy->count_ptrs[dctbl]);
+      /* Work on a copy of counts that belong to the application */
+      MEMCOPY(freq, entropy->count_ptrs[dctbl], SIZEOF(freq));
+      jpeg_gen_optimal_table(cinfo, *htblptr, freq);
       did_dc[dctbl] = TRUE;
     }
   }
@@ -17,6 +17,8 @@
 #define JPEG_INTERNALS
 #include "jinclude12.h"
 #include "jpeglib12.h"
+#include "jlossy12.h"
+#include "jlossls12.h"
 
 
 /* Forward declarations */
@@ -176,6 +178,158 @@ jpeg_read_scanlines (j_decompress_ptr cinfo, JSAMPARRAY scanlines,
 }
 
 
+/*
+ * Restrict the output to a band of columns, for decoding a region of the
+ * image.  Call after jpeg_start_decompress, before reading any scanlines.
+ *
+ * On entry *xoffset and *width give the columns the application wants.  The
+ * band is widened to whole iMCU columns, and on return they give the columns
+ * actually decoded; output_width becomes *width.  Only the blocks of those
+ * columns are inverse transformed, upsampled and color converted; all of the
+ * entropy-coded data must still be decoded.  The outermost samples of the
+ * band may differ slightly from those of the whole image where fancy
+ * upsampling needs neighbors outside it.  Lossless images are not cropped.
+ */
+
+GLOBAL(void)
+jpeg_crop_scanline (j_decompress_ptr cinfo, JDIMENSION *xoffset,
+		    JDIMENSION *width)
+{
+  int ci, align;
+  JDIMENSION input_xoffset;
+  jpeg_component_info *compptr;
+
+  if (cinfo->global_state != DSTATE_SCANNING || cinfo->output_scanline != 0)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  if (xoffset == NULL || width == NULL || *width == 0 ||
+      *xoffset + *width > cinfo->output_width)
+    ERREXIT(cinfo, JERR_BAD_CROP_SPEC);
+
+  if (cinfo->process == JPROC_LOSSLESS || *width == cinfo->output_width) {
+    *xoffset = 0;
+    *width = cinfo->output_width;
+    return;
+  }
+
+  /* Align the band to iMCU columns */
+  align = cinfo->min_codec_data_unit * cinfo->max_h_samp_factor;
+  input_xoffset = *xoffset;
+  *xoffset = (input_xoffset / align) * align;
+  *width = *width + input_xoffset - *xoffset;
+  cinfo->output_width = *width;
+  cinfo->master->first_iMCU_col = *xoffset / align;
+  cinfo->master->last_iMCU_col = (JDIMENSION)
+    jdiv_round_up((long) (*xoffset + *width), (long) align) - 1;
+
+  /* Width of each component within the band, after IDCT scaling */
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    compptr->downsampled_width = (JDIMENSION)
+      jdiv_round_up((long) cinfo->output_width *
+		    (long) (compptr->h_samp_factor * compptr->codec_data_unit),
+		    (long) (cinfo->max_h_samp_factor * cinfo->min_codec_data_unit));
+  }
+}
+
+
+/*
+ * Skip scanlines of the output.  The return value is the number of lines
+ * skipped, which is less than num_lines only at the bottom of the image or
+ * when the data source suspends.
+ *
+ * The entropy-coded data of the skipped lines is still decoded, but iMCU
+ * rows that lie wholly above the next line read (and above any rows the
+ * upsampler needs as context) are not inverse transformed.  Their lines
+ * still pass through upsampling and color conversion, at the width of the
+ * output, so that those modules keep their state.  The lossless codec
+ * predicts every row from the one above, so it reconstructs all of them.
+ */
+
+GLOBAL(JDIMENSION)
+jpeg_skip_scanlines (j_decompress_ptr cinfo, JDIMENSION num_lines)
+{
+  JDIMENSION start = cinfo->output_scanline;
+  JDIMENSION target, lines_per_iMCU_row, skip_rows, max_lines;
+  JSAMPARRAY scratch;
+
+  if (cinfo->global_state != DSTATE_SCANNING)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  if (num_lines > cinfo->output_height - start)
+    num_lines = cinfo->output_height - start;
+  if (num_lines == 0)
+    return 0;
+  target = start + num_lines;
+
+  if (cinfo->process != JPROC_LOSSLESS) {
+    lines_per_iMCU_row = (JDIMENSION)
+      (cinfo->max_v_samp_factor * cinfo->min_codec_data_unit);
+    skip_rows = target / lines_per_iMCU_row;
+    if (cinfo->upsample->need_context_rows && skip_rows > 0)
+      skip_rows--;
+    if (skip_rows > cinfo->master->first_iMCU_row)
+      cinfo->master->first_iMCU_row = skip_rows;
+  }
+
+  /* Read the lines into a scratch buffer and discard them */
+  scratch = (*cinfo->mem->alloc_sarray)
+    ((j_common_ptr) cinfo, JPOOL_IMAGE,
+     cinfo->output_width * (JDIMENSION) cinfo->output_components,
+     (JDIMENSION) cinfo->rec_outbuf_height);
+  while (cinfo->output_scanline < target) {
+    max_lines = target - cinfo->output_scanline;
+    if (max_lines > (JDIMENSION) cinfo->rec_outbuf_height)
+      max_lines = (JDIMENSION) cinfo->rec_outbuf_height;
+    if (jpeg_read_scanlines(cinfo, scratch, max_lines) == 0)
+      break;			/* suspended */
+  }
+  return cinfo->output_scanline - start;
+}
+
+
+/*
+ * Resume entropy decoding at a checkpoint recorded by an earlier decode of
+ * the same image (see jpeg_checkpoint_mgr).  Call after jpeg_start_decompress,
+ * before reading any scanlines, and position the source at the entropy-coded
+ * data recorded with the checkpoint before reading any.
+ *
+ * The iMCU rows before the checkpoint are neither entropy decoded nor
+ * reconstructed, and their scanlines hold no image data; skip them with
+ * jpeg_skip_scanlines.  Where the upsampler needs context rows, the first
+ * scanlines of the checkpoint's iMCU row are not exact either.  The
+ * predictor rows of a lossless checkpoint are only copied once decoding
+ * reaches the checkpoint, so they must stay valid until then.
+ */
+
+GLOBAL(void)
+jpeg_resume_checkpoint (j_decompress_ptr cinfo,
+			const jpeg_checkpoint * checkpoint)
+{
+  boolean supported;
+
+  if (cinfo->global_state != DSTATE_SCANNING || cinfo->output_scanline != 0)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  if (checkpoint == NULL || cinfo->inputctl->has_multiple_scans ||
+      cinfo->buffered_image || cinfo->restart_interval ||
+      checkpoint->iMCU_row >= cinfo->total_iMCU_rows)
+    ERREXIT(cinfo, JERR_BAD_CHECKPOINT);
+  if (cinfo->process == JPROC_SEQUENTIAL)
+    supported = checkpoint->num_prev_rows == 0 &&
+      ((j_lossy_d_ptr) cinfo->codec)->entropy_load_state != NULL;
+  else if (cinfo->process == JPROC_LOSSLESS)
+    supported = checkpoint->num_prev_rows > 0 &&
+      ((j_lossless_d_ptr) cinfo->codec)->entropy_load_state != NULL;
+  else
+    supported = FALSE;
+  if (! supported)
+    ERREXIT(cinfo, JERR_BAD_CHECKPOINT);
+
+  cinfo->master->resume = *checkpoint;
+  cinfo->master->resume_pending = TRUE;
+  if (checkpoint->iMCU_row > cinfo->master->first_iMCU_row)
+    cinfo->master->first_iMCU_row = checkpoint->iMCU_row;
+}
+
+
 /*
  * Alternate entry point to read raw data.
  * Processes exactly one iMCU row per call, unless suspended.
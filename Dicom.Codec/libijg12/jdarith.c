@@ -5,12 +5,918 @@
  * This file is part of the Independent JPEG Group's software.
  * For conditions of distribution and use, see the accompanying README file.
  *
- * This file holds place for arithmetic entropy decoding routines.
+ * This file contains portable arithmetic entropy decoding routines for JPEG
+ * (implementing the ISO/IEC IS 10918-1 and CCITT Recommendation ITU-T T.81).
+ *
+ * Both sequential and progressive modes are supported in this single module,
+ * as well as the lossless mode (Annex H); see jcarith.c for the statistical
+ * model of the lossless differences.
+ *
+ * Suspension is not currently supported in this module.  Corrupt data is
+ * reported with a warning, after which the rest of the scan decodes as
+ * zeros, like Huffman data that runs out.
  */
 
 #define JPEG_INTERNALS
 #include "jinclude12.h"
 #include "jpeglib12.h"
+#include "jlossy12.h"		/* Private declarations for lossy codec */
+#include "jlossls12.h"		/* Private declarations for lossless codec */
+
+
+/* Expanded entropy decoder object for arithmetic decoding. */
+
+typedef struct {
+  IJG_INT32 c;       /* C register, base of coding interval + input bit buffer */
+  IJG_INT32 a;		/* A register, normalized size of coding interval */
+  int ct;     /* bit shift counter, # of bits left in bit buffer part of C */
+		/* init: ct = -16 */
+		/* run: ct = 0..7 */
+		/* error: ct = -1 */
+  int last_dc_val[MAX_COMPS_IN_SCAN]; /* last DC coef for each component */
+  int dc_context[MAX_COMPS_IN_SCAN]; /* context index for DC conditioning */
+
+  unsigned int restarts_to_go;	/* MCUs left in this restart interval */
+
+  /* Pointers to statistics areas (these workspaces have image lifespan) */
+  unsigned char * dc_stats[NUM_ARITH_TBLS];
+  unsigned char * ac_stats[NUM_ARITH_TBLS];
+  int dc_stat_bins;		/* size of a DC statistics area */
+
+  /* Statistics bin for coding with fixed probability 0.5 */
+  unsigned char fixed_bin[4];
+
+#ifdef D_LOSSLESS_SUPPORTED
+  /* Conditioning categories of the differences in the line above, for each
+   * component, and of the difference to the left, for each group of data
+   * units within an MCU (see jcarith.c).
+   */
+  unsigned char * above_cats[MAX_COMPONENTS];
+  JDIMENSION above_width[MAX_COMPONENTS];
+  unsigned char * above_ptr[D_MAX_DATA_UNITS_IN_MCU];
+  int left_cat[D_MAX_DATA_UNITS_IN_MCU];
+
+  JDIFFROW output_ptr[D_MAX_DATA_UNITS_IN_MCU];
+  int output_ptr_ci[D_MAX_DATA_UNITS_IN_MCU];
+  int output_ptr_yoffset[D_MAX_DATA_UNITS_IN_MCU];
+  int output_ptr_MCU_width[D_MAX_DATA_UNITS_IN_MCU];
+  int num_output_ptrs;
+
+  /* Index of the proper output pointer for each data unit within an MCU */
+  int output_ptr_index[D_MAX_DATA_UNITS_IN_MCU];
+  /* Index of the scan component for each data unit within an MCU */
+  int output_comp_index[D_MAX_DATA_UNITS_IN_MCU];
+#endif
+} arith_entropy_decoder;
+
+typedef arith_entropy_decoder * arith_entropy_ptr;
+
+/* The following two definitions specify the allocation chunk size
+ * for the statistics area.
+ * According to sections F.1.4.4.1.3 and F.1.4.4.2, we need at least
+ * 49 statistics bins for DC, and 245 statistics bins for AC coding.
+ * The lossless model of Table H.3 needs 158 bins.
+ *
+ * We use a compact representation with 1 byte per statistics bin,
+ * thus the numbers directly represent byte sizes.
+ * This 1 byte per statistics bin contains the meaning of the MPS
+ * (more probable symbol) in the highest bit (mask 0x80), and the
+ * index into the probability estimation state machine table
+ * in the lower bits (mask 0x7F).
+ */
+
+#define DC_STAT_BINS 64
+#define AC_STAT_BINS 256
+#define DIFF_STAT_BINS 158
+
+
+LOCAL(int)
+get_byte (j_decompress_ptr cinfo)
+/* Read next input byte; we do not support suspension in this module.
+ * If the data runs out, we act as if an EOI marker followed it, so that
+ * the remainder of the scan decodes as zeros.
+ */
+{
+  struct jpeg_source_mgr * src = cinfo->src;
+
+  if (src->bytes_in_buffer == 0)
+    if (! (*src->fill_input_buffer) (cinfo)) {
+      WARNMS(cinfo, JWRN_JPEG_EOF);
+      return -1;
+    }
+  src->bytes_in_buffer--;
+  return GETJOCTET(*src->next_input_byte++);
+}
+
+
+/*
+ * The core arithmetic decoding routine (common in JPEG and JBIG).
+ * This needs to go as fast as possible.
+ * Machine-dependent optimization facilities
+ * are not utilized in this portable implementation.
+ * However, this code should be fairly efficient and
+ * may be a good base for further optimizations anyway.
+ *
+ * Return value is 0 or 1 (binary decision).
+ *
+ * Note: I've changed the handling of the code base & bit
+ * buffer register C compared to other implementations
+ * based on the standards layout & procedures.
+ * While it also contains both the actual base of the
+ * coding interval (16 bits) and the next-bits buffer,
+ * the cut-point between these two parts is floating
+ * (instead of fixed) with the bit shift counter CT.
+ * Thus, we also need only one (variable instead of
+ * fixed size) shift for the LPS/MPS decision, and
+ * we can do away with any renormalization update
+ * of C (except for new data insertion, of course).
+ *
+ * I've also introduced a new scheme for accessing
+ * the probability estimation state machine table,
+ * derived from Markus Kuhn's JBIG implementation.
+ */
+
+LOCAL(int)
+arith_decode (j_decompress_ptr cinfo, arith_entropy_ptr e, unsigned char *st)
+{
+  register unsigned char nl, nm;
+  register IJG_INT32 qe, temp;
+  register int sv, data;
+
+  /* Renormalization & data input per section D.2.6 */
+  while (e->a < 0x8000L) {
+    if (--e->ct < 0) {
+      /* Need to fetch next data byte */
+      if (cinfo->unread_marker)
+	data = 0;		/* stuff zero data */
+      else {
+	data = get_byte(cinfo);	/* read next input byte */
+	if (data == 0xFF) {	/* zero stuff or marker code */
+	  do data = get_byte(cinfo);
+	  while (data == 0xFF);	/* swallow extra 0xFF bytes */
+	  if (data == 0)
+	    data = 0xFF;	/* discard stuffed zero byte */
+	  else if (data > 0) {
+	    /* Note: Different from the Huffman decoder, hitting
+	     * a marker while processing the compressed data
+	     * segment is legal in arithmetic coding.
+	     * The convention is to supply zero data
+	     * then until decoding is complete.
+	     */
+	    cinfo->unread_marker = data;
+	    data = 0;
+	  }
+	}
+	if (data < 0) {
+	  /* Out of data: fake an EOI marker (see get_byte) */
+	  cinfo->unread_marker = 0xD9;
+	  data = 0;
+	}
+      }
+      e->c = (e->c << 8) | data; /* insert data into C register */
+      if ((e->ct += 8) < 0)	 /* update bit shift counter */
+	/* Need more initial bytes */
+	if (++e->ct == 0)
+	  /* Got 2 initial bytes -> re-init A and exit loop */
+	  e->a = 0x8000L; /* => e->a = 0x10000L after loop exit */
+    }
+    e->a <<= 1;
+  }
+
+  /* Fetch values from our compact representation of Table D.2:
+   * Qe values and probability estimation state machine
+   */
+  sv = *st;
+  qe = jpeg_aritab[sv & 0x7F];	/* => Qe_Value */
+  nl = (unsigned char) (qe & 0xFF); qe >>= 8;	/* Next_Index_LPS + Switch_MPS */
+  nm = (unsigned char) (qe & 0xFF); qe >>= 8;	/* Next_Index_MPS */
+
+  /* Decode & estimation procedures per sections D.2.4 & D.2.5 */
+  temp = e->a - qe;
+  e->a = temp;
+  temp <<= e->ct;
+  if (e->c >= temp) {
+    e->c -= temp;
+    /* Conditional LPS (less probable symbol) exchange */
+    if (e->a < qe) {
+      e->a = qe;
+      *st = (sv & 0x80) ^ nm;	/* Estimate_after_MPS */
+    } else {
+      e->a = qe;
+      *st = (sv & 0x80) ^ nl;	/* Estimate_after_LPS */
+      sv ^= 0x80;		/* Exchange LPS/MPS */
+    }
+  } else if (e->a < 0x8000L) {
+    /* Conditional MPS (more probable symbol) exchange */
+    if (e->a < qe) {
+      *st = (sv & 0x80) ^ nl;	/* Estimate_after_LPS */
+      sv ^= 0x80;		/* Exchange LPS/MPS */
+    } else {
+      *st = (sv & 0x80) ^ nm;	/* Estimate_after_MPS */
+    }
+  }
+
+  return sv >> 7;
+}
+
+
+/*
+ * Decode a DC coefficient difference or a lossless sample difference,
+ * using the statistics bins starting at S0 (st) and X1 (x1) of Tables F.4
+ * and H.3.  lo and hi are the bounds (1 << L) >> 1 and (1 << U) >> 1 of the
+ * conditioning table.  The conditioning category of the difference is
+ * stored in *cat (see encode_diff in jcarith.c).  On a magnitude overflow
+ * the decoder is put in the error state and 0 is returned.
+ */
+
+LOCAL(int)
+decode_diff (j_decompress_ptr cinfo, arith_entropy_ptr e, unsigned char *st,
+	     unsigned char *x1, int lo, int hi, int *cat)
+{
+  int sign, v, m;
+
+  /* Figure F.19: Decode_DC_DIFF */
+  if (arith_decode(cinfo, e, st) == 0) {
+    *cat = 0;			/* zero diff category */
+    return 0;
+  }
+
+  /* Figure F.21: Decoding nonzero value v */
+  /* Figure F.22: Decoding the sign of v */
+  sign = arith_decode(cinfo, e, st + 1);
+  st += 2; st += sign;
+  /* Figure F.23: Decoding the magnitude category of v */
+  if ((m = arith_decode(cinfo, e, st)) != 0) {
+    st = x1;
+    while (arith_decode(cinfo, e, st)) {
+      if ((m <<= 1) == 0x8000) {
+	WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
+	e->ct = -1;			/* magnitude overflow */
+	*cat = 0;
+	return 0;
+      }
+      st += 1;
+    }
+  }
+  /* Section F.1.4.4.1.2: Establish conditioning category */
+  if (m < lo)
+    *cat = 0;			/* zero diff category */
+  else if (m > hi)
+    *cat = 3 + sign;		/* large diff category */
+  else
+    *cat = 1 + sign;		/* small diff category */
+  v = m;
+  /* Figure F.24: Decoding the magnitude bit pattern of v */
+  st += 14;
+  while (m >>= 1)
+    if (arith_decode(cinfo, e, st)) v |= m;
+  v += 1; if (sign) v = -v;
+
+  return v;
+}
+
+
+/*
+ * Decode an AC coefficient value at position k, with st pointing to the
+ * SE bin of k.  On a magnitude overflow the decoder is put in the error
+ * state and 0 is returned.
+ */
+
+LOCAL(int)
+decode_ac_value (j_decompress_ptr cinfo, arith_entropy_ptr e, unsigned char *st,
+		 int tbl, int k)
+{
+  int sign, v, m;
+
+  /* Figure F.21: Decoding nonzero value v */
+  /* Figure F.22: Decoding the sign of v */
+  sign = arith_decode(cinfo, e, e->fixed_bin);
+  st += 2;
+  /* Figure F.23: Decoding the magnitude category of v */
+  if ((m = arith_decode(cinfo, e, st)) != 0) {
+    if (arith_decode(cinfo, e, st)) {
+      m <<= 1;
+      st = e->ac_stats[tbl] + (k <= cinfo->arith_ac_K[tbl] ? 189 : 217);
+      while (arith_decode(cinfo, e, st)) {
+	if ((m <<= 1) == 0x8000) {
+	  WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
+	  e->ct = -1;			/* magnitude overflow */
+	  return 0;
+	}
+	st += 1;
+      }
+    }
+  }
+  v = m;
+  /* Figure F.24: Decoding the magnitude bit pattern of v */
+  st += 14;
+  while (m >>= 1)
+    if (arith_decode(cinfo, e, st)) v |= m;
+  v += 1; if (sign) v = -v;
+
+  return v;
+}
+
+
+/*
+ * Reset the statistics areas and the decoder at the start of a scan or of a
+ * restart interval.
+ */
+
+LOCAL(void)
+reset_decoder (j_decompress_ptr cinfo, arith_entropy_ptr entropy)
+{
+  int ci;
+  jpeg_component_info * compptr;
+
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    if (cinfo->process != JPROC_PROGRESSIVE ||
+	(cinfo->Ss == 0 && cinfo->Ah == 0)) {
+      MEMZERO(entropy->dc_stats[compptr->dc_tbl_no], entropy->dc_stat_bins);
+      /* Reset DC predictions to 0 */
+      entropy->last_dc_val[ci] = 0;
+      entropy->dc_context[ci] = 0;
+    }
+    if ((cinfo->process == JPROC_SEQUENTIAL) ||
+	(cinfo->process == JPROC_PROGRESSIVE && cinfo->Ss)) {
+      MEMZERO(entropy->ac_stats[compptr->ac_tbl_no], AC_STAT_BINS);
+    }
+#ifdef D_LOSSLESS_SUPPORTED
+    /* The first line of an interval has no line above (Section H.1.2.3.1) */
+    if (cinfo->process == JPROC_LOSSLESS)
+      MEMZERO(entropy->above_cats[compptr->component_index],
+	      entropy->above_width[compptr->component_index]);
+#endif
+  }
+
+  /* Reset arithmetic decoding variables */
+  entropy->c = 0;
+  entropy->a = 0;
+  entropy->ct = -16;	/* force reading 2 initial bytes to fill C */
+
+  /* Reset restart counter */
+  entropy->restarts_to_go = cinfo->restart_interval;
+}
+
+
+/*
+ * Check for a restart marker & resynchronize decoder.
+ */
+
+LOCAL(void)
+process_restart (j_decompress_ptr cinfo, arith_entropy_ptr entropy)
+{
+  /* Advance past the RSTn marker */
+  if (! (*cinfo->marker->read_restart_marker) (cinfo))
+    ERREXIT(cinfo, JERR_CANT_SUSPEND);
+
+  reset_decoder(cinfo, entropy);
+}
+
+
+/*
+ * Allocate the statistics areas of the tables used in this scan and
+ * initialize the decoder.
+ */
+
+LOCAL(void)
+start_arith (j_decompress_ptr cinfo, arith_entropy_ptr entropy)
+{
+  int ci, tbl;
+  jpeg_component_info * compptr;
+
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    if (cinfo->process != JPROC_PROGRESSIVE ||
+	(cinfo->Ss == 0 && cinfo->Ah == 0)) {
+      tbl = compptr->dc_tbl_no;
+      if (tbl < 0 || tbl >= NUM_ARITH_TBLS)
+	ERREXIT1(cinfo, JERR_NO_ARITH_TABLE, tbl);
+      if (entropy->dc_stats[tbl] == NULL)
+	entropy->dc_stats[tbl] = (unsigned char *) (*cinfo->mem->alloc_small)
+	  ((j_common_ptr) cinfo, JPOOL_IMAGE, entropy->dc_stat_bins);
+    }
+    if ((cinfo->process == JPROC_SEQUENTIAL) ||
+	(cinfo->process == JPROC_PROGRESSIVE && cinfo->Ss)) {
+      tbl = compptr->ac_tbl_no;
+      if (tbl < 0 || tbl >= NUM_ARITH_TBLS)
+	ERREXIT1(cinfo, JERR_NO_ARITH_TABLE, tbl);
+      if (entropy->ac_stats[tbl] == NULL)
+	entropy->ac_stats[tbl] = (unsigned char *) (*cinfo->mem->alloc_small)
+	  ((j_common_ptr) cinfo, JPOOL_IMAGE, AC_STAT_BINS);
+    }
+  }
+
+  reset_decoder(cinfo, entropy);
+}
+
+
+/*
+ * Arithmetic MCU decoding.
+ * Each of these routines decodes and returns one MCU's worth of
+ * arithmetic-compressed coefficients.
+ * The coefficients are reordered from zigzag order into natural array order,
+ * but are not dequantized.
+ *
+ * The i'th block of the MCU is stored into the block pointed to by
+ * MCU_data[i].  WE ASSUME THIS AREA IS INITIALLY ZEROED BY THE CALLER.
+ */
+
+/*
+ * MCU decoding for DC initial scan (either spectral selection,
+ * or first pass of successive approximation).
+ */
+
+METHODDEF(boolean)
+decode_mcu_DC_first (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  j_lossy_d_ptr lossyd = (j_lossy_d_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) lossyd->entropy_private;
+  int blkn, ci, tbl, cat;
+
+  /* Process restart marker if needed */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      process_restart(cinfo, entropy);
+    entropy->restarts_to_go--;
+  }
+
+  if (entropy->ct == -1) return TRUE;	/* if error do nothing */
+
+  /* Outer loop handles each block in the MCU */
+
+  for (blkn = 0; blkn < cinfo->data_units_in_MCU; blkn++) {
+    ci = cinfo->MCU_membership[blkn];
+    tbl = cinfo->cur_comp_info[ci]->dc_tbl_no;
+
+    /* Sections F.2.4.1 & F.1.4.4.1: Decoding of DC coefficients */
+
+    /* Table F.4: Point to statistics bin S0 for DC coefficient coding */
+    entropy->last_dc_val[ci] +=
+      decode_diff(cinfo, entropy, entropy->dc_stats[tbl] + entropy->dc_context[ci],
+		  entropy->dc_stats[tbl] + 20, /* Table F.4: X1 = 20 */
+		  (int) ((1L << cinfo->arith_dc_L[tbl]) >> 1),
+		  (int) ((1L << cinfo->arith_dc_U[tbl]) >> 1), &cat);
+    if (entropy->ct == -1) return TRUE;
+    entropy->dc_context[ci] = 4 * cat;
+
+    /* Scale and output the DC coefficient (assumes jpeg_natural_order[0]=0) */
+    MCU_data[blkn][0][0] = (JCOEF) (entropy->last_dc_val[ci] << cinfo->Al);
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * MCU decoding for AC initial scan (either spectral selection,
+ * or first pass of successive approximation).
+ */
+
+METHODDEF(boolean)
+decode_mcu_AC_first (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  j_lossy_d_ptr lossyd = (j_lossy_d_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) lossyd->entropy_private;
+  JBLOCKROW block;
+  unsigned char *st;
+  int tbl, k, v;
+
+  /* Process restart marker if needed */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      process_restart(cinfo, entropy);
+    entropy->restarts_to_go--;
+  }
+
+  if (entropy->ct == -1) return TRUE;	/* if error do nothing */
+
+  /* There is always only one block per MCU */
+  block = MCU_data[0];
+  tbl = cinfo->cur_comp_info[0]->ac_tbl_no;
+
+  /* Sections F.2.4.2 & F.1.4.4.2: Decoding of AC coefficients */
+
+  /* Figure F.20: Decode_AC_coefficients */
+  k = cinfo->Ss - 1;
+  do {
+    st = entropy->ac_stats[tbl] + 3 * k;
+    if (arith_decode(cinfo, entropy, st)) break;	/* EOB flag */
+    for (;;) {
+      k++;
+      if (arith_decode(cinfo, entropy, st + 1)) break;
+      st += 3;
+      if (k >= cinfo->Se) {
+	WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
+	entropy->ct = -1;			/* spectral overflow */
+	return TRUE;
+      }
+    }
+    v = decode_ac_value(cinfo, entropy, st, tbl, k);
+    if (entropy->ct == -1) return TRUE;
+    /* Scale and output coefficient in natural (dezigzagged) order */
+    (*block)[jpeg_natural_order[k]] = (JCOEF) (v << cinfo->Al);
+  } while (k < cinfo->Se);
+
+  return TRUE;
+}
+
+
+/*
+ * MCU decoding for DC successive approximation refinement scan.
+ */
+
+METHODDEF(boolean)
+decode_mcu_DC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  j_lossy_d_ptr lossyd = (j_lossy_d_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) lossyd->entropy_private;
+  unsigned char *st;
+  int p1, blkn;
+
+  /* Process restart marker if needed */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      process_restart(cinfo, entropy);
+    entropy->restarts_to_go--;
+  }
+
+  st = entropy->fixed_bin;	/* use fixed probability estimation */
+  p1 = 1 << cinfo->Al;		/* 1 in the bit position being coded */
+
+  /* Outer loop handles each block in the MCU */
+
+  for (blkn = 0; blkn < cinfo->data_units_in_MCU; blkn++) {
+    /* Encoded data is simply the next bit of the two's-complement DC value */
+    if (arith_decode(cinfo, entropy, st))
+      MCU_data[blkn][0][0] |= p1;
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * MCU decoding for AC successive approximation refinement scan.
+ */
+
+METHODDEF(boolean)
+decode_mcu_AC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  j_lossy_d_ptr lossyd = (j_lossy_d_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) lossyd->entropy_private;
+  JBLOCKROW block;
+  JCOEFPTR thiscoef;
+  unsigned char *st;
+  int tbl, k, kex;
+  int p1, m1;
+
+  /* Process restart marker if needed */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      process_restart(cinfo, entropy);
+    entropy->restarts_to_go--;
+  }
+
+  if (entropy->ct == -1) return TRUE;	/* if error do nothing */
+
+  /* There is always only one block per MCU */
+  block = MCU_data[0];
+  tbl = cinfo->cur_comp_info[0]->ac_tbl_no;
+
+  p1 = 1 << cinfo->Al;		/* 1 in the bit position being coded */
+  m1 = (-1) << cinfo->Al;	/* -1 in the bit position being coded */
+
+  /* Establish EOBx (previous stage end-of-block) index */
+  kex = cinfo->Se;
+  do {
+    if ((*block)[jpeg_natural_order[kex]]) break;
+  } while (--kex);
+
+  k = cinfo->Ss - 1;
+  do {
+    st = entropy->ac_stats[tbl] + 3 * k;
+    if (k >= kex)
+      if (arith_decode(cinfo, entropy, st)) break;	/* EOB flag */
+    for (;;) {
+      thiscoef = *block + jpeg_natural_order[++k];
+      if (*thiscoef) {				/* previously nonzero coef */
+	if (arith_decode(cinfo, entropy, st + 2)) {
+	  if (*thiscoef < 0)
+	    *thiscoef += m1;
+	  else
+	    *thiscoef += p1;
+	}
+	break;
+      }
+      if (arith_decode(cinfo, entropy, st + 1)) {	/* newly nonzero coef */
+	if (arith_decode(cinfo, entropy, entropy->fixed_bin))
+	  *thiscoef = m1;
+	else
+	  *thiscoef = p1;
+	break;
+      }
+      st += 3;
+      if (k >= cinfo->Se) {
+	WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
+	entropy->ct = -1;			/* spectral overflow */
+	return TRUE;
+      }
+    }
+  } while (k < cinfo->Se);
+
+  return TRUE;
+}
+
+
+/*
+ * Decode one MCU's worth of arithmetic-compressed coefficients
+ * in sequential mode.
+ */
+
+METHODDEF(boolean)
+decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  j_lossy_d_ptr lossyd = (j_lossy_d_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) lossyd->entropy_private;
+  jpeg_component_info * compptr;
+  JBLOCKROW block;
+  unsigned char *st;
+  int blkn, ci, tbl, k, v, cat;
+
+  /* Process restart marker if needed */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      process_restart(cinfo, entropy);
+    entropy->restarts_to_go--;
+  }
+
+  if (entropy->ct == -1) return TRUE;	/* if error do nothing */
+
+  /* Outer loop handles each block in the MCU */
+
+  for (blkn = 0; blkn < cinfo->data_units_in_MCU; blkn++) {
+    block = MCU_data[blkn];
+    ci = cinfo->MCU_membership[blkn];
+    compptr = cinfo->cur_comp_info[ci];
+
+    /* Sections F.2.4.1 & F.1.4.4.1: Decoding of DC coefficients */
+
+    tbl = compptr->dc_tbl_no;
+    /* Table F.4: Point to statistics bin S0 for DC coefficient coding */
+    entropy->last_dc_val[ci] +=
+      decode_diff(cinfo, entropy, entropy->dc_stats[tbl] + entropy->dc_context[ci],
+		  entropy->dc_stats[tbl] + 20, /* Table F.4: X1 = 20 */
+		  (int) ((1L << cinfo->arith_dc_L[tbl]) >> 1),
+		  (int) ((1L << cinfo->arith_dc_U[tbl]) >> 1), &cat);
+    if (entropy->ct == -1) return TRUE;
+    entropy->dc_context[ci] = 4 * cat;
+
+    (*block)[0] = (JCOEF) entropy->last_dc_val[ci];
+
+    /* Sections F.2.4.2 & F.1.4.4.2: Decoding of AC coefficients */
+
+    tbl = compptr->ac_tbl_no;
+
+    /* Figure F.20: Decode_AC_coefficients */
+    k = 0;
+    do {
+      st = entropy->ac_stats[tbl] + 3 * k;
+      if (arith_decode(cinfo, entropy, st)) break;	/* EOB flag */
+      for (;;) {
+	k++;
+	if (arith_decode(cinfo, entropy, st + 1)) break;
+	st += 3;
+	if (k >= DCTSIZE2 - 1) {
+	  WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
+	  entropy->ct = -1;			/* spectral overflow */
+	  return TRUE;
+	}
+      }
+      v = decode_ac_value(cinfo, entropy, st, tbl, k);
+      if (entropy->ct == -1) return TRUE;
+      (*block)[jpeg_natural_order[k]] = (JCOEF) v;
+    } while (k < DCTSIZE2 - 1);
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * Initialize for an arithmetic-compressed lossy scan.
+ */
+
+METHODDEF(void)
+start_pass (j_decompress_ptr cinfo)
+{
+  j_lossy_d_ptr lossyd = (j_lossy_d_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) lossyd->entropy_private;
+  int ci, coefi;
+  int *coef_bit_ptr;
+
+  if (cinfo->process == JPROC_PROGRESSIVE) {
+    /* Validate progressive scan parameters */
+    if (cinfo->Ss == 0) {
+      if (cinfo->Se != 0)
+	goto bad;
+    } else {
+      /* need not check Ss/Se < 0 since they came from unsigned bytes */
+      if (cinfo->Se < cinfo->Ss || cinfo->Se >= DCTSIZE2)
+	goto bad;
+      /* AC scans may have only one component */
+      if (cinfo->comps_in_scan != 1)
+	goto bad;
+    }
+    if (cinfo->Ah != 0) {
+      /* Successive approximation refinement scan: must have Al = Ah-1. */
+      if (cinfo->Ah-1 != cinfo->Al)
+	goto bad;
+    }
+    if (cinfo->Al > 13) {	/* need not check for < 0 */
+      bad:
+      ERREXIT4(cinfo, JERR_BAD_PROGRESSION,
+	       cinfo->Ss, cinfo->Se, cinfo->Ah, cinfo->Al);
+    }
+    /* Update progression status, and verify that scan order is legal.
+     * Note that inter-scan inconsistencies are treated as warnings
+     * not fatal errors ... not clear if this is right way to behave.
+     */
+    for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+      int cindex = cinfo->cur_comp_info[ci]->component_index;
+      coef_bit_ptr = & cinfo->coef_bits[cindex][0];
+      if (cinfo->Ss && coef_bit_ptr[0] < 0) /* AC without prior DC scan */
+	WARNMS2(cinfo, JWRN_BOGUS_PROGRESSION, cindex, 0);
+      for (coefi = cinfo->Ss; coefi <= cinfo->Se; coefi++) {
+	int expected = (coef_bit_ptr[coefi] < 0) ? 0 : coef_bit_ptr[coefi];
+	if (cinfo->Ah != expected)
+	  WARNMS2(cinfo, JWRN_BOGUS_PROGRESSION, cindex, coefi);
+	coef_bit_ptr[coefi] = cinfo->Al;
+      }
+    }
+    /* Select MCU decoding routine */
+    if (cinfo->Ah == 0) {
+      if (cinfo->Ss == 0)
+	lossyd->entropy_decode_mcu = decode_mcu_DC_first;
+      else
+	lossyd->entropy_decode_mcu = decode_mcu_AC_first;
+    } else {
+      if (cinfo->Ss == 0)
+	lossyd->entropy_decode_mcu = decode_mcu_DC_refine;
+      else
+	lossyd->entropy_decode_mcu = decode_mcu_AC_refine;
+    }
+  } else {
+    /* Check that the scan parameters Ss, Se, Ah/Al are OK for sequential JPEG.
+     * This ought to be an error condition, but we make it a warning.
+     */
+    if (cinfo->Ss != 0 || cinfo->Se != DCTSIZE2-1 ||
+	cinfo->Ah != 0 || cinfo->Al != 0)
+      WARNMS(cinfo, JWRN_NOT_SEQUENTIAL);
+    /* Select MCU decoding routine */
+    lossyd->entropy_decode_mcu = decode_mcu;
+  }
+
+  start_arith(cinfo, entropy);
+}
+
+
+#ifdef D_LOSSLESS_SUPPORTED
+
+/*
+ * Check for a restart marker & resynchronize decoder.
+ * The difference controller calls this at the start of an MCU row.
+ */
+
+METHODDEF(boolean)
+process_restart_diff (j_decompress_ptr cinfo)
+{
+  j_lossless_d_ptr losslsd = (j_lossless_d_ptr) cinfo->codec;
+
+  process_restart(cinfo, (arith_entropy_ptr) losslsd->entropy_private);
+  return TRUE;
+}
+
+
+/*
+ * Decode and return nMCU's worth of arithmetic-compressed differences.
+ * Each MCU is also disassembled and placed accordingly in diff_buf.
+ * See jcarith.c for the conditioning of the statistics.
+ */
+
+METHODDEF(JDIMENSION)
+decode_mcus_diff (j_decompress_ptr cinfo, JDIFFIMAGE diff_buf,
+		  JDIMENSION MCU_row_num, JDIMENSION MCU_col_num,
+		  JDIMENSION nMCU)
+{
+  j_lossless_d_ptr losslsd = (j_lossless_d_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) losslsd->entropy_private;
+  jpeg_component_info * compptr;
+  unsigned char *st;
+  unsigned int mcu_num;
+  int sampn, ci, ptrn, tbl, da, db;
+  int lo[MAX_COMPS_IN_SCAN], hi[MAX_COMPS_IN_SCAN];
+
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    tbl = cinfo->cur_comp_info[ci]->dc_tbl_no;
+    lo[ci] = (int) ((1L << cinfo->arith_dc_L[tbl]) >> 1);
+    hi[ci] = (int) ((1L << cinfo->arith_dc_U[tbl]) >> 1);
+  }
+
+  /* Set output pointer locations based on MCU_col_num; the difference to
+   * the left of the first one in a line counts as zero.
+   */
+  for (ptrn = 0; ptrn < entropy->num_output_ptrs; ptrn++) {
+    ci = entropy->output_ptr_ci[ptrn];
+    entropy->output_ptr[ptrn] =
+      diff_buf[ci][MCU_row_num + entropy->output_ptr_yoffset[ptrn]] +
+      (MCU_col_num * entropy->output_ptr_MCU_width[ptrn]);
+    entropy->above_ptr[ptrn] = entropy->above_cats[ci] +
+      (MCU_col_num * entropy->output_ptr_MCU_width[ptrn]);
+    if (MCU_col_num == 0)
+      entropy->left_cat[ptrn] = 0;
+  }
+
+  for (mcu_num = 0; mcu_num < nMCU; mcu_num++) {
+
+    /* After an error, output zero differences up to the next restart */
+    if (entropy->ct == -1) {
+      for (ptrn = 0; ptrn < entropy->num_output_ptrs; ptrn++)
+	jzero_far((void FAR *) entropy->output_ptr[ptrn],
+		  (nMCU - mcu_num) * entropy->output_ptr_MCU_width[ptrn] *
+		  SIZEOF(JDIFF));
+      break;
+    }
+
+    /* Inner loop handles the samples in the MCU */
+    for (sampn = 0; sampn < cinfo->data_units_in_MCU; sampn++) {
+      ptrn = entropy->output_ptr_index[sampn];
+      ci = entropy->output_comp_index[sampn];
+      compptr = cinfo->cur_comp_info[ci];
+      st = entropy->dc_stats[compptr->dc_tbl_no];
+
+      /* Table H.3: Point to statistics bins S0 and X1 */
+      da = entropy->left_cat[ptrn];
+      db = *entropy->above_ptr[ptrn];
+      *entropy->output_ptr[ptrn]++ = (JDIFF)
+	decode_diff(cinfo, entropy, st + 4 * (5 * da + db),
+		    st + (db > 2 ? 129 : 100), lo[ci], hi[ci], &da);
+      entropy->left_cat[ptrn] = da;
+      *entropy->above_ptr[ptrn]++ = (unsigned char) da;
+    }
+  }
+
+  return nMCU;
+}
+
+
+/*
+ * Initialize for an arithmetic-compressed lossless scan.
+ */
+
+METHODDEF(void)
+start_pass_diff (j_decompress_ptr cinfo)
+{
+  j_lossless_d_ptr losslsd = (j_lossless_d_ptr) cinfo->codec;
+  arith_entropy_ptr entropy = (arith_entropy_ptr) losslsd->entropy_private;
+  int ci, sampn, ptrn, yoffset, xoffset;
+  JDIMENSION width;
+  jpeg_component_info * compptr;
+
+  /* Allocate the conditioning rows, which span the MCUs of a line */
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    width = cinfo->MCUs_per_row * (JDIMENSION) compptr->MCU_width;
+    if (entropy->above_width[compptr->component_index] < width) {
+      entropy->above_cats[compptr->component_index] = (unsigned char *)
+	(*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				    (size_t) width);
+      entropy->above_width[compptr->component_index] = width;
+    }
+  }
+
+  /* Precalculate decoding info for each sample in an MCU of this scan */
+  for (sampn = 0, ptrn = 0; sampn < cinfo->data_units_in_MCU;) {
+    compptr = cinfo->cur_comp_info[cinfo->MCU_membership[sampn]];
+    for (yoffset = 0; yoffset < compptr->MCU_height; yoffset++, ptrn++) {
+      /* Precalculate the setup info for each output pointer */
+      entropy->output_ptr_ci[ptrn] = compptr->component_index;
+      entropy->output_ptr_yoffset[ptrn] = yoffset;
+      entropy->output_ptr_MCU_width[ptrn] = compptr->MCU_width;
+      for (xoffset = 0; xoffset < compptr->MCU_width; xoffset++, sampn++) {
+	/* Precalculate the output pointer index for each sample */
+	entropy->output_ptr_index[sampn] = ptrn;
+	entropy->output_comp_index[sampn] = cinfo->MCU_membership[sampn];
+      }
+    }
+  }
+  entropy->num_output_ptrs = ptrn;
+
+  start_arith(cinfo, entropy);
+}
+
+#endif /* D_LOSSLESS_SUPPORTED */
 
 
 /*
@@ -20,5 +926,56 @@
 GLOBAL(void)
 jinit_arith_decoder (j_decompress_ptr cinfo)
 {
-  ERREXIT(cinfo, JERR_ARITH_NOTIMPL);
+  arith_entropy_ptr entropy;
+  int i;
+
+  entropy = (arith_entropy_ptr)
+    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				SIZEOF(arith_entropy_decoder));
+
+  if (cinfo->process == JPROC_LOSSLESS) {
+#ifdef D_LOSSLESS_SUPPORTED
+    j_lossless_d_ptr losslsd = (j_lossless_d_ptr) cinfo->codec;
+
+    losslsd->entropy_private = (void *) entropy;
+    losslsd->entropy_start_pass = start_pass_diff;
+    losslsd->entropy_process_restart = process_restart_diff;
+    losslsd->entropy_decode_mcus = decode_mcus_diff;
+    entropy->dc_stat_bins = DIFF_STAT_BINS;
+
+    for (i = 0; i < MAX_COMPONENTS; i++) {
+      entropy->above_cats[i] = NULL;
+      entropy->above_width[i] = 0;
+    }
+#else
+    ERREXIT(cinfo, JERR_NOT_COMPILED);
+#endif
+  } else {
+    j_lossy_d_ptr lossyd = (j_lossy_d_ptr) cinfo->codec;
+
+    lossyd->entropy_private = (void *) entropy;
+    lossyd->entropy_start_pass = start_pass;
+    entropy->dc_stat_bins = DC_STAT_BINS;
+
+    if (cinfo->process == JPROC_PROGRESSIVE) {
+      /* Create progression status table */
+      int *coef_bit_ptr, ci;
+      cinfo->coef_bits = (int (*)[DCTSIZE2])
+	(*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				    cinfo->num_components*DCTSIZE2*SIZEOF(int));
+      coef_bit_ptr = & cinfo->coef_bits[0][0];
+      for (ci = 0; ci < cinfo->num_components; ci++)
+	for (i = 0; i < DCTSIZE2; i++)
+	  *coef_bit_ptr++ = -1;
+    }
+  }
+
+  /* Mark tables unallocated */
+  for (i = 0; i < NUM_ARITH_TBLS; i++) {
+    entropy->dc_stats[i] = NULL;
+    entropy->ac_stats[i] = NULL;
+  }
+
+  /* Initialize index for fixed probability estimation */
+  entropy->fixed_bin[0] = 113;
 }
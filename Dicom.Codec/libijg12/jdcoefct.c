@@ -134,6 +134,96 @@ start_output_pass (j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Determine the block columns of a component that are reconstructed,
+ * ie, those of the iMCU columns selected by jpeg_crop_scanline.
+ */
+
+LOCAL(void)
+get_block_cols (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		JDIMENSION * first_col, JDIMENSION * end_col)
+{
+  *first_col = cinfo->master->first_iMCU_col * compptr->h_samp_factor;
+  *end_col = (cinfo->master->last_iMCU_col + 1) * compptr->h_samp_factor;
+  if (*end_col > compptr->width_in_data_units)
+    *end_col = compptr->width_in_data_units;
+}
+
+
+/*
+ * Fill the output of an iMCU row that is not reconstructed (see
+ * jpeg_skip_scanlines).  The upsampler and color converter still process
+ * these rows, so they must hold valid sample values.
+ */
+
+LOCAL(void)
+skip_iMCU_row (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+{
+  JDIMENSION first_col, end_col;
+  int ci, row;
+  jpeg_component_info *compptr;
+
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    if (! compptr->component_needed)
+      continue;
+    get_block_cols(cinfo, compptr, &first_col, &end_col);
+    for (row = 0; row < compptr->v_samp_factor * compptr->codec_data_unit;
+	 row++)
+      jzero_far((void FAR *) output_buf[ci][row],
+		(size_t) ((end_col - first_col) * compptr->codec_data_unit *
+			  SIZEOF(JSAMPLE)));
+  }
+}
+
+
+/*
+ * Handle checkpoints at the start of an iMCU row in the single-pass case:
+ * record one for the application, or load the one decoding resumes from.
+ * Returns FALSE if the row lies before that checkpoint; it is then neither
+ * entropy decoded nor reconstructed.
+ */
+
+LOCAL(boolean)
+checkpoint_iMCU_row (j_decompress_ptr cinfo)
+{
+  j_lossy_d_ptr lossyd = (j_lossy_d_ptr) cinfo->codec;
+  struct jpeg_decomp_master * master = cinfo->master;
+  jpeg_checkpoint checkpoint;
+
+  if (master->resume_pending) {
+    if (cinfo->input_iMCU_row < master->resume.iMCU_row)
+      return FALSE;
+    (*lossyd->entropy_load_state) (cinfo, &master->resume);
+    master->resume_pending = FALSE;
+  } else if (cinfo->checkpoint != NULL && cinfo->checkpoint->interval > 0 &&
+	     lossyd->entropy_save_state != NULL && cinfo->input_iMCU_row > 0 &&
+	     cinfo->input_iMCU_row % cinfo->checkpoint->interval == 0) {
+    if ((*lossyd->entropy_save_state) (cinfo, &checkpoint))
+      (*cinfo->checkpoint->record_checkpoint) (cinfo, &checkpoint);
+  }
+  return TRUE;
+}
+
+
+/*
+ * Advance the counters of the single-pass case past a completed iMCU row.
+ */
+
+LOCAL(int)
+finish_iMCU_row (j_decompress_ptr cinfo)
+{
+  cinfo->output_iMCU_row++;
+  if (++(cinfo->input_iMCU_row) < cinfo->total_iMCU_rows) {
+    start_iMCU_row(cinfo);
+    return JPEG_ROW_COMPLETED;
+  }
+  /* Completed the scan */
+  (*cinfo->inputctl->finish_input_pass) (cinfo);
+  return JPEG_SCAN_COMPLETED;
+}
+
+
 /*
  * Decompress and return some data in the single-pass case.
  * Always attempts to emit one fully interleaved MCU row ("iMCU" row).
@@ -152,11 +242,19 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   JDIMENSION MCU_col_num;	/* index of current MCU within row */
   JDIMENSION last_MCU_col = cinfo->MCUs_per_row - 1;
   JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
-  int blkn, ci, xindex, yindex, yoffset, useful_width;
+  int blkn, ci, xindex, yindex, yoffset, useful_width, first_x;
   JSAMPARRAY output_ptr;
-  JDIMENSION start_col, output_col;
+  JDIMENSION start_col, output_col, first_col, end_col;
   jpeg_component_info *compptr;
   inverse_DCT_method_ptr inverse_DCT;
+  boolean skip = cinfo->output_iMCU_row < cinfo->master->first_iMCU_row;
+
+  if (coef->MCU_vert_offset == 0 && coef->MCU_ctr == 0) {
+    if (skip)
+      skip_iMCU_row(cinfo, output_buf);
+    if (! checkpoint_iMCU_row(cinfo))
+      return finish_iMCU_row(cinfo);
+  }
 
   /* Loop to process as much as one whole iMCU row */
   for (yoffset = coef->MCU_vert_offset; yoffset < coef->MCU_rows_per_iMCU_row;
@@ -180,22 +278,35 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
       blkn = 0;			/* index of current DCT block within MCU */
       for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
 	compptr = cinfo->cur_comp_info[ci];
-	/* Don't bother to IDCT an uninteresting component. */
-	if (! compptr->component_needed) {
+	/* Don't bother to IDCT an uninteresting component,
+	 * or the blocks outside the region being reconstructed.
+	 */
+	if (! compptr->component_needed || skip) {
 	  blkn += compptr->MCU_data_units;
 	  continue;
 	}
-	inverse_DCT = lossyd->inverse_DCT[compptr->component_index];
+	get_block_cols(cinfo, compptr, &first_col, &end_col);
+	start_col = MCU_col_num * compptr->MCU_width;
+	first_x = (start_col < first_col) ? (int) (first_col - start_col) : 0;
 	useful_width = (MCU_col_num < last_MCU_col) ? compptr->MCU_width
 						    : compptr->last_col_width;
+	if (start_col >= end_col)
+	  useful_width = 0;
+	else if (start_col + useful_width > end_col)
+	  useful_width = (int) (end_col - start_col);
+	if (first_x >= useful_width) {
+	  blkn += compptr->MCU_data_units;
+	  continue;
+	}
+	inverse_DCT = lossyd->inverse_DCT[compptr->component_index];
 	output_ptr = output_buf[compptr->component_index] +
 	  yoffset * compptr->codec_data_unit;
-	start_col = MCU_col_num * compptr->MCU_sample_width;
 	for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
 	  if (cinfo->input_iMCU_row < last_iMCU_row ||
 	      yoffset+yindex < compptr->last_row_height) {
-	    output_col = start_col;
-	    for (xindex = 0; xindex < useful_width; xindex++) {
+	    output_col = (start_col + first_x - first_col) *
+			 compptr->codec_data_unit;
+	    for (xindex = first_x; xindex < useful_width; xindex++) {
 	      (*inverse_DCT) (cinfo, compptr,
 			      (JCOEFPTR) coef->MCU_buffer[blkn+xindex],
 			      output_ptr, output_col);
@@ -211,14 +322,7 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
     coef->MCU_ctr = 0;
   }
   /* Completed the iMCU row, advance counters for next one */
-  cinfo->output_iMCU_row++;
-  if (++(cinfo->input_iMCU_row) < cinfo->total_iMCU_rows) {
-    start_iMCU_row(cinfo);
-    return JPEG_ROW_COMPLETED;
-  }
-  /* Completed the scan */
-  (*cinfo->inputctl->finish_input_pass) (cinfo);
-  return JPEG_SCAN_COMPLETED;
+  return finish_iMCU_row(cinfo);
 }
 
 
@@ -320,7 +424,7 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   j_lossy_d_ptr lossyd = (j_lossy_d_ptr) cinfo->codec;
   d_coef_ptr coef = (d_coef_ptr) lossyd->coef_private;
   JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
-  JDIMENSION block_num;
+  JDIMENSION block_num, first_col, end_col;
   int ci, block_row, block_rows;
   JBLOCKARRAY buffer;
   JBLOCKROW buffer_ptr;
@@ -337,6 +441,13 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
       return JPEG_SUSPENDED;
   }
 
+  if (cinfo->output_iMCU_row < cinfo->master->first_iMCU_row) {
+    skip_iMCU_row(cinfo, output_buf);
+    if (++(cinfo->output_iMCU_row) < cinfo->total_iMCU_rows)
+      return JPEG_ROW_COMPLETED;
+    return JPEG_SCAN_COMPLETED;
+  }
+
   /* OK, output from the virtual arrays. */
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
@@ -358,11 +469,12 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
     }
     inverse_DCT = lossyd->inverse_DCT[ci];
     output_ptr = output_buf[ci];
+    get_block_cols(cinfo, compptr, &first_col, &end_col);
     /* Loop over all DCT blocks to be processed. */
     for (block_row = 0; block_row < block_rows; block_row++) {
-      buffer_ptr = buffer[block_row];
+      buffer_ptr = buffer[block_row] + first_col;
       output_col = 0;
-      for (block_num = 0; block_num < compptr->width_in_data_units; block_num++) {
+      for (block_num = first_col; block_num < end_col; block_num++) {
 	(*inverse_DCT) (cinfo, compptr, (JCOEFPTR) buffer_ptr,
 			output_ptr, output_col);
 	buffer_ptr++;
@@ -468,7 +580,7 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   j_lossy_d_ptr lossyd = (j_lossy_d_ptr) cinfo->codec;
   d_coef_ptr coef = (d_coef_ptr) lossyd->coef_private;
   JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
-  JDIMENSION block_num, last_block_column;
+  JDIMENSION block_num, last_block_column, first_col, end_col;
   int ci, block_row, block_rows, access_rows;
   JBLOCKARRAY buffer;
   JBLOCKROW buffer_ptr, prev_block_row, next_block_row;
@@ -501,6 +613,13 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
       return JPEG_SUSPENDED;
   }
 
+  if (cinfo->output_iMCU_row < cinfo->master->first_iMCU_row) {
+    skip_iMCU_row(cinfo, output_buf);
+    if (++(cinfo->output_iMCU_row) < cinfo->total_iMCU_rows)
+      return JPEG_ROW_COMPLETED;
+    return JPEG_SCAN_COMPLETED;
+  }
+
   /* OK, output from the virtual arrays. */
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
@@ -545,26 +664,33 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
     Q02 = quanttbl->quantval[Q02_POS];
     inverse_DCT = lossyd->inverse_DCT[ci];
     output_ptr = output_buf[ci];
+    get_block_cols(cinfo, compptr, &first_col, &end_col);
     /* Loop over all DCT blocks to be processed. */
     for (block_row = 0; block_row < block_rows; block_row++) {
-      buffer_ptr = buffer[block_row];
+      buffer_ptr = buffer[block_row] + first_col;
       if (first_row && block_row == 0)
 	prev_block_row = buffer_ptr;
       else
-	prev_block_row = buffer[block_row-1];
+	prev_block_row = buffer[block_row-1] + first_col;
       if (last_row && block_row == block_rows-1)
 	next_block_row = buffer_ptr;
       else
-	next_block_row = buffer[block_row+1];
+	next_block_row = buffer[block_row+1] + first_col;
       /* We fetch the surrounding DC values using a sliding-register approach.
-       * Initialize all nine here so as to do the right thing on narrow pics.
+       * Initialize all nine here so as to do the right thing on narrow pics;
+       * a cropped row starts with the real values left of it.
        */
       DC1 = DC2 = DC3 = (int) prev_block_row[0][0];
       DC4 = DC5 = DC6 = (int) buffer_ptr[0][0];
       DC7 = DC8 = DC9 = (int) next_block_row[0][0];
+      if (first_col > 0) {
+	DC1 = (int) prev_block_row[-1][0];
+	DC4 = (int) buffer_ptr[-1][0];
+	DC7 = (int) next_block_row[-1][0];
+      }
       output_col = 0;
       last_block_column = compptr->width_in_data_units - 1;
-      for (block_num = 0; block_num <= last_block_column; block_num++) {
+      for (block_num = first_col; block_num < end_col; block_num++) {
 	/* Fetch current DCT block into workspace so we can modify it. */
 	jcopy_block_row(buffer_ptr, (JBLOCKROW) workspace, (JDIMENSION) 1);
 	/* Update DC values */
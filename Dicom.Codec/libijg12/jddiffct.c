@@ -38,6 +38,15 @@ typedef struct {
   JDIFFARRAY diff_buf[MAX_COMPONENTS];	/* iMCU row of differences */
   JDIFFARRAY undiff_buf[MAX_COMPONENTS]; /* iMCU row of undiff'd samples */
 
+  /* Single-component scans with predictor 1 and no scaling are decoded
+   * straight into the output by entropy_decode_sv1_row, bypassing the
+   * buffers above.
+   */
+  boolean fused_sv1;		/* TRUE to do so for the current scan */
+  int sv1_Ra;			/* predictor for the next sample */
+  int sv1_Rb;			/* predictor for the first sample of a row */
+  JDIFF sv1_prev_row;		/* sv1_Rb as the predictor row of a checkpoint */
+
 #ifdef D_MULTISCAN_FILES_SUPPORTED
   /* In multi-pass modes, we need a virtual sample array for each component. */
   jvirt_sarray_ptr whole_image[MAX_COMPONENTS];
@@ -100,6 +109,15 @@ start_input_pass (j_decompress_ptr cinfo)
   /* Initialize restart counter */
   diff->restart_rows_to_go = cinfo->restart_interval / cinfo->MCUs_per_row;
 
+  /* Decide on the fused path; the predictor and scaler modules have
+   * validated Ss and Al by now.
+   */
+  diff->fused_sv1 = (cinfo->comps_in_scan == 1 && cinfo->Ss == 1 &&
+		     cinfo->Al == 0 &&
+		     cinfo->data_precision <= BITS_IN_JSAMPLE &&
+		     losslsd->entropy_decode_sv1_row != NULL);
+  diff->sv1_Rb = 1 << (cinfo->data_precision - cinfo->Al - 1);
+
   cinfo->input_iMCU_row = 0;
   start_iMCU_row(cinfo);
 }
@@ -123,6 +141,7 @@ process_restart (j_decompress_ptr cinfo)
 
   /* Reset restart counter */
   diff->restart_rows_to_go = cinfo->restart_interval / cinfo->MCUs_per_row;
+  diff->sv1_Rb = 1 << (cinfo->data_precision - cinfo->Al - 1);
 
   return TRUE;
 }
@@ -139,6 +158,128 @@ start_output_pass (j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Save the state of the decoder at the start of an iMCU row for a checkpoint:
+ * that of the bit reader, and the row of each component that the first row
+ * of the iMCU row is predicted from.
+ */
+
+LOCAL(boolean)
+save_checkpoint (j_decompress_ptr cinfo, jpeg_checkpoint * checkpoint)
+{
+  j_lossless_d_ptr losslsd = (j_lossless_d_ptr) cinfo->codec;
+  d_diff_ptr diff = (d_diff_ptr) losslsd->diff_private;
+  int comp;
+  jpeg_component_info *compptr;
+
+  if (! (*losslsd->entropy_save_state) (cinfo, checkpoint))
+    return FALSE;
+
+  if (diff->fused_sv1) {
+    /* Predictor 1 only predicts the first sample from the row above */
+    diff->sv1_prev_row = (JDIFF) diff->sv1_Rb;
+    checkpoint->num_prev_rows = 1;
+    checkpoint->prev_row_width[0] = 1;
+    checkpoint->prev_row[0] = &diff->sv1_prev_row;
+  } else {
+    checkpoint->num_prev_rows = cinfo->comps_in_scan;
+    for (comp = 0; comp < cinfo->comps_in_scan; comp++) {
+      compptr = cinfo->cur_comp_info[comp];
+      checkpoint->prev_row_width[comp] = compptr->width_in_data_units;
+      checkpoint->prev_row[comp] =
+	diff->undiff_buf[compptr->component_index][compptr->v_samp_factor - 1];
+    }
+  }
+  return TRUE;
+}
+
+
+/*
+ * Load the state of a checkpoint saved by save_checkpoint.
+ */
+
+LOCAL(void)
+load_checkpoint (j_decompress_ptr cinfo, const jpeg_checkpoint * checkpoint)
+{
+  j_lossless_d_ptr losslsd = (j_lossless_d_ptr) cinfo->codec;
+  d_diff_ptr diff = (d_diff_ptr) losslsd->diff_private;
+  int comp;
+  jpeg_component_info *compptr;
+
+  if (diff->fused_sv1) {
+    if (checkpoint->num_prev_rows != 1 || checkpoint->prev_row_width[0] != 1)
+      ERREXIT(cinfo, JERR_BAD_CHECKPOINT);
+    diff->sv1_Rb = (int) checkpoint->prev_row[0][0];
+  } else {
+    if (checkpoint->num_prev_rows != cinfo->comps_in_scan)
+      ERREXIT(cinfo, JERR_BAD_CHECKPOINT);
+    for (comp = 0; comp < cinfo->comps_in_scan; comp++) {
+      compptr = cinfo->cur_comp_info[comp];
+      if (checkpoint->prev_row_width[comp] != compptr->width_in_data_units)
+	ERREXIT(cinfo, JERR_BAD_CHECKPOINT);
+      MEMCOPY(diff->undiff_buf[compptr->component_index]
+			      [compptr->v_samp_factor - 1],
+	      checkpoint->prev_row[comp],
+	      compptr->width_in_data_units * SIZEOF(JDIFF));
+    }
+    (*losslsd->predict_resume) (cinfo);
+  }
+  (*losslsd->entropy_load_state) (cinfo, checkpoint);
+}
+
+
+/*
+ * Handle checkpoints at the start of an iMCU row in the single-pass case:
+ * record one for the application, or load the one decoding resumes from.
+ * Returns FALSE if the row lies before that checkpoint; it is then neither
+ * entropy decoded nor reconstructed.
+ */
+
+LOCAL(boolean)
+checkpoint_iMCU_row (j_decompress_ptr cinfo)
+{
+  j_lossless_d_ptr losslsd = (j_lossless_d_ptr) cinfo->codec;
+  d_diff_ptr diff = (d_diff_ptr) losslsd->diff_private;
+  struct jpeg_decomp_master * master = cinfo->master;
+  jpeg_checkpoint checkpoint;
+
+  if (master->resume_pending) {
+    if (cinfo->input_iMCU_row < master->resume.iMCU_row)
+      return FALSE;
+    load_checkpoint(cinfo, &master->resume);
+    master->resume_pending = FALSE;
+  } else if (cinfo->checkpoint != NULL && cinfo->checkpoint->interval > 0 &&
+	     losslsd->entropy_save_state != NULL &&
+	     diff->whole_image[0] == NULL && cinfo->input_iMCU_row > 0 &&
+	     cinfo->input_iMCU_row % cinfo->checkpoint->interval == 0) {
+    if (save_checkpoint(cinfo, &checkpoint))
+      (*cinfo->checkpoint->record_checkpoint) (cinfo, &checkpoint);
+  }
+  return TRUE;
+}
+
+
+/*
+ * Advance the input counters past a completed iMCU row.
+ *
+ * NB: output_data will increment output_iMCU_row.
+ * This counter is not needed for the single-pass case
+ * or the input side of the multi-pass case.
+ */
+
+LOCAL(int)
+finish_iMCU_row (j_decompress_ptr cinfo)
+{
+  if (++(cinfo->input_iMCU_row) < cinfo->total_iMCU_rows) {
+    start_iMCU_row(cinfo);
+    return JPEG_ROW_COMPLETED;
+  }
+  /* Completed the scan */
+  (*cinfo->inputctl->finish_input_pass) (cinfo);
+  return JPEG_SCAN_COMPLETED;
+}
+
+
 /*
  * Decompress and return some data in the supplied buffer.
  * Always attempts to emit one fully interleaved MCU row ("iMCU" row).
@@ -161,6 +302,10 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   unsigned int yoffset;
   jpeg_component_info *compptr;
 
+  if (diff->MCU_vert_offset == 0 && diff->MCU_ctr == 0 &&
+      ! checkpoint_iMCU_row(cinfo))
+    return finish_iMCU_row(cinfo);
+
   /* Loop to process as much as one whole iMCU row */
   for (yoffset = diff->MCU_vert_offset; yoffset < diff->MCU_rows_per_iMCU_row;
        yoffset++) {
@@ -174,10 +319,22 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
 
     MCU_col_num = diff->MCU_ctr;
     /* Try to fetch an MCU-row (or remaining portion of suspended MCU-row). */
-    MCU_count =
-      (*losslsd->entropy_decode_mcus) (cinfo,
-				       diff->diff_buf, yoffset, MCU_col_num,
-				       cinfo->MCUs_per_row - MCU_col_num);
+    if (diff->fused_sv1) {
+      /* An MCU is a single sample here; decode into the output row */
+      compptr = cinfo->cur_comp_info[0];
+      if (MCU_col_num == 0)
+	diff->sv1_Ra = diff->sv1_Rb;
+      MCU_count =
+	(*losslsd->entropy_decode_sv1_row) (cinfo,
+			output_buf[compptr->component_index][yoffset],
+			MCU_col_num, cinfo->MCUs_per_row - MCU_col_num,
+			&diff->sv1_Ra, &diff->sv1_Rb);
+    } else {
+      MCU_count =
+	(*losslsd->entropy_decode_mcus) (cinfo,
+					 diff->diff_buf, yoffset, MCU_col_num,
+					 cinfo->MCUs_per_row - MCU_col_num);
+    }
     if (MCU_count != cinfo->MCUs_per_row - MCU_col_num) {
       /* Suspension forced; update state counters and exit */
       diff->MCU_vert_offset = yoffset;
@@ -195,9 +352,9 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   /*
    * Undifference and scale each scanline of the disassembled MCU-row
    * separately.  We do not process dummy samples at the end of a scanline
-   * or dummy rows at the end of the image.
+   * or dummy rows at the end of the image.  The fused path has done that.
    */
-  for (comp = 0; comp < cinfo->comps_in_scan; comp++) {
+  for (comp = 0; comp < cinfo->comps_in_scan && ! diff->fused_sv1; comp++) {
     compptr = cinfo->cur_comp_info[comp];
     ci = compptr->component_index;
     for (row = 0, prev_row = compptr->v_samp_factor - 1;
@@ -215,19 +372,8 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
     }
   }
 
-  /* Completed the iMCU row, advance counters for next one.
-   *
-   * NB: output_data will increment output_iMCU_row.
-   * This counter is not needed for the single-pass case
-   * or the input side of the multi-pass case.
-   */
-  if (++(cinfo->input_iMCU_row) < cinfo->total_iMCU_rows) {
-    start_iMCU_row(cinfo);
-    return JPEG_ROW_COMPLETED;
-  }
-  /* Completed the scan */
-  (*cinfo->inputctl->finish_input_pass) (cinfo);
-  return JPEG_SCAN_COMPLETED;
+  /* Completed the iMCU row, advance counters for next one */
+  return finish_iMCU_row(cinfo);
 }
 
 
@@ -239,16 +239,8 @@ decode_mcus (j_decompress_ptr cinfo, JDIFFIMAGE diff_buf,
 	register int s, r;
 
 	/* Section H.2.2: decode the sample difference */
-	HUFF_DECODE(s, br_state, dctbl, return mcu_num, label1);
-	if (s) {
-	  if (s == 16)	/* special case: always output 32768 */
-	    s = 32768;
-	  else {	/* normal case: fetch subsequent bits */
-	    CHECK_BIT_BUFFER(br_state, s, return mcu_num);
-	    r = GET_BITS(s);
-	    s = HUFF_EXTEND(r, s);
-	  }
-	}
+	/* (symbol 16 is a special case that always gives 32768) */
+	HUFF_DECODE_VALUE(r, s, br_state, dctbl, return mcu_num);
 
 	/* Output the sample difference */
 	*entropy->output_ptr[entropy->output_ptr_index[sampn]]++ = (JDIFF) s;
@@ -263,6 +255,113 @@ decode_mcus (j_decompress_ptr cinfo, JDIFFIMAGE diff_buf,
 }
 
 
+/*
+ * Decode nMCU samples of a single-component scan that uses predictor 1 and
+ * needs no scaling, undifferencing each one and storing it into output_row
+ * as soon as it is decoded.  This does the work of decode_mcus,
+ * jpeg_undifference1 and noscale (jdscale.c) without the difference
+ * buffers in between.  Suspension is handled like in decode_mcus, with the
+ * predictor saved along with the bitread state after every sample.
+ */
+
+METHODDEF(JDIMENSION)
+decode_sv1_row (j_decompress_ptr cinfo, JSAMPROW output_row,
+		JDIMENSION MCU_col_num, JDIMENSION nMCU, int * Ra, int * Rb)
+{
+  j_lossless_d_ptr losslsd = (j_lossless_d_ptr) cinfo->codec;
+  lhuff_entropy_ptr entropy = (lhuff_entropy_ptr) losslsd->entropy_private;
+  d_derived_tbl * dctbl = entropy->cur_tbls[0];
+  JDIMENSION col, end_col = MCU_col_num + nMCU;
+  register int s, r, pred;
+  BITREAD_STATE_VARS;
+
+  /* If we've run out of data, act like decode_mcus: zero differences and
+   * a restarted predictor make every sample the initial predictor.
+   */
+  if (entropy->insufficient_data) {
+    pred = 1 << (cinfo->data_precision - cinfo->Al - 1);
+    for (col = MCU_col_num; col < end_col; col++)
+      output_row[col] = (JSAMPLE) pred;
+    *Ra = *Rb = pred;
+    return nMCU;
+  }
+
+  /* Load up working state */
+  BITREAD_LOAD_STATE(cinfo,entropy->bitstate);
+  pred = *Ra;
+
+  for (col = MCU_col_num; col < end_col; col++) {
+    /* Section H.2.2: decode the sample difference */
+    /* (symbol 16 is a special case that always gives 32768) */
+    HUFF_DECODE_VALUE(r, s, br_state, dctbl, return col - MCU_col_num);
+
+    /* Undifference modulo 2^16 and output the sample */
+    pred = (s + pred) & 0xFFFF;
+    output_row[col] = (JSAMPLE) pred;
+
+    /* Completed sample, so update state */
+    BITREAD_SAVE_STATE(cinfo,entropy->bitstate);
+    *Ra = pred;
+    if (col == 0)
+      *Rb = pred;
+  }
+
+  return nMCU;
+}
+
+
+/*
+ * Save the bit reader state for a checkpoint.  The bits read ahead of the
+ * source position go with it, so that decoding can resume at that position.
+ * A state after running out of data or reaching a marker is not saved.
+ */
+
+METHODDEF(boolean)
+save_state (j_decompress_ptr cinfo, jpeg_checkpoint * checkpoint)
+{
+  j_lossless_d_ptr losslsd = (j_lossless_d_ptr) cinfo->codec;
+  lhuff_entropy_ptr entropy = (lhuff_entropy_ptr) losslsd->entropy_private;
+  bit_buf_type bits;
+  int i;
+
+  if (entropy->insufficient_data || cinfo->unread_marker != 0 ||
+      cinfo->restart_interval)
+    return FALSE;
+
+  checkpoint->iMCU_row = cinfo->input_iMCU_row;
+  checkpoint->bits_left = entropy->bitstate.bits_left;
+  bits = (checkpoint->bits_left > 0) ?
+    entropy->bitstate.get_buffer << (BIT_BUF_SIZE - checkpoint->bits_left) : 0;
+  for (i = 0; i < (int) SIZEOF(checkpoint->bits); i++)
+    checkpoint->bits[i] = (JOCTET) (bits >> (BIT_BUF_SIZE - 8 - 8 * i));
+  for (i = 0; i < MAX_COMPS_IN_SCAN; i++)
+    checkpoint->last_dc_val[i] = 0;
+  return TRUE;
+}
+
+
+/*
+ * Load the bit reader state of a checkpoint.  The caller positions the
+ * source.
+ */
+
+METHODDEF(void)
+load_state (j_decompress_ptr cinfo, const jpeg_checkpoint * checkpoint)
+{
+  j_lossless_d_ptr losslsd = (j_lossless_d_ptr) cinfo->codec;
+  lhuff_entropy_ptr entropy = (lhuff_entropy_ptr) losslsd->entropy_private;
+  bit_buf_type bits = 0;
+  int i;
+
+  for (i = 0; i < (int) SIZEOF(checkpoint->bits); i++)
+    bits = (bits << 8) | checkpoint->bits[i];
+  entropy->bitstate.bits_left = checkpoint->bits_left;
+  entropy->bitstate.get_buffer = (checkpoint->bits_left > 0) ?
+    bits >> (BIT_BUF_SIZE - checkpoint->bits_left) : 0;
+  entropy->insufficient_data = FALSE;
+}
+
+
 /*
  * Module initialization routine for lossless Huffman entropy decoding.
  */
@@ -281,6 +380,9 @@ jinit_lhuff_decoder (j_decompress_ptr cinfo)
   losslsd->entropy_start_pass = start_pass_lhuff_decoder;
   losslsd->entropy_process_restart = process_restart;
   losslsd->entropy_decode_mcus = decode_mcus;
+  losslsd->entropy_decode_sv1_row = decode_sv1_row;
+  losslsd->entropy_save_state = save_state;
+  losslsd->entropy_load_state = load_state;
 
   /* Mark tables unallocated */
   for (i = 0; i < NUM_HUFF_TBLS; i++) {
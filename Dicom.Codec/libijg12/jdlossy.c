@@ -197,6 +197,9 @@ jinit_lossy_d_codec (j_decompress_ptr cinfo)
 
   /* Inverse DCT */
   jinit_inverse_dct(cinfo);
+  /* Only the sequential Huffman decoder supports checkpoints */
+  lossyd->entropy_save_state = NULL;
+  lossyd->entropy_load_state = NULL;
   /* Entropy decoding: either Huffman or arithmetic coding. */
   if (cinfo->arith_code) {
 #ifdef WITH_ARITHMETIC_PATCH
@@ -456,5 +456,13 @@ jinit_master_decompress (j_decompress_ptr cinfo)
 
   master->pub.is_dummy_pass = FALSE;
 
+  /* Reconstruct the whole image unless the application crops it */
+  master->pub.first_iMCU_col = 0;
+  master->pub.last_iMCU_col = (JDIMENSION)
+    jdiv_round_up((long) cinfo->image_width,
+		  (long) (cinfo->max_h_samp_factor * cinfo->data_unit)) - 1;
+  master->pub.first_iMCU_row = 0;
+  master->pub.resume_pending = FALSE;
+
   master_selection(cinfo);
 }
@@ -63,8 +63,12 @@ typedef struct {
   JSAMPROW spare_row;
   boolean spare_full;		/* T if spare buffer is occupied */
 
-  JDIMENSION out_row_width;	/* samples per output row */
+  JDIMENSION out_row_width;	/* samples per uncropped output row */
   JDIMENSION rows_to_go;	/* counts rows remaining in image */
+
+#ifdef JSIMD_COLOR_SUPPORTED
+  boolean use_simd;		/* TRUE to use the jsimd merged upsamplers */
+#endif
 } my_upsampler;
 
 typedef my_upsampler * my_upsample_ptr;
@@ -153,9 +157,12 @@ merged_2v_upsample (j_decompress_ptr cinfo,
   JDIMENSION num_rows;		/* number of rows returned to caller */
 
   if (upsample->spare_full) {
-    /* If we have a spare row saved from a previous cycle, just return it. */
+    /* If we have a spare row saved from a previous cycle, just return it.
+     * Its width is that of the output, which jpeg_crop_scanline may have
+     * reduced since the spare row was allocated.
+     */
     jcopy_sample_rows(& upsample->spare_row, 0, output_buf + *out_row_ctr, 0,
-		      1, upsample->out_row_width);
+		      1, cinfo->output_width * cinfo->out_color_components);
     num_rows = 1;
     upsample->spare_full = FALSE;
   } else {
@@ -245,8 +252,19 @@ h2v1_merged_upsample (j_decompress_ptr cinfo,
   inptr1 = input_buf[1][in_row_group_ctr];
   inptr2 = input_buf[2][in_row_group_ctr];
   outptr = output_buf[0];
+  col = cinfo->output_width >> 1;
+#ifdef JSIMD_COLOR_SUPPORTED
+  if (upsample->use_simd) {
+    JDIMENSION done = jsimd_h2v1_merged_row(inptr0, inptr1, inptr2, outptr, col);
+    inptr0 += 2 * done;
+    inptr1 += done;
+    inptr2 += done;
+    outptr += 2 * done * RGB_PIXELSIZE;
+    col -= done;
+  }
+#endif
   /* Loop for each pair of output pixels */
-  for (col = cinfo->output_width >> 1; col > 0; col--) {
+  for (; col > 0; col--) {
     /* Do the chroma part of the calculation */
     cb = GETJSAMPLE(*inptr1++);
     cr = GETJSAMPLE(*inptr2++);
@@ -309,8 +327,22 @@ h2v2_merged_upsample (j_decompress_ptr cinfo,
   inptr2 = input_buf[2][in_row_group_ctr];
   outptr0 = output_buf[0];
   outptr1 = output_buf[1];
+  col = cinfo->output_width >> 1;
+#ifdef JSIMD_COLOR_SUPPORTED
+  if (upsample->use_simd) {
+    JDIMENSION done = jsimd_h2v2_merged_row(inptr00, inptr01, inptr1, inptr2,
+					    outptr0, outptr1, col);
+    inptr00 += 2 * done;
+    inptr01 += 2 * done;
+    inptr1 += done;
+    inptr2 += done;
+    outptr0 += 2 * done * RGB_PIXELSIZE;
+    outptr1 += 2 * done * RGB_PIXELSIZE;
+    col -= done;
+  }
+#endif
   /* Loop for each group of output pixels */
-  for (col = cinfo->output_width >> 1; col > 0; col--) {
+  for (; col > 0; col--) {
     /* Do the chroma part of the calculation */
     cb = GETJSAMPLE(*inptr1++);
     cr = GETJSAMPLE(*inptr2++);
@@ -395,6 +427,9 @@ jinit_merged_upsampler (j_decompress_ptr cinfo)
   }
 
   build_ycc_rgb_table(cinfo);
+#ifdef JSIMD_COLOR_SUPPORTED
+  upsample->use_simd = (jsimd_support() & JSIMD_SSE2) != 0;
+#endif
 }
 
 #endif /* UPSAMPLE_MERGING_SUPPORTED */
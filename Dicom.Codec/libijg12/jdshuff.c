@@ -251,17 +251,12 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
       JBLOCKROW block = MCU_data[blkn];
       d_derived_tbl * dctbl = entropy->dc_cur_tbls[blkn];
       d_derived_tbl * actbl = entropy->ac_cur_tbls[blkn];
-      register int s, k, r;
+      register int s, k, r, v;
 
       /* Decode a single block's worth of coefficients */
 
       /* Section F.2.2.1: decode the DC coefficient difference */
-      HUFF_DECODE(s, br_state, dctbl, return FALSE, label1);
-      if (s) {
-	CHECK_BIT_BUFFER(br_state, s, return FALSE);
-	r = GET_BITS(s);
-	s = HUFF_EXTEND(r, s);
-      }
+      HUFF_DECODE_VALUE(r, s, br_state, dctbl, return FALSE);
 
       if (entropy->dc_needed[blkn]) {
 	/* Convert DC difference to actual value, update last_dc_val */
@@ -277,21 +272,18 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 	/* Section F.2.2.2: decode the AC coefficients */
 	/* Since zeroes are skipped, output area must be cleared beforehand */
 	for (k = 1; k < DCTSIZE2; k++) {
-	  HUFF_DECODE(s, br_state, actbl, return FALSE, label2);
+	  HUFF_DECODE_VALUE(s, v, br_state, actbl, return FALSE);
       
 	  r = s >> 4;
 	  s &= 15;
       
 	  if (s) {
 	    k += r;
-	    CHECK_BIT_BUFFER(br_state, s, return FALSE);
-	    r = GET_BITS(s);
-	    s = HUFF_EXTEND(r, s);
 	    /* Output coefficient in natural (dezigzagged) order.
 	     * Note: the extra entries in jpeg_natural_order[] will save us
 	     * if k >= DCTSIZE2, which could happen if the data is corrupted.
 	     */
-	    (*block)[jpeg_natural_order[k]] = (JCOEF) s;
+	    (*block)[jpeg_natural_order[k]] = (JCOEF) v;
 	  } else {
 	    if (r != 15)
 	      break;
@@ -304,15 +296,13 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 	/* Section F.2.2.2: decode the AC coefficients */
 	/* In this path we just discard the values */
 	for (k = 1; k < DCTSIZE2; k++) {
-	  HUFF_DECODE(s, br_state, actbl, return FALSE, label3);
+	  HUFF_DECODE_VALUE(s, v, br_state, actbl, return FALSE);
       
 	  r = s >> 4;
 	  s &= 15;
       
 	  if (s) {
 	    k += r;
-	    CHECK_BIT_BUFFER(br_state, s, return FALSE);
-	    DROP_BITS(s);
 	  } else {
 	    if (r != 15)
 	      break;
@@ -335,6 +325,66 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 }
 
 
+/*
+ * Save the decoder state for a checkpoint.  The bits read ahead of the
+ * source position go with it, so that decoding can resume at that position.
+ * A state from which the rest of the scan would be decoded differently
+ * (after running out of data or reaching a marker, or without the DC
+ * predictions of components that are not needed) is not saved.
+ */
+
+METHODDEF(boolean)
+save_state (j_decompress_ptr cinfo, jpeg_checkpoint * checkpoint)
+{
+  j_lossy_d_ptr lossyd = (j_lossy_d_ptr) cinfo->codec;
+  shuff_entropy_ptr entropy = (shuff_entropy_ptr) lossyd->entropy_private;
+  bit_buf_type bits;
+  int i;
+
+  if (entropy->insufficient_data || cinfo->unread_marker != 0 ||
+      cinfo->restart_interval)
+    return FALSE;
+  /* The DC predictions of unneeded components are not kept up to date */
+  for (i = 0; i < cinfo->comps_in_scan; i++)
+    if (! cinfo->cur_comp_info[i]->component_needed)
+      return FALSE;
+
+  checkpoint->iMCU_row = cinfo->input_iMCU_row;
+  checkpoint->bits_left = entropy->bitstate.bits_left;
+  bits = (checkpoint->bits_left > 0) ?
+    entropy->bitstate.get_buffer << (BIT_BUF_SIZE - checkpoint->bits_left) : 0;
+  for (i = 0; i < (int) SIZEOF(checkpoint->bits); i++)
+    checkpoint->bits[i] = (JOCTET) (bits >> (BIT_BUF_SIZE - 8 - 8 * i));
+  for (i = 0; i < MAX_COMPS_IN_SCAN; i++)
+    checkpoint->last_dc_val[i] = entropy->saved.last_dc_val[i];
+  checkpoint->num_prev_rows = 0;
+  return TRUE;
+}
+
+
+/*
+ * Load the decoder state of a checkpoint.  The caller positions the source.
+ */
+
+METHODDEF(void)
+load_state (j_decompress_ptr cinfo, const jpeg_checkpoint * checkpoint)
+{
+  j_lossy_d_ptr lossyd = (j_lossy_d_ptr) cinfo->codec;
+  shuff_entropy_ptr entropy = (shuff_entropy_ptr) lossyd->entropy_private;
+  bit_buf_type bits = 0;
+  int i;
+
+  for (i = 0; i < (int) SIZEOF(checkpoint->bits); i++)
+    bits = (bits << 8) | checkpoint->bits[i];
+  entropy->bitstate.bits_left = checkpoint->bits_left;
+  entropy->bitstate.get_buffer = (checkpoint->bits_left > 0) ?
+    bits >> (BIT_BUF_SIZE - checkpoint->bits_left) : 0;
+  for (i = 0; i < MAX_COMPS_IN_SCAN; i++)
+    entropy->saved.last_dc_val[i] = checkpoint->last_dc_val[i];
+  entropy->insufficient_data = FALSE;
+}
+
+
 /*
  * Module initialization routine for Huffman entropy decoding.
  */
@@ -352,6 +402,8 @@ jinit_shuff_decoder (j_decompress_ptr cinfo)
   lossyd->entropy_private = (void *) entropy;
   lossyd->entropy_start_pass = start_pass_huff_decoder;
   lossyd->entropy_decode_mcu = decode_mcu;
+  lossyd->entropy_save_state = save_state;
+  lossyd->entropy_load_state = load_state;
 
   /* Mark tables unallocated */
   for (i = 0; i < NUM_HUFF_TBLS; i++) {
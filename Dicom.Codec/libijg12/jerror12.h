@@ -44,7 +44,9 @@ JMESSAGE(JERR_ARITH_NOTIMPL,
 JMESSAGE(JERR_BAD_ALIGN_TYPE, "ALIGN_TYPE is wrong, please fix")
 JMESSAGE(JERR_BAD_ALLOC_CHUNK, "MAX_ALLOC_CHUNK is wrong, please fix")
 JMESSAGE(JERR_BAD_BUFFER_MODE, "Bogus buffer control mode")
+JMESSAGE(JERR_BAD_CHECKPOINT, "Cannot resume decoding at this checkpoint")
 JMESSAGE(JERR_BAD_COMPONENT_ID, "Invalid component ID 0 in SOS")
+JMESSAGE(JERR_BAD_CROP_SPEC, "Invalid crop request")
 JMESSAGE(JERR_BAD_DCT_COEF, "DCT coefficient out of range")
 JMESSAGE(JERR_BAD_DCTSIZE, "IDCT output block size 0 not supported")
 JMESSAGE(JERR_BAD_DIFF, "spatial difference out of range")
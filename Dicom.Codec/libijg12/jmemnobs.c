@@ -6,13 +6,13 @@
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file provides a really simple implementation of the system-
- * dependent portion of the JPEG memory manager.  This implementation
- * assumes that no backing-store files are needed: all required space
- * can be obtained from malloc().
- * This is very portable in the sense that it'll compile on almost anything,
- * but you'd better have lots of main memory (or virtual memory) if you want
- * to process big images.
- * Note that the max_memory_to_use option is ignored by this implementation.
+ * dependent portion of the JPEG memory manager.  All required space is
+ * obtained from malloc(), optionally through a per-object arena (see
+ * struct jpeg_memory_arena in jpeglib.h) that keeps freed blocks for reuse
+ * and counts the space handed out.
+ * If max_memory_to_use is set, virtual arrays that do not fit in it are
+ * kept in temporary files created with the ANSI tmpfile() routine, as in
+ * jmemansi.c; otherwise all space comes from main memory.
  */
 
 #define JPEG_INTERNALS
@@ -25,22 +25,165 @@ extern void * malloc JPP((size_t size));
 extern void free JPP((void *ptr));
 #endif
 
+#ifndef SEEK_SET		/* pre-ANSI systems may not define this; */
+#define SEEK_SET  0		/* if not, assume 0 is correct */
+#endif
+
+
+/*
+ * Every block carries a header with its size and its arena, so that a freed
+ * block goes back where it came from and can be matched against later
+ * requests.  The union keeps the object that follows the header as strictly
+ * aligned as malloc() would.
+ */
+
+typedef union block_struct * block_ptr;
+
+typedef union block_struct {
+  struct {
+    void * link;		/* arena while in use, next block while cached */
+    size_t size;		/* bytes available after the header */
+  } hdr;
+  double dummy;			/* included only to ensure alignment */
+} block;
+
+
+/*
+ * Free cached blocks until no more than max_cached bytes remain.
+ * The most recently freed blocks, at the head of the list, are kept first.
+ */
+
+LOCAL(void)
+arena_trim (struct jpeg_memory_arena * arena, size_t max_cached)
+{
+  block_ptr blk;
+  void ** prev = &arena->free_blocks;
+  size_t kept = 0;
+
+  while ((blk = (block_ptr) *prev) != NULL) {
+    if (kept + blk->hdr.size <= max_cached) {
+      kept += blk->hdr.size;
+      prev = &blk->hdr.link;
+    } else {
+      *prev = blk->hdr.link;
+      free((void *) blk);
+    }
+  }
+  arena->cached_bytes = kept;
+}
+
+
+/*
+ * Get a block for an object.  With an arena, take the smallest cached block
+ * that fits the request without wasting more than half of itself, before
+ * turning to the heap.
+ */
+
+LOCAL(void *)
+get_block (struct jpeg_memory_arena * arena, size_t sizeofobject)
+{
+  block_ptr blk;
+  void ** prev;
+  void ** best = NULL;
+
+  if (arena == NULL) {
+    blk = (block_ptr) malloc(SIZEOF(block) + sizeofobject);
+    if (blk == NULL)
+      return NULL;
+    blk->hdr.link = NULL;
+    blk->hdr.size = sizeofobject;
+    return (void *) (blk + 1);
+  }
+
+  for (prev = &arena->free_blocks; (blk = (block_ptr) *prev) != NULL;
+       prev = &blk->hdr.link) {
+    if (blk->hdr.size >= sizeofobject &&
+	blk->hdr.size - sizeofobject <= blk->hdr.size / 2 &&
+	(best == NULL || blk->hdr.size < ((block_ptr) *best)->hdr.size))
+      best = prev;
+  }
+
+  if (best != NULL) {
+    blk = (block_ptr) *best;
+    *best = blk->hdr.link;
+    arena->cached_bytes -= blk->hdr.size;
+  } else {
+    blk = (block_ptr) malloc(SIZEOF(block) + sizeofobject);
+    if (blk == NULL && arena->free_blocks != NULL) {
+      /* Give the cache back to the heap and try again */
+      arena_trim(arena, 0);
+      blk = (block_ptr) malloc(SIZEOF(block) + sizeofobject);
+    }
+    if (blk == NULL)
+      return NULL;
+    blk->hdr.size = sizeofobject;
+    arena->heap_bytes += sizeofobject;
+  }
+
+  blk->hdr.link = (void *) arena;
+  arena->bytes_in_use += blk->hdr.size;
+  if (arena->peak_bytes < arena->bytes_in_use)
+    arena->peak_bytes = arena->bytes_in_use;
+  arena->total_bytes += blk->hdr.size;
+  return (void *) (blk + 1);
+}
+
+
+/*
+ * Return a block to its arena, or to the heap.  An arena's cache is bounded
+ * by the largest amount of space the object has held since the counters
+ * were reset, so it never holds more than an image needs, and by
+ * max_memory_to_use if that is set; older blocks make room for this one
+ * first.
+ */
+
+LOCAL(void)
+free_block (j_common_ptr cinfo, void * object)
+{
+  block_ptr blk = (block_ptr) object - 1;
+  struct jpeg_memory_arena * arena = (struct jpeg_memory_arena *) blk->hdr.link;
+  size_t max_cached;
+
+  if (arena == NULL) {
+    free((void *) blk);
+    return;
+  }
+
+  arena->bytes_in_use -= blk->hdr.size;
+
+  max_cached = arena->peak_bytes;
+  if (cinfo->mem != NULL && cinfo->mem->max_memory_to_use > 0 &&
+      max_cached > (size_t) cinfo->mem->max_memory_to_use)
+    max_cached = (size_t) cinfo->mem->max_memory_to_use;
+
+  if (blk->hdr.size > max_cached) {
+    free((void *) blk);
+    return;
+  }
+  if (arena->cached_bytes + blk->hdr.size > max_cached)
+    arena_trim(arena, max_cached - blk->hdr.size);
+  blk->hdr.link = arena->free_blocks;
+  arena->free_blocks = (void *) blk;
+  arena->cached_bytes += blk->hdr.size;
+}
+
 
 /*
  * Memory allocation and freeing are controlled by the regular library
- * routines malloc() and free().
+ * routines malloc() and free(), through the arena of the object if it has
+ * one.
  */
 
 GLOBAL(void *)
 jpeg_get_small (j_common_ptr cinfo, size_t sizeofobject)
 {
-  return (void *) malloc(sizeofobject);
+  return get_block(cinfo->arena, sizeofobject);
 }
 
 GLOBAL(void)
 jpeg_free_small (j_common_ptr cinfo, void * object, size_t sizeofobject)
 {
-  free(object);
+  free_block(cinfo, object);
 }
 
 
@@ -54,46 +197,117 @@ jpeg_free_small (j_common_ptr cinfo, void * object, size_t sizeofobject)
 GLOBAL(void FAR *)
 jpeg_get_large (j_common_ptr cinfo, size_t sizeofobject)
 {
-  return (void FAR *) malloc(sizeofobject);
+  return (void FAR *) get_block(cinfo->arena, sizeofobject);
 }
 
 GLOBAL(void)
 jpeg_free_large (j_common_ptr cinfo, void FAR * object, size_t sizeofobject)
 {
-  free(object);
+  free_block(cinfo, (void *) object);
 }
 
 
 /*
  * This routine computes the total memory space available for allocation.
- * Here we always say, "we got all you want bud!"
+ * Without a max_memory_to_use limit we say, "we got all you want bud!";
+ * with one, the space left under the limit, or none once it is used up.
  */
 
 GLOBAL(long)
 jpeg_mem_available (j_common_ptr cinfo, long min_bytes_needed,
 		    long max_bytes_needed, long already_allocated)
 {
-  return max_bytes_needed;
+  if (cinfo->mem->max_memory_to_use <= 0)
+    return max_bytes_needed;
+  if (already_allocated >= cinfo->mem->max_memory_to_use)
+    return 0;
+  return cinfo->mem->max_memory_to_use - already_allocated;
 }
 
 
 /*
  * Backing store (temporary file) management.
- * Since jpeg_mem_available always promised the moon,
- * this should never be called and we can just error out.
+ * Backing store objects are only used when the value returned by
+ * jpeg_mem_available is less than the total space needed, that is when
+ * max_memory_to_use is set.  The files are anonymous and vanish when closed.
+ */
+
+
+METHODDEF(void)
+read_backing_store (j_common_ptr cinfo, backing_store_ptr info,
+		    void FAR * buffer_address,
+		    long file_offset, long byte_count)
+{
+  if (fseek(info->temp_file, file_offset, SEEK_SET))
+    ERREXIT(cinfo, JERR_TFILE_SEEK);
+  if (JFREAD(info->temp_file, buffer_address, byte_count)
+      != (size_t) byte_count)
+    ERREXIT(cinfo, JERR_TFILE_READ);
+}
+
+
+METHODDEF(void)
+write_backing_store (j_common_ptr cinfo, backing_store_ptr info,
+		     void FAR * buffer_address,
+		     long file_offset, long byte_count)
+{
+  if (fseek(info->temp_file, file_offset, SEEK_SET))
+    ERREXIT(cinfo, JERR_TFILE_SEEK);
+  if (JFWRITE(info->temp_file, buffer_address, byte_count)
+      != (size_t) byte_count)
+    ERREXIT(cinfo, JERR_TFILE_WRITE);
+}
+
+
+METHODDEF(void)
+close_backing_store (j_common_ptr cinfo, backing_store_ptr info)
+{
+  fclose(info->temp_file);
+  /* Since this implementation uses tmpfile() to create the file,
+   * no explicit file deletion is needed.
+   */
+}
+
+
+/*
+ * Initial opening of a backing-store object.
+ *
+ * The Microsoft C library creates tmpfile() files in the root directory of
+ * the current drive, which is usually not writable; there we create the file
+ * in the directory named by TMP instead, and let the library delete it when
+ * it is closed.
  */
 
 GLOBAL(void)
 jpeg_open_backing_store (j_common_ptr cinfo, backing_store_ptr info,
 			 long total_bytes_needed)
 {
-  ERREXIT(cinfo, JERR_NO_BACKING_STORE);
+#ifdef _MSC_VER
+  char * name = _tempnam(NULL, "jpg");
+
+  info->temp_file = NULL;
+  if (name != NULL) {
+    strncpy(info->temp_name, name, TEMP_NAME_LENGTH - 1);
+    info->temp_name[TEMP_NAME_LENGTH - 1] = '\0';
+    info->temp_file = fopen(name, "w+bTD");
+    free(name);
+  }
+#else
+  info->temp_name[0] = '\0';
+  info->temp_file = tmpfile();
+#endif
+  if (info->temp_file == NULL)
+    ERREXITS(cinfo, JERR_TFILE_CREATE, "");
+  info->read_backing_store = read_backing_store;
+  info->write_backing_store = write_backing_store;
+  info->close_backing_store = close_backing_store;
+  TRACEMSS(cinfo, 1, JTRC_TFILE_OPEN, info->temp_name);
 }
 
 
 /*
  * These routines take care of any system-dependent initialization and
- * cleanup required.  Here, there isn't any.
+ * cleanup required.  The arena's cache is released along with the object.
  */
 
 GLOBAL(long)
@@ -105,5 +319,6 @@ jpeg_mem_init (j_common_ptr cinfo)
 GLOBAL(void)
 jpeg_mem_term (j_common_ptr cinfo)
 {
-  /* no work */
+  if (cinfo->arena != NULL)
+    arena_trim(cinfo->arena, 0L);
 }
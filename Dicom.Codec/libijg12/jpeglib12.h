@@ -260,6 +260,7 @@ typedef enum {
   struct jpeg_memory_mgr * mem;	/* Memory manager module */\
   struct jpeg_progress_mgr * progress; /* Progress monitor, or NULL if none */\
   void * client_data;		/* Available for use by application */\
+  struct jpeg_memory_arena * arena; /* Block cache for jmemnobs.c, or NULL */\
   boolean is_decompressor;	/* So common code can tell which is which */\
   int global_state		/* For checking call sequence validity */
 
@@ -343,6 +344,23 @@ struct jpeg_compress_struct {
   int smoothing_factor;		/* 1..100, or 0 for no input smoothing */
   J_DCT_METHOD dct_method;	/* DCT algorithm selector */
 
+  /* When an image is compressed in pieces that must share Huffman tables
+   * (e.g. stripes that are coded concurrently and then joined with restart
+   * markers), the application can collect the symbol statistics itself:
+   * if an entry is not NULL, a sequential or lossless optimize_coding pass
+   * adds its counts for that table to the given 257-entry array instead of
+   * counting privately.  The arrays are not cleared and are left intact.
+   */
+  long * dc_huff_counts[NUM_HUFF_TBLS];
+  long * ac_huff_counts[NUM_HUFF_TBLS];
+
+  /* Lossless scans normally ignore optimize_coding and always build their
+   * own Huffman tables, since the default tables cannot code every
+   * difference.  If this is TRUE they honour optimize_coding = FALSE; the
+   * application must then supply tables that code every symbol it meets.
+   */
+  boolean lossless_supplied_tables;
+
   /* The restart interval can be specified in absolute MCUs by setting
    * restart_interval, or in MCU rows by setting restart_in_rows
    * (in which case the correct restart_interval will be figured
@@ -433,6 +451,9 @@ struct jpeg_decompress_struct {
   /* Source of compressed data */
   struct jpeg_source_mgr * src;
 
+  /* Recorder of entropy decoder checkpoints, or NULL */
+  struct jpeg_checkpoint_mgr * checkpoint;
+
   /* Basic description of image --- filled in by jpeg_read_header(). */
   /* Application may inspect these values to decide how to process image. */
 
@@ -753,6 +774,44 @@ struct jpeg_source_mgr {
 };
 
 
+/* State of the entropy decoder at the start of an iMCU row of a sequential
+ * or lossless, Huffman-coded, single-scan image without restart markers.
+ * Decoding can later resume from it (see jpeg_resume_checkpoint) instead of
+ * from the start of the scan.  The state goes with the source position at
+ * which it was recorded, which the application keeps.
+ *
+ * A lossless state also holds the row of each component that the first row
+ * of the iMCU row is predicted from (just its first sample, in a scan that
+ * uses predictor 1).  The rows belong to the decoder while the checkpoint is
+ * recorded, so the recorder must copy them, and to the application while
+ * decoding resumes from it.
+ */
+
+typedef struct {
+  JDIMENSION iMCU_row;		/* first iMCU row decoded from this state */
+  int bits_left;		/* # of bits read ahead of the position */
+  JOCTET bits[8];		/* those bits, left justified */
+  int last_dc_val[MAX_COMPS_IN_SCAN]; /* DC predictions */
+  int num_prev_rows;		/* # of predictor rows; 0 if lossy */
+  JDIMENSION prev_row_width[MAX_COMPS_IN_SCAN]; /* samples in each */
+  JDIFFROW prev_row[MAX_COMPS_IN_SCAN]; /* predictor rows */
+} jpeg_checkpoint;
+
+
+/* Checkpoint recorder object for decompression.  record_checkpoint is
+ * called with the source positioned at the entropy-coded data of the
+ * checkpoint's iMCU row, every interval iMCU rows.  It may be called again
+ * for the same row if the data source suspends there.
+ */
+
+struct jpeg_checkpoint_mgr {
+  JMETHOD(void, record_checkpoint, (j_decompress_ptr cinfo,
+				    const jpeg_checkpoint * checkpoint));
+
+  JDIMENSION interval;		/* iMCU rows between checkpoints */
+};
+
+
 /* Memory manager object.
  * Allocates "small" objects (a few K total), "large" objects (tens of K),
  * and "really big" objects (virtual arrays with backing store if needed).
@@ -792,11 +851,12 @@ struct jpeg_memory_mgr {
   JMETHOD(JBLOCKARRAY, alloc_barray, (j_common_ptr cinfo, int pool_id,
 				      JDIMENSION blocksperrow,
 				      JDIMENSION numrows));
-#ifdef NEED_DARRAY
+  /* Declared even without NEED_DARRAY: applications do not see the lossless
+   * options, and the fields below must have the same offsets for them.
+   */
   JMETHOD(JDIFFARRAY, alloc_darray, (j_common_ptr cinfo, int pool_id,
 				     JDIMENSION diffsperrow,
 				     JDIMENSION numrows));
-#endif
   JMETHOD(jvirt_sarray_ptr, request_virt_sarray, (j_common_ptr cinfo,
 						  int pool_id,
 						  boolean pre_zero,
@@ -835,6 +895,28 @@ struct jpeg_memory_mgr {
 };
 
 
+/* Block cache and accounting for the system-dependent memory manager
+ * (jmemnobs.c).  An application may zero one of these and point cinfo->arena
+ * at it after calling jpeg_create_compress/decompress.  Memory that the JPEG
+ * object obtains from then on is counted, and once freed (for instance the
+ * image pool, at the end of each image) it is kept for reuse by later images
+ * instead of going back to the heap.  The cache never holds more than
+ * peak_bytes, nor more than max_memory_to_use if that is set, and it is
+ * emptied when the object is destroyed; the arena must
+ * stay attached until then.  The counters may be read and reset by the
+ * application between images.
+ */
+
+struct jpeg_memory_arena {
+  void * free_blocks;		/* blocks kept for reuse (private) */
+  size_t cached_bytes;		/* size of the blocks in free_blocks */
+  size_t bytes_in_use;		/* space held by the JPEG object */
+  size_t peak_bytes;		/* high-water mark of bytes_in_use */
+  size_t total_bytes;		/* space handed out, including reused blocks */
+  size_t heap_bytes;		/* space newly obtained from malloc() */
+};
+
+
 /* Routine signature for application-supplied marker processing methods.
  * Need not pass marker code since it is stored in cinfo->unread_marker.
  */
@@ -920,6 +1002,7 @@ typedef JMETHOD(boolean, jpeg_marker_parser_method, (j_decompress_ptr cinfo));
 #define jpeg_calc_output_dimensions    jpeg12_calc_output_dimensions
 #define jpeg_consume_input             jpeg12_consume_input
 #define jpeg_copy_critical_parameters  jpeg12_copy_critical_parameters
+#define jpeg_crop_scanline             jpeg12_crop_scanline
 #define jpeg_default_colorspace        jpeg12_default_colorspace
 #define jpeg_destroy                   jpeg12_destroy
 #define jpeg_destroy_compress          jpeg12_destroy_compress
@@ -944,6 +1027,8 @@ typedef JMETHOD(boolean, jpeg_marker_parser_method, (j_decompress_ptr cinfo));
 #define jpeg_idct_float                jpeg12_idct_float
 #define jpeg_idct_ifast                jpeg12_idct_ifast
 #define jpeg_idct_islow                jpeg12_idct_islow
+#define jpeg_idct_islow_avx2           jpeg12_idct_islow_avx2
+#define jpeg_idct_islow_sse2           jpeg12_idct_islow_sse2
 #define jpeg_input_complete            jpeg12_input_complete
 #define jpeg_make_c_derived_tbl        jpeg12_make_c_derived_tbl
 #define jpeg_make_d_derived_tbl        jpeg12_make_d_derived_tbl
@@ -957,6 +1042,7 @@ typedef JMETHOD(boolean, jpeg_marker_parser_method, (j_decompress_ptr cinfo));
 #define jpeg_read_header               jpeg12_read_header
 #define jpeg_read_raw_data             jpeg12_read_raw_data
 #define jpeg_read_scanlines            jpeg12_read_scanlines
+#define jpeg_resume_checkpoint         jpeg12_resume_checkpoint
 #define jpeg_resync_to_restart         jpeg12_resync_to_restart
 #define jpeg_save_markers              jpeg12_save_markers
 #define jpeg_set_colorspace            jpeg12_set_colorspace
@@ -966,6 +1052,8 @@ typedef JMETHOD(boolean, jpeg_marker_parser_method, (j_decompress_ptr cinfo));
 #define jpeg_set_quality               jpeg12_set_quality
 #define jpeg_simple_lossless           jpeg12_simple_lossless
 #define jpeg_simple_progression        jpeg12_simple_progression
+#define jpeg_simd_mask                 jpeg12_simd_mask
+#define jpeg_skip_scanlines            jpeg12_skip_scanlines
 #define jpeg_start_compress            jpeg12_start_compress
 #define jpeg_start_decompress          jpeg12_start_decompress
 #define jpeg_start_output              jpeg12_start_output
@@ -981,6 +1069,12 @@ typedef JMETHOD(boolean, jpeg_marker_parser_method, (j_decompress_ptr cinfo));
 #define jpeg_write_scanlines           jpeg12_write_scanlines
 #define jpeg_write_tables              jpeg12_write_tables
 #define jround_up                      jround12_up
+#define jsimd_h2v1_fancy_row           jsimd12_h2v1_fancy_row
+#define jsimd_h2v1_merged_row          jsimd12_h2v1_merged_row
+#define jsimd_h2v2_fancy_row           jsimd12_h2v2_fancy_row
+#define jsimd_h2v2_merged_row          jsimd12_h2v2_merged_row
+#define jsimd_support                  jsimd12_support
+#define jsimd_ycc_rgb_row              jsimd12_ycc_rgb_row
 #define jzero_far                      jzero12_far
 #endif /* NEED_SHORT_EXTERNAL_NAMES */
 
@@ -1085,6 +1179,14 @@ EXTERN(JDIMENSION) jpeg_read_scanlines JPP((j_decompress_ptr cinfo,
 					    JDIMENSION max_lines));
 EXTERN(boolean) jpeg_finish_decompress JPP((j_decompress_ptr cinfo));
 
+/* Decode a region of the image: narrow the output, skip scanlines. */
+EXTERN(void) jpeg_crop_scanline JPP((j_decompress_ptr cinfo,
+				     JDIMENSION *xoffset, JDIMENSION *width));
+EXTERN(JDIMENSION) jpeg_skip_scanlines JPP((j_decompress_ptr cinfo,
+					    JDIMENSION num_lines));
+EXTERN(void) jpeg_resume_checkpoint JPP((j_decompress_ptr cinfo,
+					 const jpeg_checkpoint * checkpoint));
+
 /* Replaces jpeg_read_scanlines when reading raw downsampled data. */
 EXTERN(JDIMENSION) jpeg_read_raw_data JPP((j_decompress_ptr cinfo,
 					   JSAMPIMAGE data,
@@ -1140,6 +1242,14 @@ EXTERN(void) jpeg_abort_decompress JPP((j_decompress_ptr cinfo));
 EXTERN(void) jpeg_abort JPP((j_common_ptr cinfo));
 EXTERN(void) jpeg_destroy JPP((j_common_ptr cinfo));
 
+/* SIMD code paths (jsimd.c).  They give the same results as the portable
+ * code; restricting them only matters for testing and troubleshooting.
+ * The mask applies process wide, to objects that start working afterwards.
+ */
+#define JSIMD_SSE2	0x01
+#define JSIMD_AVX2	0x02
+EXTERN(void) jpeg_simd_mask JPP((unsigned int mask));
+
 /* Default restart-marker-resync procedure for use by data source modules */
 EXTERN(boolean) jpeg_resync_to_restart JPP((j_decompress_ptr cinfo,
 					    int desired));
@@ -133,18 +133,27 @@ start_pass_huff (j_compress_ptr cinfo, boolean gather_statistics)
 	ERREXIT1(cinfo, JERR_NO_HUFF_TABLE, dctbl);
       if (actbl < 0 || actbl >= NUM_HUFF_TBLS)
 	ERREXIT1(cinfo, JERR_NO_HUFF_TABLE, actbl);
-      /* Allocate and zero the statistics tables */
+      /* Allocate and zero the statistics tables, unless the application */
+      /* collects the counts itself */
       /* Note that jpeg_gen_optimal_table expects 257 entries in each table! */
-      if (entropy->dc_count_ptrs[dctbl] == NULL)
-	entropy->dc_count_ptrs[dctbl] = (long *)
-	  (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				      257 * SIZEOF(long));
-      MEMZERO(entropy->dc_count_ptrs[dctbl], 257 * SIZEOF(long));
-      if (entropy->ac_count_ptrs[actbl] == NULL)
-	entropy->ac_count_ptrs[actbl] = (long *)
-	  (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				      257 * SIZEOF(long));
-      MEMZERO(entropy->ac_count_ptrs[actbl], 257 * SIZEOF(long));
+      if (cinfo->dc_huff_counts[dctbl] != NULL)
+	entropy->dc_count_ptrs[dctbl] = cinfo->dc_huff_counts[dctbl];
+      else {
+	if (entropy->dc_count_ptrs[dctbl] == NULL)
+	  entropy->dc_count_ptrs[dctbl] = (long *)
+	    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+					257 * SIZEOF(long));
+	MEMZERO(entropy->dc_count_ptrs[dctbl], 257 * SIZEOF(long));
+      }
+      if (cinfo->ac_huff_counts[actbl] != NULL)
+	entropy->ac_count_ptrs[actbl] = cinfo->ac_huff_counts[actbl];
+      else {
+	if (entropy->ac_count_ptrs[actbl] == NULL)
+	  entropy->ac_count_ptrs[actbl] = (long *)
+	    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+					257 * SIZEOF(long));
+	MEMZERO(entropy->ac_count_ptrs[actbl], 257 * SIZEOF(long));
+      }
 #endif
     } else {
       /* Compute derived values for Huffman tables */
@@ -594,6 +603,7 @@ finish_pass_gather (j_compress_ptr cinfo)
   JHUFF_TBL **htblptr;
   boolean did_dc[NUM_HUFF_TBLS];
   boolean did_ac[NUM_HUFF_TBLS];
+  long freq[257];
 
   /* It's important not to apply jpeg_gen_optimal_table more than once
    * per table, because it clobbers the input frequency counts!
@@ -609,14 +619,17 @@ finish_pass_gather (j_compress_ptr cinfo)
       htblptr = & cinfo->dc_huff_tbl_ptrs[dctbl];
       if (*htblptr == NULL)
 	*htblptr = jpeg_alloc_huff_table((j_common_ptr) cinfo);
-      jpeg_gen_optimal_table(cinfo, *htblptr, entropy->dc_count_ptrs[dctbl]);
+      /* Work on a copy of counts that belong to the application */
+      MEMCOPY(freq, entropy->dc_count_ptrs[dctbl], SIZEOF(freq));
+      jpeg_gen_optimal_table(cinfo, *htblptr, freq);
       did_dc[dctbl] = TRUE;
     }
     if (! did_ac[actbl]) {
       htblptr = & cinfo->ac_huff_tbl_ptrs[actbl];
       if (*htblptr == NULL)
 	*htblptr = jpeg_alloc_huff_table((j_common_ptr) cinfo);
-      jpeg_gen_optimal_table(cinfo, *htblptr, entropy->ac_count_ptrs[actbl]);
+      MEMCOPY(freq, entropy->ac_count_ptrs[actbl], SIZEOF(freq));
+      jpeg_gen_optimal_table(cinfo, *htblptr, freq);
       did_ac[actbl] = TRUE;
     }
   }
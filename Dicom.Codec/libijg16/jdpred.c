@@ -156,26 +156,14 @@ jpeg_undifference7(j_decompress_ptr cinfo, int comp_index,
 
 
 /*
- * Undifferencer for the first row in a scan or restart interval.  The first
- * sample in the row is undifferenced using the special predictor constant
- * x=2^(P-Pt-1).  The rest of the samples are undifferenced using the
- * 1-D horizontal predictor (1).
+ * Select the undifferencer for the rows after the first of a component.
  */
 
-METHODDEF(void)
-jpeg_undifference_first_row(j_decompress_ptr cinfo, int comp_index,
-			    JDIFFROW diff_buf, JDIFFROW prev_row,
-			    JDIFFROW undiff_buf, JDIMENSION width)
+LOCAL(void)
+select_undifferencer (j_decompress_ptr cinfo, int comp_index)
 {
   j_lossless_d_ptr losslsd = (j_lossless_d_ptr) cinfo->codec;
 
-  UNDIFFERENCE_1D(INITIAL_PREDICTORx);
-
-  /*
-   * Now that we have undifferenced the first row, we want to use the
-   * undifferencer which corresponds to the predictor specified in the
-   * scan header.
-   */
   switch (cinfo->Ss) {
   case 1:
     losslsd->predict_undifference[comp_index] = jpeg_undifference1;
@@ -202,6 +190,29 @@ jpeg_undifference_first_row(j_decompress_ptr cinfo, int comp_index,
 }
 
 
+/*
+ * Undifferencer for the first row in a scan or restart interval.  The first
+ * sample in the row is undifferenced using the special predictor constant
+ * x=2^(P-Pt-1).  The rest of the samples are undifferenced using the
+ * 1-D horizontal predictor (1).
+ */
+
+METHODDEF(void)
+jpeg_undifference_first_row(j_decompress_ptr cinfo, int comp_index,
+			    JDIFFROW diff_buf, JDIFFROW prev_row,
+			    JDIFFROW undiff_buf, JDIMENSION width)
+{
+  UNDIFFERENCE_1D(INITIAL_PREDICTORx);
+
+  /*
+   * Now that we have undifferenced the first row, we want to use the
+   * undifferencer which corresponds to the predictor specified in the
+   * scan header.
+   */
+  select_undifferencer(cinfo, comp_index);
+}
+
+
 /*
  * Initialize for an input processing pass.
  */
@@ -233,6 +244,21 @@ predict_start_pass (j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Resume at a checkpoint: the first row decoded is predicted from the
+ * predictor row of the checkpoint, like any row after the first.
+ */
+
+METHODDEF(void)
+predict_resume (j_decompress_ptr cinfo)
+{
+  int ci;
+
+  for (ci = 0; ci < cinfo->num_components; ci++)
+    select_undifferencer(cinfo, ci);
+}
+
+
 /*
  * Module initialization routine for the undifferencer.
  */
@@ -244,6 +270,7 @@ jinit_undifferencer (j_decompress_ptr cinfo)
 
   losslsd->predict_start_pass = predict_start_pass;
   losslsd->predict_process_restart = predict_start_pass;
+  losslsd->predict_resume = predict_resume;
 }
 
 #endif /* D_LOSSLESS_SUPPORTED */
@@ -56,6 +56,10 @@ typedef struct {
    */
   UINT8 h_expand[MAX_COMPONENTS];
   UINT8 v_expand[MAX_COMPONENTS];
+
+#ifdef JSIMD_COLOR_SUPPORTED
+  boolean use_simd;		/* TRUE to use the jsimd fancy upsamplers */
+#endif
 } my_upsampler;
 
 typedef my_upsampler * my_upsample_ptr;
@@ -309,6 +313,10 @@ h2v1_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
   register int invalue;
   register JDIMENSION colctr;
   int inrow;
+#ifdef JSIMD_COLOR_SUPPORTED
+  my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
+  JDIMENSION done;
+#endif
 
   for (inrow = 0; inrow < cinfo->max_v_samp_factor; inrow++) {
     inptr = input_data[inrow];
@@ -318,7 +326,16 @@ h2v1_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
     *outptr++ = (JSAMPLE) invalue;
     *outptr++ = (JSAMPLE) ((invalue * 3 + GETJSAMPLE(*inptr) + 2) >> 2);
 
-    for (colctr = compptr->downsampled_width - 2; colctr > 0; colctr--) {
+    colctr = compptr->downsampled_width - 2;
+#ifdef JSIMD_COLOR_SUPPORTED
+    if (upsample->use_simd) {
+      done = jsimd_h2v1_fancy_row(inptr, outptr, colctr);
+      inptr += done;
+      outptr += 2 * done;
+      colctr -= done;
+    }
+#endif
+    for (; colctr > 0; colctr--) {
       /* General case: 3/4 * nearer pixel + 1/4 * further pixel */
       invalue = GETJSAMPLE(*inptr++) * 3;
       *outptr++ = (JSAMPLE) ((invalue + GETJSAMPLE(inptr[-2]) + 1) >> 2);
@@ -354,6 +371,10 @@ h2v2_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
 #endif
   register JDIMENSION colctr;
   int inrow, outrow, v;
+#ifdef JSIMD_COLOR_SUPPORTED
+  my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
+  JDIMENSION done;
+#endif
 
   inrow = outrow = 0;
   while (outrow < cinfo->max_v_samp_factor) {
@@ -373,7 +394,22 @@ h2v2_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
       *outptr++ = (JSAMPLE) ((thiscolsum * 3 + nextcolsum + 7) >> 4);
       lastcolsum = thiscolsum; thiscolsum = nextcolsum;
 
-      for (colctr = compptr->downsampled_width - 2; colctr > 0; colctr--) {
+      colctr = compptr->downsampled_width - 2;
+#ifdef JSIMD_COLOR_SUPPORTED
+      if (upsample->use_simd) {
+	/* The input pointers are one column ahead of the output */
+	done = jsimd_h2v2_fancy_row(inptr0 - 1, inptr1 - 1, outptr, colctr);
+	if (done > 0) {
+	  inptr0 += done;
+	  inptr1 += done;
+	  outptr += 2 * done;
+	  colctr -= done;
+	  lastcolsum = GETJSAMPLE(inptr0[-2]) * 3 + GETJSAMPLE(inptr1[-2]);
+	  thiscolsum = GETJSAMPLE(inptr0[-1]) * 3 + GETJSAMPLE(inptr1[-1]);
+	}
+      }
+#endif
+      for (; colctr > 0; colctr--) {
 	/* General case: 3/4 * nearer pixel + 1/4 * further pixel in each */
 	/* dimension, thus 9/16, 3/16, 3/16, 1/16 overall */
 	nextcolsum = GETJSAMPLE(*inptr0++) * 3 + GETJSAMPLE(*inptr1++);
@@ -419,6 +455,9 @@ jinit_upsampler (j_decompress_ptr cinfo)
    * so don't ask for it.
    */
   do_fancy = cinfo->do_fancy_upsampling && cinfo->min_codec_data_unit > 1;
+#ifdef JSIMD_COLOR_SUPPORTED
+  upsample->use_simd = (jsimd_support() & JSIMD_SSE2) != 0;
+#endif
 
   /* Verify we can handle the sampling factors, select per-component methods,
    * and create storage as needed.
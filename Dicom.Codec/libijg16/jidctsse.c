@@ -0,0 +1,303 @@
+/*
+ * jidctsse.c
+ *
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains an SSE2 version of the slow-but-accurate integer
+ * inverse DCT (jidctint.c).
+ *
+ * The routine mirrors jpeg_idct_islow step by step on four 32-bit lanes:
+ * same constants, same wrap-around multiplications, same rounding, same
+ * range limiting.  The zero-AC shortcuts of both passes are evaluated for
+ * every lane and merged by mask, so the output equals that of the scalar
+ * code for any input, including corrupt or out-of-range coefficients.
+ * Pass 1 works on two groups of four columns; its results are transposed
+ * so that pass 2 can work on two groups of four rows.
+ *
+ * jddctmgr.c selects this routine at run time when the CPU has SSE2.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude16.h"
+#include "jpeglib16.h"
+#include "jdct16.h"		/* Private declarations for DCT subsystem */
+
+#ifdef IDCT_SIMD_SUPPORTED
+
+#include <emmintrin.h>
+
+
+/*
+ * This module is specialized to the case DCTSIZE = 8.
+ */
+
+#if DCTSIZE != 8
+  Sorry, this code only copes with 8x8 DCTs. /* deliberate syntax err */
+#endif
+
+
+/* Scaling and constants must be those of jidctint.c. */
+
+#if BITS_IN_JSAMPLE == 8
+#define CONST_BITS  13
+#define PASS1_BITS  2
+#else
+#define CONST_BITS  13
+#define PASS1_BITS  1		/* lose a little precision to avoid overflow */
+#endif
+
+#define FIX_0_298631336  2446
+#define FIX_0_390180644  3196
+#define FIX_0_541196100  4433
+#define FIX_0_765366865  6270
+#define FIX_0_899976223  7373
+#define FIX_1_175875602  9633
+#define FIX_1_501321110  12299
+#define FIX_1_847759065  15137
+#define FIX_1_961570560  16069
+#define FIX_2_053119869  16819
+#define FIX_2_562915447  20995
+#define FIX_3_072711026  25172
+
+
+/* Low 32 bits of the lane-wise product, as a 32-bit C multiply gives. */
+
+LOCAL(__m128i)
+mullo (__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+			    _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+
+#define MULTIPLY(var,const)  mullo(var, _mm_set1_epi32(const))
+
+#undef DESCALE			/* jdct.h has a scalar version */
+#define DESCALE(x,n)  _mm_srai_epi32(_mm_add_epi32(x, _mm_set1_epi32(1 << ((n)-1))), n)
+
+/* Per-lane select: mask ? a : b */
+#define SELECT(mask,a,b)  _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b))
+
+
+/*
+ * Equivalent of range_limit[x & RANGE_MASK] for the post-IDCT table
+ * built by prepare_range_limit_table (jdmaster.c).  Offsetting the index
+ * by CENTERJSAMPLE turns the table into three plain segments: identity up
+ * to MAXJSAMPLE, then MAXJSAMPLE, then zero.
+ */
+
+LOCAL(__m128i)
+range_limit (__m128i x)
+{
+  __m128i z = _mm_and_si128(_mm_add_epi32(x, _mm_set1_epi32(CENTERJSAMPLE)),
+			    _mm_set1_epi32(RANGE_MASK));
+  __m128i over = _mm_cmpgt_epi32(z, _mm_set1_epi32(MAXJSAMPLE));
+  __m128i wrap = _mm_cmpgt_epi32(z, _mm_set1_epi32(2 * (MAXJSAMPLE+1) +
+						   CENTERJSAMPLE - 1));
+
+  z = SELECT(over, _mm_set1_epi32(MAXJSAMPLE), z);
+  return _mm_andnot_si128(wrap, z);
+}
+
+
+/*
+ * One 1-D IDCT on four lanes; x[0..7] are the inputs y0..y7 and receive
+ * the undescaled outputs.
+ */
+
+LOCAL(void)
+idct_1d (__m128i * x)
+{
+  __m128i tmp0, tmp1, tmp2, tmp3;
+  __m128i tmp10, tmp11, tmp12, tmp13;
+  __m128i z1, z2, z3, z4, z5;
+
+  /* Even part */
+
+  z2 = x[2];
+  z3 = x[6];
+
+  z1 = MULTIPLY(_mm_add_epi32(z2, z3), FIX_0_541196100);
+  tmp2 = _mm_add_epi32(z1, MULTIPLY(z3, - FIX_1_847759065));
+  tmp3 = _mm_add_epi32(z1, MULTIPLY(z2, FIX_0_765366865));
+
+  tmp0 = _mm_slli_epi32(_mm_add_epi32(x[0], x[4]), CONST_BITS);
+  tmp1 = _mm_slli_epi32(_mm_sub_epi32(x[0], x[4]), CONST_BITS);
+
+  tmp10 = _mm_add_epi32(tmp0, tmp3);
+  tmp13 = _mm_sub_epi32(tmp0, tmp3);
+  tmp11 = _mm_add_epi32(tmp1, tmp2);
+  tmp12 = _mm_sub_epi32(tmp1, tmp2);
+
+  /* Odd part */
+
+  tmp0 = x[7];
+  tmp1 = x[5];
+  tmp2 = x[3];
+  tmp3 = x[1];
+
+  z1 = _mm_add_epi32(tmp0, tmp3);
+  z2 = _mm_add_epi32(tmp1, tmp2);
+  z3 = _mm_add_epi32(tmp0, tmp2);
+  z4 = _mm_add_epi32(tmp1, tmp3);
+  z5 = MULTIPLY(_mm_add_epi32(z3, z4), FIX_1_175875602);
+
+  tmp0 = MULTIPLY(tmp0, FIX_0_298631336);
+  tmp1 = MULTIPLY(tmp1, FIX_2_053119869);
+  tmp2 = MULTIPLY(tmp2, FIX_3_072711026);
+  tmp3 = MULTIPLY(tmp3, FIX_1_501321110);
+  z1 = MULTIPLY(z1, - FIX_0_899976223);
+  z2 = MULTIPLY(z2, - FIX_2_562915447);
+  z3 = MULTIPLY(z3, - FIX_1_961570560);
+  z4 = MULTIPLY(z4, - FIX_0_390180644);
+
+  z3 = _mm_add_epi32(z3, z5);
+  z4 = _mm_add_epi32(z4, z5);
+
+  tmp0 = _mm_add_epi32(tmp0, _mm_add_epi32(z1, z3));
+  tmp1 = _mm_add_epi32(tmp1, _mm_add_epi32(z2, z4));
+  tmp2 = _mm_add_epi32(tmp2, _mm_add_epi32(z2, z3));
+  tmp3 = _mm_add_epi32(tmp3, _mm_add_epi32(z1, z4));
+
+  /* Final output stage */
+
+  x[0] = _mm_add_epi32(tmp10, tmp3);
+  x[7] = _mm_sub_epi32(tmp10, tmp3);
+  x[1] = _mm_add_epi32(tmp11, tmp2);
+  x[6] = _mm_sub_epi32(tmp11, tmp2);
+  x[2] = _mm_add_epi32(tmp12, tmp1);
+  x[5] = _mm_sub_epi32(tmp12, tmp1);
+  x[3] = _mm_add_epi32(tmp13, tmp0);
+  x[4] = _mm_sub_epi32(tmp13, tmp0);
+}
+
+
+/* Transpose a 4x4 block held in four vectors. */
+
+LOCAL(void)
+transpose (__m128i * r0, __m128i * r1, __m128i * r2, __m128i * r3)
+{
+  __m128i t0 = _mm_unpacklo_epi32(*r0, *r1);
+  __m128i t1 = _mm_unpacklo_epi32(*r2, *r3);
+  __m128i t2 = _mm_unpackhi_epi32(*r0, *r1);
+  __m128i t3 = _mm_unpackhi_epi32(*r2, *r3);
+
+  *r0 = _mm_unpacklo_epi64(t0, t1);
+  *r1 = _mm_unpackhi_epi64(t0, t1);
+  *r2 = _mm_unpacklo_epi64(t2, t3);
+  *r3 = _mm_unpackhi_epi64(t2, t3);
+}
+
+
+/* Store one output row; all values are already range limited. */
+
+LOCAL(void)
+store_row (JSAMPROW outptr, __m128i lo, __m128i hi)
+{
+#if BITS_IN_JSAMPLE == 8
+  _mm_storel_epi64((__m128i *) outptr,
+		   _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128()));
+#elif BITS_IN_JSAMPLE == 12
+  _mm_storeu_si128((__m128i *) outptr, _mm_packs_epi32(lo, hi));
+#else
+  /* Samples use all 16 bits; bias them into the signed range for packing. */
+  __m128i bias = _mm_set1_epi32(32768);
+
+  _mm_storeu_si128((__m128i *) outptr,
+		   _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(lo, bias),
+						 _mm_sub_epi32(hi, bias)),
+				 _mm_set1_epi16((short) 0x8000)));
+#endif
+}
+
+
+/*
+ * Perform dequantization and inverse DCT on one block of coefficients.
+ */
+
+GLOBAL(void)
+jpeg_idct_islow_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  ISLOW_MULT_TYPE * quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+  __m128i ws[DCTSIZE][2];	/* [row or column][group of four lanes] */
+  __m128i x[DCTSIZE];
+  __m128i zero[2];
+  __m128i ac, dcval, coef;
+  int g, i;
+
+  /* Pass 1: process columns from input, four at a time. */
+  /* A column whose AC terms are all zero just repeats its scaled DC term. */
+
+  ac = _mm_setzero_si128();
+  for (i = 1; i < DCTSIZE; i++)
+    ac = _mm_or_si128(ac, _mm_loadu_si128((const __m128i *) (coef_block + DCTSIZE*i)));
+  ac = _mm_cmpeq_epi16(ac, _mm_setzero_si128());
+  zero[0] = _mm_unpacklo_epi16(ac, ac);
+  zero[1] = _mm_unpackhi_epi16(ac, ac);
+
+  for (g = 0; g < 2; g++) {
+    for (i = 0; i < DCTSIZE; i++) {
+      coef = _mm_loadl_epi64((const __m128i *) (coef_block + DCTSIZE*i + 4*g));
+      coef = _mm_srai_epi32(_mm_unpacklo_epi16(coef, coef), 16);
+      x[i] = mullo(coef, _mm_loadu_si128((const __m128i *) (quantptr + DCTSIZE*i + 4*g)));
+    }
+    dcval = _mm_slli_epi32(x[0], PASS1_BITS);
+
+    idct_1d(x);
+
+    for (i = 0; i < DCTSIZE; i++)
+      ws[i][g] = SELECT(zero[g], dcval, DESCALE(x[i], CONST_BITS-PASS1_BITS));
+  }
+
+  /* Turn rows of column results into columns of row inputs. */
+
+  for (g = 0; g < DCTSIZE; g += 4) {
+    transpose(&ws[g][0], &ws[g+1][0], &ws[g+2][0], &ws[g+3][0]);
+    transpose(&ws[g][1], &ws[g+1][1], &ws[g+2][1], &ws[g+3][1]);
+  }
+  for (i = 0; i < 4; i++) {
+    x[0] = ws[4+i][0];
+    ws[4+i][0] = ws[i][1];
+    ws[i][1] = x[0];
+  }
+
+  /* Pass 2: process rows from work array, four at a time. */
+
+  for (g = 0; g < 2; g++) {
+    ac = _mm_setzero_si128();
+    for (i = 0; i < DCTSIZE; i++) {
+      x[i] = ws[i][g];
+      if (i > 0)
+	ac = _mm_or_si128(ac, x[i]);
+    }
+    ac = _mm_cmpeq_epi32(ac, _mm_setzero_si128());
+#ifdef NO_ZERO_ROW_TEST
+    ac = _mm_setzero_si128();
+#endif
+    dcval = range_limit(DESCALE(x[0], PASS1_BITS+3));
+
+    idct_1d(x);
+
+    for (i = 0; i < DCTSIZE; i++)
+      ws[i][g] = SELECT(ac, dcval,
+			range_limit(DESCALE(x[i], CONST_BITS+PASS1_BITS+3)));
+  }
+
+  /* Back to row order for output. */
+
+  for (g = 0; g < DCTSIZE; g += 4) {
+    transpose(&ws[g][0], &ws[g+1][0], &ws[g+2][0], &ws[g+3][0]);
+    transpose(&ws[g][1], &ws[g+1][1], &ws[g+2][1], &ws[g+3][1]);
+  }
+
+  for (i = 0; i < 4; i++) {
+    store_row(output_buf[i] + output_col, ws[i][0], ws[4+i][0]);
+    store_row(output_buf[4+i] + output_col, ws[i][1], ws[4+i][1]);
+  }
+}
+
+#endif /* IDCT_SIMD_SUPPORTED */
@@ -109,6 +109,28 @@ typedef struct {
 					    JDIMENSION MCU_col_num,
 					    JDIMENSION nMCU));
 
+  /* Entropy decoding, undifferencing and output in one step, for a
+   * single-component scan with predictor 1 and no scaling (NULL if not
+   * available).  Decodes nMCU samples of output_row from column MCU_col_num
+   * on.  *Ra is the predictor for the next sample and *Rb receives the
+   * first sample of the row, both kept up to date across suspensions.
+   */
+  JMETHOD(JDIMENSION, entropy_decode_sv1_row, (j_decompress_ptr cinfo,
+					       JSAMPROW output_row,
+					       JDIMENSION MCU_col_num,
+					       JDIMENSION nMCU,
+					       int * Ra, int * Rb));
+
+  /* Save or load the bit reader state between MCU rows, for checkpoints;
+   * NULL if the entropy decoder does not support them.  entropy_save_state
+   * returns FALSE if the current state cannot be resumed from.  The
+   * difference buffer controller keeps the predictor rows.
+   */
+  JMETHOD(boolean, entropy_save_state, (j_decompress_ptr cinfo,
+					jpeg_checkpoint * checkpoint));
+  JMETHOD(void, entropy_load_state, (j_decompress_ptr cinfo,
+				     const jpeg_checkpoint * checkpoint));
+
   /* Pointer to data which is private to entropy module */
   void *entropy_private;
 
@@ -116,6 +138,8 @@ typedef struct {
   /* Prediction, undifferencing */
   JMETHOD(void, predict_start_pass, (j_decompress_ptr cinfo));
   JMETHOD(void, predict_process_restart, (j_decompress_ptr cinfo));
+  /* Predict from the row above from the first row on, when resuming */
+  JMETHOD(void, predict_resume, (j_decompress_ptr cinfo));
 
   /* It is useful to allow each component to have a separate undiff method. */
   predict_undifference_method_ptr predict_undifference[MAX_COMPONENTS];
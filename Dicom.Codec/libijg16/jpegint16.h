@@ -126,6 +126,21 @@ struct jpeg_decomp_master {
 
   /* State variables made visible to other modules */
   boolean is_dummy_pass;	/* True during 1st pass for 2-pass quant */
+
+  /* Region reconstructed by the coefficient controllers; see
+   * jpeg_crop_scanline and jpeg_skip_scanlines.  Only iMCU columns
+   * first_iMCU_col..last_iMCU_col are inverse transformed, and iMCU rows
+   * before first_iMCU_row are entropy decoded but not reconstructed.
+   */
+  JDIMENSION first_iMCU_col;
+  JDIMENSION last_iMCU_col;
+  JDIMENSION first_iMCU_row;
+
+  /* Entropy decoder state to load at the start of iMCU row resume.iMCU_row,
+   * if resume_pending; see jpeg_resume_checkpoint.
+   */
+  boolean resume_pending;
+  jpeg_checkpoint resume;
 };
 
 /* Input control module */
@@ -304,8 +319,17 @@ struct jpeg_color_quantizer {
 #define jcopy_sample_rows		jcopy16_sample_rows
 #define jcopy_block_row		jcopy16_block_row
 #define jzero_far		jzero16_far
+#define jsimd_support		jsimd16_support
+#define jsimd_ycc_rgb_row		jsimd16_ycc_rgb_row
+#define jsimd_h2v1_fancy_row		jsimd16_h2v1_fancy_row
+#define jsimd_h2v2_fancy_row		jsimd16_h2v2_fancy_row
+#define jsimd_h2v1_merged_row		jsimd16_h2v1_merged_row
+#define jsimd_h2v2_merged_row		jsimd16_h2v2_merged_row
 #define jpeg_zigzag_order		jpeg16_zigzag_order
 #define jpeg_natural_order		jpeg16_natural_order
+#ifdef WITH_ARITHMETIC_PATCH
+#define jpeg_aritab		jpeg16_aritab
+#endif
 #endif /* NEED_SHORT_EXTERNAL_NAMES */
 
 
@@ -357,11 +381,46 @@ EXTERN(void) jcopy_sample_rows JPP((JSAMPARRAY input_array, int source_row,
 EXTERN(void) jcopy_block_row JPP((JBLOCKROW input_row, JBLOCKROW output_row,
 				  JDIMENSION num_blocks));
 EXTERN(void) jzero_far JPP((void FAR * target, size_t bytestozero));
+
+/* SIMD support in jsimd.c */
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define JSIMD_SUPPORTED
+#endif
+EXTERN(unsigned int) jsimd_support JPP((void));
+
+/* SSE2 row routines for color conversion and upsampling (jdcolsse.c).
+ * Each handles as much of a row as it can and returns the number of
+ * columns (pixel pairs for the merged upsamplers) it has done; the
+ * portable code finishes the rest.
+ */
+#if defined(JSIMD_SUPPORTED) && BITS_IN_JSAMPLE == 8 && RGB_PIXELSIZE == 3 && \
+    RGB_RED == 0 && RGB_GREEN == 1 && RGB_BLUE == 2
+#define JSIMD_COLOR_SUPPORTED
+EXTERN(JDIMENSION) jsimd_ycc_rgb_row
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	 JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jsimd_h2v1_fancy_row
+    JPP((JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols));
+EXTERN(JDIMENSION) jsimd_h2v2_fancy_row
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+	 JDIMENSION num_cols));
+EXTERN(JDIMENSION) jsimd_h2v1_merged_row
+    JPP((JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	 JSAMPROW outptr, JDIMENSION num_pairs));
+EXTERN(JDIMENSION) jsimd_h2v2_merged_row
+    JPP((JSAMPROW inptr00, JSAMPROW inptr01, JSAMPROW inptr1,
+	 JSAMPROW inptr2, JSAMPROW outptr0, JSAMPROW outptr1,
+	 JDIMENSION num_pairs));
+#endif
 /* Constant tables in jutils.c */
 #if 0				/* This table is not actually needed in v6a */
 extern const int jpeg_zigzag_order[]; /* natural coef order to zigzag order */
 #endif
 extern const int jpeg_natural_order[]; /* zigzag coef order to natural order */
+#ifdef WITH_ARITHMETIC_PATCH
+/* Arithmetic coding probability estimation tables in jaricom.c */
+extern const IJG_INT32 jpeg_aritab[];
+#endif
 
 /* Suppress undefined-structure complaints if necessary. */
 
@@ -0,0 +1,109 @@
+/*
+ * jsimd.c
+ *
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains the run-time CPU detection that decides which SIMD
+ * versions of the inner loops (jidctsse.c, jidctavx.c, jdcolsse.c) may be
+ * used.  The SIMD routines give exactly the same results as the portable
+ * code, so the choice only affects speed.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude16.h"
+#include "jpeglib16.h"
+
+#ifdef JSIMD_SUPPORTED
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+
+static unsigned int simd_mask = ~0U;	/* set by jpeg_simd_mask */
+
+
+#ifdef JSIMD_SUPPORTED
+
+/*
+ * Query CPUID.  AVX2 also needs the OS to save the YMM registers, which
+ * XGETBV reports once CPUID has announced OSXSAVE.
+ */
+
+LOCAL(unsigned int)
+detect_cpu (void)
+{
+  unsigned int flags = 0;
+  unsigned int regs[4], xcr0;
+
+#ifdef _MSC_VER
+  __cpuid((int *) regs, 0);
+  if (regs[0] < 1)
+    return 0;
+  if (regs[0] >= 7) {
+    __cpuidex((int *) regs, 1, 0);
+    if (regs[2] & (1 << 27)) {	/* OSXSAVE */
+      xcr0 = (unsigned int) _xgetbv(0);
+      __cpuidex((int *) regs, 7, 0);
+      if ((xcr0 & 6) == 6 && (regs[1] & (1 << 5)))	/* YMM state, AVX2 */
+	flags |= JSIMD_AVX2;
+    }
+  }
+  __cpuid((int *) regs, 1);
+#else
+  unsigned int max = __get_cpuid_max(0, NULL);
+
+  if (max < 1)
+    return 0;
+  if (max >= 7) {
+    __cpuid_count(1, 0, regs[0], regs[1], regs[2], regs[3]);
+    if (regs[2] & (1 << 27)) {	/* OSXSAVE */
+      __asm__ ("xgetbv" : "=a" (xcr0) : "c" (0) : "edx");
+      __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+      if ((xcr0 & 6) == 6 && (regs[1] & (1 << 5)))	/* YMM state, AVX2 */
+	flags |= JSIMD_AVX2;
+    }
+  }
+  __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  if (regs[3] & (1 << 26))	/* SSE2 */
+    flags |= JSIMD_SSE2;
+
+  return flags;
+}
+
+#endif /* JSIMD_SUPPORTED */
+
+
+/*
+ * Report the instruction set extensions the SIMD routines may use.
+ * The CPU is only queried once; the result is the same on every thread.
+ */
+
+GLOBAL(unsigned int)
+jsimd_support (void)
+{
+#ifdef JSIMD_SUPPORTED
+  static int cpu_flags = -1;
+
+  if (cpu_flags < 0)
+    cpu_flags = (int) detect_cpu();
+  return (unsigned int) cpu_flags & simd_mask;
+#else
+  return 0;
+#endif
+}
+
+
+/*
+ * Restrict the SIMD routines used by JPEG objects that start decompressing
+ * from now on, e.g. to compare them against the portable code.
+ */
+
+GLOBAL(void)
+jpeg_simd_mask (unsigned int mask)
+{
+  simd_mask = mask;
+}
@@ -235,8 +235,16 @@ emit_dac (j_compress_ptr cinfo)
   
   for (i = 0; i < cinfo->comps_in_scan; i++) {
     compptr = cinfo->cur_comp_info[i];
-    dc_in_use[compptr->dc_tbl_no] = 1;
-    ac_in_use[compptr->ac_tbl_no] = 1;
+    /* Lossless scans only code differences with the DC statistics; */
+    /* progressive scans code either DC (but not in refinement) or AC. */
+    if (cinfo->process == JPROC_LOSSLESS)
+      dc_in_use[compptr->dc_tbl_no] = 1;
+    else {
+      if (cinfo->Ss == 0 && cinfo->Ah == 0)
+	dc_in_use[compptr->dc_tbl_no] = 1;
+      if (cinfo->Se)
+	ac_in_use[compptr->ac_tbl_no] = 1;
+    }
   }
   
   length = 0;
@@ -629,13 +629,17 @@ jinit_c_master_control (j_compress_ptr cinfo, boolean transcode_only)
 #ifdef WITH_ARITHMETIC_PATCH
   if ((cinfo->arith_code == 0) &&
       (cinfo->process == JPROC_PROGRESSIVE ||	/*  TEMPORARY HACK ??? */
-       cinfo->process == JPROC_LOSSLESS))
+       (cinfo->process == JPROC_LOSSLESS && ! cinfo->lossless_supplied_tables)))
 #else
   if (cinfo->process == JPROC_PROGRESSIVE ||	/*  TEMPORARY HACK ??? */
-      cinfo->process == JPROC_LOSSLESS)
+      (cinfo->process == JPROC_LOSSLESS && ! cinfo->lossless_supplied_tables))
 #endif
     cinfo->optimize_coding = TRUE; /* assume default tables no good for
 				    * progressive mode or lossless mode */
+#ifdef WITH_ARITHMETIC_PATCH
+  if (cinfo->arith_code)
+    cinfo->optimize_coding = FALSE; /* arithmetic coding adapts by itself */
+#endif
 
   /* Initialize my private state */
   if (transcode_only) {
@@ -318,6 +318,9 @@ jpeg_set_defaults (j_compress_ptr cinfo)
   if (cinfo->data_precision > 8)
     cinfo->optimize_coding = TRUE;
 
+  /* Lossless scans build their own tables unless told otherwise */
+  cinfo->lossless_supplied_tables = FALSE;
+
   /* By default, use the simpler non-cosited sampling alignment */
   cinfo->CCIR601_sampling = FALSE;
 
@@ -23,6 +23,10 @@ typedef struct {
   int * Cb_b_tab;		/* => table for Cb to B conversion */
   IJG_INT32 * Cr_g_tab;		/* => table for Cr to G conversion */
   IJG_INT32 * Cb_g_tab;		/* => table for Cb to G conversion */
+
+#ifdef JSIMD_COLOR_SUPPORTED
+  boolean use_simd;		/* TRUE to use jsimd_ycc_rgb_row */
+#endif
 } my_color_deconverter;
 
 typedef my_color_deconverter * my_cconvert_ptr;
@@ -158,7 +162,14 @@ ycc_rgb_convert (j_decompress_ptr cinfo,
     inptr2 = input_buf[2][input_row];
     input_row++;
     outptr = *output_buf++;
-    for (col = 0; col < num_cols; col++) {
+    col = 0;
+#ifdef JSIMD_COLOR_SUPPORTED
+    if (cconvert->use_simd) {
+      col = jsimd_ycc_rgb_row(inptr0, inptr1, inptr2, outptr, num_cols);
+      outptr += col * RGB_PIXELSIZE;
+    }
+#endif
+    for (; col < num_cols; col++) {
       y  = GETJSAMPLE(inptr0[col]);
       cb = GETJSAMPLE(inptr1[col]);
       cr = GETJSAMPLE(inptr2[col]);
@@ -377,6 +388,9 @@ jinit_color_deconverter (j_decompress_ptr cinfo)
     if (cinfo->jpeg_color_space == JCS_YCbCr) {
       cconvert->pub.color_convert = ycc_rgb_convert;
       build_ycc_rgb_table(cinfo);
+#ifdef JSIMD_COLOR_SUPPORTED
+      cconvert->use_simd = (jsimd_support() & JSIMD_SSE2) != 0;
+#endif
     } else if (cinfo->jpeg_color_space == JCS_GRAYSCALE) {
       cconvert->pub.color_convert = gray_rgb_convert;
     } else if (cinfo->jpeg_color_space == JCS_RGB && RGB_PIXELSIZE == 3) {
@@ -0,0 +1,291 @@
+/*
+ * jdcolsse.c
+ *
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains SSE2 row routines for YCbCr->RGB color conversion
+ * (jdcolor.c), fancy upsampling (jdsample.c) and merged upsampling
+ * (jdmerge.c) of 8-bit samples.
+ *
+ * The color conversion does not use the lookup tables of jdcolor.c and
+ * jdmerge.c, but computes the same integers: each table constant is split
+ * into a multiple of 2^16, which passes through the final right shift
+ * exactly, and a 16-bit remainder handled by PMADDWD.  The upsamplers use
+ * the triangle filter formulas of jdsample.c unchanged.  The results are
+ * therefore identical to the portable code.
+ *
+ * Every routine works on 16 output columns at a time and returns how far
+ * it got; the caller finishes the row, including its edges, itself.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude8.h"
+#include "jpeglib8.h"
+
+#ifdef JSIMD_COLOR_SUPPORTED
+
+#include <emmintrin.h>
+
+
+/*
+ * Chroma terms (red, green, blue) for eight Cb and Cr samples, given as
+ * 16-bit values less CENTERJSAMPLE.  These match the table entries built by
+ * build_ycc_rgb_table:
+ *	Cr_r_tab = (91881 * cr + 32768) >> 16
+ *	Cb_b_tab = (116130 * cb + 32768) >> 16
+ *	green    = (-22554 * cb - 46802 * cr + 32768) >> 16
+ * with 91881 = 65536 + 26345, 116130 = 131072 - 14942 and
+ * -46802 = -65536 + 18734.
+ */
+
+#define PAIR(lo,hi)  _mm_set1_epi32((int) (((unsigned int) (hi) << 16) | ((lo) & 0xFFFF)))
+
+LOCAL(void)
+chroma_terms (__m128i cb, __m128i cr, __m128i * terms)
+{
+  __m128i two = _mm_set1_epi16(2);
+  __m128i half = _mm_set1_epi32(32768);
+  __m128i lo, hi;
+
+  lo = _mm_madd_epi16(_mm_unpacklo_epi16(cr, two), PAIR(26345, 16384));
+  hi = _mm_madd_epi16(_mm_unpackhi_epi16(cr, two), PAIR(26345, 16384));
+  terms[0] = _mm_add_epi16(_mm_packs_epi32(_mm_srai_epi32(lo, 16),
+					    _mm_srai_epi32(hi, 16)), cr);
+
+  lo = _mm_madd_epi16(_mm_unpacklo_epi16(cb, two), PAIR(-14942, 16384));
+  hi = _mm_madd_epi16(_mm_unpackhi_epi16(cb, two), PAIR(-14942, 16384));
+  terms[2] = _mm_add_epi16(_mm_packs_epi32(_mm_srai_epi32(lo, 16),
+					    _mm_srai_epi32(hi, 16)),
+			    _mm_add_epi16(cb, cb));
+
+  lo = _mm_madd_epi16(_mm_unpacklo_epi16(cb, cr), PAIR(-22554, 18734));
+  hi = _mm_madd_epi16(_mm_unpackhi_epi16(cb, cr), PAIR(-22554, 18734));
+  terms[1] = _mm_sub_epi16(_mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(lo, half), 16),
+					    _mm_srai_epi32(_mm_add_epi32(hi, half), 16)), cr);
+}
+
+
+/* Widen eight samples to 16 bits, less CENTERJSAMPLE. */
+
+LOCAL(__m128i)
+load_chroma (JSAMPROW ptr)
+{
+  return _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) ptr),
+					 _mm_setzero_si128()),
+		       _mm_set1_epi16(CENTERJSAMPLE));
+}
+
+
+/* Pack three pixels of four bytes (the last one zero) into 12 bytes. */
+
+LOCAL(__m128i)
+pack_pixels (__m128i p)
+{
+  __m128i mask = _mm_set_epi32(0, -1, 0, -1);
+
+  p = _mm_or_si128(_mm_and_si128(p, mask),
+		   _mm_srli_epi64(_mm_andnot_si128(mask, p), 8));
+  mask = _mm_set_epi32(0, 0, -1, -1);
+  return _mm_or_si128(_mm_and_si128(p, mask),
+		      _mm_srli_si128(_mm_andnot_si128(mask, p), 2));
+}
+
+
+/*
+ * Emit 16 pixels: R = y + red term etc., range limited to 0..MAXJSAMPLE
+ * (which is all the range_limit table does here), and interleaved.
+ * lo and hi hold the chroma terms of the first and last eight pixels.
+ */
+
+LOCAL(void)
+store_rgb (JSAMPROW outptr, __m128i y, const __m128i * lo, const __m128i * hi)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i ylo = _mm_unpacklo_epi8(y, zero);
+  __m128i yhi = _mm_unpackhi_epi8(y, zero);
+  __m128i r, g, b, rg, bz, p0, p1, p2, p3;
+
+  r = _mm_packus_epi16(_mm_add_epi16(ylo, lo[0]), _mm_add_epi16(yhi, hi[0]));
+  g = _mm_packus_epi16(_mm_add_epi16(ylo, lo[1]), _mm_add_epi16(yhi, hi[1]));
+  b = _mm_packus_epi16(_mm_add_epi16(ylo, lo[2]), _mm_add_epi16(yhi, hi[2]));
+
+  rg = _mm_unpacklo_epi8(r, g);
+  bz = _mm_unpacklo_epi8(b, zero);
+  p0 = pack_pixels(_mm_unpacklo_epi16(rg, bz));
+  p1 = pack_pixels(_mm_unpackhi_epi16(rg, bz));
+  rg = _mm_unpackhi_epi8(r, g);
+  bz = _mm_unpackhi_epi8(b, zero);
+  p2 = pack_pixels(_mm_unpacklo_epi16(rg, bz));
+  p3 = pack_pixels(_mm_unpackhi_epi16(rg, bz));
+
+  _mm_storeu_si128((__m128i *) outptr,
+		   _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+  _mm_storeu_si128((__m128i *) (outptr + 16),
+		   _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+  _mm_storeu_si128((__m128i *) (outptr + 32),
+		   _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+}
+
+
+/*
+ * YCbCr->RGB conversion of one row (ycc_rgb_convert).
+ */
+
+GLOBAL(JDIMENSION)
+jsimd_ycc_rgb_row (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+		   JSAMPROW outptr, JDIMENSION num_cols)
+{
+  __m128i lo[3], hi[3];
+  JDIMENSION col;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    chroma_terms(load_chroma(inptr1 + col), load_chroma(inptr2 + col), lo);
+    chroma_terms(load_chroma(inptr1 + col + 8), load_chroma(inptr2 + col + 8), hi);
+    store_rgb(outptr + col * RGB_PIXELSIZE,
+	      _mm_loadu_si128((const __m128i *) (inptr0 + col)), lo, hi);
+  }
+  return col;
+}
+
+
+/* Duplicate the chroma terms of eight pixel pairs for their 16 pixels. */
+
+LOCAL(void)
+pair_terms (const __m128i * terms, __m128i * lo, __m128i * hi)
+{
+  int i;
+
+  for (i = 0; i < 3; i++) {
+    lo[i] = _mm_unpacklo_epi16(terms[i], terms[i]);
+    hi[i] = _mm_unpackhi_epi16(terms[i], terms[i]);
+  }
+}
+
+
+/*
+ * Merged upsampling and conversion of one row, 2h1v (h2v1_merged_upsample).
+ * Each Cb/Cr sample serves two horizontally adjacent pixels.
+ */
+
+GLOBAL(JDIMENSION)
+jsimd_h2v1_merged_row (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+		       JSAMPROW outptr, JDIMENSION num_pairs)
+{
+  __m128i terms[3], lo[3], hi[3];
+  JDIMENSION pair;
+
+  for (pair = 0; pair + 8 <= num_pairs; pair += 8) {
+    chroma_terms(load_chroma(inptr1 + pair), load_chroma(inptr2 + pair), terms);
+    pair_terms(terms, lo, hi);
+    store_rgb(outptr + 2 * pair * RGB_PIXELSIZE,
+	      _mm_loadu_si128((const __m128i *) (inptr0 + 2 * pair)), lo, hi);
+  }
+  return pair;
+}
+
+
+/*
+ * Merged upsampling and conversion of two rows, 2h2v (h2v2_merged_upsample).
+ * Each Cb/Cr sample serves a 2x2 block of pixels.
+ */
+
+GLOBAL(JDIMENSION)
+jsimd_h2v2_merged_row (JSAMPROW inptr00, JSAMPROW inptr01, JSAMPROW inptr1,
+		       JSAMPROW inptr2, JSAMPROW outptr0, JSAMPROW outptr1,
+		       JDIMENSION num_pairs)
+{
+  __m128i terms[3], lo[3], hi[3];
+  JDIMENSION pair;
+
+  for (pair = 0; pair + 8 <= num_pairs; pair += 8) {
+    chroma_terms(load_chroma(inptr1 + pair), load_chroma(inptr2 + pair), terms);
+    pair_terms(terms, lo, hi);
+    store_rgb(outptr0 + 2 * pair * RGB_PIXELSIZE,
+	      _mm_loadu_si128((const __m128i *) (inptr00 + 2 * pair)), lo, hi);
+    store_rgb(outptr1 + 2 * pair * RGB_PIXELSIZE,
+	      _mm_loadu_si128((const __m128i *) (inptr01 + 2 * pair)), lo, hi);
+  }
+  return pair;
+}
+
+
+/*
+ * Fancy upsampling, 2h1v (h2v1_fancy_upsample), of the interior columns
+ * starting at inptr: 3/4 * nearer pixel + 1/4 * further pixel.
+ * inptr[-1] and inptr[num_cols] must be valid.
+ */
+
+GLOBAL(JDIMENSION)
+jsimd_h2v1_fancy_row (JSAMPROW inptr, JSAMPROW outptr, JDIMENSION num_cols)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i one = _mm_set1_epi16(1);
+  __m128i two = _mm_set1_epi16(2);
+  __m128i prev, cur, next, even[2], odd[2], cur3;
+  JDIMENSION col;
+  int h;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    prev = _mm_loadu_si128((const __m128i *) (inptr + col - 1));
+    cur = _mm_loadu_si128((const __m128i *) (inptr + col));
+    next = _mm_loadu_si128((const __m128i *) (inptr + col + 1));
+    for (h = 0; h < 2; h++) {
+      __m128i p = h ? _mm_unpackhi_epi8(prev, zero) : _mm_unpacklo_epi8(prev, zero);
+      __m128i c = h ? _mm_unpackhi_epi8(cur, zero) : _mm_unpacklo_epi8(cur, zero);
+      __m128i n = h ? _mm_unpackhi_epi8(next, zero) : _mm_unpacklo_epi8(next, zero);
+
+      cur3 = _mm_add_epi16(_mm_add_epi16(c, c), c);
+      even[h] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(cur3, p), one), 2);
+      odd[h] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(cur3, n), two), 2);
+    }
+    even[0] = _mm_packus_epi16(even[0], even[1]);
+    odd[0] = _mm_packus_epi16(odd[0], odd[1]);
+    _mm_storeu_si128((__m128i *) (outptr + 2 * col), _mm_unpacklo_epi8(even[0], odd[0]));
+    _mm_storeu_si128((__m128i *) (outptr + 2 * col + 16), _mm_unpackhi_epi8(even[0], odd[0]));
+  }
+  return col;
+}
+
+
+/*
+ * Fancy upsampling, 2h2v (h2v2_fancy_upsample), of the interior columns
+ * starting at inptr0 into one output row.  inptr0 is the nearer input row,
+ * inptr1 the further one; 9/16, 3/16, 3/16, 1/16 overall.
+ * inptr0/1[-1] and inptr0/1[num_cols] must be valid.
+ */
+
+GLOBAL(JDIMENSION)
+jsimd_h2v2_fancy_row (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+		      JDIMENSION num_cols)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i seven = _mm_set1_epi16(7);
+  __m128i eight = _mm_set1_epi16(8);
+  __m128i near0, far0, even[2], odd[2];
+  JDIMENSION col;
+  int h, k;
+
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    for (h = 0; h < 2; h++) {
+      __m128i sum[3];		/* column sums at col-1, col, col+1 */
+
+      for (k = 0; k < 3; k++) {
+	near0 = _mm_loadu_si128((const __m128i *) (inptr0 + col + k - 1));
+	far0 = _mm_loadu_si128((const __m128i *) (inptr1 + col + k - 1));
+	near0 = h ? _mm_unpackhi_epi8(near0, zero) : _mm_unpacklo_epi8(near0, zero);
+	far0 = h ? _mm_unpackhi_epi8(far0, zero) : _mm_unpacklo_epi8(far0, zero);
+	sum[k] = _mm_add_epi16(_mm_add_epi16(_mm_add_epi16(near0, near0), near0), far0);
+      }
+      sum[1] = _mm_add_epi16(_mm_add_epi16(sum[1], sum[1]), sum[1]);
+      even[h] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(sum[1], sum[0]), eight), 4);
+      odd[h] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(sum[1], sum[2]), seven), 4);
+    }
+    even[0] = _mm_packus_epi16(even[0], even[1]);
+    odd[0] = _mm_packus_epi16(odd[0], odd[1]);
+    _mm_storeu_si128((__m128i *) (outptr + 2 * col), _mm_unpacklo_epi8(even[0], odd[0]));
+    _mm_storeu_si128((__m128i *) (outptr + 2 * col + 16), _mm_unpackhi_epi8(even[0], odd[0]));
+  }
+  return col;
+}
+
+#endif /* JSIMD_COLOR_SUPPORTED */
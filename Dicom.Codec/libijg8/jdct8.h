@@ -78,6 +78,15 @@ typedef FAST_FLOAT FLOAT_MULT_TYPE; /* preferred floating type */
 #define RANGE_MASK  (MAXJSAMPLE * 4 + 3) /* 2 bits wider than legal samples */
 
 
+/* SIMD versions of the ISLOW IDCT (jidctsse.c, jidctavx.c) are available
+ * on x86 and x64; jddctmgr.c picks one at run time.
+ */
+
+#if defined(DCT_ISLOW_SUPPORTED) && defined(JSIMD_SUPPORTED)
+#define IDCT_SIMD_SUPPORTED
+#endif
+
+
 /* Short forms of external names for systems with brain-damaged linkers. */
 
 #ifdef NEED_SHORT_EXTERNAL_NAMES
@@ -85,6 +94,8 @@ typedef FAST_FLOAT FLOAT_MULT_TYPE; /* preferred floating type */
 #define jpeg_fdct_ifast		jpeg8_fdct_ifast
 #define jpeg_fdct_float		jpeg8_fdct_float
 #define jpeg_idct_islow		jpeg8_idct_islow
+#define jpeg_idct_islow_sse2	jpeg8_idct_islow_sse2
+#define jpeg_idct_islow_avx2	jpeg8_idct_islow_avx2
 #define jpeg_idct_ifast		jpeg8_idct_ifast
 #define jpeg_idct_float		jpeg8_idct_float
 #define jpeg_idct_4x4		jpeg8_idct_4x4
@@ -101,6 +112,14 @@ EXTERN(void) jpeg_fdct_float JPP((FAST_FLOAT * data));
 EXTERN(void) jpeg_idct_islow
     JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
 	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+#ifdef IDCT_SIMD_SUPPORTED
+EXTERN(void) jpeg_idct_islow_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_islow_avx2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+#endif
 EXTERN(void) jpeg_idct_ifast
     JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
 	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
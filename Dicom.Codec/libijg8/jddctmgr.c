@@ -78,6 +78,28 @@ typedef union {
 #endif
 
 
+#ifdef IDCT_SIMD_SUPPORTED
+
+/*
+ * Pick the fastest ISLOW routine this CPU can run.
+ * All of them give identical results.
+ */
+
+LOCAL(inverse_DCT_method_ptr)
+select_idct_islow (void)
+{
+  unsigned int simd = jsimd_support();
+
+  if (simd & JSIMD_AVX2)
+    return jpeg_idct_islow_avx2;
+  if (simd & JSIMD_SSE2)
+    return jpeg_idct_islow_sse2;
+  return jpeg_idct_islow;
+}
+
+#endif /* IDCT_SIMD_SUPPORTED */
+
+
 /*
  * Prepare for an output pass.
  * Here we select the proper IDCT routine for each component and build
@@ -117,7 +139,11 @@ start_pass (j_decompress_ptr cinfo)
       switch (cinfo->dct_method) {
 #ifdef DCT_ISLOW_SUPPORTED
       case JDCT_ISLOW:
+#ifdef IDCT_SIMD_SUPPORTED
+	method_ptr = select_idct_islow();
+#else
 	method_ptr = jpeg_idct_islow;
+#endif
 	method = JDCT_ISLOW;
 	break;
 #endif
@@ -17,6 +17,11 @@
 #include "jdhuff8.h"		/* Declarations shared with jd*huff.c */
 
 
+/* Figure F.12: extend sign bit. */
+
+#define HUFF_EXTEND(x,s)  ((x) < (1<<((s)-1)) ? (x) + (((-1)<<(s)) + 1) : (x))
+
+
 /*
  * Compute the derived values for a Huffman table.
  * This routine also performs some validation checks on the table.
@@ -29,7 +34,7 @@ jpeg_make_d_derived_tbl (j_decompress_ptr cinfo, boolean isDC, int tblno,
   JHUFF_TBL *htbl;
   d_derived_tbl *dtbl;
   int p, i, l, si, numsymbols;
-  int lookbits, ctr;
+  int lookbits, ctr, width, size, mag;
   char huffsize[257];
   unsigned int huffcode[257];
   unsigned int code;
@@ -47,10 +52,13 @@ jpeg_make_d_derived_tbl (j_decompress_ptr cinfo, boolean isDC, int tblno,
     ERREXIT1(cinfo, JERR_NO_HUFF_TABLE, tblno);
 
   /* Allocate a workspace if we haven't already done so. */
-  if (*pdtbl == NULL)
+  if (*pdtbl == NULL) {
     *pdtbl = (d_derived_tbl *)
       (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
 				  SIZEOF(d_derived_tbl));
+    (*pdtbl)->look2 = NULL;
+    (*pdtbl)->look2_size = 0;
+  }
   dtbl = *pdtbl;
   dtbl->pub = htbl;		/* fill in back link */
   
@@ -128,6 +136,78 @@ jpeg_make_d_derived_tbl (j_decompress_ptr cinfo, boolean isDC, int tblno,
     }
   }
 
+  /* Build the second-level tables for the remaining, longer codes.
+   * First find the width of the table under each first-level index: the
+   * number of bits by which its longest code exceeds HUFF_LOOKAHEAD.
+   */
+
+  MEMZERO(dtbl->look_sub, SIZEOF(dtbl->look_sub));
+
+  for (i = p; i < numsymbols; i++) {
+    l = huffsize[i];
+    lookbits = (int) (huffcode[i] >> (l-HUFF_LOOKAHEAD));
+    if (dtbl->look_sub[lookbits] < (unsigned int) (l-HUFF_LOOKAHEAD))
+      dtbl->look_sub[lookbits] = l-HUFF_LOOKAHEAD;
+  }
+
+  size = 1;			/* look2[0] is the empty entry */
+  for (lookbits = 0; lookbits < (1<<HUFF_LOOKAHEAD); lookbits++) {
+    width = (int) dtbl->look_sub[lookbits];
+    if (width) {
+      dtbl->look_sub[lookbits] = ((unsigned int) size << 4) | width;
+      size += 1 << width;
+    }
+  }
+
+  if (size > dtbl->look2_size) {
+    dtbl->look2 = (UINT16 *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				  size * SIZEOF(UINT16));
+    dtbl->look2_size = size;
+  }
+  MEMZERO(dtbl->look2, size * SIZEOF(UINT16));
+
+  for (i = p; i < numsymbols; i++) {
+    l = huffsize[i];
+    lookbits = (int) (huffcode[i] >> (l-HUFF_LOOKAHEAD));
+    width = (int) (dtbl->look_sub[lookbits] & 15);
+    /* Code bits after the first HUFF_LOOKAHEAD, followed by all possible
+     * bit sequences up to the width of the table
+     */
+    ctr = (int) (huffcode[i] & ((1 << (l-HUFF_LOOKAHEAD)) - 1))
+	  << (width - (l-HUFF_LOOKAHEAD));
+    size = 1 << (width - (l-HUFF_LOOKAHEAD));
+    ctr += (int) (dtbl->look_sub[lookbits] >> 4);
+    while (size--)
+      dtbl->look2[ctr++] = (UINT16) ((l << 8) | htbl->huffval[i]);
+  }
+
+  /* Combine short codes with the magnitude bits that follow them, where
+   * both fit into the lookahead.  The lossless symbol 16 stands for a
+   * difference of 32768 and is followed by no magnitude bits.
+   */
+
+  dtbl->mag_mask = isDC ? 0x1F : 0x0F;
+
+  for (lookbits = 0; lookbits < (1<<HUFF_LOOKAHEAD); lookbits++) {
+    l = dtbl->look_nbits[lookbits];
+    mag = dtbl->look_sym[lookbits] & dtbl->mag_mask;
+    dtbl->look_total[lookbits] = 0;
+    if (l == 0)
+      continue;
+    if (mag == 16) {
+      dtbl->look_total[lookbits] = (UINT8) l;
+      dtbl->look_val[lookbits] = 32768;
+    } else if (l + mag <= HUFF_LOOKAHEAD) {
+      dtbl->look_total[lookbits] = (UINT8) (l + mag);
+      dtbl->look_val[lookbits] = 0;
+      if (mag) {
+	ctr = (lookbits >> (HUFF_LOOKAHEAD - l - mag)) & ((1 << mag) - 1);
+	dtbl->look_val[lookbits] = HUFF_EXTEND(ctr, mag);
+      }
+    }
+  }
+
   /* Validate symbols as being reasonable.
    * For AC tables, we make no check, but accept all byte values 0..255.
    * For DC tables, we require the symbols to be in range 0..16.
@@ -165,6 +245,10 @@ jpeg_make_d_derived_tbl (j_decompress_ptr cinfo, boolean isDC, int tblno,
 #define MIN_GET_BITS  (BIT_BUF_SIZE-7)
 #endif
 
+/* Byte masks for the bulk refill's test for 0xFF bytes */
+#define BULK_ONES   ((((bit_buf_type) 0x01010101) << 32) | 0x01010101)
+#define BULK_HIGHS  ((((bit_buf_type) 0x80808080) << 32) | 0x80808080)
+
 
 GLOBAL(boolean)
 jpeg_fill_bit_buffer (bitread_working_state * state,
@@ -182,6 +266,31 @@ jpeg_fill_bit_buffer (bitread_working_state * state,
   /* We fail to do so only if we hit a marker or are forced to suspend. */
 
   if (cinfo->unread_marker == 0) {	/* cannot advance past a marker */
+    /* Bulk refill: if the next 8 bytes are in the source buffer and none of
+     * them is 0xFF, there is neither a stuffed byte nor a marker to handle,
+     * and as many of them as fit are shifted in at once.  The byte loop
+     * below takes over near 0xFF bytes and at the end of the buffer.
+     */
+    if (bits_left < MIN_GET_BITS && bytes_in_buffer >= 8) {
+      register bit_buf_type bytes = 0;
+      register int nbytes;
+
+      for (nbytes = 0; nbytes < 8; nbytes++)
+	bytes = (bytes << 8) | GETJOCTET(next_input_byte[nbytes]);
+      /* a byte of ~bytes is zero iff that byte of bytes is 0xFF */
+      if ((((~bytes) - BULK_ONES) & bytes & BULK_HIGHS) == 0) {
+	nbytes = (BIT_BUF_SIZE - bits_left) >> 3;
+	if (nbytes == 8)
+	  get_buffer = bytes;
+	else
+	  get_buffer = (get_buffer << (nbytes << 3)) |
+		       (bytes >> ((8 - nbytes) << 3));
+	bits_left += nbytes << 3;
+	next_input_byte += nbytes;
+	bytes_in_buffer -= nbytes;
+      }
+    }
+
     while (bits_left < MIN_GET_BITS) {
       register int c;
 
@@ -285,6 +394,25 @@ jpeg_huff_decode (bitread_working_state * state,
   register int l = min_bits;
   register IJG_INT32 code;
 
+  /* If HUFF_DECODE found the code to be longer than the lookahead and */
+  /* the buffer holds any code, look it up in the second-level table. */
+
+  if (l == HUFF_LOOKAHEAD+1 && bits_left >= 16) {
+    register int sub, nb, look;
+
+    sub = (int) htbl->look_sub[PEEK_BITS(HUFF_LOOKAHEAD)];
+    nb = HUFF_LOOKAHEAD + (sub & 15);
+    look = htbl->look2[(sub >> 4) + (PEEK_BITS(nb) & ((1 << (sub & 15)) - 1))];
+    if (look != 0) {
+      nb = look >> 8;
+      DROP_BITS(nb);
+      state->get_buffer = get_buffer;
+      state->bits_left = bits_left;
+      return look & 0xFF;
+    }
+    /* Invalid code: take the bit-by-bit path, which reports it */
+  }
+
   /* HUFF_DECODE has determined that the code is at least min_bits */
   /* bits long, so fetch that many bits in one swoop. */
 
@@ -314,3 +442,39 @@ jpeg_huff_decode (bitread_working_state * state,
 
   return htbl->pub->huffval[ (int) (code + htbl->valoffset[l]) ];
 }
+
+
+/*
+ * Out-of-line code for decoding a symbol and its magnitude bits.
+ * See jdhuff.h for info about usage.
+ */
+
+GLOBAL(int)
+jpeg_huff_decode_value (bitread_working_state * state,
+			register bit_buf_type get_buffer, register int bits_left,
+			d_derived_tbl * htbl, int * value)
+{
+  bitread_working_state br_state;
+  register int s, r, mag;
+
+  br_state = *state;
+
+  HUFF_DECODE(s, br_state, htbl, return -1, label1);
+
+  mag = s & htbl->mag_mask;
+  if (mag == 16)		/* lossless special case: always 32768 */
+    *value = 32768;
+  else if (mag) {		/* normal case: fetch subsequent bits */
+    CHECK_BIT_BUFFER(br_state, mag, return -1);
+    r = GET_BITS(mag);
+    *value = HUFF_EXTEND(r, mag);
+  } else
+    *value = 0;
+
+  /* Unload the local registers */
+  br_state.get_buffer = get_buffer;
+  br_state.bits_left = bits_left;
+  *state = br_state;
+
+  return s;
+}
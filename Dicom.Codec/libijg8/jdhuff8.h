@@ -17,12 +17,13 @@
 #define jpeg_make_d_derived_tbl		jpeg8_make_d_derived_tbl
 #define jpeg_fill_bit_buffer		jpeg8_fill_bit_buffer
 #define jpeg_huff_decode		jpeg8_huff_decode
+#define jpeg_huff_decode_value		jpeg8_huff_decode_value
 #endif /* NEED_SHORT_EXTERNAL_NAMES */
 
 
 /* Derived data constructed for each Huffman table */
 
-#define HUFF_LOOKAHEAD	8	/* # of bits of lookahead */
+#define HUFF_LOOKAHEAD	10	/* # of bits of first-level lookahead */
 
 typedef struct {
   /* Basic tables: (element [0] of each array is unused) */
@@ -44,6 +45,28 @@ typedef struct {
    */
   int look_nbits[1<<HUFF_LOOKAHEAD]; /* # bits, or 0 if too long */
   UINT8 look_sym[1<<HUFF_LOOKAHEAD]; /* symbol, or unused */
+
+  /* If the magnitude bits that follow a short code fit into the lookahead
+   * too, look_total gives the length of code plus magnitude bits and
+   * look_val the extended value, so that HUFF_DECODE_VALUE decodes both in
+   * one step.  look_total is 0 for all other entries.
+   */
+  UINT8 look_total[1<<HUFF_LOOKAHEAD];
+  int look_val[1<<HUFF_LOOKAHEAD];
+
+  /* Second-level tables for codes longer than HUFF_LOOKAHEAD bits.  An entry
+   * of look_sub whose look_nbits is 0 holds (offset << 4) | width of a table
+   * in look2 that is indexed by the next width bits; its entries are
+   * (# bits << 8) | symbol, or 0 for an invalid code.  look2[0] is always 0.
+   */
+  unsigned int look_sub[1<<HUFF_LOOKAHEAD];
+  UINT16 * look2;
+  int look2_size;		/* # of entries allocated for look2 */
+
+  /* Mask giving the number of magnitude bits that follow a symbol:
+   * the whole symbol for DC and lossless tables, the low 4 bits for AC.
+   */
+  int mag_mask;
 } d_derived_tbl;
 
 /* Expand a Huffman table definition into the derived format */
@@ -70,14 +93,20 @@ EXTERN(void) jpeg_make_d_derived_tbl
  * necessary.
  */
 
-typedef IJG_INT32 bit_buf_type;	/* type of bit-extraction buffer */
-#define BIT_BUF_SIZE  32	/* size of buffer in bits */
-
-/* If long is > 32 bits on your machine, and shifting/masking longs is
- * reasonably fast, making bit_buf_type be long and setting BIT_BUF_SIZE
- * appropriately should be a win.  Unfortunately we can't define the size
- * with something like  #define BIT_BUF_SIZE (sizeof(bit_buf_type)*8)
- * because not all machines measure sizeof in 8-bit bytes.
+#ifdef _MSC_VER
+typedef unsigned __int64 bit_buf_type;	/* type of bit-extraction buffer */
+#else
+typedef unsigned long long bit_buf_type; /* type of bit-extraction buffer */
+#endif
+#define BIT_BUF_SIZE  64	/* size of buffer in bits */
+
+/* The buffer is 64 bits wide on every target, 32-bit ones included.
+ * A sample can take 31 bits (a 16-bit code plus 15 magnitude bits), so a
+ * 32-bit buffer needs refilling for almost every sample of 12- and 16-bit
+ * lossless data, while a 64-bit one holds at least HUFF_VALUE_BITS after
+ * each refill.  Unfortunately we can't define the size with something like
+ * #define BIT_BUF_SIZE (sizeof(bit_buf_type)*8) because not all machines
+ * measure sizeof in 8-bit bytes.
  */
 
 typedef struct {		/* Bitreading state saved across MCUs */
@@ -202,6 +231,73 @@ EXTERN(int) jpeg_huff_decode
 	     register int bits_left, d_derived_tbl * htbl, int min_bits));
 
 
+/*
+ * HUFF_DECODE_VALUE decodes a Huffman-coded symbol together with the
+ * magnitude bits that follow it, as used for DC and lossless differences
+ * and for AC coefficients: result receives the symbol and value the
+ * extended magnitude (0 if there are no magnitude bits, 32768 for the
+ * lossless symbol 16).  The caller must define HUFF_EXTEND.
+ *
+ * A single refill check covers the whole sample: with HUFF_VALUE_BITS in
+ * the buffer, neither the code nor its magnitude bits can run short.
+ * Short codes whose magnitude bits fit into the lookahead too are decoded
+ * with one table lookup; longer codes go through the second-level tables.
+ * Invalid codes and the last bits before a marker are left to
+ * jpeg_huff_decode_value, which returns -1 if forced to suspend.
+ */
+
+#define HUFF_VALUE_BITS  32	/* 16-bit code plus 15 magnitude bits, rounded up */
+
+#define HUFF_DECODE_VALUE(result,value,state,htbl,failaction) \
+{ register int look, nb, mag; \
+  int slowval; \
+  if (bits_left < HUFF_VALUE_BITS) { \
+    if (! jpeg_fill_bit_buffer(&state,get_buffer,bits_left, 0)) {failaction;} \
+    get_buffer = state.get_buffer; bits_left = state.bits_left; \
+  } \
+  nb = 0; \
+  if (bits_left >= HUFF_VALUE_BITS) { \
+    look = PEEK_BITS(HUFF_LOOKAHEAD); \
+    if ((nb = htbl->look_total[look]) != 0) { \
+      DROP_BITS(nb); \
+      result = htbl->look_sym[look]; \
+      value = htbl->look_val[look]; \
+    } else { \
+      if ((nb = htbl->look_nbits[look]) != 0) \
+	result = htbl->look_sym[look]; \
+      else { \
+	mag = (int) htbl->look_sub[look]; \
+	nb = HUFF_LOOKAHEAD + (mag & 15); \
+	look = htbl->look2[(mag >> 4) + (PEEK_BITS(nb) & ((1 << (mag & 15)) - 1))]; \
+	nb = look >> 8; \
+	result = look & 0xFF; \
+      } \
+      if (nb != 0) { \
+	DROP_BITS(nb); \
+	if ((mag = result & htbl->mag_mask) == 16) \
+	  value = 32768; \
+	else if (mag != 0) { \
+	  look = GET_BITS(mag); \
+	  value = HUFF_EXTEND(look, mag); \
+	} else \
+	  value = 0; \
+      } \
+    } \
+  } \
+  if (nb == 0) { \
+    if ((result = jpeg_huff_decode_value(&state,get_buffer,bits_left,htbl,&slowval)) < 0) \
+      { failaction; } \
+    get_buffer = state.get_buffer; bits_left = state.bits_left; \
+    value = slowval; \
+  } \
+}
+
+/* Out-of-line case for HUFF_DECODE_VALUE */
+EXTERN(int) jpeg_huff_decode_value
+	JPP((bitread_working_state * state, register bit_buf_type get_buffer,
+	     register int bits_left, d_derived_tbl * htbl, int * value));
+
+
 /* Common fields between sequential, progressive and lossless Huffman entropy
  * decoder master structs.
  */
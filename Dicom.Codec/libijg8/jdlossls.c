@@ -67,6 +67,10 @@ jinit_lossless_d_codec(j_decompress_ptr cinfo)
 
   /* Initialize sub-modules */
   /* Entropy decoding: either Huffman or arithmetic coding. */
+  losslsd->entropy_decode_sv1_row = NULL;
+  /* Only the Huffman decoder supports checkpoints */
+  losslsd->entropy_save_state = NULL;
+  losslsd->entropy_load_state = NULL;
   if (cinfo->arith_code) {
 #ifdef WITH_ARITHMETIC_PATCH
     jinit_arith_decoder(cinfo);
@@ -0,0 +1,284 @@
+/*
+ * jidctavx.c
+ *
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains an AVX2 version of the slow-but-accurate integer
+ * inverse DCT (jidctint.c).
+ *
+ * Like jidctsse.c, the routine mirrors jpeg_idct_islow step by step in
+ * 32-bit lanes, so its output equals that of the scalar code for any
+ * input.  With eight lanes each pass covers the whole block at once:
+ * pass 1 works on all columns, an 8x8 transpose follows, and pass 2 works
+ * on all rows.
+ *
+ * This file must be compiled with AVX code generation enabled (/arch:AVX),
+ * so that the compiler does not mix legacy SSE and VEX instructions.
+ * jddctmgr.c only selects the routine when the CPU and OS support AVX2.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude8.h"
+#include "jpeglib8.h"
+#include "jdct8.h"		/* Private declarations for DCT subsystem */
+
+#ifdef IDCT_SIMD_SUPPORTED
+
+#include <immintrin.h>
+
+#ifdef __GNUC__
+#define AVX2_TARGET  __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+
+/*
+ * This module is specialized to the case DCTSIZE = 8.
+ */
+
+#if DCTSIZE != 8
+  Sorry, this code only copes with 8x8 DCTs. /* deliberate syntax err */
+#endif
+
+
+/* Scaling and constants must be those of jidctint.c. */
+
+#if BITS_IN_JSAMPLE == 8
+#define CONST_BITS  13
+#define PASS1_BITS  2
+#else
+#define CONST_BITS  13
+#define PASS1_BITS  1		/* lose a little precision to avoid overflow */
+#endif
+
+#define FIX_0_298631336  2446
+#define FIX_0_390180644  3196
+#define FIX_0_541196100  4433
+#define FIX_0_765366865  6270
+#define FIX_0_899976223  7373
+#define FIX_1_175875602  9633
+#define FIX_1_501321110  12299
+#define FIX_1_847759065  15137
+#define FIX_1_961570560  16069
+#define FIX_2_053119869  16819
+#define FIX_2_562915447  20995
+#define FIX_3_072711026  25172
+
+
+#define MULTIPLY(var,const)  _mm256_mullo_epi32(var, _mm256_set1_epi32(const))
+
+#undef DESCALE			/* jdct.h has a scalar version */
+#define DESCALE(x,n)  _mm256_srai_epi32(_mm256_add_epi32(x, _mm256_set1_epi32(1 << ((n)-1))), n)
+
+/* Per-lane select: mask ? a : b */
+#define SELECT(mask,a,b)  _mm256_blendv_epi8(b, a, mask)
+
+
+/*
+ * Equivalent of range_limit[x & RANGE_MASK] for the post-IDCT table
+ * built by prepare_range_limit_table (jdmaster.c); see jidctsse.c.
+ */
+
+AVX2_TARGET LOCAL(__m256i)
+range_limit (__m256i x)
+{
+  __m256i z = _mm256_and_si256(_mm256_add_epi32(x, _mm256_set1_epi32(CENTERJSAMPLE)),
+			       _mm256_set1_epi32(RANGE_MASK));
+  __m256i over = _mm256_cmpgt_epi32(z, _mm256_set1_epi32(MAXJSAMPLE));
+  __m256i wrap = _mm256_cmpgt_epi32(z, _mm256_set1_epi32(2 * (MAXJSAMPLE+1) +
+							 CENTERJSAMPLE - 1));
+
+  z = SELECT(over, _mm256_set1_epi32(MAXJSAMPLE), z);
+  return _mm256_andnot_si256(wrap, z);
+}
+
+
+/*
+ * One 1-D IDCT on eight lanes; x[0..7] are the inputs y0..y7 and receive
+ * the undescaled outputs.
+ */
+
+AVX2_TARGET LOCAL(void)
+idct_1d (__m256i * x)
+{
+  __m256i tmp0, tmp1, tmp2, tmp3;
+  __m256i tmp10, tmp11, tmp12, tmp13;
+  __m256i z1, z2, z3, z4, z5;
+
+  /* Even part */
+
+  z2 = x[2];
+  z3 = x[6];
+
+  z1 = MULTIPLY(_mm256_add_epi32(z2, z3), FIX_0_541196100);
+  tmp2 = _mm256_add_epi32(z1, MULTIPLY(z3, - FIX_1_847759065));
+  tmp3 = _mm256_add_epi32(z1, MULTIPLY(z2, FIX_0_765366865));
+
+  tmp0 = _mm256_slli_epi32(_mm256_add_epi32(x[0], x[4]), CONST_BITS);
+  tmp1 = _mm256_slli_epi32(_mm256_sub_epi32(x[0], x[4]), CONST_BITS);
+
+  tmp10 = _mm256_add_epi32(tmp0, tmp3);
+  tmp13 = _mm256_sub_epi32(tmp0, tmp3);
+  tmp11 = _mm256_add_epi32(tmp1, tmp2);
+  tmp12 = _mm256_sub_epi32(tmp1, tmp2);
+
+  /* Odd part */
+
+  tmp0 = x[7];
+  tmp1 = x[5];
+  tmp2 = x[3];
+  tmp3 = x[1];
+
+  z1 = _mm256_add_epi32(tmp0, tmp3);
+  z2 = _mm256_add_epi32(tmp1, tmp2);
+  z3 = _mm256_add_epi32(tmp0, tmp2);
+  z4 = _mm256_add_epi32(tmp1, tmp3);
+  z5 = MULTIPLY(_mm256_add_epi32(z3, z4), FIX_1_175875602);
+
+  tmp0 = MULTIPLY(tmp0, FIX_0_298631336);
+  tmp1 = MULTIPLY(tmp1, FIX_2_053119869);
+  tmp2 = MULTIPLY(tmp2, FIX_3_072711026);
+  tmp3 = MULTIPLY(tmp3, FIX_1_501321110);
+  z1 = MULTIPLY(z1, - FIX_0_899976223);
+  z2 = MULTIPLY(z2, - FIX_2_562915447);
+  z3 = MULTIPLY(z3, - FIX_1_961570560);
+  z4 = MULTIPLY(z4, - FIX_0_390180644);
+
+  z3 = _mm256_add_epi32(z3, z5);
+  z4 = _mm256_add_epi32(z4, z5);
+
+  tmp0 = _mm256_add_epi32(tmp0, _mm256_add_epi32(z1, z3));
+  tmp1 = _mm256_add_epi32(tmp1, _mm256_add_epi32(z2, z4));
+  tmp2 = _mm256_add_epi32(tmp2, _mm256_add_epi32(z2, z3));
+  tmp3 = _mm256_add_epi32(tmp3, _mm256_add_epi32(z1, z4));
+
+  /* Final output stage */
+
+  x[0] = _mm256_add_epi32(tmp10, tmp3);
+  x[7] = _mm256_sub_epi32(tmp10, tmp3);
+  x[1] = _mm256_add_epi32(tmp11, tmp2);
+  x[6] = _mm256_sub_epi32(tmp11, tmp2);
+  x[2] = _mm256_add_epi32(tmp12, tmp1);
+  x[5] = _mm256_sub_epi32(tmp12, tmp1);
+  x[3] = _mm256_add_epi32(tmp13, tmp0);
+  x[4] = _mm256_sub_epi32(tmp13, tmp0);
+}
+
+
+/* Transpose the 8x8 block held in x[0..7]. */
+
+AVX2_TARGET LOCAL(void)
+transpose (__m256i * x)
+{
+  __m256i t0, t1, t2, t3, t4, t5, t6, t7;
+  __m256i u0, u1, u2, u3, u4, u5, u6, u7;
+
+  t0 = _mm256_unpacklo_epi32(x[0], x[1]);
+  t1 = _mm256_unpackhi_epi32(x[0], x[1]);
+  t2 = _mm256_unpacklo_epi32(x[2], x[3]);
+  t3 = _mm256_unpackhi_epi32(x[2], x[3]);
+  t4 = _mm256_unpacklo_epi32(x[4], x[5]);
+  t5 = _mm256_unpackhi_epi32(x[4], x[5]);
+  t6 = _mm256_unpacklo_epi32(x[6], x[7]);
+  t7 = _mm256_unpackhi_epi32(x[6], x[7]);
+
+  u0 = _mm256_unpacklo_epi64(t0, t2);
+  u1 = _mm256_unpackhi_epi64(t0, t2);
+  u2 = _mm256_unpacklo_epi64(t1, t3);
+  u3 = _mm256_unpackhi_epi64(t1, t3);
+  u4 = _mm256_unpacklo_epi64(t4, t6);
+  u5 = _mm256_unpackhi_epi64(t4, t6);
+  u6 = _mm256_unpacklo_epi64(t5, t7);
+  u7 = _mm256_unpackhi_epi64(t5, t7);
+
+  x[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+  x[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+  x[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+  x[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+  x[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+  x[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+  x[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+  x[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+
+/* Store one output row; all values are already range limited. */
+
+AVX2_TARGET LOCAL(void)
+store_row (JSAMPROW outptr, __m256i row)
+{
+  __m128i lo = _mm256_castsi256_si128(row);
+  __m128i hi = _mm256_extracti128_si256(row, 1);
+
+#if BITS_IN_JSAMPLE == 8
+  _mm_storel_epi64((__m128i *) outptr,
+		   _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128()));
+#else
+  _mm_storeu_si128((__m128i *) outptr, _mm_packus_epi32(lo, hi));
+#endif
+}
+
+
+/*
+ * Perform dequantization and inverse DCT on one block of coefficients.
+ */
+
+AVX2_TARGET GLOBAL(void)
+jpeg_idct_islow_avx2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  ISLOW_MULT_TYPE * quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+  __m256i x[DCTSIZE];
+  __m256i zero, dcval;
+  __m128i ac;
+  int i;
+
+  /* Pass 1: process all columns from input. */
+  /* A column whose AC terms are all zero just repeats its scaled DC term. */
+
+  ac = _mm_setzero_si128();
+  for (i = 1; i < DCTSIZE; i++)
+    ac = _mm_or_si128(ac, _mm_loadu_si128((const __m128i *) (coef_block + DCTSIZE*i)));
+  zero = _mm256_cvtepi16_epi32(_mm_cmpeq_epi16(ac, _mm_setzero_si128()));
+
+  for (i = 0; i < DCTSIZE; i++)
+    x[i] = _mm256_mullo_epi32(
+	_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (coef_block + DCTSIZE*i))),
+	_mm256_loadu_si256((const __m256i *) (quantptr + DCTSIZE*i)));
+  dcval = _mm256_slli_epi32(x[0], PASS1_BITS);
+
+  idct_1d(x);
+
+  for (i = 0; i < DCTSIZE; i++)
+    x[i] = SELECT(zero, dcval, DESCALE(x[i], CONST_BITS-PASS1_BITS));
+
+  transpose(x);
+
+  /* Pass 2: process all rows from work array. */
+
+  zero = x[1];
+  for (i = 2; i < DCTSIZE; i++)
+    zero = _mm256_or_si256(zero, x[i]);
+  zero = _mm256_cmpeq_epi32(zero, _mm256_setzero_si256());
+#ifdef NO_ZERO_ROW_TEST
+  zero = _mm256_setzero_si256();
+#endif
+  dcval = range_limit(DESCALE(x[0], PASS1_BITS+3));
+
+  idct_1d(x);
+
+  for (i = 0; i < DCTSIZE; i++)
+    x[i] = SELECT(zero, dcval,
+		  range_limit(DESCALE(x[i], CONST_BITS+PASS1_BITS+3)));
+
+  transpose(x);
+
+  for (i = 0; i < DCTSIZE; i++)
+    store_row(output_buf[i] + output_col, x[i]);
+
+  _mm256_zeroupper();
+}
+
+#endif /* IDCT_SIMD_SUPPORTED */
@@ -79,6 +79,15 @@ typedef struct {
   JMETHOD(boolean, entropy_decode_mcu, (j_decompress_ptr cinfo,
 					JBLOCKROW *MCU_data));
 
+  /* Save or load the entropy decoder state between MCUs, for checkpoints;
+   * NULL if the entropy decoder does not support them.  entropy_save_state
+   * returns FALSE if the current state cannot be resumed from.
+   */
+  JMETHOD(boolean, entropy_save_state, (j_decompress_ptr cinfo,
+					jpeg_checkpoint * checkpoint));
+  JMETHOD(void, entropy_load_state, (j_decompress_ptr cinfo,
+				     const jpeg_checkpoint * checkpoint));
+
   /* This is here to share code between baseline and progressive decoders; */
   /* other modules probably should not use it */
   boolean entropy_insufficient_data;	/* set TRUE after emitting warning */
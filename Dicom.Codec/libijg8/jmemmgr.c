@@ -1123,6 +1123,8 @@ jinit_memory_mgr (j_common_ptr cinfo)
   mem->pub.alloc_barray = alloc_barray;
 #ifdef NEED_DARRAY
   mem->pub.alloc_darray = alloc_darray;
+#else
+  mem->pub.alloc_darray = NULL;
 #endif
   mem->pub.request_virt_sarray = request_virt_sarray;
   mem->pub.request_virt_barray = request_virt_barray;
@@ -0,0 +1,123 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Text;
+
+using NUnit.Framework;
+
+using Dicom.Codec;
+using Dicom.Codec.Jpeg;
+using Dicom.Codec.JpegLs;
+using Dicom.Data;
+
+namespace Dicom.Tests.Codec {
+	/// <summary>
+	/// Encode and decode timings for the codecs. These are explicit and in the Benchmark
+	/// category, so that they only run on request; the results are written to the console.
+	/// </summary>
+	[TestFixture, Explicit, Category("Benchmark")]
+	public class CodecBenchmarks {
+		private const int Width = 1024;
+		private const int Height = 1024;
+		private const int Iterations = 20;
+
+		private static DcmPixelData CreateImage(int bits, bool background) {
+			var pixelData = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian);
+			pixelData.ImageWidth = Width;
+			pixelData.ImageHeight = Height;
+			pixelData.BitsAllocated = (ushort)(bits > 8 ? 16 : 8);
+			pixelData.BitsStored = (ushort)bits;
+			pixelData.HighBit = (ushort)(bits - 1);
+			pixelData.SamplesPerPixel = 1;
+			pixelData.PixelRepresentation = 0;
+			pixelData.PlanarConfiguration = 0;
+			pixelData.PhotometricInterpretation = "MONOCHROME2";
+
+			// smooth anatomy-like gradient plus noise, so that the code lengths resemble real images
+			var random = new Random(1234);
+			int max = (1 << bits) - 1;
+			int bytes = pixelData.BitsAllocated / 8;
+			var data = new byte[Width * Height * bytes];
+			for (int y = 0, i = 0; y < Height; y++) {
+				for (int x = 0; x < Width; x++) {
+					double r = Math.Sqrt((x - Width / 2) * (x - Width / 2) + (y - Height / 2) * (y - Height / 2));
+					int value = (int)(max * (0.5 + 0.4 * Math.Cos(r / 40.0))) + random.Next(max / 64 + 1);
+					value = Math.Min(max, value);
+
+					// black surroundings, as in CR, MG and US images, are coded in run mode
+					if (background && r > Width / 4)
+						value = 0;
+					data[i++] = (byte)value;
+					if (bytes == 2)
+						data[i++] = (byte)(value >> 8);
+				}
+			}
+			pixelData.AddFrame(data);
+			return pixelData;
+		}
+
+		// Runs action once to warm up, so that the timing does not include JIT and table setup, then times it.
+		private static void Time(string name, Action action) {
+			action();
+
+			Stopwatch watch = Stopwatch.StartNew();
+			for (int i = 0; i < Iterations; i++)
+				action();
+			watch.Stop();
+
+			double ms = watch.Elapsed.TotalMilliseconds / Iterations;
+			double mpixels = (double)Width * Height / 1000000.0;
+			Console.WriteLine("{0}: {1:0.00} ms/frame, {2:0.0} Mpixel/s", name, ms, mpixels / (ms / 1000.0));
+		}
+
+		private static void TimeEncode(string name, IDcmCodec codec, DcmCodecParameters parameters, int bits, bool background) {
+			DcmPixelData image = CreateImage(bits, background);
+			Time(name, () => codec.Encode(null, image, new DcmPixelData(codec.GetTransferSyntax(), image), parameters));
+		}
+
+		private static void TimeDecode(string name, IDcmCodec codec, DcmCodecParameters parameters, int bits, bool background) {
+			DcmPixelData image = CreateImage(bits, background);
+			var encoded = new DcmPixelData(codec.GetTransferSyntax(), image);
+			codec.Encode(null, image, encoded, parameters);
+			Time(name, () => codec.Decode(null, encoded, new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, encoded), parameters));
+		}
+
+		private static DcmJpegParameters JpegParameters() {
+			var jparams = new DcmJpegParameters();
+			jparams.Quality = 90;
+			jparams.Predictor = 1;
+			jparams.PointTransform = 0;
+			return jparams;
+		}
+
+		[Test]
+		public void JpegDecodeBaseline8() {
+			TimeDecode("JPEG baseline 8-bit", new DcmJpegProcess1Codec(), JpegParameters(), 8, false);
+		}
+
+		[Test]
+		public void JpegDecodeExtended12() {
+			TimeDecode("JPEG extended 12-bit", new DcmJpegProcess4Codec(), JpegParameters(), 12, false);
+		}
+
+		[Test]
+		public void JpegDecodeLossless([Values(8, 12, 16)] int bits) {
+			TimeDecode(String.Format("JPEG lossless SV1 {0}-bit", bits), new DcmJpegLossless14SV1Codec(), JpegParameters(), bits, false);
+		}
+
+		[Test]
+		public void JpegLsDecodeLossless([Values(8, 12, 16)] int bits) {
+			TimeDecode(String.Format("JPEG-LS lossless {0}-bit", bits), new DcmJpegLsLosslessCodec(), new DcmJpegLsParameters(), bits, false);
+		}
+
+		[Test]
+		public void JpegLsDecodeBackground([Values(8, 16)] int bits) {
+			TimeDecode(String.Format("JPEG-LS lossless {0}-bit, black background", bits), new DcmJpegLsLosslessCodec(), new DcmJpegLsParameters(), bits, true);
+		}
+
+		[Test]
+		public void JpegLsEncodeBackground([Values(8, 16)] int bits) {
+			TimeEncode(String.Format("JPEG-LS lossless encode {0}-bit, black background", bits), new DcmJpegLsLosslessCodec(), new DcmJpegLsParameters(), bits, true);
+		}
+	}
+}
@@ -0,0 +1,596 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Runtime.InteropServices;
+using System.Text;
+
+using NUnit.Framework;
+
+using Dicom.Codec;
+using Dicom.Codec.Jpeg;
+using Dicom.Data;
+
+namespace Dicom.Tests.Codec {
+	[TestFixture]
+	public class DcmJpegCodecTests {
+		// odd sizes, so that the SIMD row routines leave a tail for the portable code
+		private const int Width = 203;
+		private const int Height = 67;
+
+		[TearDown]
+		public void TearDown() {
+			DcmJpegCodec.UseSimd = true;
+		}
+
+		private static DcmPixelData CreateRgbImage() {
+			return CreateRgbImage(1234);
+		}
+
+		private static DcmPixelData CreateRgbImage(int seed) {
+			var pixelData = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian);
+			pixelData.ImageWidth = Width;
+			pixelData.ImageHeight = Height;
+			pixelData.BitsAllocated = 8;
+			pixelData.BitsStored = 8;
+			pixelData.HighBit = 7;
+			pixelData.SamplesPerPixel = 3;
+			pixelData.PixelRepresentation = 0;
+			pixelData.PlanarConfiguration = 0;
+			pixelData.PhotometricInterpretation = "RGB";
+
+			// smooth ramps with noise and a few saturated spots to exercise the range limiting
+			var random = new Random(seed);
+			var data = new byte[Width * Height * 3];
+			for (int y = 0, i = 0; y < Height; y++) {
+				for (int x = 0; x < Width; x++) {
+					if (random.Next(50) == 0) {
+						data[i++] = 255;
+						data[i++] = 0;
+						data[i++] = (byte)(random.Next(2) * 255);
+						continue;
+					}
+					data[i++] = (byte)Math.Min(255, x + random.Next(40));
+					data[i++] = (byte)Math.Min(255, y * 3 + random.Next(40));
+					data[i++] = (byte)Math.Min(255, (x + y) / 2 + random.Next(40));
+				}
+			}
+			pixelData.AddFrame(data);
+			return pixelData;
+		}
+
+		private static DcmPixelData CreateMonochromeImage() {
+			var pixelData = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian);
+			pixelData.ImageWidth = Width;
+			pixelData.ImageHeight = Height;
+			pixelData.BitsAllocated = 8;
+			pixelData.BitsStored = 8;
+			pixelData.HighBit = 7;
+			pixelData.SamplesPerPixel = 1;
+			pixelData.PixelRepresentation = 0;
+			pixelData.PlanarConfiguration = 0;
+			pixelData.PhotometricInterpretation = "MONOCHROME2";
+
+			var random = new Random(1234);
+			var data = new byte[Width * Height];
+			for (int y = 0, i = 0; y < Height; y++) {
+				for (int x = 0; x < Width; x++)
+					data[i++] = (byte)Math.Min(255, x + y + random.Next(40));
+			}
+			pixelData.AddFrame(data);
+			return pixelData;
+		}
+
+		private static DcmPixelData CreateColorImage12(int seed, string photometricInterpretation) {
+			var pixelData = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian);
+			pixelData.ImageWidth = Width;
+			pixelData.ImageHeight = Height;
+			pixelData.BitsAllocated = 16;
+			pixelData.BitsStored = 12;
+			pixelData.HighBit = 11;
+			pixelData.SamplesPerPixel = 3;
+			pixelData.PixelRepresentation = 0;
+			pixelData.PlanarConfiguration = 0;
+			pixelData.PhotometricInterpretation = photometricInterpretation;
+
+			// the 8 bit ramps widened to 12 bits, with noise in the low bits so the differences span the full range
+			var random = new Random(seed);
+			byte[] source = CreateRgbImage(seed).GetFrameDataU8(0);
+			var data = new byte[source.Length * 2];
+			for (int i = 0; i < source.Length; i++) {
+				int value = (source[i] << 4) | random.Next(16);
+				data[i * 2] = (byte)value;
+				data[i * 2 + 1] = (byte)(value >> 8);
+			}
+			pixelData.AddFrame(data);
+			return pixelData;
+		}
+
+		private static DcmPixelData Encode(DcmPixelData pixelData, JpegSampleFactor sampleFactor) {
+			return Encode(new DcmJpegProcess1Codec(), pixelData, sampleFactor, 1);
+		}
+
+		private static DcmPixelData Encode(DcmJpegCodec codec, DcmPixelData pixelData, JpegSampleFactor sampleFactor, int stripes) {
+			var jparams = new DcmJpegParameters();
+			jparams.Quality = 75;
+			jparams.SampleFactor = sampleFactor;
+			jparams.MaxStripeParallelism = stripes;
+
+			var newPixelData = new DcmPixelData(codec.GetTransferSyntax(), pixelData);
+			codec.Encode(null, pixelData, newPixelData, jparams);
+			return newPixelData;
+		}
+
+		private static byte[] Decode(DcmPixelData pixelData, bool toRgb, bool merged, bool simd) {
+			var codec = new DcmJpegProcess1Codec();
+			var jparams = new DcmJpegParameters();
+			jparams.ConvertColorspaceToRGB = toRgb;
+			jparams.MergedUpsampling = merged;
+
+			DcmJpegCodec.UseSimd = simd;
+			var newPixelData = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, pixelData);
+			codec.Decode(null, pixelData, newPixelData, jparams);
+			return newPixelData.GetFrameDataU8(0);
+		}
+
+		private static void CompareSimdWithPortable(JpegSampleFactor sampleFactor, bool toRgb, bool merged) {
+			DcmPixelData jpeg = Encode(CreateRgbImage(), sampleFactor);
+
+			byte[] portable = Decode(jpeg, toRgb, merged, false);
+			byte[] simd = Decode(jpeg, toRgb, merged, true);
+
+			CollectionAssert.AreEqual(portable, simd);
+		}
+
+		[Test]
+		public void ColorConversion444() {
+			CompareSimdWithPortable(JpegSampleFactor.SF444, true, false);
+		}
+
+		[Test]
+		public void FancyUpsampling422() {
+			CompareSimdWithPortable(JpegSampleFactor.SF422, false, false);
+		}
+
+		[Test]
+		public void FancyUpsamplingAndColorConversion422() {
+			CompareSimdWithPortable(JpegSampleFactor.SF422, true, false);
+		}
+
+		[Test]
+		public void MergedUpsampling422() {
+			CompareSimdWithPortable(JpegSampleFactor.SF422, true, true);
+		}
+
+		[Test]
+		public void LosslessStripes() {
+			DcmPixelData image = CreateRgbImage();
+			var codec = new DcmJpegLossless14SV1Codec();
+			DcmPixelData jpeg = Encode(codec, image, JpegSampleFactor.SF444, 4);
+
+			var newPixelData = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			codec.Decode(null, jpeg, newPixelData, new DcmJpegParameters());
+
+			CollectionAssert.AreEqual(image.GetFrameDataU8(0), newPixelData.GetFrameDataU8(0));
+		}
+
+		[Test]
+		public void LossyStripesDecodeInParallel() {
+			var codec = new DcmJpegProcess1Codec();
+			DcmPixelData jpeg = Encode(codec, CreateRgbImage(), JpegSampleFactor.SF422, 4);
+
+			var jparams = new DcmJpegParameters();
+			var serial = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			codec.Decode(null, jpeg, serial, jparams);
+
+			jparams.MaxRestartParallelism = 4;
+			var parallel = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			codec.Decode(null, jpeg, parallel, jparams);
+
+			CollectionAssert.AreEqual(serial.GetFrameDataU8(0), parallel.GetFrameDataU8(0));
+		}
+
+		[Test]
+		public void CheckpointBandsDecodeInParallel([Values(JpegSampleFactor.SF444, JpegSampleFactor.SF422)] JpegSampleFactor sampleFactor) {
+			foreach (var codec in new DcmJpegCodec[] { new DcmJpegProcess1Codec(), new DcmJpegLossless14SV1Codec() }) {
+				DcmPixelData jpeg = Encode(codec, CreateRgbImage(), sampleFactor, 1);
+
+				var cache = new JpegCheckpointCache();
+				cache.Interval = 2;
+				var jparams = new DcmJpegParameters();
+				jparams.Checkpoints = cache;
+
+				// the serial decode records the checkpoints, at which the parallel decode splits the frame
+				var serial = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+				codec.Decode(null, jpeg, serial, jparams);
+				Assert.Greater(cache.GetIndex(jpeg, 0).Count, 0);
+
+				jparams.MaxRestartParallelism = 4;
+				var parallel = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+				codec.Decode(null, jpeg, parallel, jparams);
+
+				CollectionAssert.AreEqual(serial.GetFrameDataU8(0), parallel.GetFrameDataU8(0));
+			}
+		}
+
+		[Test]
+		public void StaleCheckpointsAreNotResumed() {
+			DcmPixelData image = CreateRgbImage();
+			var codec = new DcmJpegProcess1Codec();
+			DcmPixelData jpeg = Encode(codec, image, JpegSampleFactor.SF444, 1);
+
+			var cache = new JpegCheckpointCache();
+			cache.Interval = 2;
+			var jparams = new DcmJpegParameters();
+			jparams.Checkpoints = cache;
+			codec.Decode(null, jpeg, new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg), jparams);
+			Assert.Greater(cache.GetIndex(jpeg, 0).Count, 0);
+
+			// the frame is replaced in place by a far smaller one, past the end of which the later checkpoints lie
+			var lowQuality = new DcmJpegParameters();
+			lowQuality.Quality = 5;
+			var replacement = new DcmPixelData(codec.GetTransferSyntax(), image);
+			codec.Encode(null, image, replacement, lowQuality);
+			var fragments = jpeg.GetFrameFragments(0);
+			fragments[0].FromBytes(GetCompressedFrame(replacement));
+			for (int i = 1; i < fragments.Count; i++)
+				fragments[i].Clear();
+
+			var expected = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			codec.Decode(null, jpeg, expected, new DcmJpegParameters());
+
+			// the bands fall back to decoding the frame serially, instead of resuming some of them at checkpoints
+			jparams.MaxRestartParallelism = 4;
+			var actual = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			codec.Decode(null, jpeg, actual, jparams);
+			CollectionAssert.AreEqual(expected.GetFrameDataU8(0), actual.GetFrameDataU8(0));
+
+			var region = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			Assert.Throws<DicomCodecException>(() => codec.DecodeRegion(jpeg, region, 0, jparams, 0, Height - 1, Width, 1));
+		}
+
+		[Test]
+		public void FramesCodeInParallel([Values(false, true)] bool toRgb) {
+			const int frames = 6;
+			DcmPixelData image = CreateRgbImage(1);
+			for (int frame = 1; frame < frames; frame++)
+				image.AddFrame(CreateRgbImage(frame + 1).GetFrameDataU8(0));
+
+			var codec = new DcmJpegProcess1Codec();
+			var jparams = new DcmJpegParameters();
+			jparams.Quality = 75;
+			jparams.SampleFactor = JpegSampleFactor.SF422;
+			jparams.ConvertColorspaceToRGB = toRgb;
+
+			var jpeg = new DcmPixelData[2];
+			var decoded = new DcmPixelData[2];
+			for (int i = 0; i < 2; i++) {
+				jparams.MaxDegreeOfParallelism = (i == 0) ? 1 : 4;
+				jpeg[i] = new DcmPixelData(codec.GetTransferSyntax(), image);
+				codec.Encode(null, image, jpeg[i], jparams);
+				Assert.AreEqual("YBR_FULL_422", jpeg[i].PhotometricInterpretation);
+
+				decoded[i] = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg[i]);
+				codec.Decode(null, jpeg[i], decoded[i], jparams);
+				Assert.AreEqual(toRgb ? "RGB" : "YBR_FULL", decoded[i].PhotometricInterpretation);
+				Assert.AreEqual(toRgb ? 0 : 1, decoded[i].PlanarConfiguration);
+				Assert.AreEqual(frames, decoded[i].NumberOfFrames);
+			}
+
+			for (int frame = 0; frame < frames; frame++) {
+				CollectionAssert.AreEqual(jpeg[0].GetFrameDataU8(frame), jpeg[1].GetFrameDataU8(frame));
+				CollectionAssert.AreEqual(decoded[0].GetFrameDataU8(frame), decoded[1].GetFrameDataU8(frame));
+			}
+		}
+
+		[Test]
+		public void CachedHuffmanTables() {
+			var cache = new JpegHuffmanTableCache();
+
+			// the first image builds the tables, the others are coded with them in a single pass
+			foreach (var codec in new DcmJpegCodec[] { new DcmJpegLossless14SV1Codec(), new DcmJpegProcess1Codec() }) {
+				for (int seed = 1; seed <= 3; seed++) {
+					DcmPixelData image = CreateRgbImage(seed);
+					var jparams = new DcmJpegParameters();
+
+					var optimized = new DcmPixelData(codec.GetTransferSyntax(), image);
+					codec.Encode(null, image, optimized, jparams);
+
+					jparams.HuffmanTables = cache;
+					var cached = new DcmPixelData(codec.GetTransferSyntax(), image);
+					codec.Encode(null, image, cached, jparams);
+
+					var expected = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, optimized);
+					codec.Decode(null, optimized, expected, new DcmJpegParameters());
+					var actual = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, cached);
+					codec.Decode(null, cached, actual, new DcmJpegParameters());
+
+					CollectionAssert.AreEqual(expected.GetFrameDataU8(0), actual.GetFrameDataU8(0));
+				}
+			}
+		}
+
+		[Test]
+		public void CachedHuffmanTablesAcrossColorSpaces() {
+			var cache = new JpegHuffmanTableCache();
+			var codec = new DcmJpegLossless14SV1Codec();
+
+			// RGB frames share one table for all components while YBR frames code the chroma with their own, so
+			// tables built for one colour space must not be reused for the other
+			foreach (string photometricInterpretation in new string[] { "RGB", "YBR_FULL", "RGB", "YBR_FULL" }) {
+				DcmPixelData image = CreateColorImage12(7, photometricInterpretation);
+				var jparams = new DcmJpegParameters();
+				jparams.HuffmanTables = cache;
+
+				var jpeg = new DcmPixelData(codec.GetTransferSyntax(), image);
+				codec.Encode(null, image, jpeg, jparams);
+				var decoded = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+				codec.Decode(null, jpeg, decoded, new DcmJpegParameters());
+
+				Assert.AreEqual(photometricInterpretation, decoded.PhotometricInterpretation);
+				CollectionAssert.AreEqual(image.GetFrameDataU8(0), decoded.GetFrameDataU8(0));
+			}
+		}
+
+		[Test]
+		public void ArithmeticCoding() {
+			DcmPixelData image = CreateRgbImage();
+
+			// the entropy coder must not change the decoded image, with or without restart markers, and arithmetic
+			// frames are only written under the transfer syntax of their process
+			var codecs = new DcmJpegCodec[,] {
+				{ new DcmJpegLossless14SV1Codec(), new DcmJpegLossless15Codec() },
+				{ new DcmJpegProcess4Codec(), new DcmJpegProcess5Codec() }
+			};
+			for (int i = 0; i < codecs.GetLength(0); i++) {
+				DcmJpegCodec huffmanCodec = codecs[i, 0];
+				DcmJpegCodec arithmeticCodec = codecs[i, 1];
+
+				foreach (int stripes in new int[] { 1, 4 }) {
+					var jparams = new DcmJpegParameters();
+					jparams.MaxStripeParallelism = stripes;
+
+					var huffman = new DcmPixelData(huffmanCodec.GetTransferSyntax(), image);
+					huffmanCodec.Encode(null, image, huffman, jparams);
+					Assert.Throws<DicomCodecException>(() => arithmeticCodec.Encode(null, image, new DcmPixelData(arithmeticCodec.GetTransferSyntax(), image), jparams));
+
+					jparams.ArithmeticCoding = true;
+					Assert.Throws<DicomCodecException>(() => huffmanCodec.Encode(null, image, new DcmPixelData(huffmanCodec.GetTransferSyntax(), image), jparams));
+
+					var arithmetic = new DcmPixelData(arithmeticCodec.GetTransferSyntax(), image);
+					arithmeticCodec.Encode(null, image, arithmetic, jparams);
+					Assert.AreEqual(i == 0 ? DicomTransferSyntax.JPEGProcess15Retired : DicomTransferSyntax.JPEGProcess3_5Retired, arithmetic.TransferSyntax);
+					Assert.AreEqual(i == 0 ? 11 : 9, FrameProbe.Probe(arithmetic).Process);
+
+					var expected = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, huffman);
+					huffmanCodec.Decode(null, huffman, expected, new DcmJpegParameters());
+					var actual = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, arithmetic);
+					arithmeticCodec.Decode(null, arithmetic, actual, new DcmJpegParameters());
+
+					CollectionAssert.AreEqual(expected.GetFrameDataU8(0), actual.GetFrameDataU8(0));
+				}
+			}
+		}
+
+		[Test]
+		public void MemoryBudgetAndStatistics() {
+			DcmPixelData image = CreateRgbImage();
+			var codec = new DcmJpegProcess4Codec();
+
+			var jparams = new DcmJpegParameters();
+			jparams.MemoryStatistics = new JpegMemoryStatistics();
+			var unlimited = new DcmPixelData(codec.GetTransferSyntax(), image);
+			codec.Encode(null, image, unlimited, jparams);
+
+			JpegMemoryStatistics statistics = jparams.MemoryStatistics;
+			Assert.Greater(statistics.PeakBytes, 0);
+			Assert.GreaterOrEqual(statistics.TotalBytes, statistics.PeakBytes);
+			Assert.GreaterOrEqual(statistics.TotalBytes, statistics.HeapBytes);
+
+			// whole-image buffers that do not fit in the budget go to temporary files, without changing the output
+			jparams.MaxMemoryToUse = 32 * 1024;
+			var limited = new DcmPixelData(codec.GetTransferSyntax(), image);
+			codec.Encode(null, image, limited, jparams);
+			CollectionAssert.AreEqual(unlimited.GetFrameDataU8(0), limited.GetFrameDataU8(0));
+
+			var decoded = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, limited);
+			codec.Decode(null, limited, decoded, jparams);
+			Assert.Greater(statistics.PeakBytes, 0);
+			Assert.GreaterOrEqual(statistics.TotalBytes, statistics.PeakBytes);
+		}
+
+		private static byte[] GetCompressedFrame(DcmPixelData pixelData) {
+			var data = new List<byte>();
+			foreach (var fragment in pixelData.GetFrameFragments(0))
+				data.AddRange(fragment.ToBytes());
+			return data.ToArray();
+		}
+
+		[Test]
+		public void ProgressiveDecoding() {
+			DcmPixelData image = CreateRgbImage();
+			var codec = new Jpeg8Codec(JpegMode.Progressive, 0, 0);
+			var jparams = new DcmJpegParameters();
+
+			var jpeg = new DcmPixelData(DicomTransferSyntax.JPEGProcess2_4, image);
+			codec.Encode(image, jpeg, jparams, 0);
+			var expected = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			codec.Decode(jpeg, expected, jparams, 0);
+			byte[] data = GetCompressedFrame(jpeg);
+
+			// a first image is ready long before the whole frame has arrived
+			var frames = new List<byte[]>();
+			var partial = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			JpegProgressiveDecoder decoder = codec.CreateProgressiveDecoder(jpeg, partial, jparams, (frame, scan, complete) => frames.Add(frame));
+			decoder.Append(data, 0, data.Length / 3);
+			decoder.Finish();
+			Assert.IsTrue(decoder.IsComplete);
+			Assert.Greater(frames.Count, 1);
+			Assert.AreEqual(expected.GetFrameDataU8(0).Length, frames[frames.Count - 1].Length);
+
+			// fed in small pieces, the final image is the one Decode produces
+			frames.Clear();
+			int completed = 0;
+			var actual = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			decoder = codec.CreateProgressiveDecoder(jpeg, actual, jparams, (frame, scan, complete) => {
+				frames.Add(frame);
+				if (complete)
+					completed++;
+			});
+			for (int offset = 0; offset < data.Length; offset += 500)
+				decoder.Append(data, offset, Math.Min(500, data.Length - offset));
+			Assert.IsTrue(decoder.IsComplete);
+			Assert.Greater(frames.Count, 2);
+			Assert.AreEqual(1, completed);
+			CollectionAssert.AreEqual(expected.GetFrameDataU8(0), frames[frames.Count - 1]);
+			Assert.AreEqual(expected.PhotometricInterpretation, actual.PhotometricInterpretation);
+		}
+
+		[Test]
+		public void DecodeIntoFrameBuffer() {
+			var codec = new DcmJpegProcess1Codec();
+			DcmPixelData jpeg = Encode(codec, CreateRgbImage(), JpegSampleFactor.SF422, 1);
+
+			var jparams = new DcmJpegParameters();
+			var expected = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			codec.Decode(null, jpeg, expected, jparams);
+			byte[] packed = expected.GetFrameDataU8(0);
+
+			// interleaved rows with padding, then planes of padded rows with a gap between them
+			const int rowStride = Width * 3 + 13;
+			const int planeRowStride = Width + 5;
+			const int planeStride = planeRowStride * Height + 7;
+			foreach (bool planar in new bool[] { false, true }) {
+				var buffer = new byte[planar ? planeStride * 3 : rowStride * Height];
+				var handle = GCHandle.Alloc(buffer, GCHandleType.Pinned);
+				try {
+					var destination = planar ?
+						new FrameBuffer(handle.AddrOfPinnedObject(), buffer.Length, planeRowStride, planeStride, true) :
+						new FrameBuffer(handle.AddrOfPinnedObject(), buffer.Length, rowStride, 0, false);
+					var actual = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+					codec.DecodeFrame(jpeg, actual, 0, jparams, destination);
+				}
+				finally {
+					handle.Free();
+				}
+
+				for (int y = 0; y < Height; y++) {
+					for (int x = 0; x < Width; x++) {
+						for (int c = 0; c < 3; c++) {
+							int offset = planar ? c * planeStride + y * planeRowStride + x : y * rowStride + x * 3 + c;
+							Assert.AreEqual(packed[(y * Width + x) * 3 + c], buffer[offset]);
+						}
+					}
+				}
+			}
+
+			// a buffer that cannot hold the frame is refused
+			var small = new byte[rowStride * (Height - 1)];
+			var smallHandle = GCHandle.Alloc(small, GCHandleType.Pinned);
+			try {
+				var destination = new FrameBuffer(smallHandle.AddrOfPinnedObject(), small.Length, rowStride, 0, false);
+				var actual = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+				Assert.Throws<ArgumentException>(() => codec.DecodeFrame(jpeg, actual, 0, jparams, destination));
+			}
+			finally {
+				smallHandle.Free();
+			}
+		}
+
+		[Test]
+		public void DecodeRegion([Values(JpegSampleFactor.SF444, JpegSampleFactor.SF422)] JpegSampleFactor sampleFactor,
+			[Values(1, 4)] int stripes, [Values(JpegScale.Full, JpegScale.Half)] JpegScale scale) {
+			// stripes are separated by restart markers, which let the decoder start near the region
+			var codec = new DcmJpegProcess1Codec();
+			DcmPixelData jpeg = Encode(codec, CreateRgbImage(), sampleFactor, stripes);
+			var jparams = new DcmJpegParameters();
+			jparams.Scale = scale;
+			DecodeRegions(codec, jpeg, jparams);
+		}
+
+		[Test]
+		public void DecodeRegionFromCheckpoints([Values(JpegSampleFactor.SF444, JpegSampleFactor.SF422)] JpegSampleFactor sampleFactor,
+			[Values(JpegScale.Full, JpegScale.Quarter)] JpegScale scale, [Values(1, 3)] int interval) {
+			var codec = new DcmJpegProcess1Codec();
+			DcmPixelData jpeg = Encode(codec, CreateRgbImage(), sampleFactor, 1);
+
+			var cache = new JpegCheckpointCache();
+			cache.Interval = interval;
+			var jparams = new DcmJpegParameters();
+			jparams.Scale = scale;
+			jparams.Checkpoints = cache;
+
+			// the full decode of the helper records the checkpoints that its region decodes resume from
+			DecodeRegions(codec, jpeg, jparams);
+			JpegCheckpointIndex index = cache.GetIndex(jpeg, 0);
+			Assert.IsTrue(index.IsRecorded);
+			Assert.AreEqual(((Height + 7) / 8 - 1) / interval, index.Count);
+		}
+
+		[Test]
+		public void DecodeLosslessRegion([Values(1, 4)] int stripes) {
+			var codec = new DcmJpegLossless14SV1Codec();
+			DcmPixelData jpeg = Encode(codec, CreateRgbImage(), JpegSampleFactor.SF444, stripes);
+			DecodeRegions(codec, jpeg, new DcmJpegParameters());
+		}
+
+		[Test]
+		public void DecodeLosslessRegionFromCheckpoints([Values(1, 3)] int samplesPerPixel, [Values(1, 6)] int predictor,
+			[Values(1, 3)] int interval) {
+			// a single component with predictor 1 is decoded by the fused path, whose checkpoints keep one sample
+			// of the row above; the other scans keep the whole row of each component
+			DcmPixelData image = (samplesPerPixel == 1) ? CreateMonochromeImage() : CreateRgbImage();
+			var codec = new DcmJpegLossless14Codec();
+			var encodeParams = new DcmJpegParameters();
+			encodeParams.Predictor = predictor;
+			var jpeg = new DcmPixelData(codec.GetTransferSyntax(), image);
+			codec.Encode(null, image, jpeg, encodeParams);
+
+			var cache = new JpegCheckpointCache();
+			cache.Interval = interval;
+			var jparams = new DcmJpegParameters();
+			jparams.Checkpoints = cache;
+
+			DecodeRegions(codec, jpeg, jparams);
+			JpegCheckpointIndex index = cache.GetIndex(jpeg, 0);
+			Assert.IsTrue(index.IsRecorded);
+			Assert.AreEqual((Height - 1) / interval, index.Count);
+		}
+
+		private static void DecodeRegions(DcmJpegCodec codec, DcmPixelData jpeg, DcmJpegParameters jparams) {
+			var full = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			codec.Decode(null, jpeg, full, jparams);
+			byte[] expected = full.GetFrameDataU8(0);
+			int width = full.ImageWidth, height = full.ImageHeight, components = full.SamplesPerPixel;
+
+			// corners, edges, single pixels and the whole frame
+			var regions = new int[][] {
+				new int[] { 0, 0, width, height },
+				new int[] { 0, 0, 17, 9 },
+				new int[] { width / 2 - 20, height / 2 - 11, 41, 23 },
+				new int[] { width - 33, height - 18, 33, 18 },
+				new int[] { 37, height - 1, 1, 1 },
+				new int[] { 8, 16, width - 8, 1 },
+			};
+			foreach (var region in regions) {
+				int x = region[0], y = region[1], w = region[2], h = region[3];
+				var actual = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+				byte[] data = codec.DecodeRegion(jpeg, actual, 0, jparams, x, y, w, h);
+
+				Assert.AreEqual(w, actual.ImageWidth);
+				Assert.AreEqual(h, actual.ImageHeight);
+				bool planar = actual.IsPlanar;
+				for (int row = 0; row < h; row++) {
+					for (int col = 0; col < w; col++) {
+						for (int c = 0; c < components; c++) {
+							int source = planar ? (c * height + y + row) * width + x + col : ((y + row) * width + x + col) * components + c;
+							int target = planar ? (c * h + row) * w + col : (row * w + col) * components + c;
+							Assert.AreEqual(expected[source], data[target], "Region {0},{1} {2}x{3}", x, y, w, h);
+						}
+					}
+				}
+			}
+
+			var outside = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			Assert.Throws<ArgumentOutOfRangeException>(() => codec.DecodeRegion(jpeg, outside, 0, jparams, width - 4, 0, 5, 1));
+		}
+	}
+}
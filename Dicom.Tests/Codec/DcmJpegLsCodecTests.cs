@@ -0,0 +1,290 @@
+using System;
+using System.Collections.Generic;
+using System.Runtime.InteropServices;
+using System.Text;
+
+using NUnit.Framework;
+
+using Dicom.Codec;
+using Dicom.Codec.Jpeg;
+using Dicom.Codec.JpegLs;
+using Dicom.Data;
+
+namespace Dicom.Tests.Codec {
+	[TestFixture]
+	public class DcmJpegLsCodecTests {
+		// odd sizes, so that no row or plane ends on a byte boundary of the bit stream
+		private const int Width = 203;
+		private const int Height = 67;
+
+		private static DcmPixelData CreateImage(int samplesPerPixel, int bitsStored) {
+			var pixelData = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian);
+			pixelData.ImageWidth = Width;
+			pixelData.ImageHeight = Height;
+			pixelData.BitsAllocated = (ushort)(bitsStored > 8 ? 16 : 8);
+			pixelData.BitsStored = (ushort)bitsStored;
+			pixelData.HighBit = (ushort)(bitsStored - 1);
+			pixelData.SamplesPerPixel = (ushort)samplesPerPixel;
+			pixelData.PixelRepresentation = 0;
+			pixelData.PlanarConfiguration = 0;
+			pixelData.PhotometricInterpretation = samplesPerPixel == 3 ? "RGB" : "MONOCHROME2";
+
+			// ramps with noise, so that both the regular and the run mode are used
+			var random = new Random(1234);
+			int bytes = pixelData.BytesAllocated;
+			var data = new byte[Width * Height * samplesPerPixel * bytes];
+			for (int y = 0, i = 0; y < Height; y++) {
+				for (int x = 0; x < Width; x++) {
+					for (int c = 0; c < samplesPerPixel; c++) {
+						int value = (x * (c + 1) + y * 3 + (random.Next(8) == 0 ? random.Next(64) : 0)) & ((1 << bitsStored) - 1);
+						if ((x / 16 + y / 8) % 3 == 0)
+							value = 0;
+						data[i++] = (byte)value;
+						if (bytes == 2)
+							data[i++] = (byte)(value >> 8);
+					}
+				}
+			}
+			pixelData.AddFrame(data);
+			return pixelData;
+		}
+
+		private static DcmPixelData Encode(DcmJpegLsCodec codec, DcmPixelData pixelData, DcmJpegLsInterleaveMode interleaveMode) {
+			var jparams = new DcmJpegLsParameters();
+			jparams.InterleaveMode = interleaveMode;
+			jparams.ColorTransform = DcmJpegLsColorTransform.None;
+
+			var newPixelData = new DcmPixelData(codec.GetTransferSyntax(), pixelData);
+			codec.Encode(null, pixelData, newPixelData, jparams);
+			return newPixelData;
+		}
+
+		// Encodes the planes of a color image separately and joins the scans into one non-interleaved frame, with
+		// the presets and scan header of each plane before its scan; the encoder itself reads non-interleaved color
+		// frames with the row length of interleaved ones.
+		private static DcmPixelData EncodeScans(DcmJpegLsCodec codec, DcmPixelData pixelData) {
+			int samplesPerPixel = pixelData.SamplesPerPixel;
+			int bytes = pixelData.BytesAllocated;
+			byte[] data = pixelData.GetFrameDataU8(0);
+
+			var joined = new List<byte>();
+			for (int c = 0; c < samplesPerPixel; c++) {
+				var plane = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, pixelData);
+				plane.SamplesPerPixel = 1;
+				plane.PhotometricInterpretation = "MONOCHROME2";
+				var planeData = new byte[Width * Height * bytes];
+				for (int i = 0; i < Width * Height; i++)
+					for (int b = 0; b < bytes; b++)
+						planeData[i * bytes + b] = data[(i * samplesPerPixel + c) * bytes + b];
+				plane.AddFrame(planeData);
+				byte[] scan = Encode(codec, plane, DcmJpegLsInterleaveMode.None).GetFrameDataU8(0);
+
+				int sof = 2;
+				while (scan[sof + 1] != 0xF7)
+					sof += 2 + (scan[sof + 2] << 8 | scan[sof + 3]);
+				int start = sof + 2 + (scan[sof + 2] << 8 | scan[sof + 3]);
+				int sos = start;
+				while (scan[sos + 1] != 0xDA)
+					sos += 2 + (scan[sos + 2] << 8 | scan[sos + 3]);
+				int eoi = scan.Length - 2;
+				while (scan[eoi] != 0xFF || scan[eoi + 1] != 0xD9)
+					eoi--;
+
+				if (c == 0) {
+					// the frame header, with a component per scan
+					for (int i = 0; i < sof; i++)
+						joined.Add(scan[i]);
+					int length = 8 + 3 * samplesPerPixel;
+					joined.AddRange(new byte[] { 0xFF, 0xF7, (byte)(length >> 8), (byte)length });
+					for (int i = sof + 4; i < sof + 9; i++)
+						joined.Add(scan[i]);
+					joined.Add((byte)samplesPerPixel);
+					for (int i = 0; i < samplesPerPixel; i++)
+						joined.AddRange(new byte[] { (byte)(i + 1), 0x11, 0 });
+				}
+
+				int offset = joined.Count;
+				for (int i = start; i < eoi; i++)
+					joined.Add(scan[i]);
+				joined[offset + sos - start + 5] = (byte)(c + 1);
+			}
+			joined.Add(0xFF);
+			joined.Add(0xD9);
+			if ((joined.Count % 2) != 0)
+				joined.Add(0);
+
+			var jpeg = new DcmPixelData(codec.GetTransferSyntax(), pixelData);
+			jpeg.PlanarConfiguration = 1;
+			jpeg.AddFrame(joined.ToArray());
+			return jpeg;
+		}
+
+		[Test]
+		public void EncodeExpandingFrames([Values(1, 3)] int degreeOfParallelism) {
+			// frames of noise come out larger than they went in
+			const int frames = 4;
+			var pixelData = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian);
+			pixelData.ImageWidth = Width;
+			pixelData.ImageHeight = Height;
+			pixelData.BitsAllocated = 8;
+			pixelData.BitsStored = 8;
+			pixelData.HighBit = 7;
+			pixelData.SamplesPerPixel = 1;
+			pixelData.PixelRepresentation = 0;
+			pixelData.PlanarConfiguration = 0;
+			pixelData.PhotometricInterpretation = "MONOCHROME2";
+			var random = new Random(5678);
+			for (int frame = 0; frame < frames; frame++) {
+				var data = new byte[Width * Height];
+				random.NextBytes(data);
+				pixelData.AddFrame(data);
+			}
+
+			var codec = new DcmJpegLsLosslessCodec();
+			var jparams = new DcmJpegLsParameters();
+			jparams.MaxDegreeOfParallelism = degreeOfParallelism;
+			var jpeg = new DcmPixelData(codec.GetTransferSyntax(), pixelData);
+			jpeg.FragmentSize = 4096;
+			codec.Encode(null, pixelData, jpeg, jparams);
+
+			var decoded = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			codec.Decode(null, jpeg, decoded, jparams);
+			Assert.AreEqual(frames, jpeg.NumberOfFrames);
+			for (int frame = 0; frame < frames; frame++) {
+				Assert.Greater(jpeg.GetFrameSize(frame), Width * Height);
+				CollectionAssert.AreEqual(pixelData.GetFrameDataU8(frame), decoded.GetFrameDataU8(frame));
+			}
+		}
+
+		[Test]
+		public void TranscodeToJpegBaseline() {
+			DcmPixelData image = CreateImage(3, 8);
+			var codec = new DcmJpegLsLosslessCodec();
+			DcmPixelData jpegLs = Encode(codec, image, DcmJpegLsInterleaveMode.Line);
+
+			// as in DcmDataset.ChangeTransferSyntax, the parameters of the target codec are passed to the decoder
+			var jparams = new DcmJpegParameters();
+			var decoded = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpegLs);
+			codec.Decode(null, jpegLs, decoded, jparams);
+			CollectionAssert.AreEqual(image.GetFrameDataU8(0), decoded.GetFrameDataU8(0));
+
+			var jpegCodec = new DcmJpegProcess1Codec();
+			var transcoded = new DcmPixelData(jpegCodec.GetTransferSyntax(), decoded);
+			jpegCodec.Encode(null, decoded, transcoded, jparams);
+			var direct = new DcmPixelData(jpegCodec.GetTransferSyntax(), image);
+			jpegCodec.Encode(null, image, direct, jparams);
+
+			CollectionAssert.AreEqual(direct.GetFrameDataU8(0), transcoded.GetFrameDataU8(0));
+		}
+
+		[Test]
+		public void DecodeRegion([Values(DcmJpegLsInterleaveMode.None, DcmJpegLsInterleaveMode.Line, DcmJpegLsInterleaveMode.Sample)] DcmJpegLsInterleaveMode interleaveMode,
+			[Values(1, 3)] int samplesPerPixel, [Values(8, 12)] int bitsStored) {
+			// planar color frames are joined from scans of the planes, as the encoder reads ILV_NONE color frames
+			// with the row length of interleaved ones
+			var codec = new DcmJpegLsLosslessCodec();
+			DcmPixelData image = CreateImage(samplesPerPixel, bitsStored);
+			DcmPixelData jpeg = (samplesPerPixel > 1 && interleaveMode == DcmJpegLsInterleaveMode.None) ?
+				EncodeScans(codec, image) : Encode(codec, image, interleaveMode);
+
+			// the whole frame, decoded into the packed layout that the region decodes use
+			var full = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			int bytes = full.BytesAllocated;
+			bool planar = full.IsPlanar && samplesPerPixel > 1;
+			var expected = new byte[Width * Height * samplesPerPixel * bytes];
+			var handle = GCHandle.Alloc(expected, GCHandleType.Pinned);
+			try {
+				var destination = planar ?
+					new FrameBuffer(handle.AddrOfPinnedObject(), expected.Length, Width * bytes, Width * Height * bytes, true) :
+					new FrameBuffer(handle.AddrOfPinnedObject(), expected.Length, Width * samplesPerPixel * bytes, 0, false);
+				codec.DecodeFrame(jpeg, full, 0, null, destination);
+			}
+			finally {
+				handle.Free();
+			}
+
+			// corners, edges, single pixels and the whole frame; regions above the last line leave the scans early
+			var regions = new int[][] {
+				new int[] { 0, 0, Width, Height },
+				new int[] { 0, 0, 17, 9 },
+				new int[] { Width / 2 - 20, Height / 2 - 11, 41, 23 },
+				new int[] { Width - 33, Height - 18, 33, 18 },
+				new int[] { 37, Height - 1, 1, 1 },
+				new int[] { 8, 16, Width - 8, 1 },
+			};
+			foreach (var region in regions) {
+				int x = region[0], y = region[1], w = region[2], h = region[3];
+				var actual = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+				byte[] data = codec.DecodeRegion(jpeg, actual, 0, null, x, y, w, h);
+
+				Assert.AreEqual(w, actual.ImageWidth);
+				Assert.AreEqual(h, actual.ImageHeight);
+				for (int row = 0; row < h; row++) {
+					for (int col = 0; col < w; col++) {
+						for (int c = 0; c < samplesPerPixel; c++) {
+							int source = planar ? (c * Height + y + row) * Width + x + col : ((y + row) * Width + x + col) * samplesPerPixel + c;
+							int target = planar ? (c * h + row) * w + col : (row * w + col) * samplesPerPixel + c;
+							for (int b = 0; b < bytes; b++)
+								Assert.AreEqual(expected[source * bytes + b], data[target * bytes + b], "Region {0},{1} {2}x{3}", x, y, w, h);
+						}
+					}
+				}
+			}
+
+			var outside = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			Assert.Throws<ArgumentOutOfRangeException>(() => codec.DecodeRegion(jpeg, outside, 0, null, Width - 10, 0, 11, 1));
+		}
+
+		[Test]
+		public void DecodeComponentScans([Values(8, 12, 16)] int bitsStored, [Values(1, 3, 0)] int maxComponentParallelism) {
+			const int samplesPerPixel = 3;
+			var codec = new DcmJpegLsLosslessCodec();
+			DcmPixelData image = CreateImage(samplesPerPixel, bitsStored);
+			DcmPixelData jpeg = EncodeScans(codec, image);
+
+			// the planes of the image
+			int bytes = image.BytesAllocated;
+			byte[] data = image.GetFrameDataU8(0);
+			var expected = new byte[Width * Height * samplesPerPixel * bytes];
+			for (int c = 0; c < samplesPerPixel; c++)
+				for (int i = 0; i < Width * Height; i++)
+					for (int b = 0; b < bytes; b++)
+						expected[(c * Width * Height + i) * bytes + b] = data[(i * samplesPerPixel + c) * bytes + b];
+
+			var jparams = new DcmJpegLsParameters();
+			jparams.MaxComponentParallelism = maxComponentParallelism;
+
+			var decoded = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			codec.Decode(null, jpeg, decoded, jparams);
+			byte[] frame = decoded.GetFrameDataU8(0);
+			for (int i = 0; i < expected.Length; i++)
+				Assert.AreEqual(expected[i], frame[i], "Decode at {0}", i);
+
+			var full = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			var actual = new byte[expected.Length];
+			var handle = GCHandle.Alloc(actual, GCHandleType.Pinned);
+			try {
+				var destination = new FrameBuffer(handle.AddrOfPinnedObject(), actual.Length, Width * bytes, Width * Height * bytes, true);
+				codec.DecodeFrame(jpeg, full, 0, jparams, destination);
+			}
+			finally {
+				handle.Free();
+			}
+			CollectionAssert.AreEqual(expected, actual);
+
+			int x = 31, y = 9, w = 57, h = 40;
+			var region = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian, jpeg);
+			byte[] regionData = codec.DecodeRegion(jpeg, region, 0, jparams, x, y, w, h);
+			for (int c = 0; c < samplesPerPixel; c++) {
+				for (int row = 0; row < h; row++) {
+					for (int col = 0; col < w; col++) {
+						int source = (c * Height + y + row) * Width + x + col;
+						int target = (c * h + row) * w + col;
+						for (int b = 0; b < bytes; b++)
+							Assert.AreEqual(expected[source * bytes + b], regionData[target * bytes + b], "Region at {0},{1}", col, row);
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,132 @@
+using System;
+using System.Collections.Generic;
+using System.Text;
+
+using NUnit.Framework;
+
+using Dicom.Codec;
+using Dicom.Codec.Jpeg;
+using Dicom.Data;
+using Dicom.IO;
+
+namespace Dicom.Tests.Codec {
+	[TestFixture]
+	public class FrameProbeTests {
+		private const int Width = 203;
+		private const int Height = 67;
+
+		private static DcmPixelData CreateRgbImage() {
+			var pixelData = new DcmPixelData(DicomTransferSyntax.ExplicitVRLittleEndian);
+			pixelData.ImageWidth = Width;
+			pixelData.ImageHeight = Height;
+			pixelData.BitsAllocated = 8;
+			pixelData.BitsStored = 8;
+			pixelData.HighBit = 7;
+			pixelData.SamplesPerPixel = 3;
+			pixelData.PixelRepresentation = 0;
+			pixelData.PlanarConfiguration = 0;
+			pixelData.PhotometricInterpretation = "RGB";
+
+			var random = new Random(1234);
+			var data = new byte[Width * Height * 3];
+			for (int y = 0, i = 0; y < Height; y++) {
+				for (int x = 0; x < Width; x++) {
+					data[i++] = (byte)Math.Min(255, x + random.Next(40));
+					data[i++] = (byte)Math.Min(255, y * 3 + random.Next(40));
+					data[i++] = (byte)Math.Min(255, (x + y) / 2 + random.Next(40));
+				}
+			}
+			pixelData.AddFrame(data);
+			return pixelData;
+		}
+
+		private static DcmPixelData Encode(DcmJpegCodec codec, DcmJpegParameters jparams) {
+			DcmPixelData image = CreateRgbImage();
+			var jpeg = new DcmPixelData(codec.GetTransferSyntax(), image);
+			codec.Encode(null, image, jpeg, jparams);
+			return jpeg;
+		}
+
+		private static byte[] GetCompressedFrame(DcmPixelData pixelData) {
+			var data = new List<byte>();
+			foreach (var fragment in pixelData.GetFrameFragments(0))
+				data.AddRange(fragment.ToBytes());
+			return data.ToArray();
+		}
+
+		private static void AssertFrame(FrameHeader header, int process, bool lossless) {
+			Assert.AreEqual(FrameCoding.Jpeg, header.Coding);
+			Assert.AreEqual(process, header.Process);
+			Assert.AreEqual(lossless, header.IsLossless);
+			Assert.AreEqual(8, header.Precision);
+			Assert.AreEqual(Width, header.Width);
+			Assert.AreEqual(Height, header.Height);
+			Assert.AreEqual(3, header.Components);
+			Assert.IsFalse(header.IsSigned);
+		}
+
+		[Test]
+		public void Baseline() {
+			var jparams = new DcmJpegParameters();
+			jparams.SampleFactor = JpegSampleFactor.SF422;
+			FrameHeader header = FrameProbe.Probe(Encode(new DcmJpegProcess1Codec(), jparams));
+
+			AssertFrame(header, 0, false);
+			Assert.AreEqual(2, header.GetHorizontalSampling(0));
+			Assert.AreEqual(1, header.GetVerticalSampling(0));
+			for (int c = 1; c < 3; c++) {
+				Assert.AreEqual(1, header.GetHorizontalSampling(c));
+				Assert.AreEqual(1, header.GetVerticalSampling(c));
+			}
+		}
+
+		[Test]
+		public void Lossless() {
+			var jparams = new DcmJpegParameters();
+			jparams.Predictor = 6;
+			jparams.PointTransform = 2;
+			FrameHeader header = FrameProbe.Probe(Encode(new DcmJpegLossless14Codec(), jparams));
+
+			AssertFrame(header, 3, true);
+			Assert.AreEqual(6, header.Predictor);
+			Assert.AreEqual(2, header.Transform);
+			for (int c = 0; c < 3; c++) {
+				Assert.AreEqual(1, header.GetHorizontalSampling(c));
+				Assert.AreEqual(1, header.GetVerticalSampling(c));
+			}
+		}
+
+		[Test]
+		public void Progressive() {
+			DcmPixelData image = CreateRgbImage();
+			var codec = new Jpeg8Codec(JpegMode.Progressive, 0, 0);
+			var jpeg = new DcmPixelData(DicomTransferSyntax.JPEGProcess2_4, image);
+			codec.Encode(image, jpeg, new DcmJpegParameters(), 0);
+
+			FrameHeader header = FrameProbe.Probe(jpeg);
+			AssertFrame(header, 2, false);
+			Assert.AreEqual(0, header.Predictor);
+			Assert.AreEqual(0, header.Transform);
+		}
+
+		[Test]
+		public void Truncated() {
+			byte[] data = GetCompressedFrame(Encode(new DcmJpegProcess1Codec(), new DcmJpegParameters()));
+
+			// only the header up to the first scan is read, so a frame cut in its entropy coded data is probed
+			var half = new byte[data.Length / 2];
+			Buffer.BlockCopy(data, 0, half, 0, half.Length);
+			AssertFrame(FrameProbe.Probe(new ByteBuffer(half)), 0, false);
+
+			// a frame cut before the end of its first scan header is not
+			int sos = 2;
+			while (data[sos + 1] != 0xda)
+				sos += 2 + ((data[sos + 2] << 8) | data[sos + 3]);
+			foreach (int length in new int[] { 1, sos, sos + 4 }) {
+				var truncated = new byte[length];
+				Buffer.BlockCopy(data, 0, truncated, 0, length);
+				Assert.Throws<DicomCodecException>(() => FrameProbe.Probe(new ByteBuffer(truncated)));
+			}
+		}
+	}
+}
@@ -0,0 +1,115 @@
+using System;
+using System.Collections.Generic;
+using System.Text;
+
+using NUnit.Framework;
+
+using Dicom.Codec;
+
+namespace Dicom.Tests.Codec {
+	[TestFixture]
+	public class SampleConverterTests {
+		// odd counts, so that the SIMD routines leave a tail for the portable code
+		private const int Pixels = 1031;
+
+		private ManagedSampleConverter _managed = new ManagedSampleConverter();
+		private NativeSampleConverter _native = new NativeSampleConverter();
+
+		[TearDown]
+		public void TearDown() {
+			NativeSampleConverter.UseSimd = true;
+		}
+
+		private static byte[] RandomBytes(int length, int seed) {
+			var data = new byte[length];
+			new Random(seed).NextBytes(data);
+			return data;
+		}
+
+		private static ushort[] RandomWords(int length, int seed) {
+			var bytes = RandomBytes(length * 2, seed);
+			var data = new ushort[length];
+			Buffer.BlockCopy(bytes, 0, data, 0, bytes.Length);
+			return data;
+		}
+
+		[Test]
+		public void ChangePlanarConfiguration([Values(true, false)] bool useSimd, [Values(1, 2)] int bytesAllocated,
+			[Values(1, 3, 4)] int samplesPerPixel, [Values(0, 1)] int oldPlanarConfiguration) {
+			NativeSampleConverter.UseSimd = useSimd;
+
+			int numValues = Pixels * samplesPerPixel;
+			var source = RandomBytes(numValues * bytesAllocated, 1);
+			var expected = new byte[source.Length];
+			var actual = new byte[source.Length];
+
+			_managed.ChangePlanarConfiguration(source, expected, numValues, bytesAllocated, samplesPerPixel, oldPlanarConfiguration);
+			_native.ChangePlanarConfiguration(source, actual, numValues, bytesAllocated, samplesPerPixel, oldPlanarConfiguration);
+			Assert.AreEqual(expected, actual);
+		}
+
+		[Test]
+		public void ManagedChangePlanarConfiguration([Values(1, 2, 4)] int bytesAllocated, [Values(1, 3)] int samplesPerPixel) {
+			// the reference for the native converter: sample s of pixel n moves to plane s, and back
+			int numValues = Pixels * samplesPerPixel;
+			var source = RandomBytes(numValues * bytesAllocated, 4);
+			var planar = new byte[source.Length];
+			var interleaved = new byte[source.Length];
+
+			_managed.ChangePlanarConfiguration(source, planar, numValues, bytesAllocated, samplesPerPixel, 0);
+			for (int n = 0; n < Pixels; n++)
+				for (int s = 0; s < samplesPerPixel; s++)
+					for (int b = 0; b < bytesAllocated; b++)
+						Assert.AreEqual(source[(n * samplesPerPixel + s) * bytesAllocated + b], planar[(s * Pixels + n) * bytesAllocated + b]);
+
+			_managed.ChangePlanarConfiguration(planar, interleaved, numValues, bytesAllocated, samplesPerPixel, 1);
+			Assert.AreEqual(source, interleaved);
+		}
+
+		[Test]
+		public void SwapBytes([Values(true, false)] bool useSimd, [Values(2, 4)] int bytesToSwap) {
+			NativeSampleConverter.UseSimd = useSimd;
+
+			var expected = RandomBytes(Pixels * bytesToSwap, 2);
+			var actual = (byte[])expected.Clone();
+
+			_managed.SwapBytes(expected, bytesToSwap);
+			_native.SwapBytes(actual, bytesToSwap);
+			Assert.AreEqual(expected, actual);
+		}
+
+		[Test]
+		public void ToInt16([Values(true, false)] bool useSimd, [Values(7, 11, 15)] int highBit, [Values(true, false)] bool signed) {
+			NativeSampleConverter.UseSimd = useSimd;
+
+			var source = RandomWords(Pixels, 3);
+			var expected = new short[Pixels];
+			var actual = new short[Pixels];
+
+			_managed.ToInt16(source, expected, Pixels, highBit, signed);
+			_native.ToInt16(source, actual, Pixels, highBit, signed);
+			Assert.AreEqual(expected, actual);
+		}
+
+		[Test]
+		public void ToInt32([Values(true, false)] bool useSimd, [Values(7, 11, 15)] int highBit, [Values(true, false)] bool signed) {
+			NativeSampleConverter.UseSimd = useSimd;
+
+			var source = RandomWords(Pixels, 4);
+			var expected = new int[Pixels];
+			var actual = new int[Pixels];
+
+			_managed.ToInt32(source, expected, Pixels, highBit, signed);
+			_native.ToInt32(source, actual, Pixels, highBit, signed);
+			Assert.AreEqual(expected, actual);
+
+			if (highBit > 7)
+				return;
+
+			var source8 = RandomBytes(Pixels, 5);
+			_managed.ToInt32(source8, expected, Pixels, highBit, signed);
+			_native.ToInt32(source8, actual, Pixels, highBit, signed);
+			Assert.AreEqual(expected, actual);
+		}
+	}
+}
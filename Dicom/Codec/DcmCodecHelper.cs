@@ -25,36 +25,142 @@
 using System.Text;
 
 using Dicom.Data;
+using Dicom.IO;
 
 namespace Dicom.Codec {
-	public static class DcmCodecHelper {
-		public static void ChangePlanarConfiguration(byte[] pixelData, int numValues, int bitsAllocated, 
+	// Sample format conversions of the codecs and of the pixel data accessors. Samples are in the byte order
+	// of the machine; HighBit is the highest stored bit. Signed samples are read as a magnitude with the sign
+	// at HighBit, unsigned ones lose the bits above HighBit.
+	public interface ISampleConverter {
+		void ChangePlanarConfiguration(byte[] source, byte[] destination, int numValues, int bytesAllocated,
+			int samplesPerPixel, int oldPlanarConfiguration);
+		void SwapBytes(byte[] data, int bytesToSwap);
+		void ToInt16(ushort[] source, short[] destination, int count, int highBit, bool signed);
+		void ToInt32(byte[] source, int[] destination, int count, int highBit, bool signed);
+		void ToInt32(ushort[] source, int[] destination, int count, int highBit, bool signed);
+	}
+
+	// Marks a native ISampleConverter of a codec assembly, installed when its codecs are registered.
+	[AttributeUsage(AttributeTargets.Class, AllowMultiple = false)]
+	public class DicomSampleConverterAttribute : Attribute {
+		public DicomSampleConverterAttribute() {
+		}
+	}
+
+	public class ManagedSampleConverter : ISampleConverter {
+		public void ChangePlanarConfiguration(byte[] source, byte[] destination, int numValues, int bytesAllocated,
 			int samplesPerPixel, int oldPlanarConfiguration) {
-			int bytesAllocated = bitsAllocated / 8;
 			int numPixels = numValues / samplesPerPixel;
-			if (bytesAllocated == 1) {
-				byte[] buffer = new byte[pixelData.Length];
-				if (oldPlanarConfiguration == 1) {
-					for (int n = 0; n < numPixels; n++) {
-						for (int s = 0; s < samplesPerPixel; s++) {
-							buffer[n * samplesPerPixel + s] = pixelData[n + numPixels * s];
+			if (samplesPerPixel == 1) {
+				Buffer.BlockCopy(source, 0, destination, 0, numPixels * bytesAllocated);
+				return;
+			}
+
+			// one plane at a time, copying samples directly; a BlockCopy per sample costs more than the copy
+			bool toInterleaved = oldPlanarConfiguration == 1;
+			for (int s = 0; s < samplesPerPixel; s++) {
+				int planar = numPixels * s * bytesAllocated;
+				int interleaved = s * bytesAllocated;
+				int stride = samplesPerPixel * bytesAllocated;
+				if (bytesAllocated == 1) {
+					if (toInterleaved) {
+						for (int n = 0; n < numPixels; n++, interleaved += stride)
+							destination[interleaved] = source[planar + n];
+					} else {
+						for (int n = 0; n < numPixels; n++, interleaved += stride)
+							destination[planar + n] = source[interleaved];
+					}
+				} else if (bytesAllocated == 2) {
+					if (toInterleaved) {
+						for (int n = 0; n < numPixels * 2; n += 2, interleaved += stride) {
+							destination[interleaved] = source[planar + n];
+							destination[interleaved + 1] = source[planar + n + 1];
+						}
+					} else {
+						for (int n = 0; n < numPixels * 2; n += 2, interleaved += stride) {
+							destination[planar + n] = source[interleaved];
+							destination[planar + n + 1] = source[interleaved + 1];
 						}
 					}
-				}
-				else {
-					for (int n = 0; n < numPixels; n++) {
-						for (int s = 0; s < samplesPerPixel; s++) {
-							buffer[n + numPixels * s] = pixelData[n * samplesPerPixel + s];
+				} else {
+					for (int n = 0; n < numPixels * bytesAllocated; n += bytesAllocated, interleaved += stride) {
+						for (int b = 0; b < bytesAllocated; b++) {
+							if (toInterleaved)
+								destination[interleaved + b] = source[planar + n + b];
+							else
+								destination[planar + n + b] = source[interleaved + b];
 						}
 					}
 				}
-				Buffer.BlockCopy(buffer, 0, pixelData, 0, numValues);
 			}
-			else if (bytesAllocated == 2) {
-				throw new DicomCodecException(String.Format("BitsAllocated={0} is not supported!", bitsAllocated));
+		}
+
+		public void SwapBytes(byte[] data, int bytesToSwap) {
+			Endian.SwapBytes(bytesToSwap, data);
+		}
+
+		public void ToInt16(ushort[] source, short[] destination, int count, int highBit, bool signed) {
+			unchecked {
+				int sign = 1 << highBit;
+				int mask = signed ? sign - 1 : (sign << 1) - 1;
+				for (int p = 0; p < count; p++) {
+					ushort d = source[p];
+					if (signed && (d & sign) != 0)
+						destination[p] = (short)-(d & mask);
+					else
+						destination[p] = (short)(d & mask);
+				}
 			}
-			else
+		}
+
+		public void ToInt32(byte[] source, int[] destination, int count, int highBit, bool signed) {
+			unchecked {
+				int sign = 1 << highBit;
+				int mask = signed ? sign - 1 : (sign << 1) - 1;
+				for (int p = 0; p < count; p++) {
+					byte d = source[p];
+					if (signed && (d & sign) != 0)
+						destination[p] = -(d & mask);
+					else
+						destination[p] = d & mask;
+				}
+			}
+		}
+
+		public void ToInt32(ushort[] source, int[] destination, int count, int highBit, bool signed) {
+			unchecked {
+				int sign = 1 << highBit;
+				int mask = signed ? sign - 1 : (sign << 1) - 1;
+				for (int p = 0; p < count; p++) {
+					ushort d = source[p];
+					if (signed && (d & sign) != 0)
+						destination[p] = -(d & mask);
+					else
+						destination[p] = d & mask;
+				}
+			}
+		}
+	}
+
+	public static class DcmCodecHelper {
+		private static ISampleConverter _sampleConverter = new ManagedSampleConverter();
+
+		// Conversions used by the pixel data accessors; replaced by the native converter of a codec
+		// assembly when its codecs are registered.
+		public static ISampleConverter SampleConverter {
+			get { return _sampleConverter; }
+			set { _sampleConverter = value ?? new ManagedSampleConverter(); }
+		}
+
+		public static void ChangePlanarConfiguration(byte[] pixelData, int numValues, int bitsAllocated, 
+			int samplesPerPixel, int oldPlanarConfiguration) {
+			int bytesAllocated = bitsAllocated / 8;
+			if (bytesAllocated != 1 && bytesAllocated != 2)
 				throw new DicomCodecException(String.Format("BitsAllocated={0} is not supported!", bitsAllocated));
+
+			byte[] buffer = new byte[pixelData.Length];
+			_sampleConverter.ChangePlanarConfiguration(pixelData, buffer, numValues, bytesAllocated, samplesPerPixel, oldPlanarConfiguration);
+			Buffer.BlockCopy(buffer, 0, pixelData, 0, numValues * bytesAllocated);
 		}
 
 		public static void DumpFrameToDisk(DcmDataset data, int frame, string file) {
@@ -25,5 +25,20 @@
 
 namespace Dicom.Codec {
 	public abstract class DcmCodecParameters {
+		#region Private Members
+		private int _maxDegreeOfParallelism = 1;
+		#endregion
+
+		#region Public Properties
+		/// <summary>
+		/// Maximum number of frames a codec may encode or decode concurrently. Frames are still
+		/// added to the new pixel data in frame order. The default of 1 processes frames serially;
+		/// values less than 1 use one worker per processor.
+		/// </summary>
+		public int MaxDegreeOfParallelism {
+			get { return _maxDegreeOfParallelism; }
+			set { _maxDegreeOfParallelism = value; }
+		}
+		#endregion
 	}
 }
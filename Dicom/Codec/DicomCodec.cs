@@ -152,6 +152,10 @@ public static class DicomCodec {
 					_codecNames.Add(codec.GetName() + m);
 					Debug.Log.Info("Codec: {0}", codec.GetName() + m);
 				}
+				else if (types[i].IsDefined(typeof(DicomSampleConverterAttribute), false)) {
+					DcmCodecHelper.SampleConverter = (ISampleConverter)Activator.CreateInstance(types[i]);
+					Debug.Log.Info("Sample converter: {0}", types[i].Name + m);
+				}
 			}
 #endif
         }
@@ -27,6 +27,7 @@
 using System.Text;
 using System.Threading;
 
+using Dicom.Codec;
 using Dicom.IO;
 using Dicom.Utility;
 
@@ -405,9 +406,9 @@ private T[] GetFrameDataUnsigned<T>(int frame)
                 if (typeSize == 1)
                 {
                     if (BytesAllocated > 1 && data.Endian != Endian.LocalMachine)
-                        Endian.SwapBytes(BytesAllocated, buffer as byte[]);
+                        DcmCodecHelper.SampleConverter.SwapBytes(buffer as byte[], BytesAllocated);
                     else if (PixelDataItem.VR == DicomVR.OW && data.Endian == Endian.Big)
-                        Endian.SwapBytes(2, buffer as byte[]);
+                        DcmCodecHelper.SampleConverter.SwapBytes(buffer as byte[], 2);
                 }
                 return buffer;
             }
@@ -418,23 +419,10 @@ public short[] GetFrameDataS16(int frame)
             if (frame < 0 || frame >= NumberOfFrames)
                 throw new IndexOutOfRangeException("Requested frame out of range!");
 
-            unchecked
-            {
-                int sign = 1 << HighBit;
-                int mask = sign - 1;
-                int count = ImageWidth * ImageHeight;
-                short[] pixels = new short[count];
-                ushort[] data = GetFrameDataU16(frame);
-                for (int p = 0; p < count; p++)
-                {
-                    ushort d = data[p];
-                    if ((d & sign) != 0)
-                        pixels[p] = (short)-(d & mask);
-                    else
-                        pixels[p] = (short)(d & mask);
-                }
-                return pixels;
-            }
+            int count = ImageWidth * ImageHeight;
+            short[] pixels = new short[count];
+            DcmCodecHelper.SampleConverter.ToInt16(GetFrameDataU16(frame), pixels, count, HighBit, true);
+            return pixels;
         }
 
         public int[] GetFrameDataS32(int frame)
@@ -444,82 +432,13 @@ public int[] GetFrameDataS32(int frame)
                 if (BitsAllocated != 8 && BitsAllocated != 16)
                     throw new DicomDataException("BitsAllocated=" + BitsAllocated + " is unsupported!");
 
-                if (IsSigned)
-                {
-                    if (BitsAllocated == 8)
-                    {
-                        unchecked
-                        {
-                            int sign = 1 << HighBit;
-                            int mask = sign - 1;
-                            int count = ImageWidth * ImageHeight;
-                            int[] pixels = new int[count];
-                            byte[] data = GetFrameDataU8(frame);
-                            for (int p = 0; p < count; p++)
-                            {
-                                byte d = data[p];
-                                if ((d & sign) != 0)
-                                    pixels[p] = -(d & mask);
-                                else
-                                    pixels[p] = d & mask;
-                            }
-                            return pixels;
-                        }
-                    }
-                    else
-                    {
-                        unchecked
-                        {
-                            int sign = 1 << HighBit;
-                            int mask = sign - 1;
-                            int count = ImageWidth * ImageHeight;
-                            int[] pixels = new int[count];
-                            ushort[] data = GetFrameDataU16(frame);
-                            for (int p = 0; p < count; p++)
-                            {
-                                ushort d = data[p];
-                                if ((d & sign) != 0)
-                                    pixels[p] = -(d & mask);
-                                else
-                                    pixels[p] = d & mask;
-                            }
-                            return pixels;
-                        }
-                    }
-                }
+                int count = ImageWidth * ImageHeight;
+                int[] pixels = new int[count];
+                if (BitsAllocated == 8)
+                    DcmCodecHelper.SampleConverter.ToInt32(GetFrameDataU8(frame), pixels, count, HighBit, IsSigned);
                 else
-                {
-                    if (BitsAllocated == 8)
-                    {
-                        unchecked
-                        {
-                            int count = ImageWidth * ImageHeight;
-                            int mask = (1 << (HighBit + 1)) - 1;
-                            int[] pixels = new int[count];
-                            byte[] data = GetFrameDataU8(frame);
-                            for (int p = 0; p < count; p++)
-                            {
-                                pixels[p] = data[p] & mask;
-                            }
-                            return pixels;
-                        }
-                    }
-                    else
-                    {
-                        unchecked
-                        {
-                            int count = ImageWidth * ImageHeight;
-                            int mask = (1 << (HighBit + 1)) - 1;
-                            int[] pixels = new int[count];
-                            ushort[] data = GetFrameDataU16(frame);
-                            for (int p = 0; p < count; p++)
-                            {
-                                pixels[p] = data[p] & mask;
-                            }
-                            return pixels;
-                        }
-                    }
-                }
+                    DcmCodecHelper.SampleConverter.ToInt32(GetFrameDataU16(frame), pixels, count, HighBit, IsSigned);
+                return pixels;
             }
             else if (SamplesPerPixel == 3)
             {
@@ -720,6 +639,33 @@ public void AddFrame(byte[] data)
             }
         }
 
+        public void AddFrame(IList<ByteBuffer> fragments)
+        {
+            if (!IsFragmented)
+                throw new InvalidOperationException("No fragmented pixel data!");
+
+            foreach (ByteBuffer fragment in fragments)
+            {
+                if ((fragment.Length % 2) != 0)
+                    throw new DicomDataException("Pixel data fragments must have an even length!");
+            }
+
+            _frames++;
+            DcmFragmentSequence sequence = PixelDataSequence;
+
+            uint offset = 0;
+            foreach (ByteBuffer fragment in sequence.Fragments)
+            {
+                offset += (uint)(8 + fragment.Length);
+            }
+            sequence.OffsetTable.Add(offset);
+
+            foreach (ByteBuffer fragment in fragments)
+            {
+                sequence.Fragments.Add(fragment);
+            }
+        }
+
         #endregion
 
         #region Dataset Methods